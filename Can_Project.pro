@@ -3,7 +3,7 @@ TARGET=Can_project
 # where to put the .o files
 OBJECTS_DIR=obj
 # core Qt Libs to use add more here if needed.
-QT+=gui opengl core
+QT+=gui opengl core network
 # as I want to support 4.8 and 5 this will set a flag for some of the mac stuff
 # mainly in the types.h file for the setMacVisual which is native in Qt5
 isEqual(QT_MAJOR_VERSION, 5) {
@@ -17,9 +17,70 @@ CONFIG-=app_bundle
 # Auto include all .cpp files in the project src directory (can specifiy individually if required)
 SOURCES+= $$PWD/src/NGLScene.cpp    \
           $$PWD/src/NGLSceneMouseControls.cpp    \
+          $$PWD/src/NGLSceneShelf.cpp    \
+          $$PWD/src/IndexedMesh.cpp    \
+          $$PWD/src/NGLSceneCulling.cpp    \
+          $$PWD/src/NGLSceneObjects.cpp    \
+          $$PWD/src/SceneStore.cpp    \
+          $$PWD/src/BVH.cpp    \
+          $$PWD/src/Benchmarks.cpp    \
+          $$PWD/src/MeshSimplifier.cpp    \
+          $$PWD/src/NGLSceneAntiAliasing.cpp    \
+          $$PWD/src/NGLSceneQuality.cpp    \
+          $$PWD/src/QualityGovernor.cpp    \
+          $$PWD/src/PassTimer.cpp    \
+          $$PWD/src/ProgramCache.cpp    \
+          $$PWD/src/NGLScenePrograms.cpp    \
+          $$PWD/src/ShaderVariants.cpp    \
+          $$PWD/src/RenderThread.cpp    \
+          $$PWD/src/NGLSceneThread.cpp    \
+          $$PWD/src/Histogram.cpp    \
+          $$PWD/src/NGLSceneLatency.cpp    \
+          $$PWD/src/TransformBatch.cpp    \
+          $$PWD/src/NGLSceneShadows.cpp    \
+          $$PWD/src/ShadowAtlas.cpp    \
+          $$PWD/src/NGLSceneReflection.cpp    \
+          $$PWD/src/LabelCache.cpp    \
+          $$PWD/src/NGLSceneTurntable.cpp    \
+          $$PWD/src/RenderServer.cpp    \
+          $$PWD/src/NGLSceneServer.cpp    \
+          $$PWD/src/LoadGenerator.cpp    \
+          $$PWD/src/StreamBuffer.cpp    \
+          $$PWD/src/AssetCache.cpp    \
+          $$PWD/src/ShardCoordinator.cpp    \
+          $$PWD/src/TiffWriter.cpp    \
+          $$PWD/src/NGLSceneTiled.cpp    \
+          $$PWD/src/WideBVH.cpp    \
+          $$PWD/src/RayTracer.cpp    \
+          $$PWD/src/NGLSceneAccumulation.cpp    \
 					$$PWD/src/main.cpp
 # same for the .h files
 HEADERS+= $$PWD/include/NGLScene.h \
+          $$PWD/include/IndexedMesh.h \
+          $$PWD/include/Frustum.h \
+          $$PWD/include/SceneStore.h \
+          $$PWD/include/BVH.h \
+          $$PWD/include/Benchmarks.h \
+          $$PWD/include/MeshSimplifier.h \
+          $$PWD/include/QualityGovernor.h \
+          $$PWD/include/PassTimer.h \
+          $$PWD/include/ProgramCache.h \
+          $$PWD/include/ShaderVariants.h \
+          $$PWD/include/RenderThread.h \
+          $$PWD/include/TripleBuffer.h \
+          $$PWD/include/SPSCQueue.h \
+          $$PWD/include/Histogram.h \
+          $$PWD/include/TransformBatch.h \
+          $$PWD/include/ShadowAtlas.h \
+          $$PWD/include/LabelCache.h \
+          $$PWD/include/RenderServer.h \
+          $$PWD/include/LoadGenerator.h \
+          $$PWD/include/StreamBuffer.h \
+          $$PWD/include/AssetCache.h \
+          $$PWD/include/ShardCoordinator.h \
+          $$PWD/include/TiffWriter.h \
+          $$PWD/include/WideBVH.h \
+          $$PWD/include/RayTracer.h \
           $$PWD/include/WindowParams.h
 # and add the include dir into the search path for Qt and make
 INCLUDEPATH +=./include
@@ -27,6 +88,7 @@ INCLUDEPATH +=./include
 DESTDIR=./
 # add the glsl shader files
 OTHER_FILES+= $$PWD/shaders/*.glsl \
+              $$PWD/data/*.json \
               README.md
 LIBS += -lnoise -L$$(NOISEDIR)/lib
 # were are going to default to a console app
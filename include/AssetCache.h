@@ -0,0 +1,135 @@
+#ifndef ASSETCACHE_H_
+#define ASSETCACHE_H_
+#include <ngl/Types.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class IndexedMesh;
+//----------------------------------------------------------------------------------------------------------------------
+/// @file AssetCache.h
+/// @brief decoded textures and meshes shared between every renderer process on a machine
+/// @version 1.0
+/// @class AssetCache
+/// @brief an asset is stored in the cache directory (on /dev/shm where there is one, so it is
+/// shared memory) under a 64 bit FNV-1a key hashed from its kind, the decoder version and the
+/// bytes of the source file, so a changed file is simply a new asset. A small .source record
+/// named by the file's path, size and modification time keeps that key, so a lookup only reads
+/// and hashes the file when the record is missing or its entry has gone. The first process to ask
+/// for an asset decodes it while holding an exclusive lock on the key, writes it to a temporary
+/// file and publishes it with link(), which is atomic and never replaces an entry another process
+/// published first. Everyone else waits on the lock, then maps the published file read only, so
+/// the pixels and vertices are in memory once however many processes use them.
+/// Each Asset holds a shared flock on its file for as long as it is mapped, the kernel's count of
+/// those is the reference count. When the directory grows past its budget, the least recently
+/// used entries that no process holds are removed.
+//----------------------------------------------------------------------------------------------------------------------
+
+class AssetCache
+{
+  public:
+    static constexpr size_t DEFAULT_BUDGET=512*1024*1024;
+    static constexpr int MAX_SECTIONS=4;
+    static constexpr int META_COUNT=6;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a read only mapping of a published asset, up to MAX_SECTIONS blocks of bytes and a few
+    /// words describing them. The asset can't be evicted while it is held
+    //----------------------------------------------------------------------------------------------------------------------
+    class Asset
+    {
+      public:
+        Asset()=default;
+        ~Asset();
+        Asset(Asset &&_other);
+        Asset &operator=(Asset &&_other);
+        Asset(const Asset &)=delete;
+        Asset &operator=(const Asset &)=delete;
+        bool valid() const { return m_map!=nullptr; }
+        uint32_t meta(int _i) const;
+        const uint8_t *section(int _i) const;
+        size_t sectionBytes(int _i) const;
+        size_t bytes() const { return m_size; }
+        void release();
+
+      private:
+        friend class AssetCache;
+        int m_fd=-1;
+        void *m_map=nullptr;
+        size_t m_size=0;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief what a decoder fills in on a miss
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Decoded
+    {
+      std::vector<std::vector<uint8_t>> sections;
+      uint32_t meta[META_COUNT]={0,0,0,0,0,0};
+    };
+    typedef std::function<bool(const std::string &_file, Decoded &o_decoded)> Decoder;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief counters for this process
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Stats
+    {
+      uint32_t hits=0;
+      /// decoded and published here
+      uint32_t misses=0;
+      /// found once another process had decoded it
+      uint32_t waits=0;
+      uint32_t evictions=0;
+      uint32_t failures=0;
+      float decodeTime=0.0f;
+      float waitTime=0.0f;
+      size_t mappedBytes=0;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ctor, the directory is created if it isn't there
+    /// @param [in] _dir the cache directory, empty for defaultDir()
+    /// @param [in] _budget bytes the directory may hold before entries are evicted
+    //----------------------------------------------------------------------------------------------------------------------
+    explicit AssetCache(const std::string &_dir=std::string(), size_t _budget=DEFAULT_BUDGET);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief /dev/shm/can_assets if there is a /dev/shm, else cache/assets
+    //----------------------------------------------------------------------------------------------------------------------
+    static std::string defaultDir();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief map the asset for _file, decoding and publishing it first if no process has
+    /// @param [in] _kind what the decoder makes of the file, with its version, part of the key
+    //----------------------------------------------------------------------------------------------------------------------
+    Asset acquire(const std::string &_kind, const std::string &_file, const Decoder &_decode);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief an image as ngl::Image decodes it, meta 0-2 are the width, height and GL format and
+    /// section 0 the pixels
+    //----------------------------------------------------------------------------------------------------------------------
+    Asset image(const std::string &_file);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief an obj welded, given tangents and simplified into _lods levels, ready for createVAO
+    //----------------------------------------------------------------------------------------------------------------------
+    std::unique_ptr<IndexedMesh> mesh(const std::string &_file, int _lods);
+    const Stats &stats() const { return m_stats; }
+    const std::string &dir() const { return m_dir; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a one line summary of the counters
+    //----------------------------------------------------------------------------------------------------------------------
+    std::string report() const;
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief map a published entry, an invalid Asset if there is none or it isn't whole
+    //----------------------------------------------------------------------------------------------------------------------
+    Asset open(const std::string &_path, uint64_t _key);
+    bool publish(const std::string &_path, uint64_t _key, const Decoded &_decoded);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief remove the least recently used unheld entries until the directory is within budget
+    //----------------------------------------------------------------------------------------------------------------------
+    void evict();
+
+    std::string m_dir;
+    size_t m_budget;
+    Stats m_stats;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef BVH_H_
+#define BVH_H_
+#include "Frustum.h"
+#include "SceneStore.h"
+#include <cstdint>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file BVH.h
+/// @brief bounding volume hierarchy over the object bounding spheres in a SceneStore
+/// @version 1.0
+/// @class BVH
+/// @brief a binary tree of axis aligned boxes built with a median split. Nodes are stored depth
+/// first so every node covers a contiguous range of the leaf ordered sphere arrays, a node that is
+/// completely inside the frustum emits its whole range without visiting its children. Leaves hold
+/// up to LEAF_SIZE spheres which are tested against the planes 8 at a time with AVX when the
+/// CPU has it (scalar otherwise). Moving objects only need refit(), which updates the
+/// dirty leaves and their ancestors rather than rebuilding.
+//----------------------------------------------------------------------------------------------------------------------
+
+class BVH
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the largest number of objects in a leaf, one AVX register of spheres
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr uint32_t LEAF_SIZE=8;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief build the tree from the store's current bounding spheres
+    //----------------------------------------------------------------------------------------------------------------------
+    void build(const SceneStore &_store);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief refit the nodes above any object in the store's dirty list
+    //----------------------------------------------------------------------------------------------------------------------
+    void refit(const SceneStore &_store);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief collect the indices of every object whose sphere is not outside the frustum
+    /// @param [in] _frustum the frustum to test against
+    /// @param [out] o_visible the visible object indices, cleared first
+    //----------------------------------------------------------------------------------------------------------------------
+    void cull(const Frustum &_frustum, std::vector<uint32_t> &o_visible) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief brute force scalar test of every sphere, used to check and benchmark cull()
+    //----------------------------------------------------------------------------------------------------------------------
+    static void cullBruteForce(const SceneStore &_store, const Frustum &_frustum, std::vector<uint32_t> &o_visible);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the box around every object, the root node's bounds
+    /// @returns false if the tree is empty
+    //----------------------------------------------------------------------------------------------------------------------
+    bool bounds(float o_min[3], float o_max[3]) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief true if the leaves are tested with AVX, the build targets x86 and the CPU has AVX
+    //----------------------------------------------------------------------------------------------------------------------
+    static bool simd();
+    size_t numNodes() const { return m_nodes.size(); }
+    size_t numObjects() const { return m_object.size(); }
+
+  private:
+    struct Node
+    {
+      float minX, minY, minZ;
+      float maxX, maxY, maxZ;
+      // the range of leaf ordered spheres under this node
+      uint32_t first;
+      uint32_t count;
+      // the left child is always the next node, only the right is stored
+      int32_t right;
+      int32_t parent;
+      bool isLeaf() const { return right<0; }
+    };
+    int32_t buildRecursive(std::vector<uint32_t> &_ids, uint32_t _first, uint32_t _count, int32_t _parent, const SceneStore &_store);
+    void computeLeafBounds(Node &_node) const;
+    void emitLeaf(const Node &_node, const Frustum &_frustum, unsigned int _planeMask, std::vector<uint32_t> &o_visible) const;
+
+    std::vector<Node> m_nodes;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the spheres in leaf order, padded by LEAF_SIZE so a full width load never reads past the end
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<float> m_cx, m_cy, m_cz, m_r;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief leaf slot to object index and back, and the leaf each object lives in
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<uint32_t> m_object;
+    std::vector<uint32_t> m_slot;
+    std::vector<int32_t> m_leaf;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief scratch flags used by refit so each ancestor is only recomputed once
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<uint8_t> m_marked;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef BENCHMARKS_H_
+#define BENCHMARKS_H_
+//----------------------------------------------------------------------------------------------------------------------
+/// @file Benchmarks.h
+/// @brief command line micro benchmarks, these run without a window or GL context so the
+/// CPU side systems can be timed in isolation. Run with Can_Project --bench-<name>
+//----------------------------------------------------------------------------------------------------------------------
+
+namespace Benchmarks
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief time BVH build, refit and frustum culling against the brute force test for a range
+  /// of scene sizes, for both the camera and the light frustum
+  /// @returns the process exit code
+  //----------------------------------------------------------------------------------------------------------------------
+  int culling();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief compare the quantised and float vertex formats of the can mesh, memory for each level
+  /// of detail and the largest position, normal and uv error introduced by the quantisation
+  /// @returns the process exit code
+  //----------------------------------------------------------------------------------------------------------------------
+  int vertexFormat();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief drive the quality governor with a simulated GPU cost model of the render passes on a
+  /// slow node, including a load change half way, and print how the scale and level settle
+  /// @returns the process exit code, failure if the last frames miss the target
+  //----------------------------------------------------------------------------------------------------------------------
+  int governor();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief world and normal matrices per second through ngl one object at a time against the
+  /// batched SoA path, plus the batched MVP multiply and a sparse 1% dirty update, for a range of
+  /// object counts. The batch results are checked against ngl
+  /// @returns the process exit code, failure if the two disagree
+  //----------------------------------------------------------------------------------------------------------------------
+  int transforms();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief time the can mesh's tangent generation on one thread and on every core, check the
+  /// frames are orthonormal, then compare the per fragment normal map math of the old rotation
+  /// built in the shader against the tangent frame multiply, in time and in how far apart the
+  /// perturbed normals end up
+  /// @returns the process exit code, failure if a tangent isn't in its normal's plane
+  //----------------------------------------------------------------------------------------------------------------------
+  int tangents();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief upload an object's 240 byte matrix block before each of a frame's draws three ways,
+  /// glBufferSubData into one buffer, the StreamBuffer ring filled with glBufferSubData, and the
+  /// persistently mapped StreamBuffer, and print the time and bandwidth of each and the stream's
+  /// stalls. Unlike the others this needs a GL context, it makes an offscreen one so call it
+  /// with a QGuiApplication
+  /// @returns the process exit code, failure if there is no context
+  //----------------------------------------------------------------------------------------------------------------------
+  int streaming();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief fork 1, 4 and 16 workers that each load the scene's textures and can mesh, first each
+  /// decoding its own copy, then through a fresh AssetCache and again once it is warm, and print
+  /// the wall time, the time per worker and the proportional and private memory per worker while
+  /// they all hold their assets
+  /// @returns the process exit code, failure if a worker didn't report
+  //----------------------------------------------------------------------------------------------------------------------
+  int assets();
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef FRUSTUM_H_
+#define FRUSTUM_H_
+#include <ngl/Mat4.h>
+#include <ngl/Vec4.h>
+#include <cmath>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file Frustum.h
+/// @brief the six clip planes of a view projection matrix, used for culling
+/// @version 1.0
+/// @class Frustum
+/// @brief planes are extracted with the Gribb/Hartmann method and normalised so a plane
+/// distance can be compared directly against a bounding sphere radius. Plane order is
+/// left, right, bottom, top, near, far and the normals point into the frustum
+//----------------------------------------------------------------------------------------------------------------------
+
+struct Frustum
+{
+  ngl::Vec4 planes[6];
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief build the planes from a (model) view projection matrix in ngl's layout
+  /// @param [in] _m the matrix, as ngl uploads it the rows of the GL matrix are the columns of m_m
+  //----------------------------------------------------------------------------------------------------------------------
+  static Frustum fromMatrix(const ngl::Mat4 &_m)
+  {
+    auto row=[&_m](int _i)
+    {
+      return ngl::Vec4(_m.m_m[0][_i],_m.m_m[1][_i],_m.m_m[2][_i],_m.m_m[3][_i]);
+    };
+    ngl::Vec4 r0=row(0), r1=row(1), r2=row(2), r3=row(3);
+    Frustum f;
+    for(int i=0; i<3; ++i)
+    {
+      ngl::Vec4 r= i==0 ? r0 : (i==1 ? r1 : r2);
+      f.planes[i*2]  =ngl::Vec4(r3.m_x+r.m_x,r3.m_y+r.m_y,r3.m_z+r.m_z,r3.m_w+r.m_w);
+      f.planes[i*2+1]=ngl::Vec4(r3.m_x-r.m_x,r3.m_y-r.m_y,r3.m_z-r.m_z,r3.m_w-r.m_w);
+    }
+    for(auto &p : f.planes)
+    {
+      float len=std::sqrt(p.m_x*p.m_x+p.m_y*p.m_y+p.m_z*p.m_z);
+      p=ngl::Vec4(p.m_x/len,p.m_y/len,p.m_z/len,p.m_w/len);
+    }
+    return f;
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief conservative sphere test
+  /// @returns false only if the sphere is completely outside one of the planes
+  //----------------------------------------------------------------------------------------------------------------------
+  bool sphereVisible(float _x, float _y, float _z, float _r) const
+  {
+    for(auto &p : planes)
+    {
+      if(p.m_x*_x+p.m_y*_y+p.m_z*_z+p.m_w < -_r)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+#endif
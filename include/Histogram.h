@@ -0,0 +1,41 @@
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+#include <cstdint>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file Histogram.h
+/// @brief fixed bucket histogram of times in milliseconds
+/// @version 1.0
+/// @class Histogram
+/// @brief times are counted into BUCKET_MS wide buckets, anything past the last bucket goes in
+/// the last one, so percentiles are exact to a bucket and adding never allocates. The max and
+/// mean are kept exactly. Used for the frame times and input latency, which care about the tail
+/// more than the average.
+//----------------------------------------------------------------------------------------------------------------------
+
+class Histogram
+{
+  public:
+    static constexpr float BUCKET_MS=0.5f;
+    static constexpr int NUM_BUCKETS=400;
+    Histogram();
+    void add(float _ms);
+    void reset();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the upper edge of the bucket the _p'th fraction (0-1) of the samples fall in
+    //----------------------------------------------------------------------------------------------------------------------
+    float percentile(float _p) const;
+    float max() const { return m_max; }
+    float mean() const { return m_count>0 ? static_cast<float>(m_sum/m_count) : 0.0f; }
+    uint64_t count() const { return m_count; }
+    uint64_t bucket(int _i) const { return m_buckets[_i]; }
+    static float bucketStart(int _i) { return _i*BUCKET_MS; }
+
+  private:
+    std::vector<uint64_t> m_buckets;
+    uint64_t m_count=0;
+    double m_sum=0.0;
+    float m_max=0.0f;
+};
+
+#endif
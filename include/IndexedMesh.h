@@ -0,0 +1,231 @@
+#ifndef INDEXEDMESH_H_
+#define INDEXEDMESH_H_
+#include <ngl/Obj.h>
+#include <ngl/Vec3.h>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file IndexedMesh.h
+/// @brief an indexed (welded) version of an ngl::Obj so it can be drawn with glMultiDrawElementsIndirect
+/// @version 1.0
+/// @class IndexedMesh
+/// @brief ngl::Obj::createVAO unrolls every face into a flat vertex list and draws with glDrawArrays,
+/// this class welds identical position/uv/normal triples into one vertex buffer plus an index buffer
+/// and keeps the attribute locations the same as ngl (0 position, 1 uv, 2 normal) so the existing
+/// shaders work unchanged. Attribute 3 is a per instance index (divisor 1) fed from a buffer of
+/// visible instance ids written by the GPU culling pass. Attribute 4 is the tangent with the
+/// bitangent sign in w, generated when the mesh is built following the MikkTSpace convention. Simplified levels of detail can be appended
+/// to the index buffer, they all share the one vertex buffer and are drawn as one command each.
+/// On the GPU the vertices are quantised to 20 bytes, 16 bit positions normalised to the mesh
+/// bounds, 2_10_10_10 normals and tangents and half float uvs, the shaders rebuild the position from the
+/// positionOffset / positionScale uniforms set by loadQuantisation. Indices are 16 bit when the
+/// mesh has few enough vertices. A full float copy is kept alongside so the two can be compared.
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the layout glMultiDrawElementsIndirect expects, also written by shaders/CullComp.glsl
+//----------------------------------------------------------------------------------------------------------------------
+struct DrawElementsIndirectCommand
+{
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint  baseVertex;
+  GLuint baseInstance;
+};
+
+class IndexedMesh
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the most levels of detail a mesh can have, the culling shader has one command per level
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr int MAX_LODS=5;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief one level of detail, a range of the index buffer and its simplification error in model units
+    //----------------------------------------------------------------------------------------------------------------------
+    struct LOD
+    {
+      GLuint firstIndex;
+      GLuint count;
+      float error;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ctor builds the welded vertex and index lists from an already loaded obj
+    /// @param [in] _obj the obj to copy the data from
+    //----------------------------------------------------------------------------------------------------------------------
+    IndexedMesh(ngl::Obj &_obj);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ctor builds a flat grid in the xz plane facing +y, the same as ngl's createTrianglePlane
+    /// @param [in] _width the size in x
+    /// @param [in] _depth the size in z
+    /// @param [in] _steps the number of quads along each side
+    //----------------------------------------------------------------------------------------------------------------------
+    IndexedMesh(ngl::Real _width, ngl::Real _depth, int _steps);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief build the per vertex tangent frames the way MikkTSpace does, both ctors call it. Each
+    /// corner's uv tangent is projected onto the vertex normal's plane and weighted by the corner
+    /// angle, and a vertex whose corners disagree on the bitangent sign (a mirrored uv seam) is
+    /// split in two. Must be called before generateLODs as a split adds vertices
+    /// @param [in] _threads the threads the triangles and vertices are shared between, 0 for one per core
+    //----------------------------------------------------------------------------------------------------------------------
+    void generateTangents(unsigned int _threads=0);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief dtor releases the GL buffers
+    //----------------------------------------------------------------------------------------------------------------------
+    ~IndexedMesh();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief simplify the mesh into a chain of levels each with half the triangles of the last,
+    /// must be called before createVAO. The chain ends early if the simplifier can't collapse any more
+    /// @param [in] _levels the total number of levels including the full mesh, at most MAX_LODS
+    //----------------------------------------------------------------------------------------------------------------------
+    void generateLODs(int _levels);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief pick a level from the projected radius of the mesh in pixels, an instance only changes
+    /// level once it is _hysteresis (as a fraction) past the switch size so it doesn't flicker
+    /// @param [in] _screenRadius the projected bounding sphere radius in pixels
+    /// @param [in] _previous the level used last frame
+    /// @param [in] _thresholds the radius below which level i+1 is used instead of level i
+    /// @param [in] _hysteresis the fraction either side of a threshold before switching
+    /// @returns the level to use, the same selection is done on the GPU in CullComp.glsl
+    //----------------------------------------------------------------------------------------------------------------------
+    unsigned int selectLOD(float _screenRadius, unsigned int _previous, const float *_thresholds, float _hysteresis) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief upload the vertex and index data and create the VAOs, needs a valid GL context
+    /// @param [in] _instanced set up attribute 3 for the per instance id, only needed for drawIndirect
+    //----------------------------------------------------------------------------------------------------------------------
+    void createVAO(bool _instanced=true);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief choose between the quantised vertices (the default) and the full float copy
+    //----------------------------------------------------------------------------------------------------------------------
+    void setQuantised(bool _quantised) { m_quantised=_quantised; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set the positionOffset and positionScale uniforms in the current shader that turn the
+    /// 0-1 quantised positions back into model space (identity when drawing the float copy)
+    //----------------------------------------------------------------------------------------------------------------------
+    void loadQuantisation() const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief draw the whole of the first level, _instances times for shaders that use gl_InstanceID
+    //----------------------------------------------------------------------------------------------------------------------
+    void draw(GLsizei _instances=1) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the command to draw one level, instanceCount is left at 0 for the culling pass to fill in
+    //----------------------------------------------------------------------------------------------------------------------
+    DrawElementsIndirectCommand indirectCommand(int _lod=0) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief draw from a buffer of indirect commands in a single call
+    /// @param [in] _commands the GL_DRAW_INDIRECT_BUFFER holding the commands
+    /// @param [in] _drawCount the number of commands in the buffer
+    /// @param [in] _instanceIds the buffer of instance ids read by attribute 3, indexed from baseInstance
+    /// @param [in] _divisor instances drawn per id, above 1 when each one is drawn into several views
+    //----------------------------------------------------------------------------------------------------------------------
+    void drawIndirect(GLuint _commands, GLsizei _drawCount, GLuint _instanceIds, GLuint _divisor=1) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief accessors used for stats and bounds
+    //----------------------------------------------------------------------------------------------------------------------
+    GLsizei numIndices(int _lod=0) const { return static_cast<GLsizei>(m_lods[_lod].count); }
+    GLsizei numVerts() const { return static_cast<GLsizei>(m_verts.size()); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the vertices generateTangents had to split at mirrored uv seams
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t tangentSplits() const { return m_tangentSplits; }
+    GLsizei numTriangles(int _lod=0) const { return numIndices(_lod)/3; }
+    int numLODs() const { return static_cast<int>(m_lods.size()); }
+    const LOD &getLOD(int _lod) const { return m_lods[_lod]; }
+
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief full precision interleaved vertex, kept for the float comparison path
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Vertex
+    {
+      GLfloat x,y,z;
+      GLfloat u,v;
+      GLfloat nx,ny,nz;
+      /// the tangent, w is the bitangent sign so bitangent = w * cross(normal, tangent)
+      GLfloat tx,ty,tz,tw;
+    };
+    const std::vector<Vertex> &vertices() const { return m_verts; }
+    const std::vector<GLuint> &indices() const { return m_indices; }
+    const std::vector<LOD> &lods() const { return m_lods; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ctor from the vertices, indices and levels of a mesh already welded, given tangents and
+    /// simplified, as the AssetCache keeps them
+    //----------------------------------------------------------------------------------------------------------------------
+    IndexedMesh(const Vertex *_verts, size_t _numVerts, const GLuint *_indices, size_t _numIndices,
+                const LOD *_lods, size_t _numLODs, size_t _tangentSplits);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the quantised vertex as uploaded to the GPU, 20 bytes against 48 for the float vertex
+    //----------------------------------------------------------------------------------------------------------------------
+    struct PackedVertex
+    {
+      GLushort x,y,z,w;
+      GLushort u,v;
+      GLuint normal;
+      GLuint tangent;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief build the quantised vertices, position = positionOffset + xyz/65535 * positionScale
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<PackedVertex> quantisedVertices() const;
+    const ngl::Vec3 &positionOffset() const { return m_positionOffset; }
+    const ngl::Vec3 &positionScale() const { return m_positionScale; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief GPU memory used by the vertex and index buffers as drawn, and the same data as 32 bit floats and indices
+    //----------------------------------------------------------------------------------------------------------------------
+    size_t quantisedBytes() const;
+    size_t floatBytes() const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief IEEE half float conversions used for the uvs, round to nearest
+    //----------------------------------------------------------------------------------------------------------------------
+    static GLushort floatToHalf(float _f);
+    static float halfToFloat(GLushort _h);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief pack a unit vector into the signed normalised GL_INT_2_10_10_10_REV format and back
+    //----------------------------------------------------------------------------------------------------------------------
+    static GLuint packNormal(float _x, float _y, float _z);
+    static ngl::Vec3 unpackNormal(GLuint _n);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a tangent packs like a normal with the bitangent sign in the 2 bit w
+    //----------------------------------------------------------------------------------------------------------------------
+    static GLuint packTangent(float _x, float _y, float _z, float _w);
+    const ngl::Vec3 &getCenter() const { return m_center; }
+    ngl::Real getRadius() const { return m_radius; }
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the bounding box, the sphere and the quantisation range are all taken from the vertices
+    //----------------------------------------------------------------------------------------------------------------------
+    void computeBounds();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the welded vertices
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<Vertex> m_verts;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief triangle list indices into m_verts, every level one after the other
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<GLuint> m_indices;
+    std::vector<LOD> m_lods;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief bounding sphere of the mesh in model space
+    //----------------------------------------------------------------------------------------------------------------------
+    ngl::Vec3 m_center;
+    ngl::Real m_radius=0.0f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the box the 16 bit positions are normalised against
+    //----------------------------------------------------------------------------------------------------------------------
+    ngl::Vec3 m_positionOffset;
+    ngl::Vec3 m_positionScale;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief GL object ids
+    //----------------------------------------------------------------------------------------------------------------------
+    GLuint m_vao=0;
+    GLuint m_vbo=0;
+    GLuint m_ibo=0;
+    GLuint m_floatVao=0;
+    GLuint m_floatVbo=0;
+    size_t m_tangentSplits=0;
+    GLenum m_indexType=GL_UNSIGNED_INT;
+    GLsizei m_indexSize=sizeof(GLuint);
+    bool m_quantised=true;
+};
+
+#endif
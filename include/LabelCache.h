@@ -0,0 +1,155 @@
+#ifndef LABELCACHE_H_
+#define LABELCACHE_H_
+#include <ngl/Types.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file LabelCache.h
+/// @brief streams the can labels of a large catalogue into one texture array as they are needed
+/// @version 1.0
+/// @class LabelCache
+/// @brief every label is resized to the same size so any of them fits any layer of a
+/// GL_TEXTURE_2D_ARRAY with as many layers as the memory budget allows. Layer 0 always holds SKU 0
+/// and is what every other SKU shows until its own label is resident. A request for a label that
+/// isn't resident queues it for the loader threads, which decode, resize, tint and mipmap it off
+/// the render thread. The render thread then uploads a limited number of bytes of finished labels
+/// each frame into free or least recently used layers. The layer of every SKU is kept in a buffer
+/// the can shader reads with the instance's SKU, so a shelf of mixed SKUs is one draw with no
+/// textures rebound.
+//----------------------------------------------------------------------------------------------------------------------
+
+class LabelCache
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the most label bytes uploaded in one frame, the rest wait for the next
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr size_t UPLOAD_BYTES_PER_FRAME=8*1024*1024;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief counters, the hits and misses are per frame, one per SKU asked for
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Stats
+    {
+      uint32_t hits=0;
+      uint32_t misses=0;
+      uint32_t uploads=0;
+      uint32_t evictions=0;
+      /// loads finished with nowhere to go as every layer was in use this frame
+      uint32_t dropped=0;
+      uint32_t loading=0;
+      uint32_t resident=0;
+      uint64_t totalHits=0;
+      uint64_t totalMisses=0;
+      uint64_t uploadedBytes=0;
+      /// upload bandwidth over the last second
+      float uploadMBps=0.0f;
+    };
+
+    LabelCache()=default;
+    ~LabelCache();
+    LabelCache(const LabelCache &)=delete;
+    LabelCache &operator=(const LabelCache &)=delete;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief create the texture array and layer buffer and start the loaders, needs a current context
+    /// @param [in] _files the artwork, SKUs past the last file reuse it with the hue turned
+    /// @param [in] _count the number of SKUs
+    /// @param [in] _width _height the size of every label
+    /// @param [in] _budget bytes of texture memory, the array has as many layers as fit
+    //----------------------------------------------------------------------------------------------------------------------
+    void create(const std::vector<std::string> &_files, uint32_t _count, int _width, int _height, size_t _budget);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief stop the loaders and delete the texture array and layer buffer, needs the context they
+    /// were created in to be current. The dtor only does what is left
+    //----------------------------------------------------------------------------------------------------------------------
+    void destroy();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief start a frame, the hit and miss counts start again
+    //----------------------------------------------------------------------------------------------------------------------
+    void beginFrame();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a SKU is drawn this frame, it is queued for loading if it isn't resident
+    //----------------------------------------------------------------------------------------------------------------------
+    void request(uint32_t _sku);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief upload finished labels into the layers not used this frame, then bind the array to
+    /// _unit and the SKU layer table to the shader storage _binding
+    //----------------------------------------------------------------------------------------------------------------------
+    void update(GLuint _unit, GLuint _binding);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief whether a SKU's own label is in the array rather than the fallback
+    //----------------------------------------------------------------------------------------------------------------------
+    bool resident(uint32_t _sku) const { return _sku<m_count && m_skuResident[_sku]; }
+    const Stats &stats() const { return m_stats; }
+    int layers() const { return m_layers; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a one line summary of the counters
+    //----------------------------------------------------------------------------------------------------------------------
+    std::string report() const;
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a decoded label, every level packed one after the other
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Load
+    {
+      uint32_t sku;
+      std::vector<uint8_t> pixels;
+    };
+    void loaderLoop();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief decode, resize and tint a label and build its mips, safe to call from any thread
+    //----------------------------------------------------------------------------------------------------------------------
+    void decode(uint32_t _sku, std::vector<uint8_t> &o_pixels) const;
+    void upload(const Load &_load, int _layer);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a layer that is free or wasn't used this frame, -1 if every one was
+    //----------------------------------------------------------------------------------------------------------------------
+    int evict();
+    void stopLoaders();
+
+    static constexpr uint32_t NO_SKU=0xffffffffu;
+    std::vector<std::string> m_files;
+    uint32_t m_count=0;
+    int m_width=0;
+    int m_height=0;
+    int m_levels=1;
+    int m_layers=0;
+    size_t m_labelBytes=0;
+    GLuint m_texture=0;
+    GLuint m_layerBuffer=0;
+
+    /// per SKU, the layer it is drawn from (0 until it is resident), whether it is resident or
+    /// loading, and the frame it was last asked for
+    std::vector<uint32_t> m_skuLayer;
+    std::vector<uint8_t> m_skuResident;
+    std::vector<uint8_t> m_skuLoading;
+    std::vector<uint32_t> m_skuFrame;
+    uint32_t m_dirtyFirst=NO_SKU;
+    uint32_t m_dirtyLast=0;
+    /// per layer, its SKU and its place in the recency list, most recent at the front
+    std::vector<uint32_t> m_layerSku;
+    std::list<int> m_lru;
+    std::vector<std::list<int>::iterator> m_lruPosition;
+    uint32_t m_frame=0;
+
+    /// the loaders take SKUs from m_queue and leave the results in m_done
+    std::vector<std::thread> m_loaders;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<uint32_t> m_queue;
+    std::deque<Load> m_done;
+    bool m_quit=false;
+
+    Stats m_stats;
+    uint64_t m_windowBytes=0;
+    std::chrono::steady_clock::time_point m_windowStart;
+};
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef LOADGENERATOR_H_
+#define LOADGENERATOR_H_
+class QString;
+//----------------------------------------------------------------------------------------------------------------------
+/// @file LoadGenerator.h
+/// @brief a local client for the render server (see RenderServer.h) that keeps it busy from a
+/// number of connections and measures what the clients see. Run with Can_Project --load
+//----------------------------------------------------------------------------------------------------------------------
+
+namespace LoadGenerator
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief connect _clients times to the server on _socket and send each _jobs jobs, keeping
+  /// _inFlight of them outstanding. The jobs use a few cameras and sizes so the server has
+  /// batches to find, with the labels picked at random. Prints the throughput, the latency
+  /// percentiles and the server's own metrics
+  /// @returns the process exit code, failure if a job fails or an image isn't a PNG
+  //----------------------------------------------------------------------------------------------------------------------
+  int run(const QString &_socket, int _clients, int _jobs, int _inFlight);
+}
+
+#endif
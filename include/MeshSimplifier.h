@@ -0,0 +1,82 @@
+#ifndef MESHSIMPLIFIER_H_
+#define MESHSIMPLIFIER_H_
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file MeshSimplifier.h
+/// @brief quadric error metric mesh simplification used to build the level of detail chain
+/// @version 1.0
+/// @class MeshSimplifier
+/// @brief Garland and Heckbert style simplification using half edge collapses, a vertex is merged
+/// into one of its neighbours rather than a new optimal position so every level keeps indexing the
+/// original vertex buffer. Vertices on a border of the index topology never move, in a welded mesh
+/// that is every UV seam and hard normal edge (including the label borders) as well as any real
+/// open edge, so the texture mapping survives intact. Simplification is incremental, calling
+/// simplify() with smaller and smaller targets gives a nested chain of levels.
+//----------------------------------------------------------------------------------------------------------------------
+
+class MeshSimplifier
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ctor builds the quadrics and collapse candidates
+    /// @param [in] _positions xyz per vertex
+    /// @param [in] _indices the triangle list to simplify
+    //----------------------------------------------------------------------------------------------------------------------
+    MeshSimplifier(const std::vector<float> &_positions, const std::vector<uint32_t> &_indices);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief collapse the cheapest edges until there are no more than _targetTriangles triangles
+    /// or nothing else can be collapsed without flipping a triangle or moving a seam
+    //----------------------------------------------------------------------------------------------------------------------
+    void simplify(size_t _targetTriangles);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the current triangle list
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<uint32_t> indices() const;
+    size_t numTriangles() const { return m_liveTriangles; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the largest error of any collapse so far, the root mean square distance in model units
+    /// from the merged vertex to the area weighted planes it has taken on
+    //----------------------------------------------------------------------------------------------------------------------
+    float error() const { return m_error; }
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief symmetric 4x4 quadric stored as its upper triangle, each plane weighted by the area of
+    /// its triangle, and the total area of the planes it holds
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Quadric
+    {
+      double a[10]={0,0,0,0,0,0,0,0,0,0};
+      double area=0.0;
+      void addPlane(double _x, double _y, double _z, double _d, double _area);
+      void add(const Quadric &_q);
+      double evaluate(double _x, double _y, double _z) const;
+    };
+    struct Collapse
+    {
+      double cost;
+      uint32_t from;
+      uint32_t to;
+      bool operator>(const Collapse &_c) const { return cost>_c.cost; }
+    };
+    double collapseCost(uint32_t _from, uint32_t _to) const;
+    bool isEdge(uint32_t _a, uint32_t _b) const;
+    bool canCollapse(uint32_t _from, uint32_t _to) const;
+    void collapse(uint32_t _from, uint32_t _to);
+    void pushCandidates(uint32_t _v);
+
+    std::vector<float> m_positions;
+    std::vector<uint32_t> m_triangles;
+    std::vector<uint8_t> m_triangleAlive;
+    std::vector<std::vector<uint32_t>> m_vertexTriangles;
+    std::vector<Quadric> m_quadrics;
+    std::vector<uint8_t> m_locked;
+    std::vector<uint8_t> m_vertexAlive;
+    std::vector<Collapse> m_heap;
+    size_t m_liveTriangles=0;
+    float m_error=0.0f;
+};
+
+#endif
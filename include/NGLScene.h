@@ -3,6 +3,7 @@
 #include <ngl/Camera.h>
 #include <ngl/Colour.h>
 #include <ngl/Light.h>
+#include <ngl/Mat3.h>
 #include <ngl/Transformation.h>
 #include <ngl/Text.h>
 #include "WindowParams.h"
@@ -10,6 +11,28 @@
 #include <memory>
 #include <ngl/Obj.h>
 #include <glm/vec3.hpp>
+#include <QElapsedTimer>
+#include "IndexedMesh.h"
+#include "Frustum.h"
+#include "SceneStore.h"
+#include "BVH.h"
+#include "PassTimer.h"
+#include "ProgramCache.h"
+#include "ShaderVariants.h"
+#include "QualityGovernor.h"
+#include "RenderThread.h"
+#include "SPSCQueue.h"
+#include "TripleBuffer.h"
+#include "Histogram.h"
+#include "TransformBatch.h"
+#include "ShadowAtlas.h"
+#include "LabelCache.h"
+#include "StreamBuffer.h"
+#include "AssetCache.h"
+#include <array>
+
+constexpr auto CanProgram="CanProgram";
+constexpr auto PlaneProgram="PlaneProgram";
 //----------------------------------------------------------------------------------------------------------------------
 /// @file NGLScene.h
 /// @brief this class inherits from the Qt OpenGLWindow and allows us to use NGL to draw OpenGL
@@ -20,9 +43,14 @@
 /// This is an initial version used for the new NGL6 / Qt 5 demos
 /// @class NGLScene
 /// @brief our main glwindow widget for NGL applications all drawing elements are
-/// put in this file
+/// put in this file. The window itself only handles events and shows finished frames, all the
+/// rendering happens on a RenderThread with its own context. The GUI thread owns the camera
+/// and light state and publishes a snapshot of it after every change, the render thread picks
+/// up the latest snapshot at the start of each frame.
 //----------------------------------------------------------------------------------------------------------------------
 
+struct RenderJob;
+
 class NGLScene : public QOpenGLWindow
 {
   public:
@@ -32,10 +60,42 @@ class NGLScene : public QOpenGLWindow
     //----------------------------------------------------------------------------------------------------------------------
     NGLScene();
     //----------------------------------------------------------------------------------------------------------------------
-    /// @brief dtor must close down ngl and release OpenGL resources
+    /// @brief dtor stops the render thread, which calls releaseRenderer before giving up its context
     //----------------------------------------------------------------------------------------------------------------------
     ~NGLScene();
     //----------------------------------------------------------------------------------------------------------------------
+    /// @brief low latency mode lets the render thread get only one frame ahead of the display and
+    /// waits for each blit to finish before queuing the next, trading throughput for latency
+    //----------------------------------------------------------------------------------------------------------------------
+    void setLowLatency(bool _lowLatency);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a still far bigger than any render target, rendered in tiles and written as a TIFF
+    //----------------------------------------------------------------------------------------------------------------------
+    struct TiledRender
+    {
+      std::string file=std::string("render.tif");
+      int width=16384;
+      int height=16384;
+      int tile=1024;
+      /// pixels rendered round each tile and thrown away, -1 for enough to cover the blur and FXAA
+      int margin=-1;
+      uint32_t label=0;
+      ngl::Vec3 eye=ngl::Vec3(0.0f,1.0f,4.0f);
+      ngl::Vec3 look=ngl::Vec3(0.0f,1.0f,0.0f);
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief render _settings tile by tile with a context current on this thread, the shadows are
+    /// rendered once for the whole picture and each tile is streamed to the file as it is read back,
+    /// so the memory used doesn't depend on the picture size
+    /// @returns the process exit code
+    //----------------------------------------------------------------------------------------------------------------------
+    int renderTiled(const TiledRender &_settings);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief delete the GL objects the members own while the context they were made in is still
+    /// current on the rendering thread, the member dtors then have nothing left to delete
+    //----------------------------------------------------------------------------------------------------------------------
+    void releaseRenderer();
+    //----------------------------------------------------------------------------------------------------------------------
     /// @brief the initialize class is called once when the window is created and we have a valid GL context
     /// use this to setup any default GL stuff
     //----------------------------------------------------------------------------------------------------------------------
@@ -49,6 +109,87 @@ class NGLScene : public QOpenGLWindow
     //----------------------------------------------------------------------------------------------------------------------
     void resizeGL(int _w, int _h);
 private:
+    friend class RenderThread;
+    friend class RenderServer;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief everything the GUI thread changes that the render thread needs, copied whole on every
+    /// publish so the render thread never reads a half updated state
+    //----------------------------------------------------------------------------------------------------------------------
+    struct SceneInput
+    {
+      int spinXFace=0;
+      int spinYFace=0;
+      ngl::Vec3 modelPos;
+      ngl::Vec3 lightPosition=ngl::Vec3(8.0f,4.0f,8.0f);
+      int width=1024;
+      int height=720;
+      float devicePixelRatio=1.0f;
+      /// the last input event folded into this snapshot
+      uint32_t inputSeq=0;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a finished frame, the texture and render thread framebuffer stay with the slot and the
+    /// fence tells the window's context when the render thread's commands have finished
+    //----------------------------------------------------------------------------------------------------------------------
+    struct PresentFrame
+    {
+      GLuint texture=0;
+      GLuint fbo=0;
+      GLsync fence=nullptr;
+      int width=0;
+      int height=0;
+      unsigned int frameIndex=0;
+      float gpuTime=0.0f;
+      float aaTime=0.0f;
+      const char *aaMode="";
+      /// the last input event the frame was rendered with
+      uint32_t inputSeq=0;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief render thread side of initializeGL and paintGL
+    //----------------------------------------------------------------------------------------------------------------------
+    void initializeRenderer();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief render and publish the next frame
+    /// @returns false if nothing was rendered as the accumulated still has converged
+    //----------------------------------------------------------------------------------------------------------------------
+    bool renderFrame();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief everything after the shadow pass for the current camera, from the reflection to the
+    /// final pass into the present target
+    //----------------------------------------------------------------------------------------------------------------------
+    void renderView();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief copy the GUI state into the snapshot and hand it to the render thread
+    //----------------------------------------------------------------------------------------------------------------------
+    void publishInput();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief GUI thread, stamp an input event for the latency measurement and publish it
+    //----------------------------------------------------------------------------------------------------------------------
+    void markInput();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief GUI thread, put a timestamp after the blit of a new frame, and read back the earlier
+    /// ones to find when the frames and the input events they carried reached the screen
+    //----------------------------------------------------------------------------------------------------------------------
+    void timePresent(const PresentFrame &_frame);
+    void readPresentTimes();
+    void reportLatency();
+    void exportHistograms();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief render thread, pick up the latest snapshot and any queued key presses
+    //----------------------------------------------------------------------------------------------------------------------
+    void consumeInput();
+    void resizeRenderer();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief render thread, the keys that change render settings
+    //----------------------------------------------------------------------------------------------------------------------
+    void applyKey(int _key);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief render thread, bind the next free frame slot (resizing it to the window) for the final pass
+    /// and hand it to the window once the overlay has been drawn
+    //----------------------------------------------------------------------------------------------------------------------
+    void bindPresentTarget();
+    void publishFrame();
     //----------------------------------------------------------------------------------------------------------------------
     /// @brief the windows params such as mouse and rotations etc
     //----------------------------------------------------------------------------------------------------------------------
@@ -62,13 +203,10 @@ private:
     //----------------------------------------------------------------------------------------------------------------------
     ngl::Camera m_cam;
     //----------------------------------------------------------------------------------------------------------------------
-    /// @brief camera from light view
-    //----------------------------------------------------------------------------------------------------------------------
-    ngl::Camera m_lightCamera;
+    /// @brief the shadow maps of every light and the lights as the atlas sees them
     //----------------------------------------------------------------------------------------------------------------------
-    /// @brief transformation stack for the gl transformations etc
-    //----------------------------------------------------------------------------------------------------------------------
-    ngl::Transformation m_transform;
+    ShadowAtlas m_shadowAtlas;
+    std::vector<ShadowLight> m_shadowLights;
     //----------------------------------------------------------------------------------------------------------------------
     /// @brief the model position for mouse movement
     //----------------------------------------------------------------------------------------------------------------------
@@ -94,14 +232,6 @@ private:
     //----------------------------------------------------------------------------------------------------------------------
     ngl::Vec3 m_lightPosition;
     //----------------------------------------------------------------------------------------------------------------------
-    /// @brief our texture id used by the FBO
-    //----------------------------------------------------------------------------------------------------------------------
-    GLuint m_ShadowtextureID;
-    //----------------------------------------------------------------------------------------------------------------------
-    /// @brief our FBO id used by the FBO
-    //----------------------------------------------------------------------------------------------------------------------
-    GLuint m_ShadowfboID;
-    //----------------------------------------------------------------------------------------------------------------------
     /// @brief y pos of the light
     //----------------------------------------------------------------------------------------------------------------------
     GLfloat m_lightYPos;
@@ -123,15 +253,29 @@ private:
     void updateLight();
     //----------------------------------------------------------------------------------------------------------------------
     /// @brief draw our scene passing in the shader to use
-    /// @param[in] _shader the name of the shader to use when drawing
-    /// @param[in] _shaderFunc the function to load values to the shader
+    /// @param[in] _shaderFunc the function to load values to the shader for the primitive objects (the ground plane)
+    /// @param[in] _instanceFunc the function to load values to the shader for the instanced cans
+    /// @param[in] _pass 0 for the camera, 1 for the light or 2 for the reflection, selects the visible lists and cull buffers
+    //----------------------------------------------------------------------------------------------------------------------
+    void drawScene(std::function<void()> _shaderFunc, std::function<void()> _instanceFunc, int _pass);
     //----------------------------------------------------------------------------------------------------------------------
-    void drawScene(std::function<void()> _shaderFunc);
+    /// @brief build the global mouse rotation / translation, done once per frame
+    //----------------------------------------------------------------------------------------------------------------------
+    void updateMouseTransform();
     //----------------------------------------------------------------------------------------------------------------------
     /// @brief load all the transform values to the shader
-    /// @param[in] _tx the current transform to load
+    /// @param[in] _reflected use the mirrored view and the simplified variant for the reflection pass
+    //----------------------------------------------------------------------------------------------------------------------
+    void loadMatricesToShadowShader(bool _reflected);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief stream an object's matrices and bind them for the Shadow programs
+    //----------------------------------------------------------------------------------------------------------------------
+    void streamObjectMatrices(const ngl::Mat4 &_model, const ngl::Mat4 &_MV, const ngl::Mat4 &_MVP, const ngl::Mat3 &_normalMatrix);
     //----------------------------------------------------------------------------------------------------------------------
-    void loadMatricesToShadowShader();
+    /// @brief bind the three lights the shadow atlas was placed for, read by the Shadow and Can
+    /// programs, they are streamed once a frame
+    //----------------------------------------------------------------------------------------------------------------------
+    void loadShadowLights();
     //----------------------------------------------------------------------------------------------------------------------
     /// @brief load all the transform values to the shader from light POV
     /// @param[in] _tx the current transform to load
@@ -139,6 +283,125 @@ private:
     void loadToLightPOVShader();
     void debugTexture(float _t, float _b, float _l, float _r);
     void createShadowFBO();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief cull the casters against the atlas views and draw them into every layer in one pass
+    //----------------------------------------------------------------------------------------------------------------------
+    void renderShadowAtlas();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief place every light's shadow views for this frame, called once the scene bounds are refitted
+    //----------------------------------------------------------------------------------------------------------------------
+    void updateShadowAtlas();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief load the views into the layered shadow pass program and set a viewport for each
+    //----------------------------------------------------------------------------------------------------------------------
+    void loadShadowViews();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief create the exponential variance targets to match the atlas layers
+    //----------------------------------------------------------------------------------------------------------------------
+    void createShadowFilters();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief point each material at the Shadow variant for the current filter, every filter's
+    /// variant was built with the rest so switching never compiles anything
+    //----------------------------------------------------------------------------------------------------------------------
+    void selectShadowVariants();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief turn this frame's atlas into what the receivers sample, the exponential moments are
+    /// built, blurred and mipmapped here if any receiver uses them, then every shadow map view is
+    /// bound to its unit and the atlas layout and filter settings loaded
+    //----------------------------------------------------------------------------------------------------------------------
+    void prefilterShadows();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief cycle the filter every receiving material uses, starting with the one the scene gave it
+    //----------------------------------------------------------------------------------------------------------------------
+    void cycleShadowFilter();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief change the filter radius in shadow map texels, the Poisson disc size or the blur width
+    //----------------------------------------------------------------------------------------------------------------------
+    void changeShadowRadius(float _scale);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief add last frame's prefilter and receiver GPU time to the running average for its filter
+    //----------------------------------------------------------------------------------------------------------------------
+    void updateShadowTimings();
+    static const char *shadowFilterName(uint32_t _filter);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the cheaper features a material is drawn with in the reflection pass
+    //----------------------------------------------------------------------------------------------------------------------
+    static uint32_t reflectionFeatures(uint32_t _features);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief find the mirror and build the view mirrored in it, with an oblique near plane on the
+    /// mirror so nothing below it is drawn. Called by cullScene before the frustums are culled
+    //----------------------------------------------------------------------------------------------------------------------
+    void updateReflection();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief draw the mirrored scene at a fraction of the scene resolution, mipmap it for the
+    /// roughness blur and load it into the receiving materials
+    //----------------------------------------------------------------------------------------------------------------------
+    void renderReflection();
+    void createReflectionFBO(int _width, int _height);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief turn the reflection pass on or off to compare the frame times
+    //----------------------------------------------------------------------------------------------------------------------
+    void toggleReflections();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief keep the reflection pass within its share of the scene pass by changing its resolution
+    //----------------------------------------------------------------------------------------------------------------------
+    void updateReflectionBudget();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ask the label cache for the label of every can the camera or reflection can see, then
+    /// upload what has loaded and bind the label array and SKU layer table for the can shader
+    //----------------------------------------------------------------------------------------------------------------------
+    void streamLabels();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the features a material is drawn with in the turntable, no mirror as the reflection is
+    /// of the main camera, and the views come from the turntable buffer
+    //----------------------------------------------------------------------------------------------------------------------
+    static uint32_t turntableFeatures(uint32_t _features);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief create the layered colour and depth targets, the thumbnail array and the view buffer
+    //----------------------------------------------------------------------------------------------------------------------
+    void createTurntable();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ask for the next SKU's turntable, it is drawn once its label is resident
+    //----------------------------------------------------------------------------------------------------------------------
+    void requestTurntable();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief draw the requested turntable one view at a time the way separate frames would, then
+    /// all the views in one submission, time both, and write the multi-view thumbnails out.
+    /// Called at the end of the frame so this frame's shadow atlas is still bound
+    //----------------------------------------------------------------------------------------------------------------------
+    void renderTurntable();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief draw the ground and the turntable can into views [_firstView, _firstView+_views)
+    //----------------------------------------------------------------------------------------------------------------------
+    void drawTurntableViews(int _firstView, int _views);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief downsample layers [_firstLayer, _firstLayer+_layers) of the turntable into thumbnails
+    //----------------------------------------------------------------------------------------------------------------------
+    void resolveThumbnails(int _firstLayer, int _layers);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief render thread side of initializeGL for the render server, full quality whatever the cost
+    //----------------------------------------------------------------------------------------------------------------------
+    void initializeServer();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ask the label cache for the labels of the waiting jobs, then upload what has loaded and
+    /// bind the label array and SKU layer table
+    //----------------------------------------------------------------------------------------------------------------------
+    void streamJobLabels(const std::vector<uint32_t> &_labels);
+    bool jobLabelResident(uint32_t _label) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief render a batch of compatible jobs, the frame is set up, culled and shadowed once for
+    /// the shared camera and light then every job is drawn with its own label and read back
+    //----------------------------------------------------------------------------------------------------------------------
+    void renderJobs(std::vector<RenderJob> &io_jobs);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief show _label on every can
+    //----------------------------------------------------------------------------------------------------------------------
+    void setJobLabel(uint32_t _label);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the sub frustum one tile of a tiled render sees, the part of the whole picture from
+    /// _x-_margin to _x+_tile+_margin across and the same down, scaled to fill the scene targets
+    //----------------------------------------------------------------------------------------------------------------------
+    void setTile(int _x, int _y, int _width, int _height, int _tile, int _margin);
     void createBlurFBO();
     inline void toggleAnimation(){m_animate ^=true;}
     inline void changeLightYPos(float _dy){m_lightYPos+=_dy;}
@@ -183,13 +446,209 @@ private:
     /// Initialise the entire environment map
     void initEnvironment();
 
+    /// Build every shader program through the program binary cache
+    void createPrograms();
+
     /// Utility function for loading up a 2D texture
     void initTexture(const GLuint&, GLuint &, const char *);
 
     /// Initialise a single side of the environment map
     void initEnvironmentSide(GLenum /*target*/, const char* /*filename*/);
 
-    void loadMatrices(const std::string _program);
+    void loadMatrices(const std::string _program, bool _reflected=false);
+
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief per instance data held in the instance SSBO, must match InstanceData in CanVert.glsl (std430)
+    //----------------------------------------------------------------------------------------------------------------------
+    struct InstanceData
+    {
+      TransformBatch::Matrices transform;
+      GLuint label;
+      GLuint pad[3];
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the std140 blocks written into m_stream, ViewMatrices in CanVert.glsl, ObjectMatrices in
+    /// ShadowVert.glsl and Lights in ShadowFrag.glsl and CanFrag.glsl. A mat3 is three padded columns and the floats
+    /// after a vec3 share its last four bytes
+    //----------------------------------------------------------------------------------------------------------------------
+    struct ViewBlock
+    {
+      GLfloat V[16];
+      GLfloat VP[16];
+      GLfloat viewPos[4];
+    };
+    struct ObjectBlock
+    {
+      GLfloat MV[16];
+      GLfloat MVP[16];
+      GLfloat M[16];
+      GLfloat normalMatrix[12];
+    };
+    struct LightBlock
+    {
+      GLfloat position[4];
+      GLfloat La[4];
+      GLfloat Ld[4];
+      GLfloat Ls[4];
+      GLfloat intensity[3];
+      GLfloat linear;
+      GLfloat quadratic;
+      GLfloat pad[3];
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief load the scene description from data/scene.json (or the built in default) and create
+    /// the meshes it references
+    //----------------------------------------------------------------------------------------------------------------------
+    void loadScene();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief rebuild the scene objects and BVH from the loaded scene plus the shelf of m_shelfCount
+    /// cans in shelf mode, then the instance list for every can object
+    //----------------------------------------------------------------------------------------------------------------------
+    void buildInstances();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief recompute the matrices of the objects that moved since last frame and upload the
+    /// changed span of the instance buffer, call before the dirty list is cleared
+    //----------------------------------------------------------------------------------------------------------------------
+    void updateTransforms();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief refit the BVH for any moved objects and frustum cull it for the camera and light
+    //----------------------------------------------------------------------------------------------------------------------
+    void cullScene();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief load the material of the object being drawn to the shader in use
+    //----------------------------------------------------------------------------------------------------------------------
+    void loadMaterial(const SceneMaterial &_material);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief select the layered atlas program for the instanced depth pass
+    //----------------------------------------------------------------------------------------------------------------------
+    void loadInstancesToLightPOVShader();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief load the camera matrices and light to the can shader for the instanced scene pass
+    /// @param[in] _reflected use the mirrored view and the simplified variant for the reflection pass
+    //----------------------------------------------------------------------------------------------------------------------
+    void loadInstancesToCanShader(bool _reflected);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief start / end the frame timers and print the draw call and frame time stats
+    //----------------------------------------------------------------------------------------------------------------------
+    void beginFrameStats();
+    void endFrameStats();
+    inline void toggleShelfMode(){m_shelfMode ^=true; buildInstances();}
+    void changeShelfCount(float _scale);
+
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the buffers for one GPU culling pass, one for the camera and one for the light
+    //----------------------------------------------------------------------------------------------------------------------
+    struct CullPass
+    {
+      GLuint visible=0;
+      GLuint commands=0;
+      GLuint lodState=0;
+      GLuint readback[2]={0,0};
+      GLuint visibleCount=0;
+      GLuint triangles=0;
+      GLuint lodInstances[IndexedMesh::MAX_LODS]={0,0,0,0,0};
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief create the buffers and depth pyramid for GPU culling
+    //----------------------------------------------------------------------------------------------------------------------
+    void createCullBuffers();
+    void resizeCullBuffers();
+    void createHiZ();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief fill in the visible ids and per level of detail indirect commands for the cans, either
+    /// with the culling compute pass or from the CPU BVH results depending on m_cullMode
+    /// @param[in] _pass 0 for the camera, 1 for the light or 2 for the reflection
+    /// @param[in] _VP the view projection to extract the frustum from
+    /// @param[in] _pixelScale converts a radius over view depth to pixels for the level of detail choice
+    /// @param[in] _occlusion test against the depth pyramid from last frame as well (GPU only)
+    /// @param[in] _lodBias extra levels coarser to use, the shadow pass can get away with less detail
+    //----------------------------------------------------------------------------------------------------------------------
+    void cullInstances(int _pass, const ngl::Mat4 &_VP, float _pixelScale, bool _occlusion, unsigned int _lodBias);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief read back last frame's command counts for the stats without stalling
+    //----------------------------------------------------------------------------------------------------------------------
+    void readCullStats(CullPass &_pass, const DrawElementsIndirectCommand *_commands);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief build the hierarchical depth pyramid from the scene depth for next frame's culling
+    /// @param[in] _VP the view projection the depth was rendered with
+    //----------------------------------------------------------------------------------------------------------------------
+    void buildHiZ(const ngl::Mat4 &_VP);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief where the cans are culled, GPU compute, CPU BVH or not at all
+    //----------------------------------------------------------------------------------------------------------------------
+    enum class CullMode { GPU, CPU, NONE };
+    void cycleCullMode();
+    inline void toggleLOD(){m_lodEnabled ^=true;}
+    void cycleShadowLODBias();
+    inline void toggleOcclusionCulling(){m_occlusionCulling ^=true;}
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief switch every mesh between the quantised and float vertex buffers to compare GPU time
+    //----------------------------------------------------------------------------------------------------------------------
+    void toggleQuantisedVertices();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief anti-aliasing of the single sample scene target, either a single FXAA pass or temporal
+    /// accumulation of jittered frames
+    //----------------------------------------------------------------------------------------------------------------------
+    enum class AAMode { NONE, FXAA, TAA };
+    void createAntiAliasing();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief pick this frame's sub pixel projection offset, identity unless TAA is on or a still is
+    /// accumulating, which also turns the PCF kernel
+    //----------------------------------------------------------------------------------------------------------------------
+    void updateJitter();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief resolve the scene colour with the current mode
+    /// @param[in] _VP the unjittered camera view projection, TAA reprojects its history with it
+    /// @returns the texture holding the anti-aliased scene
+    //----------------------------------------------------------------------------------------------------------------------
+    GLuint antiAlias(const ngl::Mat4 &_VP);
+    void cycleAAMode();
+    const char *aaModeName() const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief save the last frame as aa_<mode>_<frame>.png for quality comparisons
+    //----------------------------------------------------------------------------------------------------------------------
+    void saveScreenshot();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief progressive accumulation, once the camera and light have been still for
+    /// ACCUMULATION_IDLE_MS every frame is rendered with the next sub pixel jitter and shadow kernel
+    /// rotation and averaged into a float target until ACCUMULATION_SAMPLES frames are in it
+    //----------------------------------------------------------------------------------------------------------------------
+    void createAccumulation();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief start accumulating when the view has been idle long enough and restart it when the
+    /// view, light, keys or labels change
+    /// @returns false once the still has converged and nothing needs rendering
+    //----------------------------------------------------------------------------------------------------------------------
+    bool updateAccumulation();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief average this frame's scene colour into the accumulation target, in place of antiAlias
+    /// @returns the texture holding the mean of every frame so far
+    //----------------------------------------------------------------------------------------------------------------------
+    GLuint accumulate();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the passes timed for the quality governor
+    //----------------------------------------------------------------------------------------------------------------------
+    enum RenderPass { SHADOW_PASS, SHADOW_FILTER_PASS, REFLECTION_PASS, SCENE_PASS, POST_PASS, NUM_PASSES };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief create the upscale target and pass timers, needs the anti-aliasing targets for its size
+    //----------------------------------------------------------------------------------------------------------------------
+    void createQualityTargets();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief feed last frame's GPU time to the governor and pick up this frame's render size
+    //----------------------------------------------------------------------------------------------------------------------
+    void updateQuality();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief set the blur iterations, shadow map size and noise octaves for the governor's level
+    //----------------------------------------------------------------------------------------------------------------------
+    void applyQualityLevel();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief scale the reduced resolution scene up to full size with sharpening
+    /// @param[in] _input the texture holding the scene in its lower left m_renderWidth x m_renderHeight
+    /// @returns the full size texture, or _input at full scale
+    //----------------------------------------------------------------------------------------------------------------------
+    GLuint upscale(GLuint _input);
+    void toggleGovernor();
+    void changeFrameTarget(float _dt);
 
     void createNoiseTexture();
 
@@ -206,14 +665,243 @@ private:
 
 
 
-    /// A unique pointer storing our mesh object
-    std::unique_ptr<ngl::Obj> m_mesh;
+    /// The welded, indexed can obj used for all the can draws
+    std::unique_ptr<IndexedMesh> m_canMesh;
+    /// The plane meshes indexed by scene mesh id, nullptr for the obj entries
+    std::vector<std::unique_ptr<IndexedMesh>> m_meshes;
+    bool m_quantisedVertices=true;
+
+    /// The per instance model matrices and label index, uploaded to m_instanceSSBO
+    std::vector<InstanceData> m_instances;
+    GLuint m_instanceSSBO=0;
+
+    /// Instanced shelf mode draws m_shelfCount cans, otherwise only the single hero can
+    bool m_shelfMode=false;
+    int m_shelfCount=2000;
+
+    /// Per frame stats, draw calls are counted by drawScene
+    unsigned int m_drawCalls=0;
+    QElapsedTimer m_frameTimer;
+    QElapsedTimer m_reportTimer;
+    float m_frameTime=0.0f;
+    float m_gpuFrameTime=0.0f;
+    GLuint m_frameQuery[2]={0,0};
+    unsigned int m_frameIndex=0;
+
+    /// Culling buffers, m_cull[0] is the camera, m_cull[1] the light and m_cull[2] the reflection
+    static constexpr int NUM_CULL_VIEWS=3;
+    CullPass m_cull[NUM_CULL_VIEWS];
+    CullMode m_cullMode=CullMode::GPU;
+    bool m_occlusionCulling=true;
+
+    /// The scene as loaded from file and the working copy with the shelf added, the BVH is over m_scene
+    SceneStore m_sceneBase;
+    SceneStore m_scene;
+    BVH m_bvh;
+    /// The objects inside the camera [0], light [1] and reflection [2] frustums, filled by cullScene
+    std::vector<uint32_t> m_cpuVisible[NUM_CULL_VIEWS];
+    /// The can labels of the whole catalogue, streamed into a texture array as they come into view
+    LabelCache m_labels;
+    /// The per frame uniform blocks, a persistently mapped ring fenced a frame at a time
+    StreamBuffer m_stream;
+    /// the Lights block and the stream generation it was written in, it is written again once the
+    /// stream moves on to another region, each frame or when a frame overflows its region
+    StreamBuffer::Allocation m_lightBlock;
+    uint64_t m_lightBlockGeneration=~0ull;
+
+    /// Turntable thumbnails, every view is a layer of the colour and depth arrays, drawn in one
+    /// submission by instancing each draw once per view and picking the layer in the vertex shader
+    static constexpr int MAX_TURNTABLE_VIEWS=64;
+    int m_turntableViews=36;
+    /// the SKU waiting for its label to be resident, -1 when nothing is asked for
+    int m_turntableSku=-1;
+    int m_turntableNextSku=0;
+    bool m_turntableSupported=false;
+    GLuint m_turntableFBO=0;
+    GLuint m_turntableColour=0;
+    GLuint m_turntableDepth=0;
+    GLuint m_thumbnails=0;
+    GLuint m_thumbnailFBO=0;
+    GLuint m_turntableViewUBO=0;
+    /// the single can, its instance id and its indirect draw command
+    GLuint m_turntableInstance=0;
+    GLuint m_turntableIds=0;
+    GLuint m_turntableCommand=0;
+    std::vector<int> m_turntableVariant;
+    /// Scene object to can instance index, -1 for objects that aren't drawn instanced
+    std::vector<int32_t> m_objectInstance;
+    /// Instance index to scene object, the order m_instances is built in
+    std::vector<uint32_t> m_instanceObject;
+    /// The matrices of the objects drawn on their own, m_objectSlot maps a scene object to its
+    /// entry (-1 for instanced objects) and m_slotObject maps back
+    std::vector<TransformBatch::Matrices> m_objectMatrices;
+    std::vector<int32_t> m_objectSlot;
+    std::vector<uint32_t> m_slotObject;
+    /// Scratch lists of visible instance ids per level of detail uploaded when culling on the CPU
+    std::vector<GLuint> m_visibleInstances[IndexedMesh::MAX_LODS];
+    /// The level of detail each instance used last frame in each pass when culling on the CPU
+    std::vector<uint8_t> m_cpuLOD[NUM_CULL_VIEWS];
+    /// Level of detail switching, the shadow pass uses m_shadowLODBias levels coarser than it would
+    bool m_lodEnabled=true;
+    unsigned int m_shadowLODBias=1;
+    /// The can mesh and material in m_scene, the object loadMatricesToShadowShader is drawing
+    int m_canMeshID=-1;
+    int m_canMaterialID=-1;
+    uint32_t m_currentObject=0;
+    float m_cpuCullTime=0.0f;
+
+    /// Hierarchical depth buffer built from the previous frame and the matrix it used
+    GLuint m_hiZTex=0;
+    int m_hiZWidth=0;
+    int m_hiZHeight=0;
+    int m_hiZLevels=0;
+    bool m_hiZValid=false;
+    ngl::Mat4 m_prevVP;
+
+    /// Anti-aliasing targets, TAA alternates between the two as output and history
+    AAMode m_aaMode=AAMode::FXAA;
+    GLuint m_aaFBO[2]={0,0};
+    GLuint m_aaTex[2]={0,0};
+    int m_aaWidth=0;
+    int m_aaHeight=0;
+    int m_aaCurrent=0;
+    bool m_taaHistoryValid=false;
+    /// The projection jitter applied after the camera VP and the same offset in texture space
+    ngl::Mat4 m_jitter;
+    /// Maps the part of the picture a tile covers onto the whole target, the jitter starts from it.
+    /// Identity unless rendering tiles
+    ngl::Mat4 m_tileProjection;
+    float m_jitterUV[2]={0.0f,0.0f};
+    ngl::Mat4 m_taaPrevVP;
+    /// Start and end timestamps of the resolve pass, double buffered
+    GLuint m_aaQuery[2][2]={{0,0},{0,0}};
+    float m_aaTime=0.0f;
+
+    /// Progressive accumulation stops after this many frames, the jitter and kernel rotation cover
+    /// a pixel well by then
+    static constexpr unsigned int ACCUMULATION_SAMPLES=128;
+    /// The two targets alternate as the running mean and last frame's
+    GLuint m_accumulationFBO[2]={0,0};
+    GLuint m_accumulationTex[2]={0,0};
+    int m_accumulationCurrent=0;
+    bool m_accumulating=false;
+    unsigned int m_accumulatedSamples=0;
+    /// The render size the samples so far were taken at
+    int m_accumulationWidth=0;
+    int m_accumulationHeight=0;
+    /// What the samples were rendered with, a change restarts the idle timer
+    ngl::Mat4 m_accumulationVP;
+    ngl::Vec3 m_accumulationLight;
+    /// Set by anything else that changes the picture, a key or a label upload
+    bool m_accumulationReset=true;
+    QElapsedTimer m_idleTimer;
+
+    /// Dynamic resolution and quality levels, the scene is rendered into the lower left
+    /// m_renderWidth x m_renderHeight of the full size targets
+    QualityGovernor m_governor;
+    PassTimer m_passTimer{NUM_PASSES};
+    float m_renderScale=1.0f;
+    int m_renderWidth=1;
+    int m_renderHeight=1;
+    int m_blurIterations=30;
+    int m_shadowSize=1024;
+    GLuint m_upscaleFBO=0;
+    GLuint m_upscaleTex=0;
+
+    /// Shadow filtering, m_shadowFilter is the SHADOW_ value every receiver uses or SHADOW_NONE to
+    /// keep the one each material asked for. m_shadowFiltersUsed has bit n set if a receiver uses
+    /// filter n this frame
+    uint32_t m_shadowFilter=SHADOW_NONE;
+    unsigned int m_shadowFiltersUsed=0;
+    std::vector<int> m_shadowReceivers;
+    float m_shadowRadius=2.0f;
+    /// Added to the PCF disc's per pixel rotation, in turns, so accumulated frames see new taps
+    float m_shadowKernelRotation=0.0f;
+    /// The exponential moments of every atlas layer, [0] is mipmapped and sampled, [1] is one
+    /// layer holding the horizontal blur
+    GLuint m_evsmFBO[2]={0,0};
+    GLuint m_evsmTex[2]={0,0};
+    int m_evsmLevels=0;
+    int m_evsmLayers=0;
+    int m_evsmSize=0;
+    GLuint m_shadowCompareSampler=0;
+    /// Smoothed prefilter plus receiver GPU time for each filter
+    float m_shadowFilterTime[4]={0.0f,0.0f,0.0f,0.0f};
+
+    /// Planar reflection, m_reflectionActive is set each frame if there is a mirror the camera is
+    /// above. The view and projection are world to mirrored clip space, the plane is the mirror's
+    /// world normal and offset
+    bool m_reflectionEnabled=true;
+    bool m_reflectionActive=false;
+    ngl::Mat4 m_reflectionView;
+    ngl::Mat4 m_reflectionProjection;
+    ngl::Vec4 m_reflectionPlane;
+    ngl::Vec3 m_reflectionEye;
+    /// The target is the frame size over m_reflectionDivisor, the budget moves it between 2 and 4
+    int m_reflectionDivisor=2;
+    GLuint m_reflectionFBO=0;
+    GLuint m_reflectionTex=0;
+    GLuint m_reflectionDepth=0;
+    int m_reflectionWidth=0;
+    int m_reflectionHeight=0;
+    int m_reflectionLevels=1;
+    /// Smoothed reflection pass time over scene pass time
+    float m_reflectionCost=0.0f;
+
+    /// Linked program binaries kept between runs
+    ProgramCache m_programCache;
+    /// Decoded textures and meshes shared with every other process on the machine
+    AssetCache m_assets;
+    /// Feature specialised variants of the scene and blur shaders, one per material and blur direction
+    ShaderVariants m_variants;
+    std::vector<int> m_materialVariant;
+    std::vector<int> m_reflectionVariant;
+    int m_blurVariant[2]={-1,-1};
+
+    /// Hand over between the GUI and render threads, the GUI thread writes m_inputs and queues
+    /// key presses on m_keys, the render thread works from m_frameInput and writes m_presentFrames
+    TripleBuffer<SceneInput> m_inputs;
+    SceneInput m_guiInput;
+    SceneInput m_frameInput;
+    SPSCQueue<int,64> m_keys;
+    TripleBuffer<PresentFrame> m_presentFrames;
+    /// The window's framebuffer for reading the shown frame's texture, framebuffers aren't shared
+    GLuint m_presentReadFBO=0;
+    std::unique_ptr<RenderThread> m_renderThread;
+
+    /// Input to photon latency, measured on the GUI thread. Each input event gets a sequence number
+    /// and a time, a timestamp query after the blit of each new frame gives the time it reached the
+    /// window and every event up to the frame's inputSeq is counted against it
+    static constexpr uint32_t INPUT_HISTORY=256;
+    static constexpr int PRESENT_QUERIES=8;
+    struct PresentQuery
+    {
+      GLuint query=0;
+      uint32_t firstSeq=0;
+      uint32_t lastSeq=0;
+    };
+    QElapsedTimer m_latencyClock;
+    QElapsedTimer m_latencyReportTimer;
+    uint32_t m_inputSeq=0;
+    uint32_t m_presentedSeq=0;
+    std::array<qint64,INPUT_HISTORY> m_inputTimes;
+    std::array<PresentQuery,PRESENT_QUERIES> m_presentQueries;
+    int m_presentQueryHead=0;
+    int m_presentQueryCount=0;
+    /// CPU clock minus GPU clock in nanoseconds, refreshed with every report
+    qint64 m_gpuClockOffset=0;
+    bool m_gpuClockValid=false;
+    qint64 m_lastPresentTime=-1;
+    Histogram m_latency;
+    Histogram m_presentInterval;
+    bool m_lowLatency=false;
+    GLsync m_blitFence=nullptr;
 
     ///For the light
    // std::unique_ptr<ngl::Light> m_light;
 
     /// The ID of can textures
-    GLuint m_envTex, m_glossMapTex, m_labelTex, m_bumpTex, m_textureMap;
+    GLuint m_envTex, m_glossMapTex, m_bumpTex, m_textureMap;
     /// The ID of ground textures
     GLuint m_woodTex, m_woodSpec, m_woodNorm;
 
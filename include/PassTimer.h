@@ -0,0 +1,56 @@
+#ifndef PASSTIMER_H_
+#define PASSTIMER_H_
+#include <ngl/Types.h>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file PassTimer.h
+/// @brief GPU timing of the render passes in a frame
+/// @version 1.0
+/// @class PassTimer
+/// @brief a timestamp is written at the start of the frame and after each pass, the queries are
+/// double buffered so the times read back are last frame's and reading them never stalls. Every
+/// pass must be marked every frame, in order.
+//----------------------------------------------------------------------------------------------------------------------
+
+class PassTimer
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ctor, no GL calls until create()
+    /// @param [in] _passes the number of passes marked each frame
+    //----------------------------------------------------------------------------------------------------------------------
+    explicit PassTimer(int _passes);
+    ~PassTimer();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief generate the queries, needs a current context
+    //----------------------------------------------------------------------------------------------------------------------
+    void create();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief delete the queries, needs the context they were created in to be current
+    //----------------------------------------------------------------------------------------------------------------------
+    void destroy();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief read back last frame's results and write this frame's start timestamp
+    //----------------------------------------------------------------------------------------------------------------------
+    void begin();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief write the timestamp for the end of _pass
+    //----------------------------------------------------------------------------------------------------------------------
+    void mark(int _pass);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief last available times in milliseconds
+    //----------------------------------------------------------------------------------------------------------------------
+    float passTime(int _pass) const { return m_times[_pass]; }
+    float total() const { return m_total; }
+    int numPasses() const { return m_passes; }
+
+  private:
+    int m_passes;
+    std::vector<GLuint> m_queries[2];
+    std::vector<float> m_times;
+    float m_total=0.0f;
+    unsigned int m_frame=0;
+    bool m_issued[2]={false,false};
+};
+
+#endif
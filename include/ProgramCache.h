@@ -0,0 +1,92 @@
+#ifndef PROGRAMCACHE_H_
+#define PROGRAMCACHE_H_
+#include <ngl/Types.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ProgramCache.h
+/// @brief builds ngl::ShaderLib programs from linked program binaries saved on disk
+/// @version 1.0
+/// @class ProgramCache
+/// @brief each program is stored as cache/programs/<name>.bin along with a 64 bit key hashed from
+/// the driver vendor, renderer and version, the defines and every stage's source. A program whose
+/// file is missing, has a different key or is rejected by glProgramBinary is compiled from source.
+/// All the programs that need compiling are submitted before any status is queried so the driver
+/// can build them in parallel, with KHR_parallel_shader_compile asking it for as many threads as
+/// it likes when the extension is there. The programs are created through ShaderLib so the rest of
+/// the code uses them by name exactly as before.
+//----------------------------------------------------------------------------------------------------------------------
+
+class ProgramCache
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief one shader stage, _type is the GL shader type (GL_VERTEX_SHADER etc)
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Stage
+    {
+      GLenum type;
+      std::string file;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a program to build, the defines are inserted after the #version line of every stage
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Program
+    {
+      std::string name;
+      std::vector<Stage> stages;
+      std::string defines;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ctor, no GL calls are made until build
+    /// @param [in] _dir where the binaries live, created on first save
+    //----------------------------------------------------------------------------------------------------------------------
+    explicit ProgramCache(const std::string &_dir="cache/programs");
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief create all the programs in ShaderLib, from the cache where possible
+    /// @returns false if any program failed to compile or link
+    //----------------------------------------------------------------------------------------------------------------------
+    bool build(const std::vector<Program> &_programs);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief stats from the last build
+    //----------------------------------------------------------------------------------------------------------------------
+    int cacheHits() const { return m_hits; }
+    int compiled() const { return m_compiled; }
+    float buildTime() const { return m_buildTime; }
+    bool parallelCompile() const { return m_parallel; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief 64 bit FNV-1a, used for the cache keys
+    //----------------------------------------------------------------------------------------------------------------------
+    static uint64_t hash(const std::string &_data, uint64_t _seed=14695981039346656037ULL);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief insert _defines after the #version line of _source
+    //----------------------------------------------------------------------------------------------------------------------
+    static std::string injectDefines(const std::string &_source, const std::string &_defines);
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a program being compiled from source, the shaders are deleted once it has linked
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Pending
+    {
+      const Program *program;
+      uint64_t key;
+      GLuint id;
+      std::vector<GLuint> shaders;
+    };
+    std::string cachePath(const Program &_program) const;
+    bool loadBinary(const Program &_program, uint64_t _key, GLuint _id) const;
+    void saveBinary(const Program &_program, uint64_t _key, GLuint _id) const;
+    void submit(Pending &_pending, const std::vector<std::string> &_sources) const;
+    bool finish(Pending &_pending) const;
+    void enableParallelCompile();
+
+    std::string m_dir;
+    int m_hits=0;
+    int m_compiled=0;
+    float m_buildTime=0.0f;
+    bool m_parallel=false;
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef QUALITYGOVERNOR_H_
+#define QUALITYGOVERNOR_H_
+//----------------------------------------------------------------------------------------------------------------------
+/// @file QualityGovernor.h
+/// @brief picks the render scale and quality level that keep the GPU frame time on a target
+/// @version 1.0
+/// @class QualityGovernor
+/// @brief the render scale is the fine control, it moves a small step at a time towards the scale
+/// the last frame times suggest (GPU time is taken to follow the pixel count). While the scale has
+/// to stay below LEVEL_DOWN_SCALE to hold the budget the coarser knobs, blur iterations, shadow
+/// map size and noise octaves, drop one whole level at a time. A level is only raised
+/// again after a long run of frames well under budget at full scale, so the two thresholds and
+/// frame counts give the hysteresis that stops the governor flipping between levels. There is no
+/// GL in here so the controller can be exercised headless with Can_Project --bench-governor.
+//----------------------------------------------------------------------------------------------------------------------
+
+class QualityGovernor
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the discrete knobs for one quality level, blur iterations must be even so the
+    /// ping pong blur always ends in the same buffer
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Level
+    {
+      int blurIterations;
+      int shadowSize;
+      int noiseOctaves;
+    };
+    static constexpr int NUM_LEVELS=5;
+    static const Level LEVELS[NUM_LEVELS];
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the range of the render scale, applied to both axes
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr float MIN_SCALE=0.5f;
+    static constexpr float MAX_SCALE=1.0f;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ctor starts at full scale and the top level, which is the fixed pipeline
+    /// @param [in] _targetMs the GPU frame time to aim for
+    //----------------------------------------------------------------------------------------------------------------------
+    explicit QualityGovernor(float _targetMs=16.6f);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief feed in the latest GPU frame time, call once per frame
+    /// @returns true if the quality level changed
+    //----------------------------------------------------------------------------------------------------------------------
+    bool update(float _gpuMs);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief switching off returns to full scale and the top level
+    //----------------------------------------------------------------------------------------------------------------------
+    void setEnabled(bool _enabled);
+    bool enabled() const { return m_enabled; }
+    void setTarget(float _targetMs);
+    float target() const { return m_target; }
+    float renderScale() const { return m_scale; }
+    int level() const { return m_level; }
+    const Level &settings() const { return LEVELS[m_level]; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the smoothed GPU time the decisions are based on
+    //----------------------------------------------------------------------------------------------------------------------
+    float smoothedTime() const { return m_smoothed; }
+
+  private:
+    void reset();
+    float m_target;
+    float m_smoothed=0.0f;
+    float m_scale=MAX_SCALE;
+    int m_level=NUM_LEVELS-1;
+    int m_overBudgetFrames=0;
+    int m_underBudgetFrames=0;
+    int m_cooldown=0;
+    bool m_enabled=true;
+};
+
+#endif
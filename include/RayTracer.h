@@ -0,0 +1,226 @@
+#ifndef RAYTRACER_H_
+#define RAYTRACER_H_
+#include <ngl/Vec3.h>
+#include "AssetCache.h"
+#include "SceneStore.h"
+#include "ShadowAtlas.h"
+#include "WideBVH.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file RayTracer.h
+/// @brief an offline path tracer for the scene on the CPU, for stills without the raster approximations
+/// @version 1.0
+/// @class RayTracer
+/// @brief each mesh gets its own WideBVH over its triangles and the scene objects are instances of
+/// them in a second WideBVH, a ray is moved into an instance's model space rather than the
+/// triangles being copied per object, so a shelf of cans costs one can's tree. Shading uses the
+/// scene's materials as a Lambert and GGX microfacet pair with the same textures and normal maps
+/// the raster shaders read, the three shadow casting lights with their colours and attenuation,
+/// and the sky cube map as the environment for rays that leave the scene. The camera is the
+/// raster camera, the same eye, look and vertical field of view. The picture is cut into TILE
+/// pixel tiles that are dealt out to one queue per thread, a thread that empties its own queue
+/// steals from the back of the others, so slow tiles (the cans) don't leave cores idle. Every
+/// sample's random numbers come from its pixel and index, the picture is the same for any
+/// number of threads.
+//----------------------------------------------------------------------------------------------------------------------
+
+class RayTracer
+{
+  public:
+    static constexpr int TILE=32;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief bounces after this many are kept with a chance that follows the path's throughput
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr int ROULETTE_BOUNCE=3;
+    struct Settings
+    {
+      std::string scene=std::string("data/scene.json");
+      /// where the picture is written, empty to only time the render
+      std::string file=std::string("trace.png");
+      int width=1280;
+      int height=720;
+      int samples=64;
+      int maxBounces=6;
+      /// 0 for one per core
+      int threads=0;
+      /// the raster camera and the light the user moves, as the tiled still and render server set them
+      ngl::Vec3 eye=ngl::Vec3(0.0f,1.0f,4.0f);
+      ngl::Vec3 look=ngl::Vec3(0.0f,1.0f,0.0f);
+      float fov=45.0f;
+      ngl::Vec3 lightPosition=ngl::Vec3(8.0f,4.0f,8.0f);
+    };
+    struct Stats
+    {
+      int threads=0;
+      double seconds=0.0;
+      uint64_t cameraRays=0;
+      /// the rays that carry a path on after a bounce
+      uint64_t bounceRays=0;
+      uint64_t shadowRays=0;
+      /// tiles taken from another thread's queue
+      uint64_t steals=0;
+      std::vector<uint32_t> tilesPerThread;
+      uint64_t rays() const { return cameraRays+bounceRays+shadowRays; }
+    };
+
+    explicit RayTracer(const Settings &_settings);
+    RayTracer(const RayTracer &)=delete;
+    RayTracer &operator=(const RayTracer &)=delete;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief load the scene, its meshes and textures and build the trees
+    /// @returns false if nothing could be loaded
+    //----------------------------------------------------------------------------------------------------------------------
+    bool load();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief trace the whole picture
+    /// @param [in] _threads the threads to use, 0 for one per core
+    //----------------------------------------------------------------------------------------------------------------------
+    Stats render(int _threads);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief write the last render gamma corrected to 8 bits, the format from the file's extension
+    //----------------------------------------------------------------------------------------------------------------------
+    bool save(const std::string &_file) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief print a render's numbers, _baseline is the rays per second of one thread for the speed up
+    //----------------------------------------------------------------------------------------------------------------------
+    static void print(const Stats &_stats, double _baseline=0.0);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief load, render and save _settings
+    /// @returns the process exit code
+    //----------------------------------------------------------------------------------------------------------------------
+    static int run(const Settings &_settings);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief render the same picture with 1, 2, 4... up to every core and print the rays per second
+    /// per core and the speed up of each
+    /// @returns the process exit code
+    //----------------------------------------------------------------------------------------------------------------------
+    static int scaling(const Settings &_settings);
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a triangle in leaf order as Moller Trumbore wants it, index is its place in the mesh
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Triangle
+    {
+      float v0[3];
+      float e1[3];
+      float e2[3];
+      uint32_t index;
+    };
+    struct Vertex
+    {
+      float position[3];
+      float uv[2];
+      float normal[3];
+      /// w is the bitangent sign as IndexedMesh stores it
+      float tangent[4];
+    };
+    struct Mesh
+    {
+      WideBVH bvh;
+      std::vector<Triangle> triangles;
+      std::vector<Vertex> vertices;
+      std::vector<uint32_t> indices;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief an object, its world matrix and the inverse in ngl's row vector order without the last column
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Instance
+    {
+      float world[4][3];
+      float inverse[4][3];
+      uint32_t mesh;
+      uint32_t material;
+      int label;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief an 8 bit image mapped from the asset cache, rows bottom up as ngl::Image loads them
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Texture
+    {
+      AssetCache::Asset image;
+      int width=0;
+      int height=0;
+      int channels=0;
+      //----------------------------------------------------------------------------------------------------------------------
+      /// @brief bilinear and repeating, _linear turns the sRGB values to linear light
+      //----------------------------------------------------------------------------------------------------------------------
+      ngl::Vec3 sample(float _u, float _v, bool _linear) const;
+    };
+    struct Material
+    {
+      ngl::Vec3 kd;
+      ngl::Vec3 ks;
+      float roughness;
+      /// texture indices, -1 for none, the label comes from the object instead
+      int albedo=-1;
+      int normal=-1;
+      bool labelled=false;
+      float uvScale=1.0f;
+    };
+    struct Light
+    {
+      ShadowLight::Type type;
+      ngl::Vec3 position;
+      ngl::Vec3 diffuse;
+      ngl::Vec3 specular;
+      float linear;
+      float quadratic;
+    };
+    struct Hit
+    {
+      float t;
+      uint32_t instance;
+      uint32_t triangle;
+      float u;
+      float v;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief per thread counters, added up once the thread is done
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Counters
+    {
+      uint64_t cameraRays=0;
+      uint64_t bounceRays=0;
+      uint64_t shadowRays=0;
+      uint64_t steals=0;
+      uint32_t tiles=0;
+    };
+    class Random;
+
+    void addMesh(const std::vector<Vertex> &_vertices, const std::vector<uint32_t> &_indices);
+    int texture(const std::string &_file);
+    bool intersect(const TraceRay &_ray, Hit &o_hit) const;
+    bool occluded(const float _origin[3], const ngl::Vec3 &_dir, float _distance) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the light arriving along one camera ray
+    //----------------------------------------------------------------------------------------------------------------------
+    ngl::Vec3 radiance(TraceRay _ray, Random &_random, Counters &io_counters) const;
+    ngl::Vec3 environment(const ngl::Vec3 &_dir) const;
+    void renderTile(int _tile, Counters &io_counters);
+
+    Settings m_settings;
+    AssetCache m_assets;
+    SceneStore m_store;
+    std::vector<Mesh> m_meshes;
+    std::vector<Instance> m_instances;
+    WideBVH m_top;
+    std::vector<Material> m_materials;
+    std::vector<Texture> m_textures;
+    std::vector<std::string> m_textureFiles;
+    /// the label texture of each SKU file
+    std::vector<int> m_labels;
+    /// the sky faces in GL's order +x -x +y -y +z -z
+    int m_sky[6]={-1,-1,-1,-1,-1,-1};
+    std::vector<Light> m_lights;
+    /// the camera basis, right and up are scaled to the edge of the picture
+    ngl::Vec3 m_forward;
+    ngl::Vec3 m_right;
+    ngl::Vec3 m_up;
+    /// linear RGB, top row first
+    std::vector<float> m_image;
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef RENDERSERVER_H_
+#define RENDERSERVER_H_
+#include <ngl/Vec3.h>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QByteArray>
+#include <QLocalServer>
+#include <QTimer>
+#include "Histogram.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class NGLScene;
+class QLocalSocket;
+class QOpenGLContext;
+class QOffscreenSurface;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief one render request, a label on the cans seen from a camera with the spot light at a position
+//----------------------------------------------------------------------------------------------------------------------
+struct RenderJob
+{
+  /// the client's id for the job, sent back with the image
+  double id=0.0;
+  /// the connection the job came in on
+  uint64_t client=0;
+  uint32_t label=0;
+  ngl::Vec3 eye=ngl::Vec3(0.0f,1.0f,4.0f);
+  ngl::Vec3 look=ngl::Vec3(0.0f,1.0f,0.0f);
+  ngl::Vec3 light=ngl::Vec3(8.0f,4.0f,8.0f);
+  int width=512;
+  int height=512;
+  /// nanoseconds on the server clock
+  int64_t received=0;
+  int64_t started=0;
+  /// the frame as read back, then encoded
+  QImage image;
+  QByteArray encoded;
+  float renderTime=0.0f;
+  int batchSize=1;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief jobs that can share the frame set up, the culling and the shadow pass, only the label differs
+  //----------------------------------------------------------------------------------------------------------------------
+  bool compatible(const RenderJob &_other) const;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @file RenderServer.h
+/// @brief a long lived headless renderer taking jobs over a local socket
+/// @version 1.0
+/// @class RenderServer
+/// @brief the meshes, textures, labels and programs are loaded once and stay warm for every job.
+/// Clients send one JSON object per line
+/// {"id":1,"label":12,"eye":[0,1,4],"look":[0,1,0],"light":[8,4,8],"width":512,"height":512}
+/// and get back a JSON line {"id":1,"status":"ok","format":"png","bytes":N,...} followed by the N
+/// bytes of the image, in the order the jobs finish. {"stats":true} answers with the metrics.
+/// The socket is served on the GUI thread, the jobs are rendered on this thread with its own
+/// context and encoded on the thread pool. Jobs wait until their label is resident, then the ready
+/// ones with the same size, camera and light are rendered as one batch that culls and draws the
+/// shadows once.
+//----------------------------------------------------------------------------------------------------------------------
+
+class RenderServer : public QThread
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the most jobs rendered from one frame set up
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr size_t MAX_BATCH=16;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ctor, call from the GUI thread
+    /// @param [in] _scene the scene to render, never shown
+    /// @param [in] _width _height the size the scene targets are created at, the jobs are resampled from it
+    //----------------------------------------------------------------------------------------------------------------------
+    RenderServer(NGLScene *_scene, int _width, int _height);
+    ~RenderServer();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief listen on the local socket _name and start the render thread
+    /// @returns false if the socket can't be opened
+    //----------------------------------------------------------------------------------------------------------------------
+    bool listen(const QString &_name);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief finish the batch in progress and wait for the thread to end
+    //----------------------------------------------------------------------------------------------------------------------
+    void stop();
+
+  protected:
+    void run() override;
+
+  private:
+    struct Connection
+    {
+      QLocalSocket *socket;
+      QByteArray pending;
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief GUI thread, read the complete lines from a client and queue their jobs
+    //----------------------------------------------------------------------------------------------------------------------
+    void readJobs(uint64_t _client);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief GUI thread, send a finished job back and count it
+    //----------------------------------------------------------------------------------------------------------------------
+    void deliver(const RenderJob &_job);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the metrics as one JSON line, GUI thread
+    //----------------------------------------------------------------------------------------------------------------------
+    QByteArray stats() const;
+    void report();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief render thread, take the jobs whose labels are loaded and render them in compatible batches
+    //----------------------------------------------------------------------------------------------------------------------
+    void renderReady(std::vector<RenderJob> &io_pending);
+    void encode(RenderJob &_job);
+
+    NGLScene *m_scene;
+    int m_width;
+    int m_height;
+    std::unique_ptr<QOpenGLContext> m_context;
+    std::unique_ptr<QOffscreenSurface> m_surface;
+    std::atomic<bool> m_running{true};
+    QElapsedTimer m_clock;
+
+    /// GUI thread
+    QLocalServer m_listener;
+    std::map<uint64_t,Connection> m_connections;
+    uint64_t m_nextClient=1;
+    QTimer m_reportTimer;
+    Histogram m_latency;
+    Histogram m_queueWait;
+    Histogram m_renderTime;
+    uint64_t m_completed=0;
+    uint64_t m_failed=0;
+    uint64_t m_windowCompleted=0;
+    /// the size of the batch every finished job was in, for the mean
+    uint64_t m_batchSizes=0;
+    float m_throughput=0.0f;
+    QElapsedTimer m_window;
+
+    /// jobs from the GUI thread waiting for the render thread
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<RenderJob> m_queue;
+    /// queued plus waiting for labels plus being rendered or encoded
+    std::atomic<int> m_inFlight{0};
+};
+
+#endif
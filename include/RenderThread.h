@@ -0,0 +1,75 @@
+#ifndef RENDERTHREAD_H_
+#define RENDERTHREAD_H_
+#include <QThread>
+#include <QSemaphore>
+#include <atomic>
+#include <memory>
+
+class NGLScene;
+class QOpenGLContext;
+class QOffscreenSurface;
+//----------------------------------------------------------------------------------------------------------------------
+/// @file RenderThread.h
+/// @brief runs all of the scene rendering away from the GUI thread
+/// @version 1.0
+/// @class RenderThread
+/// @brief owns a context shared with the window's so the finished frame textures can be shown by
+/// the window. The thread sets the scene up then renders frame after frame, each one is handed to
+/// the window through a TripleBuffer. The window gives a frame back each time it shows one so the
+/// thread never gets more than MAX_FRAMES_AHEAD frames in front of the display. Once the scene
+/// has nothing new to render the thread sleeps until wake() or IDLE_POLL_MS.
+//----------------------------------------------------------------------------------------------------------------------
+
+class RenderThread : public QThread
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief frames the thread may render before the window has shown any of them
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr int MAX_FRAMES_AHEAD=2;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief how often an idle thread looks for finished label loads
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr int IDLE_POLL_MS=100;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief ctor, call from the GUI thread with the window's context current
+    /// @param [in] _scene the scene to render
+    /// @param [in] _shareContext the window's context
+    //----------------------------------------------------------------------------------------------------------------------
+    RenderThread(NGLScene *_scene, QOpenGLContext *_shareContext);
+    ~RenderThread();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief finish the frame in progress and wait for the thread to end
+    //----------------------------------------------------------------------------------------------------------------------
+    void stop();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief called by the window when it has shown a new frame, lets the thread start another
+    //----------------------------------------------------------------------------------------------------------------------
+    void framePresented();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief called by the window when the input changes, starts rendering again if the thread is idle
+    //----------------------------------------------------------------------------------------------------------------------
+    void wake();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief change how many frames the thread may get in front of the display, 1 to MAX_FRAMES_AHEAD.
+    /// Lowering it takes effect as the frames already in flight are shown
+    //----------------------------------------------------------------------------------------------------------------------
+    void setFramesAhead(int _frames);
+    int framesAhead() const { return m_framesAhead; }
+
+  protected:
+    void run() override;
+
+  private:
+    NGLScene *m_scene;
+    std::unique_ptr<QOpenGLContext> m_context;
+    std::unique_ptr<QOffscreenSurface> m_surface;
+    QSemaphore m_frameSlots{MAX_FRAMES_AHEAD};
+    QSemaphore m_wake;
+    std::atomic<bool> m_running{true};
+    std::atomic<int> m_framesAhead{MAX_FRAMES_AHEAD};
+    /// slots to swallow rather than give back after a lowering of m_framesAhead
+    std::atomic<int> m_slotDebt{0};
+};
+
+#endif
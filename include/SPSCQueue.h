@@ -0,0 +1,56 @@
+#ifndef SPSCQUEUE_H_
+#define SPSCQUEUE_H_
+#include <atomic>
+#include <cstddef>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file SPSCQueue.h
+/// @brief fixed size lock free queue for one producer thread and one consumer thread
+/// @version 1.0
+/// @class SPSCQueue
+/// @brief a ring of Capacity entries, one is always left empty to tell full from empty. Used for
+/// events that must not be dropped or merged (key presses) where a TripleBuffer would lose them.
+//----------------------------------------------------------------------------------------------------------------------
+
+template <typename T, size_t Capacity>
+class SPSCQueue
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief add to the back, producer only
+    /// @returns false if the queue is full
+    //----------------------------------------------------------------------------------------------------------------------
+    bool push(const T &_value)
+    {
+      size_t tail=m_tail.load(std::memory_order_relaxed);
+      size_t next=(tail+1)%Capacity;
+      if(next==m_head.load(std::memory_order_acquire))
+      {
+        return false;
+      }
+      m_items[tail]=_value;
+      m_tail.store(next,std::memory_order_release);
+      return true;
+    }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief take from the front, consumer only
+    /// @returns false if the queue is empty
+    //----------------------------------------------------------------------------------------------------------------------
+    bool pop(T &o_value)
+    {
+      size_t head=m_head.load(std::memory_order_relaxed);
+      if(head==m_tail.load(std::memory_order_acquire))
+      {
+        return false;
+      }
+      o_value=m_items[head];
+      m_head.store((head+1)%Capacity,std::memory_order_release);
+      return true;
+    }
+
+  private:
+    T m_items[Capacity];
+    std::atomic<size_t> m_head{0};
+    std::atomic<size_t> m_tail{0};
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef SCENESTORE_H_
+#define SCENESTORE_H_
+#include <ngl/Mat4.h>
+#include <ngl/Vec3.h>
+#include "ShaderVariants.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file SceneStore.h
+/// @brief a flat structure of arrays store for every object in the scene
+/// @version 1.0
+/// @class SceneStore
+/// @brief objects are just an index into parallel arrays so the culling and matrix code can
+/// stream through only the fields it needs. Meshes and materials are small tables referenced
+/// by index. The store is filled from a JSON scene description, see data/scene.json
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief a mesh is either an obj file (drawn instanced) or an ngl primitive plane
+//----------------------------------------------------------------------------------------------------------------------
+struct SceneMesh
+{
+  std::string name;
+  std::string file;
+  bool isPlane=false;
+  float planeWidth=1.0f;
+  float planeDepth=1.0f;
+  int planeSteps=1;
+  // model space bounding sphere
+  ngl::Vec3 centre;
+  float radius=1.0f;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief material values loaded to the MaterialInfo struct in the shaders
+//----------------------------------------------------------------------------------------------------------------------
+struct SceneMaterial
+{
+  std::string name;
+  std::string program;
+  ngl::Vec3 ka=ngl::Vec3(0.2f,0.2f,0.2f);
+  ngl::Vec3 kd=ngl::Vec3(0.6f,0.6f,0.6f);
+  ngl::Vec3 ks=ngl::Vec3(0.8f,0.8f,0.8f);
+  float shininess=100.0f;
+  float roughness=0.01f;
+  // the shader variant the material is drawn with, see ShaderVariants.h
+  uint32_t features=DEFAULT_FEATURES;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the label catalogue, an object's label is a SKU index into it. The files are the artwork,
+/// SKUs past the last file reuse it with the hue turned so a test catalogue can be any size. Every
+/// label is resized to width x height to share the label texture array
+//----------------------------------------------------------------------------------------------------------------------
+struct SceneLabels
+{
+  std::vector<std::string> files{"images/colourMapCan.tif"};
+  uint32_t count=1;
+  int width=1024;
+  int height=512;
+};
+
+struct SceneStore
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief load a JSON scene, replaces anything already in the store
+  /// @param [in] _fname the file to load
+  /// @returns false if the file could not be read or parsed
+  //----------------------------------------------------------------------------------------------------------------------
+  bool load(const std::string &_fname);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the built in scene used if there is no scene file, one ground plane and one can
+  //----------------------------------------------------------------------------------------------------------------------
+  void loadDefault();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief remove all objects, meshes and materials
+  //----------------------------------------------------------------------------------------------------------------------
+  void clear();
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief add an object, rotation is in degrees applied x then y then z
+  /// @returns the index of the new object
+  //----------------------------------------------------------------------------------------------------------------------
+  uint32_t addObject(uint16_t _mesh, uint16_t _material, const ngl::Vec3 &_pos, const ngl::Vec3 &_rot, const ngl::Vec3 &_scale, uint32_t _label);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief move an object, flags it dirty so the bounds and BVH get refit
+  //----------------------------------------------------------------------------------------------------------------------
+  void setPosition(uint32_t _i, const ngl::Vec3 &_pos);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief find a mesh or material by name
+  /// @returns the index or -1 if not found
+  //----------------------------------------------------------------------------------------------------------------------
+  int findMesh(const std::string &_name) const;
+  int findMaterial(const std::string &_name) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the world matrix of an object in ngl's (row vector) order scale * rotation * translation
+  //----------------------------------------------------------------------------------------------------------------------
+  ngl::Mat4 worldMatrix(uint32_t _i) const;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief recompute the world bounding spheres, either all of them or only the dirty ones
+  //----------------------------------------------------------------------------------------------------------------------
+  void updateBounds(bool _all=false);
+  void clearDirty();
+  uint32_t size() const { return static_cast<uint32_t>(posX.size()); }
+
+  std::vector<SceneMesh> meshes;
+  std::vector<SceneMaterial> materials;
+  SceneLabels labels;
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief per object transform
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<float> posX, posY, posZ;
+  std::vector<float> rotX, rotY, rotZ;
+  std::vector<float> scaleX, scaleY, scaleZ;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief per object world bounding sphere, kept up to date by updateBounds
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<float> centreX, centreY, centreZ, radius;
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief per object references and flags
+  //----------------------------------------------------------------------------------------------------------------------
+  std::vector<uint16_t> mesh;
+  std::vector<uint16_t> material;
+  std::vector<uint32_t> label;
+  std::vector<uint8_t> dirty;
+  std::vector<uint32_t> dirtyList;
+};
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef SHADERVARIANTS_H_
+#define SHADERVARIANTS_H_
+#include "ProgramCache.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ShaderVariants.h
+/// @brief compile time permutations of the scene shaders selected by a feature bitmask
+/// @version 1.0
+/// @class ShaderVariants
+/// @brief a base program is a set of stages and the features its shaders test for. Each material
+/// asks for a variant by its feature mask, only the variants asked for are built (through the
+/// ProgramCache so each one is cached on its own) and every feature turns into a #define so the
+/// branches and lighting models a material doesn't use are never compiled in. Bits a base doesn't
+/// support are dropped so materials that only differ in those share a variant.
+/// Each draw can be wrapped in a pair of timestamps to give the GPU time spent in every variant,
+/// the queries are double buffered like the PassTimer so reading them back never stalls.
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the features a variant is specialised on
+//----------------------------------------------------------------------------------------------------------------------
+enum ShaderFeature : uint32_t
+{
+  FEATURE_LIGHT_COUNT=0x3u,           ///< number of lights (0-3) in the low two bits
+  FEATURE_MICROFACET=1u<<2,           ///< Beckmann microfacet lighting, otherwise Blinn-Phong
+  FEATURE_REFRACT=1u<<3,              ///< refract the environment, otherwise reflect it
+  FEATURE_NOISE=1u<<4,                ///< add the fbm noise layer
+  FEATURE_NORMAL_MAP=1u<<5,           ///< perturb the normal from the normal map
+  FEATURE_SHADOW_FILTER=0x3u<<6,      ///< how the shadow map is sampled, one of the SHADOW_ values
+  FEATURE_BLUR_HORIZONTAL=1u<<8,      ///< blur along x, otherwise along y
+  FEATURE_PLANAR_REFLECTION=1u<<9,    ///< blend in the mirrored scene, the surface is the mirror
+  FEATURE_MULTI_VIEW=1u<<10           ///< each instance is drawn once per view into its own layer
+};
+constexpr int SHADOW_FILTER_SHIFT=6;
+constexpr uint32_t SHADOW_NONE=0u<<SHADOW_FILTER_SHIFT;
+constexpr uint32_t SHADOW_HARD=1u<<SHADOW_FILTER_SHIFT;
+constexpr uint32_t SHADOW_PCF=2u<<SHADOW_FILTER_SHIFT;   ///< rotated Poisson disc of hardware compare taps
+constexpr uint32_t SHADOW_EVSM=3u<<SHADOW_FILTER_SHIFT;  ///< one tap of the blurred exponential variance map
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief what a material gets if the scene doesn't say, the same shading as before the permutations
+//----------------------------------------------------------------------------------------------------------------------
+constexpr uint32_t DEFAULT_FEATURES=3u | FEATURE_MICROFACET | FEATURE_NOISE | FEATURE_NORMAL_MAP | SHADOW_HARD;
+
+class ShaderVariants
+{
+  public:
+    ShaderVariants()=default;
+    ~ShaderVariants();
+    ShaderVariants(const ShaderVariants &)=delete;
+    ShaderVariants &operator=(const ShaderVariants &)=delete;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief delete the timing queries, needs the context they were made in to be current
+    //----------------------------------------------------------------------------------------------------------------------
+    void releaseQueries();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief register a base program
+    /// @param [in] _name the base name, variants are named <name>_<features in hex>
+    /// @param [in] _stages the shader files
+    /// @param [in] _supported the feature bits the shaders test for
+    //----------------------------------------------------------------------------------------------------------------------
+    void addBase(const std::string &_name, const std::vector<ProgramCache::Stage> &_stages, uint32_t _supported);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the variant of _base for _features, added to the build list the first time it is asked for
+    /// @returns the variant index or -1 if _base hasn't been registered
+    //----------------------------------------------------------------------------------------------------------------------
+    int request(const std::string &_base, uint32_t _features);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the programs for every variant asked for so far, to hand to the ProgramCache
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<ProgramCache::Program> programs() const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the ShaderLib program name and features of a variant
+    //----------------------------------------------------------------------------------------------------------------------
+    const std::string &name(int _variant) const { return m_variants[_variant].name; }
+    uint32_t features(int _variant) const { return m_variants[_variant].features; }
+    size_t size() const { return m_variants.size(); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief every variant built from _base
+    //----------------------------------------------------------------------------------------------------------------------
+    std::vector<int> variantsOf(const std::string &_base) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the #define block inserted for _features
+    //----------------------------------------------------------------------------------------------------------------------
+    static std::string defines(uint32_t _features);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a short readable list of the features, for the timing report
+    //----------------------------------------------------------------------------------------------------------------------
+    static std::string describe(uint32_t _features);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief read back last frame's timestamps, call once at the start of the frame
+    //----------------------------------------------------------------------------------------------------------------------
+    void beginFrame();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief time the GPU work between these calls against _variant, -1 times nothing
+    //----------------------------------------------------------------------------------------------------------------------
+    void beginDraw(int _variant);
+    void endDraw();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief last frame's GPU time in milliseconds and number of timed draws for a variant
+    //----------------------------------------------------------------------------------------------------------------------
+    float gpuTime(int _variant) const { return m_variants[_variant].gpuTime; }
+    unsigned int draws(int _variant) const { return m_variants[_variant].draws; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief print every variant with its features and timings
+    //----------------------------------------------------------------------------------------------------------------------
+    void printTimings() const;
+
+  private:
+    struct Base
+    {
+      std::string name;
+      std::vector<ProgramCache::Stage> stages;
+      uint32_t supported;
+    };
+    struct Variant
+    {
+      std::string name;
+      size_t base;
+      uint32_t features;
+      float gpuTime;
+      unsigned int draws;
+    };
+    std::vector<Base> m_bases;
+    std::vector<Variant> m_variants;
+    /// timestamp pairs for this and last frame's draws, the pools grow to the most draws in a frame
+    std::vector<GLuint> m_queries[2];
+    std::vector<int> m_queryVariant[2];
+    size_t m_used[2]={0,0};
+    unsigned int m_frame=0;
+    int m_current=-1;
+};
+
+#endif
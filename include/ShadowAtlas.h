@@ -0,0 +1,153 @@
+#ifndef SHADOWATLAS_H_
+#define SHADOWATLAS_H_
+#include <ngl/Mat4.h>
+#include <ngl/Types.h>
+#include <ngl/Vec3.h>
+#include <ngl/Vec4.h>
+#include <string>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ShadowAtlas.h
+/// @brief the shadow maps of every light packed into one layered depth texture
+/// @version 1.0
+/// @class ShadowAtlas
+/// @brief a spot or directional light has one view and a point light six, one per cube face. Each
+/// view is a square tile in a layer of a depth texture array, sized by how much of the screen the
+/// light can reach and packed largest first, so the whole atlas is drawn in a single layered pass
+/// with one viewport per view. The depth stored is linear between a view's near and far planes so
+/// every filter compares the same kind of value whatever the projection.
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief a light as the atlas sees it
+//----------------------------------------------------------------------------------------------------------------------
+struct ShadowLight
+{
+  enum class Type { SPOT, POINT, DIRECTIONAL };
+  Type type;
+  /// the position, or for a directional light the direction the light comes from
+  ngl::Vec3 position;
+  /// the attenuation the shaders use, it sets how far the light reaches
+  float linear;
+  float quadratic;
+};
+
+class ShadowAtlas
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the most views in the atlas, the layered pass runs one geometry shader invocation per view
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr int MAX_VIEWS=8;
+    static constexpr int MAX_LIGHTS=3;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the smallest tile is the layer size divided by this
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr int MIN_TILE_DIVISOR=8;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief one rendered view and where it is in the atlas
+    //----------------------------------------------------------------------------------------------------------------------
+    struct View
+    {
+      ngl::Mat4 VP;           ///< world to the view's clip space
+      ngl::Vec4 depthPlane;   ///< dotted with the world position gives the linear depth stored
+      int light;
+      int layer;
+      int x, y, size;         ///< the tile in texels
+    };
+
+    ShadowAtlas()=default;
+    ~ShadowAtlas();
+    ShadowAtlas(const ShadowAtlas &)=delete;
+    ShadowAtlas &operator=(const ShadowAtlas &)=delete;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the size of every layer, the largest tile
+    //----------------------------------------------------------------------------------------------------------------------
+    void setLayerSize(int _size) { m_layerSize=_size; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief delete the texture and framebuffer, needs the context they were created in to be current
+    //----------------------------------------------------------------------------------------------------------------------
+    void destroy();
+    int layerSize() const { return m_layerSize; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief place the views for this frame's lights
+    /// @param [in] _lights at most MAX_LIGHTS lights, a point light takes six views
+    /// @param [in] _view the camera view, including any model transform applied to the whole scene
+    /// @param [in] _projection the camera projection
+    /// @param [in] _sceneMin _sceneMax the box around everything that can cast a shadow
+    //----------------------------------------------------------------------------------------------------------------------
+    void update(const std::vector<ShadowLight> &_lights, const ngl::Mat4 &_view, const ngl::Mat4 &_projection,
+                const float _sceneMin[3], const float _sceneMax[3]);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief make the texture fit the layout, it only grows unless the layer size changes
+    /// @returns true if the texture was (re)created
+    //----------------------------------------------------------------------------------------------------------------------
+    bool allocate();
+    GLuint texture() const { return m_texture; }
+    GLuint fbo() const { return m_fbo; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the layers allocated and the layers this frame's views use
+    //----------------------------------------------------------------------------------------------------------------------
+    int layers() const { return m_allocatedLayers; }
+    int usedLayers() const { return m_usedLayers; }
+    const std::vector<View> &views() const { return m_views; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the views of a light are consecutive, a point light's are in +x -x +y -y +z -z order
+    //----------------------------------------------------------------------------------------------------------------------
+    int firstView(int _light) const { return m_firstView[_light]; }
+    int viewCount(int _light) const { return m_viewCount[_light]; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief an orthographic box around the scene bounds, the shadow casters are culled against
+    /// it as no single frustum holds every view
+    //----------------------------------------------------------------------------------------------------------------------
+    const ngl::Mat4 &casterVP() const { return m_casterVP; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the fraction of the used layers' texels covered by a tile
+    //----------------------------------------------------------------------------------------------------------------------
+    float usage() const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a one line summary of the layers, usage and tile size of each light
+    //----------------------------------------------------------------------------------------------------------------------
+    std::string report() const;
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief how far a light reaches before its attenuation makes it negligible
+    //----------------------------------------------------------------------------------------------------------------------
+    static float range(const ShadowLight &_light);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the fraction of the screen the light's reach covers, 0 if it is outside the view
+    //----------------------------------------------------------------------------------------------------------------------
+    static float influence(const ShadowLight &_light, float _range, const ngl::Mat4 &_view, const ngl::Mat4 &_projection);
+    void addView(int _light, const ngl::Mat4 &_view, const ngl::Mat4 &_projection, float _near, float _far, int _size);
+    void pack();
+
+    int m_layerSize=1024;
+    std::vector<View> m_views;
+    int m_firstView[MAX_LIGHTS]={0,0,0};
+    int m_viewCount[MAX_LIGHTS]={0,0,0};
+    ngl::Mat4 m_casterVP;
+    int m_usedLayers=0;
+    GLuint m_texture=0;
+    GLuint m_fbo=0;
+    int m_allocatedLayers=0;
+    int m_allocatedSize=0;
+};
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief one of the scene's shadow casting lights with the colours the shaders light with, the
+/// raster passes and the path tracer both read SCENE_LIGHTS so they light the scene the same way
+//----------------------------------------------------------------------------------------------------------------------
+struct SceneLight
+{
+  /// where the atlas places it, the spot light's position is replaced by the one the user moves
+  ShadowLight light;
+  ngl::Vec3 ambient;
+  ngl::Vec3 diffuse;
+  ngl::Vec3 specular;
+  /// scales the diffuse and specular colours
+  ngl::Vec3 intensity;
+};
+extern const SceneLight SCENE_LIGHTS[ShadowAtlas::MAX_LIGHTS];
+
+#endif
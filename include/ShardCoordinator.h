@@ -0,0 +1,152 @@
+#ifndef SHARDCOORDINATOR_H_
+#define SHARDCOORDINATOR_H_
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QTimer>
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+class QEventLoop;
+class QLocalSocket;
+class QProcess;
+//----------------------------------------------------------------------------------------------------------------------
+/// @file ShardCoordinator.h
+/// @brief renders a frame range across several local render server processes
+/// @version 1.0
+/// @class ShardCoordinator
+/// @brief each worker is this executable started with --serve on its own socket, so it has its own
+/// headless context and keeps its scene warm between frames. Frames are not split up front, a
+/// worker is given the next frame from one shared queue whenever it has fewer than inFlight
+/// outstanding, so a worker that gets slow frames simply takes fewer of them. The images come back
+/// in whatever order they finish and are held until every earlier frame has arrived, then written
+/// in order. A worker that exits, drops its socket or makes no progress for STALL_MS has its
+/// outstanding frames put back at the front of the queue and is restarted, up to maxRestarts times.
+//----------------------------------------------------------------------------------------------------------------------
+
+class ShardCoordinator
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a worker that has had frames for this long without returning one is killed and restarted
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr int STALL_MS=30000;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a frame the servers fail this many times fails the run
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr int MAX_ATTEMPTS=3;
+    struct Settings
+    {
+      int frames=120;
+      int workers=4;
+      int width=1024;
+      int height=576;
+      /// frames each worker has queued, enough to hide the round trip
+      int inFlight=2;
+      int maxRestarts=3;
+      /// where frame_00000.png... are written, empty to only time the run
+      QString outDir=QString("frames");
+      /// kill one worker half way through to exercise the reissue
+      bool killOne=false;
+    };
+    struct Result
+    {
+      bool ok=false;
+      /// from the first launch to the last frame written
+      double seconds=0.0;
+      /// from the first worker being ready to the last frame, without the start up
+      double renderSeconds=0.0;
+      int frames=0;
+      int reissued=0;
+      int restarts=0;
+      /// the most frames held waiting for an earlier one
+      size_t maxReorder=0;
+      std::vector<int> perWorker;
+    };
+
+    explicit ShardCoordinator(const Settings &_settings);
+    ~ShardCoordinator();
+    ShardCoordinator(const ShardCoordinator &)=delete;
+    ShardCoordinator &operator=(const ShardCoordinator &)=delete;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief launch the workers, render every frame and stop them again, needs a QCoreApplication
+    //----------------------------------------------------------------------------------------------------------------------
+    Result run();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief print a run's numbers, _baseline is the frames per second of one worker for the speed up
+    //----------------------------------------------------------------------------------------------------------------------
+    static void print(const Settings &_settings, const Result &_result, double _baseline=0.0);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief render the same range with 1, 2, 4... up to _settings.workers and print the throughput
+    /// and speed up of each
+    /// @returns the process exit code
+    //----------------------------------------------------------------------------------------------------------------------
+    static int scaling(Settings _settings);
+
+  private:
+    struct Worker
+    {
+      int index=0;
+      /// bumped on every restart so a new server never reuses the old one's socket
+      int generation=0;
+      QProcess *process=nullptr;
+      QLocalSocket *socket=nullptr;
+      QString name;
+      QByteArray pending;
+      /// the frame whose image is being read and its size, -1 while waiting for a header
+      int frame=-1;
+      int expectBytes=-1;
+      std::set<int> outstanding;
+      int rendered=0;
+      int restarts=0;
+      bool ready=false;
+      bool dead=false;
+      QElapsedTimer progress;
+    };
+    void launch(Worker &_worker);
+    void connectWorker(Worker &_worker);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief top the worker up to inFlight frames from the shared queue
+    //----------------------------------------------------------------------------------------------------------------------
+    void dispatch(Worker &_worker);
+    void dispatchAll();
+    void readResults(Worker &_worker);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the worker is gone, put its frames back and start it again
+    //----------------------------------------------------------------------------------------------------------------------
+    void lost(Worker &_worker, const char *_why);
+    void retire(Worker &_worker);
+    void requeue(int _frame);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief hold a finished frame and write every frame that is now in order
+    //----------------------------------------------------------------------------------------------------------------------
+    void finishFrame(int _frame, const QByteArray &_image);
+    void watchdog();
+    void finish(bool _ok);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the camera for a frame, one orbit of the shelf over the range
+    //----------------------------------------------------------------------------------------------------------------------
+    QByteArray frameJob(int _frame) const;
+
+    Settings m_settings;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::deque<int> m_queue;
+    std::vector<int> m_attempts;
+    std::vector<bool> m_done;
+    std::map<int,QByteArray> m_reorder;
+    int m_nextOut=0;
+    int m_dispatched=0;
+    bool m_killed=false;
+    bool m_finishing=false;
+    QEventLoop *m_loop=nullptr;
+    QTimer m_watchdog;
+    QElapsedTimer m_clock;
+    qint64 m_firstReady=-1;
+    Result m_result;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef STREAMBUFFER_H_
+#define STREAMBUFFER_H_
+#include <ngl/Types.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file StreamBuffer.h
+/// @brief a ring buffer for data written by the CPU every frame and read by the GPU once
+/// @version 1.0
+/// @class StreamBuffer
+/// @brief the buffer is created with glBufferStorage and stays mapped persistent and coherent, so
+/// writing is a memcpy with no GL call. It is split into REGIONS regions, a frame suballocates from
+/// its region with a bump pointer and the region is fenced when the next frame starts. A region is
+/// only written again once its fence has signalled, a wait on the fence is counted as a stall. A
+/// frame that fills its region moves on to the next one early. Without GL_ARB_buffer_storage the
+/// same ring is filled with glBufferSubData instead.
+//----------------------------------------------------------------------------------------------------------------------
+
+class StreamBuffer
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief frames the GPU can be behind the CPU before a write has to wait
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr int REGIONS=3;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a piece of this frame's region, data is only valid when the buffer is persistent
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Allocation
+    {
+      void *data=nullptr;
+      GLintptr offset=0;
+      GLsizeiptr size=0;
+      bool valid() const { return size>0; }
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief counters, bytes and stalls for the last frame and over the whole run
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Stats
+    {
+      size_t frameBytes=0;
+      uint32_t frameStalls=0;
+      uint32_t frameAllocations=0;
+      uint64_t totalStalls=0;
+      uint64_t totalBytes=0;
+      /// frames that filled their region and moved on early
+      uint64_t overflows=0;
+      float stallTime=0.0f;
+      /// write bandwidth over the last second
+      float uploadMBps=0.0f;
+    };
+
+    StreamBuffer()=default;
+    ~StreamBuffer();
+    StreamBuffer(const StreamBuffer &)=delete;
+    StreamBuffer &operator=(const StreamBuffer &)=delete;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief create the buffer, needs a current context
+    /// @param [in] _target the binding point the ranges are bound to, GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER
+    /// @param [in] _regionSize bytes per frame
+    /// @param [in] _persistent use glBufferStorage if it is there, false for the glBufferSubData ring
+    //----------------------------------------------------------------------------------------------------------------------
+    void create(GLenum _target, size_t _regionSize, bool _persistent=true);
+    void destroy();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief fence the region the last frame wrote and move to the next, waiting for the GPU if it
+    /// hasn't finished with it
+    //----------------------------------------------------------------------------------------------------------------------
+    void beginFrame();
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief bump allocate _size bytes aligned for binding as a range
+    //----------------------------------------------------------------------------------------------------------------------
+    Allocation allocate(size_t _size);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief allocate and copy _size bytes in
+    //----------------------------------------------------------------------------------------------------------------------
+    Allocation write(const void *_data, size_t _size);
+    template <typename T>
+    Allocation write(const T &_data) { return write(&_data,sizeof(T)); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief bind an allocation to the indexed _binding of the buffer's target
+    //----------------------------------------------------------------------------------------------------------------------
+    void bind(GLuint _binding, const Allocation &_allocation) const;
+    GLuint id() const { return m_buffer; }
+    bool persistent() const { return m_mapped!=nullptr; }
+    size_t regionSize() const { return m_regionSize; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief counts every move to another region, at a frame start or when a frame overflows, an
+    /// allocation made under an earlier count may be in a region that is fenced and being reused
+    //----------------------------------------------------------------------------------------------------------------------
+    uint64_t generation() const { return m_generation; }
+    const Stats &stats() const { return m_stats; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief a one line summary of the counters
+    //----------------------------------------------------------------------------------------------------------------------
+    std::string report() const;
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief fence the current region and make the next one current once the GPU is done with it
+    //----------------------------------------------------------------------------------------------------------------------
+    void nextRegion();
+
+    GLenum m_target=GL_UNIFORM_BUFFER;
+    GLuint m_buffer=0;
+    char *m_mapped=nullptr;
+    size_t m_regionSize=0;
+    size_t m_alignment=256;
+    int m_region=0;
+    size_t m_head=0;
+    uint64_t m_generation=0;
+    GLsync m_fences[REGIONS]={nullptr,nullptr,nullptr};
+    Stats m_stats;
+    uint64_t m_windowBytes=0;
+    std::chrono::steady_clock::time_point m_windowStart;
+};
+
+#endif
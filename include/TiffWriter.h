@@ -0,0 +1,55 @@
+#ifndef TIFFWRITER_H_
+#define TIFFWRITER_H_
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file TiffWriter.h
+/// @brief an uncompressed 8 bit RGB TIFF written a piece at a time
+/// @version 1.0
+/// @class TiffWriter
+/// @brief open writes the header and the strip tables and sizes the file, after that any block of
+/// pixels can be written straight to its place in the scanlines with pwrite, so however big the
+/// image only one row of the block being written is ever held. Strips are _rowsPerStrip scanlines
+/// each, stored one after the other, which is the layout every TIFF reader handles. The offsets are
+/// 32 bit so the pixel data has to stay under 4GB, a 32k x 32k RGB image is 3GB
+//----------------------------------------------------------------------------------------------------------------------
+
+class TiffWriter
+{
+  public:
+    TiffWriter()=default;
+    ~TiffWriter();
+    TiffWriter(const TiffWriter &)=delete;
+    TiffWriter &operator=(const TiffWriter &)=delete;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief create the file with its header and strip tables
+    /// @returns false if the file can't be created or the image is too big for a classic TIFF
+    //----------------------------------------------------------------------------------------------------------------------
+    bool open(const std::string &_file, uint32_t _width, uint32_t _height, uint32_t _rowsPerStrip);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief write a block of pixels with its top left corner at _x, _y
+    /// @param [in] _pixels _rows rows of _width pixels of _channels bytes, only the first three are kept
+    /// @param [in] _bottomUp the first row in _pixels is the bottom one, as glReadPixels returns them
+    //----------------------------------------------------------------------------------------------------------------------
+    bool write(uint32_t _x, uint32_t _y, uint32_t _width, uint32_t _rows, const uint8_t *_pixels, int _channels, bool _bottomUp);
+    bool close();
+    bool isOpen() const { return m_fd>=0; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the size of the finished file
+    //----------------------------------------------------------------------------------------------------------------------
+    uint64_t fileSize() const { return m_dataOffset+uint64_t(m_width)*m_height*3; }
+    uint64_t pixelBytesWritten() const { return m_written; }
+
+  private:
+    int m_fd=-1;
+    uint32_t m_width=0;
+    uint32_t m_height=0;
+    uint64_t m_dataOffset=0;
+    uint64_t m_written=0;
+    /// one row of the block being written, as RGB
+    std::vector<uint8_t> m_row;
+};
+
+#endif
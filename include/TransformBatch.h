@@ -0,0 +1,53 @@
+#ifndef TRANSFORMBATCH_H_
+#define TRANSFORMBATCH_H_
+#include "SceneStore.h"
+#include <ngl/Mat4.h>
+#include <cstddef>
+#include <cstdint>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file TransformBatch.h
+/// @brief builds the matrices for many SceneStore objects at once
+/// @version 1.0
+/// @brief the position, rotation and scale arrays of the store are read 8 objects at a time with
+/// AVX2 gathers when the CPU has them, the sines and cosines come from a vector polynomial and the rotation is built in
+/// closed form, so there are no 4x4 products and no inverse. The results are transposed back to
+/// one set of matrices per object and written with a caller supplied stride, so they can go
+/// straight into an instance buffer. Without AVX2 the same maths runs one object at a time, the
+/// check is made at run time so one build runs on any x86-64.
+//----------------------------------------------------------------------------------------------------------------------
+
+namespace TransformBatch
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the matrices of one object. world is an ngl::Mat4 (row vector scale * rotation *
+  /// translation, the same as SceneStore::worldMatrix) and normal is the inverse transpose of its
+  /// upper 3x3 laid out as a std430 mat3, three rows each padded to 4 floats
+  //----------------------------------------------------------------------------------------------------------------------
+  struct Matrices
+  {
+    float world[16];
+    float normal[12];
+  };
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief compute the matrices of _count objects
+  /// @param [in] _store the objects
+  /// @param [in] _ids the objects to compute, in output order
+  /// @param [in] _count the number of ids
+  /// @param [out] o_out the first output, the k'th goes _stride bytes after the (k-1)'th
+  /// @param [in] _stride the distance in bytes between outputs
+  //----------------------------------------------------------------------------------------------------------------------
+  void compute(const SceneStore &_store, const uint32_t *_ids, size_t _count, Matrices *o_out, size_t _stride=sizeof(Matrices));
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief multiply _count world matrices by the same view projection, o_mvp[k]=_world[k]*_VP
+  /// @param [in] _world the first world matrix, the rest follow every _worldStride bytes
+  /// @param [in] _VP the view projection
+  /// @param [out] o_mvp the results, tightly packed
+  //----------------------------------------------------------------------------------------------------------------------
+  void multiply(const float *_world, size_t _worldStride, size_t _count, const ngl::Mat4 &_VP, ngl::Mat4 *o_mvp);
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief true if the AVX2 path is used, the build targets x86 and the CPU has AVX2
+  //----------------------------------------------------------------------------------------------------------------------
+  bool simd();
+}
+
+#endif
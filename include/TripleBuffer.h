@@ -0,0 +1,68 @@
+#ifndef TRIPLEBUFFER_H_
+#define TRIPLEBUFFER_H_
+#include <atomic>
+//----------------------------------------------------------------------------------------------------------------------
+/// @file TripleBuffer.h
+/// @brief lock free hand over of the latest value from one thread to another
+/// @version 1.0
+/// @class TripleBuffer
+/// @brief one writer and one reader each own a slot and the third sits in the middle. The writer
+/// fills its slot and swaps it with the middle one, the reader swaps its slot with the middle
+/// one when there is something new there. Neither side ever waits, the reader always sees the
+/// most recent complete value and values it was too slow to pick up are simply skipped. The
+/// slots are reused so T can hold resources (textures etc) that stay with the slot.
+//----------------------------------------------------------------------------------------------------------------------
+
+template <typename T>
+class TripleBuffer
+{
+  public:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the writer's slot, only touch it from the writing thread
+    //----------------------------------------------------------------------------------------------------------------------
+    T &writeBuffer() { return m_slots[m_write]; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief hand the writer's slot over, the writer gets back whichever slot was in the middle
+    /// so it holds an older value and has to be filled in again before the next publish
+    /// @returns true if the value in the middle was never picked up by the reader
+    //----------------------------------------------------------------------------------------------------------------------
+    bool publish()
+    {
+      unsigned int old=m_middle.exchange(m_write | NEW_VALUE,std::memory_order_acq_rel);
+      m_write=old & INDEX_MASK;
+      return (old & NEW_VALUE)!=0;
+    }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief pick up the latest published value if there is one
+    /// @returns true if readBuffer() changed
+    //----------------------------------------------------------------------------------------------------------------------
+    bool update()
+    {
+      if((m_middle.load(std::memory_order_acquire) & NEW_VALUE)==0)
+      {
+        return false;
+      }
+      unsigned int old=m_middle.exchange(m_read,std::memory_order_acq_rel);
+      m_read=old & INDEX_MASK;
+      return true;
+    }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the reader's slot, only touch it from the reading thread
+    //----------------------------------------------------------------------------------------------------------------------
+    T &readBuffer() { return m_slots[m_read]; }
+    const T &readBuffer() const { return m_slots[m_read]; }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief every slot, only for setting up or tearing down when neither side is running
+    //----------------------------------------------------------------------------------------------------------------------
+    T &slot(int _i) { return m_slots[_i]; }
+
+  private:
+    static constexpr unsigned int INDEX_MASK=3;
+    static constexpr unsigned int NEW_VALUE=4;
+    T m_slots[3];
+    std::atomic<unsigned int> m_middle{1};
+    unsigned int m_write=0;
+    unsigned int m_read=2;
+};
+
+#endif
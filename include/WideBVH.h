@@ -0,0 +1,279 @@
+#ifndef WIDEBVH_H_
+#define WIDEBVH_H_
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+//----------------------------------------------------------------------------------------------------------------------
+/// @file WideBVH.h
+/// @brief a four wide bounding volume hierarchy over boxes for tracing rays
+/// @version 1.0
+/// @class WideBVH
+/// @brief the tree is first built as a binary tree, splitting each node where the surface area
+/// heuristic says a ray is cheapest to trace, the centroids are binned into BINS buckets per axis
+/// so the build is O(n log n). It is then collapsed so every node has up to four children whose
+/// boxes are stored side by side, one ray is tested against all four with SSE when the compiler
+/// targets it (scalar otherwise) and the children are visited nearest first. The tree only knows
+/// boxes, the primitives are handed to the leaf callback as a range of order() so the same tree
+/// serves triangles in a mesh and instances in a scene.
+//----------------------------------------------------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief a ray with the reciprocal direction and its signs set up for the box tests
+//----------------------------------------------------------------------------------------------------------------------
+struct TraceRay
+{
+  float origin[3];
+  float dir[3];
+  float invDir[3];
+  /// 1 where the direction is negative, the near plane of each slab is then the max side
+  int sign[3];
+  void set(const float _origin[3], const float _dir[3])
+  {
+    for(int i=0; i<3; ++i)
+    {
+      origin[i]=_origin[i];
+      // a zero component would make 0 * inf in the slab test
+      dir[i]=std::fabs(_dir[i])>1e-12f ? _dir[i] : std::copysign(1e-12f,_dir[i]);
+      invDir[i]=1.0f/dir[i];
+      sign[i]=invDir[i]<0.0f ? 1 : 0;
+    }
+  }
+};
+
+class WideBVH
+{
+  public:
+    static constexpr int WIDTH=4;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the most primitives in a leaf, the build stops sooner if splitting costs more
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr uint32_t LEAF_SIZE=4;
+    static constexpr int BINS=16;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the deepest the tree can be, which sizes the traversal stacks. The binary tree makes a
+    /// leaf of whatever is left when it reaches it and collapsing never makes the tree deeper
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr int MAX_DEPTH=32;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the cost of a box test relative to a primitive test, used by the surface area heuristic
+    //----------------------------------------------------------------------------------------------------------------------
+    static constexpr float TRAVERSAL_COST=1.0f;
+    static constexpr float PRIMITIVE_COST=1.0f;
+    struct Box
+    {
+      float min[3]={std::numeric_limits<float>::max(),std::numeric_limits<float>::max(),std::numeric_limits<float>::max()};
+      float max[3]={-std::numeric_limits<float>::max(),-std::numeric_limits<float>::max(),-std::numeric_limits<float>::max()};
+      void grow(const Box &_box);
+      void grow(const float _point[3]);
+      float area() const;
+      bool empty() const { return min[0]>max[0]; }
+    };
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief build the tree over one box per primitive
+    //----------------------------------------------------------------------------------------------------------------------
+    void build(const std::vector<Box> &_boxes);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief visit every leaf the ray passes through before io_tMax, nearest first
+    /// @param [in] _leaf called as bool(uint32_t first, uint32_t count, float &io_tMax) with a range of
+    /// order(), it shortens io_tMax and returns true when it hits something
+    /// @returns true if any leaf did
+    //----------------------------------------------------------------------------------------------------------------------
+    template<typename Leaf> bool intersect(const TraceRay &_ray, float _tMin, float &io_tMax, Leaf _leaf) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief stop at the first leaf that reports a hit, for shadow rays
+    //----------------------------------------------------------------------------------------------------------------------
+    template<typename Leaf> bool occluded(const TraceRay &_ray, float _tMin, float _tMax, Leaf _leaf) const;
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the primitive indices in leaf order, a leaf range indexes this
+    //----------------------------------------------------------------------------------------------------------------------
+    const std::vector<uint32_t> &order() const { return m_order; }
+    const Box &bounds() const { return m_bounds; }
+    size_t numNodes() const { return m_nodes.size(); }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief the surface area heuristic cost of the binary tree, lower traces faster
+    //----------------------------------------------------------------------------------------------------------------------
+    float sahCost() const { return m_sahCost; }
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief four children side by side, a child with a count is a leaf of order()[child, child+count),
+    /// otherwise it is the node at child. Unused slots have an inverted box no ray can hit
+    //----------------------------------------------------------------------------------------------------------------------
+    struct Node
+    {
+      float minX[WIDTH], minY[WIDTH], minZ[WIDTH];
+      float maxX[WIDTH], maxY[WIDTH], maxZ[WIDTH];
+      uint32_t child[WIDTH];
+      uint32_t count[WIDTH];
+    };
+    struct BinaryNode
+    {
+      Box box;
+      uint32_t first;
+      uint32_t count;
+      // the left child is always the next node, only the right is stored
+      int32_t right;
+      bool isLeaf() const { return right<0; }
+    };
+    int32_t buildRecursive(const std::vector<Box> &_boxes, const std::vector<float> &_centroids, uint32_t _first, uint32_t _count, int _depth);
+    uint32_t collapse(int32_t _binary);
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief test the ray against a node's four boxes
+    /// @returns a bit per child hit and the distance to each in o_tNear
+    //----------------------------------------------------------------------------------------------------------------------
+    int hitChildren(const Node &_node, const TraceRay &_ray, float _tMin, float _tMax, float o_tNear[WIDTH]) const;
+
+    std::vector<BinaryNode> m_binary;
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_order;
+    Box m_bounds;
+    /// the root itself a leaf, when there are too few primitives for a node
+    uint32_t m_rootCount=0;
+    float m_sahCost=0.0f;
+};
+
+//________________________________________________________________________________________________________________________________________//
+
+inline int WideBVH::hitChildren(const Node &_node, const TraceRay &_ray, float _tMin, float _tMax, float o_tNear[WIDTH]) const
+{
+  const float *nearX=_ray.sign[0] ? _node.maxX : _node.minX;
+  const float *farX=_ray.sign[0] ? _node.minX : _node.maxX;
+  const float *nearY=_ray.sign[1] ? _node.maxY : _node.minY;
+  const float *farY=_ray.sign[1] ? _node.minY : _node.maxY;
+  const float *nearZ=_ray.sign[2] ? _node.maxZ : _node.minZ;
+  const float *farZ=_ray.sign[2] ? _node.minZ : _node.maxZ;
+#ifdef __SSE__
+  __m128 ox=_mm_set1_ps(_ray.origin[0]);
+  __m128 oy=_mm_set1_ps(_ray.origin[1]);
+  __m128 oz=_mm_set1_ps(_ray.origin[2]);
+  __m128 ix=_mm_set1_ps(_ray.invDir[0]);
+  __m128 iy=_mm_set1_ps(_ray.invDir[1]);
+  __m128 iz=_mm_set1_ps(_ray.invDir[2]);
+  __m128 tNear=_mm_max_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(nearX),ox),ix),
+                                     _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(nearY),oy),iy)),
+                          _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(nearZ),oz),iz),_mm_set1_ps(_tMin)));
+  __m128 tFar=_mm_min_ps(_mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(farX),ox),ix),
+                                    _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(farY),oy),iy)),
+                         _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(farZ),oz),iz),_mm_set1_ps(_tMax)));
+  _mm_storeu_ps(o_tNear,tNear);
+  return _mm_movemask_ps(_mm_cmple_ps(tNear,tFar));
+#else
+  int mask=0;
+  for(int i=0; i<WIDTH; ++i)
+  {
+    float tNear=std::max(std::max((nearX[i]-_ray.origin[0])*_ray.invDir[0],(nearY[i]-_ray.origin[1])*_ray.invDir[1]),
+                         std::max((nearZ[i]-_ray.origin[2])*_ray.invDir[2],_tMin));
+    float tFar=std::min(std::min((farX[i]-_ray.origin[0])*_ray.invDir[0],(farY[i]-_ray.origin[1])*_ray.invDir[1]),
+                        std::min((farZ[i]-_ray.origin[2])*_ray.invDir[2],_tMax));
+    o_tNear[i]=tNear;
+    mask|=tNear<=tFar ? 1<<i : 0;
+  }
+  return mask;
+#endif
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+template<typename Leaf> bool WideBVH::intersect(const TraceRay &_ray, float _tMin, float &io_tMax, Leaf _leaf) const
+{
+  if(m_nodes.empty())
+  {
+    return m_rootCount>0 && _leaf(0,m_rootCount,io_tMax);
+  }
+  // each node adds at most three entries to the stack, the build limits the depth
+  struct Entry
+  {
+    uint32_t node;
+    float tNear;
+  };
+  Entry stack[3*MAX_DEPTH+1];
+  int top=0;
+  stack[top++]={0,_tMin};
+  bool hit=false;
+  while(top>0)
+  {
+    Entry entry=stack[--top];
+    // a closer hit was found after this node was pushed
+    if(entry.tNear>io_tMax)
+    {
+      continue;
+    }
+    const Node &node=m_nodes[entry.node];
+    float tNear[WIDTH];
+    int mask=hitChildren(node,_ray,_tMin,io_tMax,tNear);
+    Entry inner[WIDTH];
+    int innerCount=0;
+    for(int i=0; i<WIDTH; ++i)
+    {
+      if((mask & (1<<i))==0)
+      {
+        continue;
+      }
+      if(node.count[i]>0)
+      {
+        hit|=_leaf(node.child[i],node.count[i],io_tMax);
+      }
+      else
+      {
+        // insertion sort, furthest first so the nearest is popped next
+        int j=innerCount++;
+        while(j>0 && inner[j-1].tNear<tNear[i])
+        {
+          inner[j]=inner[j-1];
+          --j;
+        }
+        inner[j]={node.child[i],tNear[i]};
+      }
+    }
+    for(int i=0; i<innerCount; ++i)
+    {
+      stack[top++]=inner[i];
+    }
+  }
+  return hit;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+template<typename Leaf> bool WideBVH::occluded(const TraceRay &_ray, float _tMin, float _tMax, Leaf _leaf) const
+{
+  if(m_nodes.empty())
+  {
+    return m_rootCount>0 && _leaf(0,m_rootCount,_tMax);
+  }
+  uint32_t stack[3*MAX_DEPTH+1];
+  int top=0;
+  stack[top++]=0;
+  while(top>0)
+  {
+    const Node &node=m_nodes[stack[--top]];
+    float tNear[WIDTH];
+    int mask=hitChildren(node,_ray,_tMin,_tMax,tNear);
+    for(int i=0; i<WIDTH; ++i)
+    {
+      if((mask & (1<<i))==0)
+      {
+        continue;
+      }
+      if(node.count[i]>0)
+      {
+        if(_leaf(node.child[i],node.count[i],_tMax))
+        {
+          return true;
+        }
+      }
+      else
+      {
+        stack[top++]=node.child[i];
+      }
+    }
+  }
+  return false;
+}
+
+#endif
@@ -0,0 +1,27 @@
+#version 420 core
+
+/// @file AccumulateFrag.glsl
+/// @brief progressive accumulation of a still view, each frame is rendered with a new sub pixel
+/// jitter and shadow kernel rotation and averaged in with the frames before it. Both targets
+/// are the same size and only the rendered part is drawn, so each pixel reads its own texel
+
+out vec4 FragColour;
+
+uniform sampler2D scene;
+uniform sampler2D history;
+// 1/n for the n'th frame keeps the history the mean of every frame so far
+uniform float weight = 1.0;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec3 current = texelFetch(scene, texel, 0).rgb;
+    // the first frame never reads the history, it holds the last still or nothing at all
+    if(weight >= 1.0)
+    {
+        FragColour = vec4(current, 1.0);
+        return;
+    }
+    vec3 mean = texelFetch(history, texel, 0).rgb;
+    FragColour = vec4(mix(mean, current, weight), 1.0);
+}
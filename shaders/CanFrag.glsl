@@ -1,4 +1,4 @@
-#version 420 core
+#version 430 core
 
 // Attributes passed on from the vertex shader
 smooth in vec3 FragmentPosition;
@@ -7,6 +7,7 @@ smooth in vec2 FragmentTexCoord;
 smooth in vec4 Colour;
 smooth in vec4 ShadowCoord;
 smooth in vec3 eyeDirection;
+flat in uint LabelLayer;
 
 uniform sampler2D ShadowMap;
 
@@ -37,8 +38,11 @@ struct LightInfo {
     float Quadratic;
 };
 
-
-uniform LightInfo Light[3];
+// the same block ShadowFrag.glsl reads, written once a frame into the stream buffer
+layout (std140, binding=3) uniform Lights
+{
+    LightInfo Light[3];
+};
 
 
 // The material properties of our object
@@ -68,7 +72,7 @@ uniform int envMaxLOD = 10;
 uniform sampler2D glossMap;
 
 //Set label map texture
-uniform sampler2D labelMap;
+uniform sampler2DArray labelMap;
 
 //Set bump map texture
 uniform sampler2D normalMap;
@@ -76,8 +80,20 @@ uniform sampler2D normalMap;
 // The inverse View matrix
 uniform mat4 invV;
 
-// A toggle allowing you to set it to reflect or refract the light
-uniform bool isReflect = true;
+// LIGHT_COUNT, LIGHTING_MICROFACET, REFRACT, NOISE and NORMAL_MAP are defined by the
+// ShaderVariants for each material, the fallbacks are the full shading
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 3
+#define LIGHTING_MICROFACET 1
+#define REFRACT 0
+#define NOISE 1
+#define NORMAL_MAP 1
+#endif
+
+#if NORMAL_MAP
+// Tangent space to view space from the per vertex tangent frame
+smooth in mat3 TBN;
+#endif
 
 // Specify the refractive index for refractions
 uniform float refractiveIndex = 1.0;
@@ -90,41 +106,6 @@ float gamma = 1.5;
 
 
 
-//________________________________________________________________________________________________________________________________________//
-
-/** From http://www.neilmendoza.com/glsl-rotation-about-an-arbitrary-axis/
-        */
-mat4 rotationMatrix(vec3 axis, float angle)
-{
-    //axis = normalize(axis);
-    float s = sin(angle);
-    float c = cos(angle);
-    float oc = 1.0 - c;
-    return mat4(oc * axis.x * axis.x + c,           oc * axis.x * axis.y - axis.z * s,  oc * axis.z * axis.x + axis.y * s,  0.0,
-                oc * axis.x * axis.y + axis.z * s,  oc * axis.y * axis.y + c,           oc * axis.y * axis.z - axis.x * s,  0.0,
-                oc * axis.z * axis.x - axis.y * s,  oc * axis.y * axis.z + axis.x * s,  oc * axis.z * axis.z + c,           0.0,
-                0.0,                                0.0,                                0.0,                                1.0);
-}
-
-/**
-        * Rotate a vector vec by using the rotation that transforms from src to tgt.
-        */
-vec3 rotateVector(vec3 src, vec3 tgt, vec3 vec) {
-    float angle = acos(dot(src,tgt));
-
-    // Check for the case when src and tgt are the same vector, in which case
-    // the cross product will be ill defined.
-    if (angle == 0.0) {
-        return vec;
-    }
-    vec3 axis = normalize(cross(src,tgt));
-    mat4 R = rotationMatrix(axis,angle);
-
-    // Rotate the vec by this rotation matrix
-    vec4 _norm = R*vec4(vec,1.0);
-    return _norm.xyz / _norm.w;
-}
-
 //________________________________________________________________________________________________________________________________________//
 
 
@@ -287,7 +268,8 @@ float noise (in vec2 _st) {
             (c - a)* u.y * (1.0 - u.x) +
             (d - b) * u.x * u.y;
 }
-float NUM_OCTAVES = 8;
+// set by the quality governor
+uniform int noiseOctaves = 8;
 
 float fbm ( in vec2 _st) {
     float v = 0.0;
@@ -296,7 +278,7 @@ float fbm ( in vec2 _st) {
     // Rotate to reduce axial bias
     mat2 rot = mat2(cos(0.5), sin(0.5),
                     -sin(0.5), cos(0.50));
-    for (int i = 0; i < NUM_OCTAVES; ++i) {
+    for (int i = 0; i < noiseOctaves; ++i) {
         v += a * noise(_st);
         _st = rot * _st * 2.0 + shift;
         a *= 0.5;
@@ -349,21 +331,20 @@ void main ()
 
     vec3 lookup;
 
-    if (isReflect) {
-        lookup = reflect(v,n);
-    } else {
-        lookup = refract(v,n,refractiveIndex);
-    }
-
-
-    // Extract the normal from the normal map (rescale to [-1,1]
-       vec3 tgt = normalize(texture(normalMap, FragmentTexCoord).rgb * 2.0 - 1.0);
+#if REFRACT
+    lookup = refract(v,n,refractiveIndex);
+#else
+    lookup = reflect(v,n);
+#endif
 
-    // The source is just up in the Z-direction
-        vec3 src = vec3(0.0, 0.0, 1.0);
 
-    // Perturb the normal according to the target
-        vec3 np = rotateVector(src, tgt, n);
+#if NORMAL_MAP
+    // Extract the normal from the normal map (rescale to [-1,1]) and take it from tangent to view space
+    vec3 tgt = texture(normalMap, FragmentTexCoord).rgb * 2.0 - 1.0;
+    vec3 np = normalize(TBN * tgt);
+#else
+    vec3 np = n;
+#endif
 
 
     // This call actually finds out the current LOD
@@ -375,21 +356,27 @@ void main ()
     // This call determines the current LOD value for the texture map
     vec4 colour = textureLod(envMap, lookup, gloss*0.01);
 
-    vec4 texturedCan = texture(labelMap, FragmentTexCoord);
+    vec4 texturedCan = texture(labelMap, vec3(FragmentTexCoord, float(LabelLayer)));
 
 
 
     vec3 lightIntensity = vec3(0.0);
-    for(int i = 0; i<3; ++i)
+    for(int i = 0; i<LIGHT_COUNT; ++i)
     {
         //interchange between lighting models
-    //    lightIntensity += BlinnPhong(i, n, v);
+#if LIGHTING_MICROFACET
         lightIntensity += lightContribution(i, np);
+#else
+        lightIntensity += BlinnPhong(i, np, v);
+#endif
     }
 
 
 
-    FragColour = texturedCan * vec4(lightIntensity,1.0) * colour + generateNoise();
+    FragColour = texturedCan * vec4(lightIntensity,1.0) * colour;
+#if NOISE
+    FragColour += generateNoise();
+#endif
     FragColour.rgb = pow(FragColour.rgb, vec3(1.0/gamma));
 
 }
@@ -1,14 +1,38 @@
-#version 420
-
-// The vertex position attribute
-layout (location=0) in vec3 VertexPosition;
-
-// The texture coordinate attribute
+#version 430
+
+// MULTI_VIEW is defined by the ShaderVariants, the turntable draws every view in one submission
+#ifndef MULTI_VIEW
+#define MULTI_VIEW 0
+#endif
+#if MULTI_VIEW
+#extension GL_ARB_shader_viewport_layer_array : require
+// The views of the turntable, instance i is drawn into view firstView + i % viewCount and the
+// layer of the target with the same index
+layout (std140, binding=0) uniform TurntableViews
+{
+    mat4 viewV[64];
+    mat4 viewVP[64];
+    vec4 viewEye[64];
+};
+uniform int viewCount = 1;
+uniform int firstView = 0;
+#endif
+
+// The vertex position attribute, 16 bit normalised within the mesh bounds
+layout (location=0) in vec3 QuantisedPosition;
+
+// The texture coordinate attribute (half floats)
 layout (location=1) in vec2 TexCoord;
 
-// The vertex normal attribute
+// The vertex normal attribute (10:10:10:2 signed normalised)
 layout (location=2) in vec3 VertexNormal;
 
+// The id of this instance, one per instance from the culled visible list
+layout (location=3) in uint InstanceIndex;
+
+// The tangent, w is the sign of the bitangent (10:10:10:2 signed normalised)
+layout (location=4) in vec4 VertexTangent;
+
 // These attributes are passed onto the shader (should they all be smoothed?)
 smooth out vec3 FragmentPosition;
 smooth out vec3 FragmentNormal;
@@ -16,18 +40,80 @@ smooth out vec2 FragmentTexCoord;
 smooth out vec4 ShadowCoord;
 smooth out vec3 eyeDirection;
 
-uniform mat4 MV;            // model view matrix calculated in the App
-uniform mat4 MVP;           // model view projection calculated in the app
-uniform mat3 N;             // normal matrix calculated in the app
+// NORMAL_MAP is defined by the ShaderVariants, see CanFrag.glsl
+#ifndef NORMAL_MAP
+#define NORMAL_MAP 1
+#endif
+#if NORMAL_MAP
+// Tangent space to view space, the columns are the tangent, bitangent and normal
+smooth out mat3 TBN;
+#endif
+
+// These attributes are passed onto the fragment shader
+flat out uint LabelLayer;
+
+// The view, written into the stream buffer for each pass (see StreamBuffer.h)
+layout (std140, binding=1) uniform ViewMatrices
+{
+    mat4 V;                 // view matrix (including the mouse transform) calculated in the App
+    mat4 VP;                // view projection calculated in the app
+    vec3 viewPos;
+};
 uniform mat4 textureMatrix;
-uniform vec3 viewPos;
+
+// Per instance data, one entry per can indexed with InstanceIndex
+struct InstanceData
+{
+    mat4 M;                 // model matrix
+    mat3 N;                 // inverse transpose of the model 3x3, built on the CPU
+    uint label;             // which label (SKU) this can uses
+};
+
+layout (std430, binding=0) readonly buffer Instances
+{
+    InstanceData instances[];
+};
+// The label array layer of every SKU, 0 (the first label) until the SKU's own label is streamed in
+layout (std430, binding=4) readonly buffer LabelLayers
+{
+    uint labelLayers[];
+};
+// Rebuilds the model space position from the quantised one, 0 and 1 for float vertices
+uniform vec3 positionOffset = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
 //uniform vec3 LightPosition;
 
 
 
 void main() {
-    // Transform the vertex normal by the inverse transpose modelview matrix
-    FragmentNormal = normalize(N * VertexNormal);
+#if MULTI_VIEW
+    int view = firstView + gl_InstanceID % viewCount;
+    mat4 viewMatrix = viewV[view];
+    mat4 viewProjection = viewVP[view];
+    vec3 eye = viewEye[view].xyz;
+    gl_Layer = view;
+#else
+    mat4 viewMatrix = V;
+    mat4 viewProjection = VP;
+    vec3 eye = viewPos;
+#endif
+    vec3 VertexPosition = positionOffset + QuantisedPosition * positionScale;
+    mat4 M = instances[InstanceIndex].M;
+    mat4 MV = viewMatrix * M;
+    mat4 MVP = viewProjection * M;
+
+    // The view has no scale so only the model part of the normal matrix needs the inverse
+    FragmentNormal = normalize(mat3(viewMatrix) * instances[InstanceIndex].N * VertexNormal);
+
+#if NORMAL_MAP
+    // The tangent lies in the surface so it takes the model matrix, the bitangent is rebuilt from
+    // its sign and the three are left unnormalised after interpolation as MikkTSpace expects
+    vec3 T = normalize(mat3(MV) * VertexTangent.xyz);
+    vec3 B = VertexTangent.w * cross(FragmentNormal, T);
+    TBN = mat3(T, B, FragmentNormal);
+#endif
+
+    LabelLayer = labelLayers[instances[InstanceIndex].label];
 
 
 
@@ -40,7 +126,7 @@ void main() {
     // Copy across the texture coordinates
     FragmentTexCoord = TexCoord;
 
-    eyeDirection = normalize(viewPos - vec3(MV));
+    eyeDirection = normalize(eye - vec3(MV));
 
     // Compute the position of the vertex
     gl_Position = MVP * vec4(VertexPosition,1.0);
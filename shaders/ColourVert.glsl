@@ -1,17 +1,42 @@
-#version 330 core
-
-/// @file Colour.vs
-/// @brief a basic unshaded solid colour shader used with Colour.fs
-
-/// @brief MVP matrix passed from our app
-uniform mat4 MVP;
-
-// first attribute the vertex values from our VAO
-layout (location=0) in vec3 inVert;
-uniform vec4 Colour;
-
-void main()
-{
-// calculate the vertex position
-gl_Position = MVP*vec4(inVert, 1.0);
-}
+#version 430 core
+
+/// @file Colour.vs
+/// @brief a basic unshaded solid colour shader used with Colour.fs
+
+/// @brief MVP matrix passed from our app
+uniform mat4 MVP;
+/// @brief VP matrix used when drawing instances, the model matrix comes from the instance buffer
+uniform mat4 VP;
+uniform bool instanced = false;
+/// @brief rebuilds the model space position from the quantised one, 0 and 1 for float vertices
+uniform vec3 positionOffset = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
+
+// first attribute the vertex values from our VAO
+layout (location=0) in vec3 inPosition;
+// the instance id from the culled visible list (only used when instanced)
+layout (location=3) in uint inInstance;
+uniform vec4 Colour;
+
+// Per instance data, matches CanVert.glsl
+struct InstanceData
+{
+    mat4 M;
+    mat3 N;
+    uint label;
+};
+
+layout (std430, binding=0) readonly buffer Instances
+{
+    InstanceData instances[];
+};
+
+void main()
+{
+vec3 inVert = positionOffset + inPosition * positionScale;
+// calculate the vertex position
+if(instanced)
+    gl_Position = VP*instances[inInstance].M*vec4(inVert, 1.0);
+else
+    gl_Position = MVP*vec4(inVert, 1.0);
+}
@@ -0,0 +1,169 @@
+#version 430 core
+
+/// @file CullComp.glsl
+/// @brief GPU culling pre-pass, one invocation per instance. Each instance's bounding sphere is
+/// tested against the frustum planes and (optionally) the hierarchical depth buffer built from
+/// last frame's depth. Visible instances are appended to the visible id list and the
+/// instanceCount of the matching DrawElementsIndirectCommand is bumped so the draw can go
+/// straight to glMultiDrawElementsIndirect without reading anything back on the CPU.
+/// There is one command per level of detail, the level is picked from the projected size of
+/// the sphere with the same hysteresis as IndexedMesh::selectLOD.
+
+layout (local_size_x=64) in;
+
+// Per instance data, matches CanVert.glsl
+struct InstanceData
+{
+    mat4 M;
+    mat3 N;
+    uint label;
+};
+
+layout (std430, binding=0) readonly buffer Instances
+{
+    InstanceData instances[];
+};
+
+// Compacted list of visible instance ids, read by vertex attribute 3 from baseInstance, each
+// level of detail has its own region starting at its command's baseInstance
+layout (std430, binding=1) writeonly buffer Visible
+{
+    uint visible[];
+};
+
+struct DrawElementsIndirectCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int  baseVertex;
+    uint baseInstance;
+};
+
+layout (std430, binding=2) buffer Commands
+{
+    DrawElementsIndirectCommand commands[];
+};
+
+// the level each instance used last frame for this pass
+layout (std430, binding=3) buffer LodState
+{
+    uint lodState[];
+};
+
+uniform uint instanceCount;
+
+// normalised frustum planes, normals pointing inwards
+uniform vec4 frustumPlanes[6];
+
+// xyz centre and w radius of the mesh bounding sphere in model space
+uniform vec4 boundingSphere;
+
+uniform bool cullEnabled = true;
+uniform bool occlusionEnabled = false;
+
+// level of detail selection, lodThresholds[i] is the projected radius in pixels below which
+// level i+1 is used, pixelScale converts radius / view depth to pixels
+uniform bool lodEnabled = true;
+uniform uint lodCount = 1;
+uniform float lodThresholds[4];
+uniform float lodHysteresis = 0.15;
+uniform uint lodBias = 0;
+uniform float pixelScale;
+uniform mat4 VP;
+
+// the view projection the depth pyramid was rendered with
+uniform mat4 prevVP;
+layout (binding=7) uniform sampler2D hiZ;
+uniform vec2 hiZSize;
+
+//________________________________________________________________________________________________________________________________________//
+
+bool occluded(vec3 _c, float _r)
+{
+    // project the corners of the sphere's box with last frame's matrix
+    vec3 ndcMin = vec3(1.0);
+    vec3 ndcMax = vec3(-1.0);
+    for(int i=0; i<8; ++i)
+    {
+        vec3 corner = _c + _r * vec3((i & 1) == 0 ? -1.0 : 1.0,
+                                     (i & 2) == 0 ? -1.0 : 1.0,
+                                     (i & 4) == 0 ? -1.0 : 1.0);
+        vec4 p = prevVP * vec4(corner, 1.0);
+        // anything crossing the near plane can't be tested
+        if(p.w <= 0.0)
+            return false;
+        vec3 ndc = p.xyz / p.w;
+        ndcMin = min(ndcMin, ndc);
+        ndcMax = max(ndcMax, ndc);
+    }
+
+    vec2 uvMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0);
+    vec2 uvMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0);
+
+    // pick the level where the box covers at most 2x2 texels
+    vec2 size = (uvMax - uvMin) * hiZSize;
+    float level = ceil(log2(max(max(size.x, size.y), 1.0)));
+
+    float farthest = max(max(textureLod(hiZ, uvMin, level).r,
+                             textureLod(hiZ, vec2(uvMax.x, uvMin.y), level).r),
+                         max(textureLod(hiZ, vec2(uvMin.x, uvMax.y), level).r,
+                             textureLod(hiZ, uvMax, level).r));
+
+    float nearest = ndcMin.z * 0.5 + 0.5;
+    return nearest > farthest;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+uint selectLOD(uint _id, vec3 _c, float _r)
+{
+    if(!lodEnabled)
+        return 0u;
+    float depth = max((VP * vec4(_c, 1.0)).w, 1e-3);
+    float screenRadius = _r * pixelScale / depth;
+    uint last = lodCount - 1u;
+    uint lod = min(lodState[_id], last);
+    while(lod < last && screenRadius < lodThresholds[lod] * (1.0 - lodHysteresis))
+        ++lod;
+    while(lod > 0u && screenRadius > lodThresholds[lod-1u] * (1.0 + lodHysteresis))
+        --lod;
+    lodState[_id] = lod;
+    return min(lod + lodBias, last);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if(id >= instanceCount)
+        return;
+
+    mat4 M = instances[id].M;
+    vec3 centre = (M * vec4(boundingSphere.xyz, 1.0)).xyz;
+    float scale = max(length(M[0].xyz), max(length(M[1].xyz), length(M[2].xyz)));
+    float radius = boundingSphere.w * scale;
+
+    bool isVisible = true;
+    if(cullEnabled)
+    {
+        for(int i=0; i<6; ++i)
+        {
+            if(dot(frustumPlanes[i].xyz, centre) + frustumPlanes[i].w < -radius)
+            {
+                isVisible = false;
+                break;
+            }
+        }
+        if(isVisible && occlusionEnabled)
+            isVisible = !occluded(centre, radius);
+    }
+
+    if(isVisible)
+    {
+        uint lod = selectLOD(id, centre, radius);
+        uint slot = atomicAdd(commands[lod].instanceCount, 1u);
+        visible[commands[lod].baseInstance + slot] = id;
+    }
+}
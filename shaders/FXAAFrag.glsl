@@ -0,0 +1,152 @@
+#version 420 core
+
+/// @file FXAAFrag.glsl
+/// @brief fast approximate anti-aliasing, finds the edge direction from the luma of the 3x3
+/// neighbourhood, searches along the edge for its ends and blends across it by how far this
+/// pixel is from the nearest end (after Timothy Lottes' FXAA 3.11 quality preset)
+
+in vec2 TexCoords;
+out vec4 FragColour;
+
+uniform sampler2D scene;
+uniform vec2 texelSize;
+// the fraction of the texture the scene was rendered into, below 1 with dynamic resolution
+uniform vec2 uvScale = vec2(1.0);
+
+// the smallest local contrast that counts as an edge, absolute and relative to the brightest neighbour
+const float EDGE_THRESHOLD_MIN = 0.0312;
+const float EDGE_THRESHOLD_MAX = 0.125;
+// how much of the sub pixel aliasing to remove
+const float SUBPIXEL_QUALITY = 0.75;
+// step sizes for the edge end search, later steps skip further
+const int SEARCH_STEPS = 12;
+const float QUALITY[SEARCH_STEPS] = float[](1.0, 1.0, 1.0, 1.0, 1.0, 1.5, 2.0, 2.0, 2.0, 2.0, 4.0, 8.0);
+
+float luma(vec3 _c)
+{
+    // perceptual luma, the square root approximates gamma
+    return sqrt(dot(_c, vec3(0.299, 0.587, 0.114)));
+}
+
+float lumaAt(vec2 _uv)
+{
+    return luma(texture(scene, _uv).rgb);
+}
+
+void main()
+{
+    vec2 centreUv = TexCoords * uvScale;
+    vec3 colourCentre = texture(scene, centreUv).rgb;
+    float lumaCentre = luma(colourCentre);
+    float lumaDown  = luma(textureOffset(scene, centreUv, ivec2( 0,-1)).rgb);
+    float lumaUp    = luma(textureOffset(scene, centreUv, ivec2( 0, 1)).rgb);
+    float lumaLeft  = luma(textureOffset(scene, centreUv, ivec2(-1, 0)).rgb);
+    float lumaRight = luma(textureOffset(scene, centreUv, ivec2( 1, 0)).rgb);
+
+    float lumaMin = min(lumaCentre, min(min(lumaDown, lumaUp), min(lumaLeft, lumaRight)));
+    float lumaMax = max(lumaCentre, max(max(lumaDown, lumaUp), max(lumaLeft, lumaRight)));
+    float lumaRange = lumaMax - lumaMin;
+
+    // most pixels aren't on an edge so leave early
+    if(lumaRange < max(EDGE_THRESHOLD_MIN, lumaMax * EDGE_THRESHOLD_MAX))
+    {
+        FragColour = vec4(colourCentre, 1.0);
+        return;
+    }
+
+    float lumaDownLeft  = luma(textureOffset(scene, centreUv, ivec2(-1,-1)).rgb);
+    float lumaUpRight   = luma(textureOffset(scene, centreUv, ivec2( 1, 1)).rgb);
+    float lumaUpLeft    = luma(textureOffset(scene, centreUv, ivec2(-1, 1)).rgb);
+    float lumaDownRight = luma(textureOffset(scene, centreUv, ivec2( 1,-1)).rgb);
+
+    float lumaDownUp = lumaDown + lumaUp;
+    float lumaLeftRight = lumaLeft + lumaRight;
+    float lumaLeftCorners = lumaDownLeft + lumaUpLeft;
+    float lumaDownCorners = lumaDownLeft + lumaDownRight;
+    float lumaRightCorners = lumaDownRight + lumaUpRight;
+    float lumaUpCorners = lumaUpRight + lumaUpLeft;
+
+    // which way does the edge run
+    float edgeHorizontal = abs(-2.0 * lumaLeft + lumaLeftCorners) +
+                           abs(-2.0 * lumaCentre + lumaDownUp) * 2.0 +
+                           abs(-2.0 * lumaRight + lumaRightCorners);
+    float edgeVertical = abs(-2.0 * lumaUp + lumaUpCorners) +
+                         abs(-2.0 * lumaCentre + lumaLeftRight) * 2.0 +
+                         abs(-2.0 * lumaDown + lumaDownCorners);
+    bool isHorizontal = edgeHorizontal >= edgeVertical;
+
+    // and which side of this pixel it is on
+    float luma1 = isHorizontal ? lumaDown : lumaLeft;
+    float luma2 = isHorizontal ? lumaUp : lumaRight;
+    float gradient1 = luma1 - lumaCentre;
+    float gradient2 = luma2 - lumaCentre;
+    bool is1Steepest = abs(gradient1) >= abs(gradient2);
+    float gradientScaled = 0.25 * max(abs(gradient1), abs(gradient2));
+
+    float stepLength = isHorizontal ? texelSize.y : texelSize.x;
+    float lumaLocalAverage;
+    if(is1Steepest)
+    {
+        stepLength = -stepLength;
+        lumaLocalAverage = 0.5 * (luma1 + lumaCentre);
+    }
+    else
+    {
+        lumaLocalAverage = 0.5 * (luma2 + lumaCentre);
+    }
+
+    // start half a pixel over, on the edge itself
+    vec2 edgeUv = centreUv;
+    if(isHorizontal)
+        edgeUv.y += stepLength * 0.5;
+    else
+        edgeUv.x += stepLength * 0.5;
+
+    // walk both ways along the edge until the luma leaves the local average
+    vec2 offset = isHorizontal ? vec2(texelSize.x, 0.0) : vec2(0.0, texelSize.y);
+    vec2 uv1 = edgeUv - offset * QUALITY[0];
+    vec2 uv2 = edgeUv + offset * QUALITY[0];
+    float lumaEnd1 = lumaAt(uv1) - lumaLocalAverage;
+    float lumaEnd2 = lumaAt(uv2) - lumaLocalAverage;
+    bool reached1 = abs(lumaEnd1) >= gradientScaled;
+    bool reached2 = abs(lumaEnd2) >= gradientScaled;
+    for(int i = 1; i < SEARCH_STEPS && !(reached1 && reached2); ++i)
+    {
+        if(!reached1)
+        {
+            uv1 -= offset * QUALITY[i];
+            lumaEnd1 = lumaAt(uv1) - lumaLocalAverage;
+            reached1 = abs(lumaEnd1) >= gradientScaled;
+        }
+        if(!reached2)
+        {
+            uv2 += offset * QUALITY[i];
+            lumaEnd2 = lumaAt(uv2) - lumaLocalAverage;
+            reached2 = abs(lumaEnd2) >= gradientScaled;
+        }
+    }
+
+    float distance1 = isHorizontal ? (centreUv.x - uv1.x) : (centreUv.y - uv1.y);
+    float distance2 = isHorizontal ? (uv2.x - centreUv.x) : (uv2.y - centreUv.y);
+    bool isDirection1 = distance1 < distance2;
+    float distanceFinal = min(distance1, distance2);
+    float edgeLength = distance1 + distance2;
+
+    // only blend if the luma at the nearest end varies the same way as this pixel
+    bool isLumaCentreSmaller = lumaCentre < lumaLocalAverage;
+    bool correctVariation = ((isDirection1 ? lumaEnd1 : lumaEnd2) < 0.0) != isLumaCentreSmaller;
+    float pixelOffset = correctVariation ? 0.5 - distanceFinal / edgeLength : 0.0;
+
+    // thin features smaller than a pixel get a blend from the whole neighbourhood
+    float lumaAverage = (1.0 / 12.0) * (2.0 * (lumaDownUp + lumaLeftRight) + lumaLeftCorners + lumaRightCorners);
+    float subPixelOffset1 = clamp(abs(lumaAverage - lumaCentre) / lumaRange, 0.0, 1.0);
+    float subPixelOffset2 = (-2.0 * subPixelOffset1 + 3.0) * subPixelOffset1 * subPixelOffset1;
+    pixelOffset = max(pixelOffset, subPixelOffset2 * subPixelOffset2 * SUBPIXEL_QUALITY);
+
+    vec2 finalUv = centreUv;
+    if(isHorizontal)
+        finalUv.y += pixelOffset * stepLength;
+    else
+        finalUv.x += pixelOffset * stepLength;
+    FragColour = vec4(texture(scene, finalUv).rgb, 1.0);
+}
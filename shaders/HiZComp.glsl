@@ -0,0 +1,64 @@
+#version 430 core
+
+/// @file HiZComp.glsl
+/// @brief builds one level of the hierarchical depth buffer used by CullComp.glsl. Each texel
+/// keeps the farthest depth of the texels it covers in the level above so an object is only
+/// rejected if it is behind everything in its screen rectangle. Level 0 is a straight copy of
+/// the scene depth texture.
+
+layout (local_size_x=8, local_size_y=8) in;
+
+// the level we read from (or the scene depth texture when copyDepth is set)
+layout (binding=7) uniform sampler2D srcDepth;
+uniform int srcLevel;
+
+layout (r32f, binding=0) writeonly uniform image2D dstLevel;
+
+uniform bool copyDepth = false;
+// the fraction of the scene depth texture rendered into, below 1 with dynamic resolution
+uniform vec2 depthScale = vec2(1.0);
+
+void main()
+{
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 dstSize = imageSize(dstLevel);
+    if(any(greaterThanEqual(p, dstSize)))
+        return;
+
+    if(copyDepth)
+    {
+        if(depthScale == vec2(1.0))
+        {
+            imageStore(dstLevel, p, vec4(texelFetch(srcDepth, p, 0).r));
+            return;
+        }
+        // stretch the rendered region over the full pyramid, keeping the farthest of the source
+        // texels around this one so an upscaled occluder edge never covers more than it did
+        vec2 src = (vec2(p) + 0.5) * depthScale;
+        ivec2 srcMax = ivec2(ceil(vec2(dstSize) * depthScale)) - 1;
+        ivec2 lo = clamp(ivec2(floor(src - 0.5)), ivec2(0), srcMax);
+        ivec2 hi = clamp(lo + 1, ivec2(0), srcMax);
+        float farthest = max(max(texelFetch(srcDepth, lo, 0).r, texelFetch(srcDepth, ivec2(hi.x, lo.y), 0).r),
+                             max(texelFetch(srcDepth, ivec2(lo.x, hi.y), 0).r, texelFetch(srcDepth, hi, 0).r));
+        imageStore(dstLevel, p, vec4(farthest));
+        return;
+    }
+
+    ivec2 srcSize = textureSize(srcDepth, srcLevel);
+    ivec2 start = p * 2;
+    // the last row / column also picks up the odd texel left over from a non power of two level
+    ivec2 end = start + 2;
+    if(p.x == dstSize.x - 1) end.x = srcSize.x;
+    if(p.y == dstSize.y - 1) end.y = srcSize.y;
+    end = min(end, srcSize);
+
+    float farthest = 0.0;
+    for(int y=start.y; y<end.y; ++y)
+    {
+        for(int x=start.x; x<end.x; ++x)
+        {
+            farthest = max(farthest, texelFetch(srcDepth, ivec2(x, y), srcLevel).r);
+        }
+    }
+    imageStore(dstLevel, p, vec4(farthest));
+}
@@ -0,0 +1,11 @@
+#version 430 core
+
+/// @file ShadowAtlasFrag.glsl
+/// @brief stores linear depth so perspective and orthographic views can be filtered the same way
+
+in float LinearDepth;
+
+void main()
+{
+    gl_FragDepth = LinearDepth;
+}
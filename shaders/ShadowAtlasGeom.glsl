@@ -0,0 +1,48 @@
+#version 430 core
+
+/// @file ShadowAtlasGeom.glsl
+/// @brief sends each triangle to every shadow view in one pass, one invocation per view picks the
+/// view's layer of the atlas and its viewport, so the scene is only submitted once
+
+// MAX_VIEWS matches ShadowAtlas::MAX_VIEWS
+#define MAX_VIEWS 8
+layout (triangles, invocations=MAX_VIEWS) in;
+layout (triangle_strip, max_vertices=3) out;
+
+uniform int viewCount;
+uniform mat4 viewVP[MAX_VIEWS];
+uniform vec4 viewDepthPlane[MAX_VIEWS];
+uniform int viewLayer[MAX_VIEWS];
+
+// the depth between the view's near (0) and far (1) planes
+out float LinearDepth;
+
+void main()
+{
+    int view = gl_InvocationID;
+    if(view >= viewCount)
+        return;
+    vec4 clip[3];
+    for(int i = 0; i < 3; ++i)
+    {
+        clip[i] = viewVP[view] * gl_in[i].gl_Position;
+    }
+    // most triangles miss most views, drop the ones wholly outside a clip plane
+    vec3 w = vec3(clip[0].w, clip[1].w, clip[2].w);
+    vec3 x = vec3(clip[0].x, clip[1].x, clip[2].x);
+    vec3 y = vec3(clip[0].y, clip[1].y, clip[2].y);
+    vec3 z = vec3(clip[0].z, clip[1].z, clip[2].z);
+    if(all(lessThan(x, -w)) || all(greaterThan(x, w)) ||
+       all(lessThan(y, -w)) || all(greaterThan(y, w)) ||
+       all(lessThan(z, -w)) || all(greaterThan(z, w)))
+        return;
+    for(int i = 0; i < 3; ++i)
+    {
+        gl_Position = clip[i];
+        gl_Layer = viewLayer[view];
+        gl_ViewportIndex = view;
+        LinearDepth = dot(viewDepthPlane[view], gl_in[i].gl_Position);
+        EmitVertex();
+    }
+    EndPrimitive();
+}
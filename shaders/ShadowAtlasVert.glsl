@@ -0,0 +1,35 @@
+#version 430 core
+
+/// @file ShadowAtlasVert.glsl
+/// @brief world space positions for the layered shadow pass, the geometry shader projects them
+/// into every view
+
+/// @brief the model matrix of a primitive object, instances take theirs from the instance buffer
+uniform mat4 M;
+uniform bool instanced = false;
+/// @brief rebuilds the model space position from the quantised one, 0 and 1 for float vertices
+uniform vec3 positionOffset = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
+
+layout (location=0) in vec3 inPosition;
+// the instance id from the culled visible list (only used when instanced)
+layout (location=3) in uint inInstance;
+
+// Per instance data, matches CanVert.glsl
+struct InstanceData
+{
+    mat4 M;
+    mat3 N;
+    uint label;
+};
+
+layout (std430, binding=0) readonly buffer Instances
+{
+    InstanceData instances[];
+};
+
+void main()
+{
+    vec4 inVert = vec4(positionOffset + inPosition * positionScale, 1.0);
+    gl_Position = (instanced ? instances[inInstance].M : M) * inVert;
+}
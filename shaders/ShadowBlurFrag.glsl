@@ -0,0 +1,29 @@
+#version 420 core
+
+/// @file ShadowBlurFrag.glsl
+/// @brief one direction of the separable gaussian blur of a layer of the shadow moments, run once
+/// along x and once along y. The moments are linear so the blurred values are still valid moments
+
+in vec2 TexCoords;
+layout (location=0) out vec4 outMoments;
+
+uniform sampler2DArray image;
+uniform int layer;
+// one texel along the blur direction in texture coordinates
+uniform vec2 texelStep;
+// the kernel reaches this many texels either side
+uniform int radius;
+
+void main()
+{
+    float sigma = max(float(radius) * 0.5, 0.5);
+    vec4 sum = textureLod(image, vec3(TexCoords, layer), 0.0);
+    float total = 1.0;
+    for(int i = 1; i <= radius; ++i)
+    {
+        float weight = exp(-float(i * i) / (2.0 * sigma * sigma));
+        sum += weight * (textureLod(image, vec3(TexCoords + texelStep * float(i), layer), 0.0) + textureLod(image, vec3(TexCoords - texelStep * float(i), layer), 0.0));
+        total += 2.0 * weight;
+    }
+    outMoments = sum / total;
+}
@@ -6,11 +6,9 @@
 in vec4 Colour;
 layout (location=0) out vec4 outColour;
 
-uniform sampler2D ShadowMap;
 uniform sampler2D textureMap;
 
 
-in vec4 ShadowCoord;
 in vec2 FragmentTexCoord;
 in vec3 FragmentNormal;
 in vec3 FragmentPosition;
@@ -26,7 +24,11 @@ struct LightInfo {
     float Quadratic;
 };
 
-uniform LightInfo Light[3];
+// written once a frame into the stream buffer
+layout (std140, binding=3) uniform Lights
+{
+    LightInfo Light[3];
+};
 
 struct MaterialInfo {
     vec3 Ka; // Ambient reflectivity
@@ -61,14 +63,73 @@ uniform sampler2D difMap;
 uniform sampler2D normMap;
 
 
-// A toggle allowing you to set it to reflect or refract the light
-uniform bool isReflect = true;
+// LIGHT_COUNT, SHADOW_FILTER, PLANAR_REFLECTION and NORMAL_MAP are defined by the ShaderVariants for each material
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT 3
+#define SHADOW_FILTER 1
+#define PLANAR_REFLECTION 0
+#define NORMAL_MAP 1
+#endif
+
+#if NORMAL_MAP
+in mat3 TBN;
+#endif
+
+// every light's views are tiles in the layers of the shadow atlas, 1 reads the raw depth, 2 (PCF)
+// goes through a comparison sampler and 3 (EVSM) reads the blurred moments of the same layout
+#if SHADOW_FILTER==2
+uniform sampler2DArrayShadow ShadowMap;
+#else
+uniform sampler2DArray ShadowMap;
+#endif
+
+// MAX_SHADOW_VIEWS matches ShadowAtlas::MAX_VIEWS, the views are loaded every frame by
+// NGLScene::prefilterShadows
+#define MAX_SHADOW_VIEWS 8
+uniform mat4 shadowVP[MAX_SHADOW_VIEWS];
+// dotted with the world position gives the linear depth the atlas stores
+uniform vec4 shadowDepthPlane[MAX_SHADOW_VIEWS];
+// the tile's offset in xy and size in zw, in atlas texture coordinates
+uniform vec4 shadowTile[MAX_SHADOW_VIEWS];
+uniform int shadowLayer[MAX_SHADOW_VIEWS];
+// a light's views are consecutive, six of them is a point light's cube faces
+uniform int shadowFirstView[3];
+uniform int shadowViewCount[3];
+uniform vec3 shadowLightPosition[3];
+
+uniform float shadowRadius = 2.0;
+// turns added to the PCF disc's rotation, changed every frame while a still is accumulated
+uniform float shadowKernelRotation = 0.0;
+uniform float shadowTexelSize = 1.0 / 1024.0;
+uniform float shadowBias = 0.0005;
+uniform vec2 evsmExponents = vec2(40.0, 5.0);
+uniform float lightBleedReduction = 0.2;
+// the moments mips mix neighbouring tiles past this level
+uniform float shadowMaxLod = 3.0;
+// how dark the shadows get
+const float shadowAmbient = 0.4;
+
+in vec3 WorldPosition;
+
+#if PLANAR_REFLECTION
+// the scene mirrored in this surface, drawn by NGLScene::renderReflection at a fraction of the
+// scene resolution with a mip chain for the rough blur
+uniform sampler2D reflectionMap;
+uniform float reflectionStrength = 1.0;
+// gl_FragCoord to reflection texture coordinates and the furthest the pass drew to
+uniform vec2 reflectionScale;
+uniform vec2 reflectionMaxUV;
+uniform float reflectionMaxLod = 5.0;
+// the mirror's world normal and offset and the eye, both in world space
+uniform vec4 reflectionPlane;
+uniform vec3 reflectionEye;
+// normal incidence reflectance of a dielectric
+const float reflectance = 0.04;
+#endif
 
 // Specify the refractive index for refractions
 uniform float refractiveIndex = 1.0;
 
-float shadeAmount = 4.0;
-
 //________________________________________________________________________________________________________________________________________//
 
 
@@ -110,14 +171,111 @@ vec3 BlinnPhong(int lightIndex, vec3 _n, vec3 _v)
 }
 
 
+//________________________________________________________________________________________________________________________________________//
+
+#if SHADOW_FILTER>=1
+
+#if SHADOW_FILTER==2
+// 16 taps spread evenly over the unit disc
+const int POISSON_TAPS = 16;
+const vec2 poissonDisk[POISSON_TAPS] = vec2[](
+    vec2(-0.94201624, -0.39906216), vec2(0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870), vec2(0.34495938, 0.29387760),
+    vec2(-0.91588581, 0.45771432), vec2(-0.81544232, -0.87912464),
+    vec2(-0.38277543, 0.27676845), vec2(0.97484398, 0.75648379),
+    vec2(0.44323325, -0.97511554), vec2(0.53742981, -0.47373420),
+    vec2(-0.26496911, -0.41893023), vec2(0.79197514, 0.19090188),
+    vec2(-0.24188840, 0.99706507), vec2(-0.81409955, 0.91437590),
+    vec2(0.19984126, 0.78641367), vec2(0.14383161, -0.14100790));
+#elif SHADOW_FILTER==3
+float chebyshev(vec2 _moments, float _mean, float _minVariance)
+{
+    float variance = max(_moments.y - _moments.x * _moments.x, _minVariance);
+    float d = _mean - _moments.x;
+    float pMax = variance / (variance + d * d);
+    // cut off the tail of the bound, that is where the light bleeding comes from
+    pMax = clamp((pMax - lightBleedReduction) / (1.0 - lightBleedReduction), 0.0, 1.0);
+    return _mean <= _moments.x ? 1.0 : pMax;
+}
+#endif
+
+// the fraction of a light reaching this fragment, every filter is a fixed number of taps
+float lightVisibility(int _light)
+{
+    int count = shadowViewCount[_light];
+    if(count == 0)
+        return 1.0;
+    int view = shadowFirstView[_light];
+    if(count == 6)
+    {
+        // the cube face is the major axis of the direction from the light
+        vec3 d = WorldPosition - shadowLightPosition[_light];
+        vec3 a = abs(d);
+        if(a.x >= a.y && a.x >= a.z)
+            view += d.x >= 0.0 ? 0 : 1;
+        else if(a.y >= a.z)
+            view += d.y >= 0.0 ? 2 : 3;
+        else
+            view += d.z >= 0.0 ? 4 : 5;
+    }
+    vec4 clip = shadowVP[view] * vec4(WorldPosition, 1.0);
+    if(clip.w <= 0.0)
+        return 1.0;
+    vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+    float depth = dot(shadowDepthPlane[view], vec4(WorldPosition, 1.0));
+    if(any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0))) || depth > 1.0)
+        return 1.0;
+    vec4 tile = shadowTile[view];
+    vec2 atlasUV = tile.xy + uv * tile.zw;
+    // keep every tap inside the tile so neighbouring views never bleed in
+    vec2 lo = tile.xy + vec2(0.5 * shadowTexelSize);
+    vec2 hi = tile.xy + tile.zw - vec2(0.5 * shadowTexelSize);
+    float layer = float(shadowLayer[view]);
+#if SHADOW_FILTER==1
+    float stored = texelFetch(ShadowMap, ivec3(clamp(atlasUV, lo, hi) / shadowTexelSize, shadowLayer[view]), 0).r;
+    return depth - shadowBias > stored ? 0.0 : 1.0;
+#elif SHADOW_FILTER==2
+    // rotate the disc per pixel with interleaved gradient noise, the banding of a fixed kernel
+    // turns into fine noise the TAA and blur passes smooth out
+    float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))) + shadowKernelRotation);
+    mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+    vec2 scale = vec2(shadowRadius * shadowTexelSize);
+    float lit = 0.0;
+    for(int i = 0; i < POISSON_TAPS; ++i)
+    {
+        vec2 tap = clamp(atlasUV + rotation * poissonDisk[i] * scale, lo, hi);
+        lit += texture(ShadowMap, vec4(tap, layer, depth - shadowBias));
+    }
+    return lit / float(POISSON_TAPS);
+#else
+    // one trilinear tap of the prefiltered moments whatever the penumbra size
+    float lod = min(textureQueryLod(ShadowMap, atlasUV).y, shadowMaxLod);
+    vec4 moments = textureLod(ShadowMap, vec3(clamp(atlasUV, lo, hi), layer), lod);
+    float warpDepth = depth * 2.0 - 1.0;
+    vec2 warped = vec2(exp(evsmExponents.x * warpDepth), -exp(-evsmExponents.y * warpDepth));
+    // the smallest variance allowed grows with the warp's slope so both moments get the same bias
+    vec2 depthScale = 0.0001 * evsmExponents * warped;
+    vec2 minVariance = depthScale * depthScale;
+    float positive = chebyshev(moments.xy, warped.x, minVariance.x);
+    float negative = chebyshev(moments.zw, warped.y, minVariance.y);
+    return min(positive, negative);
+#endif
+}
+
+#endif
+
 //________________________________________________________________________________________________________________________________________//
 
 
 void main ()
 {
 
-    // Calculate the normal (this is the expensive bit in Phong)
+    // Calculate the normal (this is the expensive bit in Phong), the normal map tiles with the diffuse
+#if NORMAL_MAP
+    vec3 n = normalize(TBN * (texture(normMap, FragmentTexCoord*10).rgb * 2.0 - 1.0));
+#else
     vec3 n = FragmentNormal;
+#endif
 
     // Calculate the eye vector
     vec3 v = normalize(vec3(-FragmentPosition));
@@ -125,19 +283,29 @@ void main ()
     vec4 woodDiffuse = texture(difMap, FragmentTexCoord*10);
 
 
-    float shadeFactor=textureProj(ShadowMap,ShadowCoord).x;
-    shadeFactor *= pow(shadeFactor, shadeAmount);
-
-
-
     vec3 lightIntensity = vec3(0.0);
-    for(int i = 0; i<3; ++i)
+    for(int i = 0; i<LIGHT_COUNT; ++i)
     {
         //   lightIntensity += Microfacet(i, n, v, texturedCan, colour);
+#if SHADOW_FILTER==0
         lightIntensity += BlinnPhong(i, n, v);
+#else
+        // each light is only darkened by its own shadow
+        lightIntensity += BlinnPhong(i, n, v) * mix(shadowAmbient, 1.0, lightVisibility(i));
+#endif
     }
 
-    outColour= shadeFactor * vec4(lightIntensity, 1.0) * woodDiffuse;
+    outColour= vec4(lightIntensity, 1.0) * woodDiffuse;
+
+#if PLANAR_REFLECTION
+    // the mirror image is at this pixel, rougher surfaces read a blurrier mip
+    vec2 reflectionUV = min(gl_FragCoord.xy * reflectionScale, reflectionMaxUV);
+    vec3 reflection = textureLod(reflectionMap, reflectionUV, Material.Roughness * reflectionMaxLod).rgb;
+    // Schlick fresnel, grazing views see more of the mirror and rough ones less
+    float cosView = max(dot(reflectionPlane.xyz, normalize(reflectionEye - WorldPosition)), 0.0);
+    float fresnel = reflectance + (1.0 - reflectance) * pow(1.0 - cosView, 5.0);
+    outColour.rgb = mix(outColour.rgb, reflection, fresnel * (1.0 - Material.Roughness) * reflectionStrength);
+#endif
 
 }
 
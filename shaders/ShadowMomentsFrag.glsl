@@ -0,0 +1,24 @@
+#version 420 core
+
+/// @file ShadowMomentsFrag.glsl
+/// @brief turn one layer of the shadow atlas into exponential variance moments. The atlas already
+/// holds linear depth, it is warped by a positive and a negative exponential and stored with its
+/// square so the moments can be blurred and mipmapped
+
+in vec2 TexCoords;
+layout (location=0) out vec4 outMoments;
+
+uniform sampler2DArray depthMap;
+uniform int layer;
+// the positive and negative warp exponents
+uniform vec2 exponents;
+
+void main()
+{
+    float linear = texelFetch(depthMap, ivec3(gl_FragCoord.xy, layer), 0).r;
+    // warp from [-1,1] so both exponentials have the same range either side of zero
+    float depth = linear * 2.0 - 1.0;
+    float positive = exp(exponents.x * depth);
+    float negative = -exp(-exponents.y * depth);
+    outMoments = vec4(positive, positive * positive, negative, negative * negative);
+}
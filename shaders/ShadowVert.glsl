@@ -1,39 +1,95 @@
 #version 420 core
 
+// MULTI_VIEW is defined by the ShaderVariants, the turntable draws every view in one submission
+#ifndef MULTI_VIEW
+#define MULTI_VIEW 0
+#endif
+#if MULTI_VIEW
+#extension GL_ARB_shader_viewport_layer_array : require
+// The views of the turntable, instance i is drawn into view firstView + i % viewCount and the
+// layer of the target with the same index
+layout (std140, binding=0) uniform TurntableViews
+{
+    mat4 viewV[64];
+    mat4 viewVP[64];
+    vec4 viewEye[64];
+};
+uniform int viewCount = 1;
+uniform int firstView = 0;
+#endif
+
 /// modified from the OpenGL Shading Language Example "Orange Book"
 /// Roost 2002
 
-uniform mat4 MV;
-uniform mat4 MVP;
-uniform mat3 normalMatrix;
-uniform mat4 textureMatrix;
+// The object's matrices, written into the stream buffer per object (see StreamBuffer.h)
+layout (std140, binding=2) uniform ObjectMatrices
+{
+    mat4 MV;
+    mat4 MVP;
+    // the model matrix, the shadow lookups are done in world space
+    mat4 M;
+    mat3 normalMatrix;
+};
 uniform vec3 LightPosition;
 uniform  vec4  inColour;
+// Rebuilds the model space position from the quantised one, 0 and 1 for float vertices
+uniform vec3 positionOffset = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
 
 
-layout (location=0) in  vec4  inVert;
+layout (location=0) in  vec3  inPosition;
 layout (location=1) in vec2 inUV;
 layout (location=2) in  vec3  inNormal;
+// the tangent with the bitangent sign in w, built with the mesh
+layout (location=4) in  vec4  inTangent;
+
+// NORMAL_MAP is defined by the ShaderVariants, see ShadowFrag.glsl
+#ifndef NORMAL_MAP
+#define NORMAL_MAP 1
+#endif
 
-out vec4  ShadowCoord;
+out vec3  WorldPosition;
 out vec4  Colour;
 out vec2 FragmentTexCoord;
 out vec3 FragmentNormal;
+out vec3 FragmentPosition;
+#if NORMAL_MAP
+// tangent space to view space, the columns are the tangent, bitangent and normal
+out mat3 TBN;
+#endif
 //out vec2 FragmentTexCoord;
 void main()
 {
-        vec4 ecPosition = MV * inVert;
+#if MULTI_VIEW
+        // the object's matrices come from the view, the model is rigid so MV gives the normals
+        int view = firstView + gl_InstanceID % viewCount;
+        mat4 modelView = viewV[view] * M;
+        mat4 modelViewProjection = viewVP[view] * M;
+        mat3 normalTransform = mat3(modelView);
+        gl_Layer = view;
+#else
+        mat4 modelView = MV;
+        mat4 modelViewProjection = MVP;
+        mat3 normalTransform = normalMatrix;
+#endif
+        vec4 inVert = vec4(positionOffset + inPosition * positionScale, 1.0);
+        vec4 ecPosition = modelView * inVert;
 	vec3 ecPosition3 = (vec3(ecPosition)) / ecPosition.w;
 	vec3 VP = LightPosition - ecPosition3;
 	VP = normalize(VP);
-	vec3 normal = normalize(normalMatrix * inNormal);
+	vec3 normal = normalize(normalTransform * inNormal);
 	float diffuse = max(0.0, dot(normal, VP));
-	vec4 texCoord = textureMatrix * inVert;
-	      ShadowCoord   = texCoord;
+	WorldPosition = vec3(M * inVert);
 				FragmentTexCoord = inUV;
-        FragmentNormal = normalize(normalMatrix * inNormal);
+        FragmentNormal = normalize(normalTransform * inNormal);
+        FragmentPosition = ecPosition3;
+#if NORMAL_MAP
+        // the same frame the cans use, the tangent follows the surface so it takes MV
+        vec3 T = normalize(mat3(modelView) * inTangent.xyz);
+        TBN = mat3(T, inTangent.w * cross(FragmentNormal, T), FragmentNormal);
+#endif
 
 	Colour  = vec4(diffuse * inColour.rgb, inColour.a);
-        gl_Position    = MVP * inVert;
+        gl_Position    = modelViewProjection * inVert;
 }
 
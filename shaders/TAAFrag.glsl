@@ -0,0 +1,79 @@
+#version 420 core
+
+/// @file TAAFrag.glsl
+/// @brief temporal anti-aliasing resolve, the projection is jittered by a sub pixel offset every
+/// frame and the result is blended into a history buffer reprojected from depth. The history is
+/// clipped to the colour range of the current 3x3 neighbourhood so disocclusions and lighting
+/// changes don't ghost
+
+in vec2 TexCoords;
+out vec4 FragColour;
+
+uniform sampler2D scene;
+uniform sampler2D depth;
+uniform sampler2D history;
+
+// the unjittered camera matrices for this frame (inverted) and last frame
+uniform mat4 inverseVP;
+uniform mat4 prevVP;
+// this frame's jitter in texture coordinates
+uniform vec2 jitter;
+uniform vec2 texelSize;
+// the fraction of the textures the scene was rendered into, below 1 with dynamic resolution
+uniform vec2 uvScale = vec2(1.0);
+// how much of the history to keep each frame
+uniform float feedback = 0.9;
+uniform bool historyValid = false;
+
+// clipping in YCoCg keeps the box tight around the luma
+vec3 RGBToYCoCg(vec3 _c)
+{
+    return vec3(dot(_c, vec3(0.25, 0.5, 0.25)), dot(_c, vec3(0.5, 0.0, -0.5)), dot(_c, vec3(-0.25, 0.5, -0.25)));
+}
+
+vec3 YCoCgToRGB(vec3 _c)
+{
+    return vec3(_c.x + _c.y - _c.z, _c.x + _c.z, _c.x - _c.y - _c.z);
+}
+
+void main()
+{
+    // the jittered image is offset from the pixel centre, sample where this pixel's surface landed
+    vec2 uv = (TexCoords + jitter) * uvScale;
+    vec3 current = RGBToYCoCg(texture(scene, uv).rgb);
+
+    // neighbourhood mean and variance for the clipping box, and the nearest depth so the
+    // foreground edge is reprojected with its own motion
+    vec3 m1 = vec3(0.0);
+    vec3 m2 = vec3(0.0);
+    float closest = 1.0;
+    for(int y = -1; y <= 1; ++y)
+    {
+        for(int x = -1; x <= 1; ++x)
+        {
+            vec2 sampleUv = uv + vec2(x, y) * texelSize;
+            vec3 c = RGBToYCoCg(texture(scene, sampleUv).rgb);
+            m1 += c;
+            m2 += c * c;
+            closest = min(closest, texture(depth, sampleUv).r);
+        }
+    }
+    vec3 mean = m1 / 9.0;
+    vec3 sigma = sqrt(max(m2 / 9.0 - mean * mean, 0.0));
+    vec3 boxMin = min(mean - 1.25 * sigma, current);
+    vec3 boxMax = max(mean + 1.25 * sigma, current);
+
+    // back to world space with this frame's matrix then forward with last frame's
+    vec4 world = inverseVP * vec4(TexCoords * 2.0 - 1.0, closest * 2.0 - 1.0, 1.0);
+    world /= world.w;
+    vec4 prevClip = prevVP * world;
+    vec2 prevUv = prevClip.xy / prevClip.w * 0.5 + 0.5;
+
+    vec3 result = current;
+    if(historyValid && all(greaterThanEqual(prevUv, vec2(0.0))) && all(lessThanEqual(prevUv, vec2(1.0))))
+    {
+        vec3 previous = clamp(RGBToYCoCg(texture(history, prevUv * uvScale).rgb), boxMin, boxMax);
+        result = mix(current, previous, feedback);
+    }
+    FragColour = vec4(YCoCgToRGB(result), 1.0);
+}
@@ -0,0 +1,34 @@
+#version 430 core
+
+/// @file ThumbnailComp.glsl
+/// @brief shrinks layers of the turntable target into thumbnails, each texel is the average of the
+/// 4x4 block of the target it covers. The layer is the z of the dispatch so every view of a
+/// turntable is resolved in one dispatch, or one at a time with a single layer.
+
+layout (local_size_x=8, local_size_y=8) in;
+
+// the turntable colour, one layer per view
+layout (binding=7) uniform sampler2DArray turntable;
+
+layout (rgba8, binding=0) writeonly uniform image2DArray thumbnails;
+
+uniform int firstLayer = 0;
+
+const int FACTOR = 4;
+
+void main()
+{
+    ivec3 p = ivec3(gl_GlobalInvocationID.xy, int(gl_GlobalInvocationID.z) + firstLayer);
+    if(any(greaterThanEqual(p.xy, imageSize(thumbnails).xy)))
+        return;
+
+    vec4 sum = vec4(0.0);
+    for(int y=0; y<FACTOR; ++y)
+    {
+        for(int x=0; x<FACTOR; ++x)
+        {
+            sum += texelFetch(turntable, ivec3(p.xy * FACTOR + ivec2(x, y), p.z), 0);
+        }
+    }
+    imageStore(thumbnails, p, sum / float(FACTOR * FACTOR));
+}
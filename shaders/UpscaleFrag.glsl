@@ -0,0 +1,33 @@
+#version 420 core
+
+/// @file UpscaleFrag.glsl
+/// @brief bilinear upscale of the reduced resolution scene to the full size target with a
+/// contrast limited unsharp mask to win back some of the detail the lower scale loses
+
+in vec2 TexCoords;
+out vec4 FragColour;
+
+uniform sampler2D scene;
+// the fraction of the texture the scene was rendered into
+uniform vec2 uvScale;
+// one texel of the source texture in texture coordinates
+uniform vec2 texelSize;
+// 0 is a plain bilinear upscale
+uniform float sharpness;
+
+void main()
+{
+    // stay half a texel inside the rendered region so the filter never reads stale texels
+    vec2 uv = min(TexCoords * uvScale, uvScale - 0.5 * texelSize);
+    vec3 centre = texture(scene, uv).rgb;
+    vec3 up     = texture(scene, uv + vec2(0.0, texelSize.y)).rgb;
+    vec3 down   = texture(scene, uv - vec2(0.0, texelSize.y)).rgb;
+    vec3 right  = texture(scene, min(uv + vec2(texelSize.x, 0.0), uvScale - 0.5 * texelSize)).rgb;
+    vec3 left   = texture(scene, uv - vec2(texelSize.x, 0.0)).rgb;
+
+    vec3 sharpened = centre + sharpness * (4.0 * centre - up - down - left - right);
+    // limiting to the local range stops halos around the can edges
+    vec3 lo = min(centre, min(min(up, down), min(left, right)));
+    vec3 hi = max(centre, max(max(up, down), max(left, right)));
+    FragColour = vec4(clamp(sharpened, lo, hi), 1.0);
+}
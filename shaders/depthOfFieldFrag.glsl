@@ -83,7 +83,10 @@ in vec2 TexCoords;
 uniform sampler2D image;
 uniform sampler2D depth;
 //uniform sampler2D image2;
-uniform bool horizontal;
+// one program per direction, BLUR_HORIZONTAL is defined by the ShaderVariants
+#ifndef BLUR_HORIZONTAL
+#define BLUR_HORIZONTAL 1
+#endif
 
 float focalDepth = 0.5;
 float blurRadius = 0.8;
@@ -101,7 +104,7 @@ void main()
      vec2 tex_offset = 1.0 / textureSize(image, 0); // gets size of single texel
      vec3 result = texture(image, TexCoords).rgb * weight[0];
      vec2 samplepos;
-     if(horizontal)
+#if BLUR_HORIZONTAL
      {
          for(int i = 1; i < 5; ++i)
          {
@@ -110,7 +113,7 @@ void main()
             result += texture(image, TexCoords - vec2(tex_offset.x * i, 0.0)).rgb * weight[i] ;//* samplepos.y ;//* depthBlur;//*sigma;
          }
      }
-     else
+#else
      {
          for(int i = 1; i < 5; ++i)
          {
@@ -119,6 +122,7 @@ void main()
              result += texture(image, TexCoords - vec2(0.0, tex_offset.y * i)).rgb * weight[i] ;//* samplepos.y;// * depthBlur;//*sigma;
          }
      }
+#endif
      FragColour = vec4(result, 1.0) * clamp(samplepos.yyyy, 0, 1);
      FragColour = texture(depth, TexCoords);
  //    FragColour = texture(image, TexCoords);
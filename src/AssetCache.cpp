@@ -0,0 +1,579 @@
+#include "AssetCache.h"
+#include "IndexedMesh.h"
+#include "ProgramCache.h"
+#include <ngl/Image.h>
+#include <ngl/Obj.h>
+#include <QDir>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_set>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief identifies an entry and its layout, bump the version if the layout changes
+//----------------------------------------------------------------------------------------------------------------------
+constexpr uint32_t ASSET_MAGIC=0x31534143; // "CAS1"
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief sections start on a cache line so the vertex and pixel data can be read in place
+//----------------------------------------------------------------------------------------------------------------------
+constexpr size_t SECTION_ALIGNMENT=64;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the decoders' versions, part of the key so a change to one never maps the old layout
+//----------------------------------------------------------------------------------------------------------------------
+constexpr const char *IMAGE_KIND="image.v1";
+constexpr const char *MESH_KIND="mesh.v2";
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the start of every entry, the sections follow at the offsets given
+//----------------------------------------------------------------------------------------------------------------------
+struct AssetHeader
+{
+  uint32_t magic;
+  uint32_t sections;
+  uint64_t key;
+  uint64_t total;
+  uint32_t meta[AssetCache::META_COUNT];
+  uint64_t offsets[AssetCache::MAX_SECTIONS];
+  uint64_t sizes[AssetCache::MAX_SECTIONS];
+};
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the whole of a binary file, false if it can't be read
+//----------------------------------------------------------------------------------------------------------------------
+static bool readFile(const std::string &_file, std::string &o_data)
+{
+  std::ifstream in(_file,std::ios::binary);
+  if(!in.is_open())
+  {
+    return false;
+  }
+  std::stringstream buffer;
+  buffer<<in.rdbuf();
+  o_data=buffer.str();
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the file name a key is stored under, without the extension
+//----------------------------------------------------------------------------------------------------------------------
+static std::string keyName(uint64_t _key)
+{
+  char name[32];
+  std::snprintf(name,sizeof(name),"%016llx",static_cast<unsigned long long>(_key));
+  return name;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the entry key a source record names, false if there is no record
+//----------------------------------------------------------------------------------------------------------------------
+static bool readSourceKey(const std::string &_path, uint64_t &o_key)
+{
+  std::ifstream in(_path,std::ios::binary);
+  return in.read(reinterpret_cast<char *>(&o_key),sizeof(uint64_t)).gcount()==sizeof(uint64_t);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief record the entry key for a source, renamed into place so a reader never sees half of it
+//----------------------------------------------------------------------------------------------------------------------
+static void writeSourceKey(const std::string &_path, uint64_t _key)
+{
+  std::string temp=_path+"."+std::to_string(getpid())+".tmp";
+  {
+    std::ofstream out(temp,std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&_key),sizeof(uint64_t));
+    if(!out.good())
+    {
+      out.close();
+      unlink(temp.c_str());
+      return;
+    }
+  }
+  if(std::rename(temp.c_str(),_path.c_str())!=0)
+  {
+    unlink(temp.c_str());
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief lay a decoded asset out as it is stored, header then aligned sections
+//----------------------------------------------------------------------------------------------------------------------
+static std::vector<char> serialise(uint64_t _key, const AssetCache::Decoded &_decoded)
+{
+  AssetHeader header;
+  std::memset(&header,0,sizeof(AssetHeader));
+  header.magic=ASSET_MAGIC;
+  header.key=_key;
+  header.sections=static_cast<uint32_t>(std::min<size_t>(_decoded.sections.size(),AssetCache::MAX_SECTIONS));
+  std::copy(_decoded.meta,_decoded.meta+AssetCache::META_COUNT,header.meta);
+  size_t offset=(sizeof(AssetHeader)+SECTION_ALIGNMENT-1)/SECTION_ALIGNMENT*SECTION_ALIGNMENT;
+  for(uint32_t i=0; i<header.sections; ++i)
+  {
+    header.offsets[i]=offset;
+    header.sizes[i]=_decoded.sections[i].size();
+    offset+=(header.sizes[i]+SECTION_ALIGNMENT-1)/SECTION_ALIGNMENT*SECTION_ALIGNMENT;
+  }
+  header.total=offset;
+
+  std::vector<char> data(offset,0);
+  std::memcpy(data.data(),&header,sizeof(AssetHeader));
+  for(uint32_t i=0; i<header.sections; ++i)
+  {
+    if(header.sizes[i]>0)
+    {
+      std::memcpy(data.data()+header.offsets[i],_decoded.sections[i].data(),header.sizes[i]);
+    }
+  }
+  return data;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+template <typename T>
+static std::vector<uint8_t> toBytes(const std::vector<T> &_data)
+{
+  const uint8_t *begin=reinterpret_cast<const uint8_t *>(_data.data());
+  return std::vector<uint8_t>(begin,begin+_data.size()*sizeof(T));
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+AssetCache::Asset::~Asset()
+{
+  release();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+AssetCache::Asset::Asset(Asset &&_other) : m_fd(_other.m_fd), m_map(_other.m_map), m_size(_other.m_size)
+{
+  _other.m_fd=-1;
+  _other.m_map=nullptr;
+  _other.m_size=0;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+AssetCache::Asset &AssetCache::Asset::operator=(Asset &&_other)
+{
+  if(this!=&_other)
+  {
+    release();
+    std::swap(m_fd,_other.m_fd);
+    std::swap(m_map,_other.m_map);
+    std::swap(m_size,_other.m_size);
+  }
+  return *this;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void AssetCache::Asset::release()
+{
+  if(m_map!=nullptr)
+  {
+    munmap(m_map,m_size);
+    m_map=nullptr;
+    m_size=0;
+  }
+  // closing the last descriptor drops the shared lock, the entry can be evicted from then on
+  if(m_fd>=0)
+  {
+    ::close(m_fd);
+    m_fd=-1;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+uint32_t AssetCache::Asset::meta(int _i) const
+{
+  return static_cast<const AssetHeader *>(m_map)->meta[_i];
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+const uint8_t *AssetCache::Asset::section(int _i) const
+{
+  const AssetHeader *header=static_cast<const AssetHeader *>(m_map);
+  return static_cast<const uint8_t *>(m_map)+header->offsets[_i];
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+size_t AssetCache::Asset::sectionBytes(int _i) const
+{
+  return static_cast<size_t>(static_cast<const AssetHeader *>(m_map)->sizes[_i]);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+AssetCache::AssetCache(const std::string &_dir, size_t _budget) :
+  m_dir(_dir.empty() ? defaultDir() : _dir),
+  m_budget(_budget)
+{
+  QDir().mkpath(QString::fromStdString(m_dir));
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+std::string AssetCache::defaultDir()
+{
+  struct stat info;
+  if(stat("/dev/shm",&info)==0 && S_ISDIR(info.st_mode))
+  {
+    return "/dev/shm/can_assets";
+  }
+  return "cache/assets";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+AssetCache::Asset AssetCache::open(const std::string &_path, uint64_t _key)
+{
+  Asset asset;
+  int fd=::open(_path.c_str(),O_RDONLY | O_CLOEXEC);
+  if(fd<0)
+  {
+    return asset;
+  }
+  asset.m_fd=fd;
+  // blocks only while an eviction holds it, which then finds the entry unlinked
+  struct stat info;
+  if(flock(fd,LOCK_SH)!=0 || fstat(fd,&info)!=0 || info.st_nlink==0 ||
+     static_cast<size_t>(info.st_size)<sizeof(AssetHeader))
+  {
+    return asset;
+  }
+  void *map=mmap(nullptr,static_cast<size_t>(info.st_size),PROT_READ,MAP_SHARED,fd,0);
+  if(map==MAP_FAILED)
+  {
+    return asset;
+  }
+  const AssetHeader *header=static_cast<const AssetHeader *>(map);
+  if(header->magic!=ASSET_MAGIC || header->key!=_key || header->total!=static_cast<uint64_t>(info.st_size) ||
+     header->sections>MAX_SECTIONS)
+  {
+    munmap(map,static_cast<size_t>(info.st_size));
+    return asset;
+  }
+  asset.m_map=map;
+  asset.m_size=static_cast<size_t>(info.st_size);
+  // the modification time orders the eviction, set through the path as a descriptor opened read
+  // only may only touch files this user owns
+  utimensat(AT_FDCWD,_path.c_str(),nullptr,0);
+  return asset;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool AssetCache::publish(const std::string &_path, uint64_t _key, const Decoded &_decoded)
+{
+  std::vector<char> data=serialise(_key,_decoded);
+  std::string temp=_path+"."+std::to_string(getpid())+".tmp";
+  {
+    std::ofstream out(temp,std::ios::binary | std::ios::trunc);
+    if(!out.is_open())
+    {
+      return false;
+    }
+    out.write(data.data(),static_cast<std::streamsize>(data.size()));
+    if(!out.good())
+    {
+      out.close();
+      unlink(temp.c_str());
+      return false;
+    }
+  }
+  // a reader only ever sees the whole file, and an entry published first is never replaced
+  bool linked=link(temp.c_str(),_path.c_str())==0 || errno==EEXIST;
+  unlink(temp.c_str());
+  return linked;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+AssetCache::Asset AssetCache::acquire(const std::string &_kind, const std::string &_file, const Decoder &_decode)
+{
+  // the source's path, size and modification time name the entry it was last found in, so a hit
+  // never reads the file
+  struct stat info;
+  char resolved[PATH_MAX];
+  if(stat(_file.c_str(),&info)!=0)
+  {
+    std::cerr<<"AssetCache can't read "<<_file<<"\n";
+    ++m_stats.failures;
+    return Asset();
+  }
+  std::string source=realpath(_file.c_str(),resolved)!=nullptr ? std::string(resolved) : _file;
+  source+=":"+std::to_string(info.st_size)+":"+std::to_string(info.st_mtim.tv_sec)+"."+std::to_string(info.st_mtim.tv_nsec);
+  std::string sourcePath=m_dir+"/"+keyName(ProgramCache::hash(source,ProgramCache::hash(_kind)))+".source";
+  uint64_t key=0;
+  if(readSourceKey(sourcePath,key))
+  {
+    Asset asset=open(m_dir+"/"+keyName(key)+".asset",key);
+    if(asset.valid())
+    {
+      ++m_stats.hits;
+      m_stats.mappedBytes+=asset.bytes();
+      return asset;
+    }
+  }
+
+  // a new or changed file, or its entry was evicted, the contents say which entry it is
+  std::string bytes;
+  if(!readFile(_file,bytes))
+  {
+    std::cerr<<"AssetCache can't read "<<_file<<"\n";
+    ++m_stats.failures;
+    return Asset();
+  }
+  key=ProgramCache::hash(bytes,ProgramCache::hash(_kind));
+  std::string name=keyName(key);
+  std::string path=m_dir+"/"+name+".asset";
+
+  Asset asset=open(path,key);
+  if(asset.valid())
+  {
+    writeSourceKey(sourcePath,key);
+    ++m_stats.hits;
+    m_stats.mappedBytes+=asset.bytes();
+    return asset;
+  }
+
+  // only one process decodes a key, the rest wait here and then find it published
+  std::string lockPath=m_dir+"/"+name+".lock";
+  int lock=::open(lockPath.c_str(),O_RDWR | O_CREAT | O_CLOEXEC,0644);
+  if(lock>=0)
+  {
+    bool waited=false;
+    if(flock(lock,LOCK_EX | LOCK_NB)!=0)
+    {
+      auto start=std::chrono::steady_clock::now();
+      flock(lock,LOCK_EX);
+      m_stats.waitTime+=std::chrono::duration<float,std::milli>(std::chrono::steady_clock::now()-start).count();
+      waited=true;
+    }
+    // it may have been published between the first look and taking the lock
+    asset=open(path,key);
+    if(asset.valid())
+    {
+      ::close(lock);
+      writeSourceKey(sourcePath,key);
+      ++(waited ? m_stats.waits : m_stats.hits);
+      m_stats.mappedBytes+=asset.bytes();
+      return asset;
+    }
+  }
+
+  Decoded decoded;
+  auto start=std::chrono::steady_clock::now();
+  bool ok=_decode(_file,decoded);
+  m_stats.decodeTime+=std::chrono::duration<float,std::milli>(std::chrono::steady_clock::now()-start).count();
+  if(ok && lock>=0 && publish(path,key,decoded))
+  {
+    ++m_stats.misses;
+    asset=open(path,key);
+    // anyone still waiting on the lock finds the entry once it gets it, and anyone after opens
+    // the entry without needing one, so the lock file would only pile up
+    unlink(lockPath.c_str());
+  }
+  if(lock>=0)
+  {
+    ::close(lock);
+  }
+  if(!ok)
+  {
+    ++m_stats.failures;
+    return Asset();
+  }
+  if(asset.valid())
+  {
+    writeSourceKey(sourcePath,key);
+    m_stats.mappedBytes+=asset.bytes();
+    evict();
+    return asset;
+  }
+
+  // the directory can't be used, keep a private copy so the caller still gets its asset
+  ++m_stats.failures;
+  std::vector<char> data=serialise(key,decoded);
+  void *map=mmap(nullptr,data.size(),PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+  if(map!=MAP_FAILED)
+  {
+    std::memcpy(map,data.data(),data.size());
+    asset.m_map=map;
+    asset.m_size=data.size();
+  }
+  return asset;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void AssetCache::evict()
+{
+  struct Entry
+  {
+    std::string path;
+    size_t size;
+    struct timespec used;
+  };
+  std::vector<Entry> entries;
+  std::unordered_set<std::string> names;
+  std::vector<std::string> sources;
+  size_t total=0;
+  DIR *dir=opendir(m_dir.c_str());
+  if(dir==nullptr)
+  {
+    return;
+  }
+  while(struct dirent *item=readdir(dir))
+  {
+    std::string name=item->d_name;
+    if(name.size()>7 && name.compare(name.size()-7,7,".source")==0)
+    {
+      sources.push_back(m_dir+"/"+name);
+      continue;
+    }
+    if(name.size()<6 || name.compare(name.size()-6,6,".asset")!=0)
+    {
+      continue;
+    }
+    names.insert(name);
+    Entry entry;
+    entry.path=m_dir+"/"+name;
+    struct stat info;
+    if(stat(entry.path.c_str(),&info)!=0)
+    {
+      continue;
+    }
+    entry.size=static_cast<size_t>(info.st_size);
+    entry.used=info.st_mtim;
+    total+=entry.size;
+    entries.push_back(entry);
+  }
+  closedir(dir);
+  // a record whose entry has gone would only send its next lookup to the contents anyway
+  for(const auto &source : sources)
+  {
+    uint64_t key;
+    if(readSourceKey(source,key) && names.count(keyName(key)+".asset")==0)
+    {
+      unlink(source.c_str());
+    }
+  }
+  if(total<=m_budget)
+  {
+    return;
+  }
+
+  std::sort(entries.begin(),entries.end(),[](const Entry &_a, const Entry &_b)
+  {
+    return _a.used.tv_sec!=_b.used.tv_sec ? _a.used.tv_sec<_b.used.tv_sec : _a.used.tv_nsec<_b.used.tv_nsec;
+  });
+  for(const auto &entry : entries)
+  {
+    if(total<=m_budget)
+    {
+      break;
+    }
+    int fd=::open(entry.path.c_str(),O_RDONLY | O_CLOEXEC);
+    if(fd<0)
+    {
+      continue;
+    }
+    // any process still mapping it holds a shared lock, so this fails and it stays
+    if(flock(fd,LOCK_EX | LOCK_NB)==0)
+    {
+      unlink(entry.path.c_str());
+      total-=entry.size;
+      ++m_stats.evictions;
+    }
+    ::close(fd);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+AssetCache::Asset AssetCache::image(const std::string &_file)
+{
+  return acquire(IMAGE_KIND,_file,[](const std::string &_path, Decoded &o_decoded)
+  {
+    ngl::Image image(_path);
+    if(image.getPixels()==nullptr || image.width()==0 || image.height()==0)
+    {
+      return false;
+    }
+    size_t bytes=size_t(image.width())*image.height()*static_cast<size_t>(image.channels());
+    o_decoded.meta[0]=image.width();
+    o_decoded.meta[1]=image.height();
+    o_decoded.meta[2]=image.format();
+    o_decoded.meta[3]=static_cast<uint32_t>(image.channels());
+    o_decoded.sections.emplace_back(image.getPixels(),image.getPixels()+bytes);
+    return true;
+  });
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+std::unique_ptr<IndexedMesh> AssetCache::mesh(const std::string &_file, int _lods)
+{
+  // the levels change what is stored so they are part of the kind, and so are the sizes of the
+  // records mapped in place so a change to either layout never reads the old one
+  std::string kind=std::string(MESH_KIND)+":"+std::to_string(_lods)+":"+
+                   std::to_string(sizeof(IndexedMesh::Vertex))+":"+std::to_string(sizeof(IndexedMesh::LOD));
+  Asset asset=acquire(kind,_file,[_lods](const std::string &_path, Decoded &o_decoded)
+  {
+    ngl::Obj obj(_path);
+    IndexedMesh mesh(obj);
+    mesh.generateLODs(_lods);
+    o_decoded.sections.push_back(toBytes(mesh.vertices()));
+    o_decoded.sections.push_back(toBytes(mesh.indices()));
+    o_decoded.sections.push_back(toBytes(mesh.lods()));
+    o_decoded.meta[0]=static_cast<uint32_t>(mesh.tangentSplits());
+    return !mesh.vertices().empty();
+  });
+  if(!asset.valid())
+  {
+    return nullptr;
+  }
+  // the vectors are copied out, the mapping only needs to last until the mesh is built
+  return std::unique_ptr<IndexedMesh>(new IndexedMesh(
+           reinterpret_cast<const IndexedMesh::Vertex *>(asset.section(0)),asset.sectionBytes(0)/sizeof(IndexedMesh::Vertex),
+           reinterpret_cast<const GLuint *>(asset.section(1)),asset.sectionBytes(1)/sizeof(GLuint),
+           reinterpret_cast<const IndexedMesh::LOD *>(asset.section(2)),asset.sectionBytes(2)/sizeof(IndexedMesh::LOD),
+           asset.meta(0)));
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+std::string AssetCache::report() const
+{
+  std::ostringstream out;
+  out<<"assets "<<m_dir<<" "<<m_stats.hits<<" hits "<<m_stats.misses<<" decoded "<<m_stats.waits<<" waited ("
+     <<m_stats.waitTime<<" ms) decode "<<m_stats.decodeTime<<" ms, "<<m_stats.mappedBytes/1024<<" KB mapped, evicted "
+     <<m_stats.evictions<<" failures "<<m_stats.failures;
+  return out.str();
+}
@@ -0,0 +1,344 @@
+#include "BVH.h"
+#include <algorithm>
+#include <limits>
+// the leaf test is compiled for AVX on its own and only called when the CPU has it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BVH_AVX
+#include <immintrin.h>
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief all six frustum planes active
+//----------------------------------------------------------------------------------------------------------------------
+constexpr unsigned int ALL_PLANES=0x3f;
+
+#ifdef BVH_AVX
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief true if the CPU running us has AVX, asked once
+//----------------------------------------------------------------------------------------------------------------------
+static bool hasAVX()
+{
+  static const bool supported=__builtin_cpu_supports("avx");
+  return supported;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief test 8 spheres against the planes in _planeMask
+/// @returns a bit per sphere that is not outside any of them
+//----------------------------------------------------------------------------------------------------------------------
+__attribute__((target("avx"))) static unsigned int leafInsideAVX(const float *_cx, const float *_cy, const float *_cz, const float *_r,
+                                                                 const Frustum &_frustum, unsigned int _planeMask)
+{
+  __m256 cx=_mm256_loadu_ps(_cx);
+  __m256 cy=_mm256_loadu_ps(_cy);
+  __m256 cz=_mm256_loadu_ps(_cz);
+  __m256 negR=_mm256_sub_ps(_mm256_setzero_ps(),_mm256_loadu_ps(_r));
+  __m256 inside=_mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  for(int p=0; p<6; ++p)
+  {
+    if(!(_planeMask & (1u<<p)))
+    {
+      continue;
+    }
+    const ngl::Vec4 &pl=_frustum.planes[p];
+    __m256 d=_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(pl.m_x),cx),
+                                         _mm256_mul_ps(_mm256_set1_ps(pl.m_y),cy)),
+                           _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(pl.m_z),cz),
+                                         _mm256_set1_ps(pl.m_w)));
+    inside=_mm256_and_ps(inside,_mm256_cmp_ps(d,negR,_CMP_GE_OQ));
+  }
+  return static_cast<unsigned int>(_mm256_movemask_ps(inside));
+}
+#endif
+
+//________________________________________________________________________________________________________________________________________//
+
+void BVH::build(const SceneStore &_store)
+{
+  uint32_t n=_store.size();
+  m_nodes.clear();
+  m_nodes.reserve(2*(n/LEAF_SIZE+1));
+  m_cx.assign(n+LEAF_SIZE,0.0f);
+  m_cy.assign(n+LEAF_SIZE,0.0f);
+  m_cz.assign(n+LEAF_SIZE,0.0f);
+  m_r.assign(n+LEAF_SIZE,0.0f);
+  m_object.assign(n,0);
+  m_slot.assign(n,0);
+  m_leaf.assign(n,-1);
+  m_marked.assign(0,0);
+  if(n==0)
+  {
+    return;
+  }
+  std::vector<uint32_t> ids(n);
+  for(uint32_t i=0; i<n; ++i)
+  {
+    ids[i]=i;
+  }
+  buildRecursive(ids,0,n,-1,_store);
+  m_marked.assign(m_nodes.size(),0);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int32_t BVH::buildRecursive(std::vector<uint32_t> &_ids, uint32_t _first, uint32_t _count, int32_t _parent, const SceneStore &_store)
+{
+  int32_t index=static_cast<int32_t>(m_nodes.size());
+  Node node;
+  node.first=_first;
+  node.count=_count;
+  node.right=-1;
+  node.parent=_parent;
+  m_nodes.push_back(node);
+
+  if(_count<=LEAF_SIZE)
+  {
+    // copy the spheres into leaf order
+    for(uint32_t slot=_first; slot<_first+_count; ++slot)
+    {
+      uint32_t obj=_ids[slot];
+      m_object[slot]=obj;
+      m_slot[obj]=slot;
+      m_leaf[obj]=index;
+      m_cx[slot]=_store.centreX[obj];
+      m_cy[slot]=_store.centreY[obj];
+      m_cz[slot]=_store.centreZ[obj];
+      m_r[slot]=_store.radius[obj];
+    }
+    computeLeafBounds(m_nodes[index]);
+    return index;
+  }
+
+  // split at the median centre along the longest axis of the centres
+  float minC[3]={std::numeric_limits<float>::max(),std::numeric_limits<float>::max(),std::numeric_limits<float>::max()};
+  float maxC[3]={-std::numeric_limits<float>::max(),-std::numeric_limits<float>::max(),-std::numeric_limits<float>::max()};
+  const std::vector<float> *centres[3]={&_store.centreX,&_store.centreY,&_store.centreZ};
+  for(uint32_t i=_first; i<_first+_count; ++i)
+  {
+    for(int a=0; a<3; ++a)
+    {
+      float c=(*centres[a])[_ids[i]];
+      minC[a]=std::min(minC[a],c);
+      maxC[a]=std::max(maxC[a],c);
+    }
+  }
+  int axis=0;
+  if(maxC[1]-minC[1] > maxC[axis]-minC[axis]) axis=1;
+  if(maxC[2]-minC[2] > maxC[axis]-minC[axis]) axis=2;
+  const std::vector<float> &key=*centres[axis];
+  uint32_t mid=_first+_count/2;
+  std::nth_element(_ids.begin()+_first,_ids.begin()+mid,_ids.begin()+_first+_count,
+                   [&key](uint32_t _a, uint32_t _b){ return key[_a]<key[_b]; });
+
+  // left child is index+1 as the tree is stored depth first
+  buildRecursive(_ids,_first,mid-_first,index,_store);
+  int32_t right=buildRecursive(_ids,mid,_first+_count-mid,index,_store);
+
+  Node &n=m_nodes[index];
+  const Node &l=m_nodes[index+1];
+  const Node &r=m_nodes[right];
+  n.right=right;
+  n.minX=std::min(l.minX,r.minX); n.minY=std::min(l.minY,r.minY); n.minZ=std::min(l.minZ,r.minZ);
+  n.maxX=std::max(l.maxX,r.maxX); n.maxY=std::max(l.maxY,r.maxY); n.maxZ=std::max(l.maxZ,r.maxZ);
+  return index;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void BVH::computeLeafBounds(Node &_node) const
+{
+  _node.minX=_node.minY=_node.minZ=std::numeric_limits<float>::max();
+  _node.maxX=_node.maxY=_node.maxZ=-std::numeric_limits<float>::max();
+  for(uint32_t s=_node.first; s<_node.first+_node.count; ++s)
+  {
+    _node.minX=std::min(_node.minX,m_cx[s]-m_r[s]);
+    _node.minY=std::min(_node.minY,m_cy[s]-m_r[s]);
+    _node.minZ=std::min(_node.minZ,m_cz[s]-m_r[s]);
+    _node.maxX=std::max(_node.maxX,m_cx[s]+m_r[s]);
+    _node.maxY=std::max(_node.maxY,m_cy[s]+m_r[s]);
+    _node.maxZ=std::max(_node.maxZ,m_cz[s]+m_r[s]);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void BVH::refit(const SceneStore &_store)
+{
+  // mark each dirty object's leaf and its ancestors, stopping at nodes already marked
+  std::vector<int32_t> marked;
+  for(auto obj : _store.dirtyList)
+  {
+    if(obj>=m_slot.size() || m_leaf[obj]<0)
+    {
+      continue;
+    }
+    uint32_t slot=m_slot[obj];
+    m_cx[slot]=_store.centreX[obj];
+    m_cy[slot]=_store.centreY[obj];
+    m_cz[slot]=_store.centreZ[obj];
+    m_r[slot]=_store.radius[obj];
+    for(int32_t node=m_leaf[obj]; node>=0 && !m_marked[node]; node=m_nodes[node].parent)
+    {
+      m_marked[node]=1;
+      marked.push_back(node);
+    }
+  }
+  // children always come after their parent so refit from the highest index down
+  std::sort(marked.begin(),marked.end(),[](int32_t _a, int32_t _b){ return _a>_b; });
+  for(auto index : marked)
+  {
+    Node &n=m_nodes[index];
+    if(n.isLeaf())
+    {
+      computeLeafBounds(n);
+    }
+    else
+    {
+      const Node &l=m_nodes[index+1];
+      const Node &r=m_nodes[n.right];
+      n.minX=std::min(l.minX,r.minX); n.minY=std::min(l.minY,r.minY); n.minZ=std::min(l.minZ,r.minZ);
+      n.maxX=std::max(l.maxX,r.maxX); n.maxY=std::max(l.maxY,r.maxY); n.maxZ=std::max(l.maxZ,r.maxZ);
+    }
+    m_marked[index]=0;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool BVH::bounds(float o_min[3], float o_max[3]) const
+{
+  if(m_nodes.empty())
+  {
+    return false;
+  }
+  const Node &root=m_nodes[0];
+  o_min[0]=root.minX; o_min[1]=root.minY; o_min[2]=root.minZ;
+  o_max[0]=root.maxX; o_max[1]=root.maxY; o_max[2]=root.maxZ;
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void BVH::cull(const Frustum &_frustum, std::vector<uint32_t> &o_visible) const
+{
+  o_visible.clear();
+  if(m_nodes.empty())
+  {
+    return;
+  }
+  // the stack holds the right children still to visit with the planes they still need testing against
+  struct Entry { int32_t node; unsigned int mask; };
+  Entry stack[64];
+  int top=0;
+  stack[top++]={0,ALL_PLANES};
+
+  while(top>0)
+  {
+    Entry e=stack[--top];
+    const Node &n=m_nodes[e.node];
+    unsigned int mask=e.mask;
+    bool outside=false;
+    for(int p=0; p<6; ++p)
+    {
+      if(!(mask & (1u<<p)))
+      {
+        continue;
+      }
+      const ngl::Vec4 &pl=_frustum.planes[p];
+      // the corner furthest along the plane normal decides outside, the nearest decides inside
+      float far =pl.m_x*(pl.m_x>=0.0f ? n.maxX : n.minX)+pl.m_y*(pl.m_y>=0.0f ? n.maxY : n.minY)+pl.m_z*(pl.m_z>=0.0f ? n.maxZ : n.minZ)+pl.m_w;
+      if(far<0.0f)
+      {
+        outside=true;
+        break;
+      }
+      float near=pl.m_x*(pl.m_x>=0.0f ? n.minX : n.maxX)+pl.m_y*(pl.m_y>=0.0f ? n.minY : n.maxY)+pl.m_z*(pl.m_z>=0.0f ? n.minZ : n.maxZ)+pl.m_w;
+      if(near>=0.0f)
+      {
+        mask&=~(1u<<p);
+      }
+    }
+    if(outside)
+    {
+      continue;
+    }
+    if(mask==0)
+    {
+      // completely inside, take everything below without testing
+      o_visible.insert(o_visible.end(),m_object.begin()+n.first,m_object.begin()+n.first+n.count);
+    }
+    else if(n.isLeaf())
+    {
+      emitLeaf(n,_frustum,mask,o_visible);
+    }
+    else
+    {
+      stack[top++]={n.right,mask};
+      stack[top++]={e.node+1,mask};
+    }
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void BVH::emitLeaf(const Node &_node, const Frustum &_frustum, unsigned int _planeMask, std::vector<uint32_t> &o_visible) const
+{
+  uint32_t first=_node.first;
+#ifdef BVH_AVX
+  if(hasAVX())
+  {
+    unsigned int bits=leafInsideAVX(&m_cx[first],&m_cy[first],&m_cz[first],&m_r[first],_frustum,_planeMask) & ((1u<<_node.count)-1u);
+    while(bits)
+    {
+      o_visible.push_back(m_object[first+__builtin_ctz(bits)]);
+      bits&=bits-1;
+    }
+    return;
+  }
+#endif
+  for(uint32_t s=first; s<first+_node.count; ++s)
+  {
+    bool inside=true;
+    for(int p=0; p<6 && inside; ++p)
+    {
+      if(_planeMask & (1u<<p))
+      {
+        const ngl::Vec4 &pl=_frustum.planes[p];
+        inside=pl.m_x*m_cx[s]+pl.m_y*m_cy[s]+pl.m_z*m_cz[s]+pl.m_w >= -m_r[s];
+      }
+    }
+    if(inside)
+    {
+      o_visible.push_back(m_object[s]);
+    }
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool BVH::simd()
+{
+#ifdef BVH_AVX
+  return hasAVX();
+#else
+  return false;
+#endif
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void BVH::cullBruteForce(const SceneStore &_store, const Frustum &_frustum, std::vector<uint32_t> &o_visible)
+{
+  o_visible.clear();
+  for(uint32_t i=0; i<_store.size(); ++i)
+  {
+    if(_frustum.sphereVisible(_store.centreX[i],_store.centreY[i],_store.centreZ[i],_store.radius[i]))
+    {
+      o_visible.push_back(i);
+    }
+  }
+}
@@ -0,0 +1,796 @@
+#include "Benchmarks.h"
+#include "AssetCache.h"
+#include "BVH.h"
+#include "IndexedMesh.h"
+#include "QualityGovernor.h"
+#include "SceneStore.h"
+#include "StreamBuffer.h"
+#include "TransformBatch.h"
+#include <ngl/Camera.h>
+#include <ngl/Mat3.h>
+#include <ngl/Image.h>
+#include <ngl/NGLInit.h>
+#include <ngl/Obj.h>
+#include <QDir>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QSurfaceFormat>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <random>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief run a function _iterations times and return the mean time in microseconds
+//----------------------------------------------------------------------------------------------------------------------
+template <typename F>
+static double timeMicroseconds(int _iterations, F _func)
+{
+  auto start=std::chrono::steady_clock::now();
+  for(int i=0; i<_iterations; ++i)
+  {
+    _func();
+  }
+  auto end=std::chrono::steady_clock::now();
+  return std::chrono::duration<double,std::micro>(end-start).count()/_iterations;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief fill a store with _count cans laid out as rows of shelves either side of the camera,
+/// the same spacing as the instanced shelf in NGLSceneShelf.cpp
+//----------------------------------------------------------------------------------------------------------------------
+static void buildShelfScene(SceneStore &o_store, uint32_t _count)
+{
+  o_store.clear();
+  SceneMesh can;
+  can.name="can";
+  can.radius=1.2f;
+  o_store.meshes.push_back(can);
+  SceneMaterial mat;
+  mat.name="can";
+  o_store.materials.push_back(mat);
+
+  constexpr int columns=100;
+  constexpr int levels=5;
+  constexpr float scale=0.4f;
+  const float spacing=2.0f*can.radius*scale;
+  for(uint32_t i=0; i<_count; ++i)
+  {
+    int column=static_cast<int>(i%columns);
+    int level=static_cast<int>((i/columns)%levels);
+    int row=static_cast<int>(i/(columns*levels));
+    ngl::Vec3 pos((column-columns*0.5f)*spacing,level*spacing,-row*spacing*2.0f);
+    o_store.addObject(0,0,pos,ngl::Vec3(0.0f,static_cast<float>((i*37)%360),0.0f),ngl::Vec3(scale,scale,scale),i%16);
+  }
+  o_store.updateBounds(true);
+  o_store.clearDirty();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int Benchmarks::culling()
+{
+  // the same cameras the scene uses
+  ngl::Camera camera;
+  camera.set(ngl::Vec3(0.0f,1.0f,4.0f),ngl::Vec3(0.0f,1.0f,0.0f),ngl::Vec3(0.0f,1.0f,0.0f));
+  camera.setShape(45.0f,1024.0f/720.0f,0.1f,100.0f);
+  ngl::Camera light;
+  light.set(ngl::Vec3(8.0f,4.0f,8.0f),ngl::Vec3(0.0f,0.0f,0.0f),ngl::Vec3(0.0f,1.0f,0.0f));
+  light.setShape(45.0f,1.0f,0.1f,100.0f);
+  struct View { const char *name; Frustum frustum; };
+  View views[2]={{"camera",Frustum::fromMatrix(camera.getVPMatrix())},
+                 {"light",Frustum::fromMatrix(light.getVPMatrix())}};
+
+  std::printf("%8s %7s %9s %9s %10s %10s %8s %s\n",
+              "objects","view","visible","build us","bvh us","brute us","speedup","refit 1% us");
+  std::mt19937 rng(1234);
+  bool allMatch=true;
+  for(uint32_t count : {1000u,4000u,16000u,64000u,256000u})
+  {
+    SceneStore store;
+    buildShelfScene(store,count);
+    BVH bvh;
+    double build=timeMicroseconds(5,[&](){ bvh.build(store); });
+    int iterations=std::max(10,static_cast<int>(2000000/count));
+
+    // move 1% of the objects a little each refit
+    std::uniform_int_distribution<uint32_t> pick(0,count-1);
+    std::uniform_real_distribution<float> jitter(-0.05f,0.05f);
+    double refit=timeMicroseconds(iterations,[&]()
+    {
+      for(uint32_t i=0; i<count/100; ++i)
+      {
+        uint32_t obj=pick(rng);
+        store.setPosition(obj,ngl::Vec3(store.posX[obj]+jitter(rng),store.posY[obj],store.posZ[obj]+jitter(rng)));
+      }
+      store.updateBounds();
+      bvh.refit(store);
+      store.clearDirty();
+    });
+
+    for(auto &view : views)
+    {
+      std::vector<uint32_t> visible;
+      std::vector<uint32_t> reference;
+      visible.reserve(count);
+      reference.reserve(count);
+      double bvhTime=timeMicroseconds(iterations,[&](){ bvh.cull(view.frustum,visible); });
+      double bruteTime=timeMicroseconds(iterations,[&](){ BVH::cullBruteForce(store,view.frustum,reference); });
+      std::sort(visible.begin(),visible.end());
+      bool match= visible==reference;
+      allMatch&=match;
+      std::printf("%8u %7s %9zu %9.1f %10.2f %10.2f %7.1fx %8.2f%s\n",
+                  count,view.name,visible.size(),build,bvhTime,bruteTime,bruteTime/bvhTime,refit,
+                  match ? "" : "  MISMATCH");
+    }
+  }
+  std::printf("leaf test %s\n",BVH::simd() ? "AVX" : "scalar (this CPU has no AVX)");
+  return allMatch ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int Benchmarks::vertexFormat()
+{
+  ngl::Obj obj("data/can05.obj");
+  IndexedMesh mesh(obj);
+  mesh.generateLODs(IndexedMesh::MAX_LODS);
+  std::vector<IndexedMesh::PackedVertex> packed=mesh.quantisedVertices();
+  const std::vector<IndexedMesh::Vertex> &verts=mesh.vertices();
+  ngl::Vec3 offset=mesh.positionOffset();
+  ngl::Vec3 scale=mesh.positionScale();
+
+  float positionError=0.0f;
+  float normalError=0.0f;
+  float uvError=0.0f;
+  for(size_t i=0; i<verts.size(); ++i)
+  {
+    const IndexedMesh::Vertex &v=verts[i];
+    const IndexedMesh::PackedVertex &p=packed[i];
+    float x=offset.m_x+p.x/65535.0f*scale.m_x;
+    float y=offset.m_y+p.y/65535.0f*scale.m_y;
+    float z=offset.m_z+p.z/65535.0f*scale.m_z;
+    positionError=std::max(positionError,std::sqrt((x-v.x)*(x-v.x)+(y-v.y)*(y-v.y)+(z-v.z)*(z-v.z)));
+    ngl::Vec3 n=IndexedMesh::unpackNormal(p.normal);
+    ngl::Vec3 original(v.nx,v.ny,v.nz);
+    if(n.length()>0.0f && original.length()>0.0f)
+    {
+      n.normalize();
+      original.normalize();
+      float angle=std::acos(std::min(1.0f,n.dot(original)))*180.0f/static_cast<float>(M_PI);
+      normalError=std::max(normalError,angle);
+    }
+    uvError=std::max(uvError,std::abs(IndexedMesh::halfToFloat(p.u)-v.u));
+    uvError=std::max(uvError,std::abs(IndexedMesh::halfToFloat(p.v)-v.v));
+  }
+
+  std::printf("%zu vertices, %zu byte float vertex, %zu byte quantised vertex\n",
+              verts.size(),sizeof(IndexedMesh::Vertex),sizeof(IndexedMesh::PackedVertex));
+  std::printf("%4s %10s %12s %12s\n","lod","triangles","float KB","quantised KB");
+  for(int i=0; i<mesh.numLODs(); ++i)
+  {
+    // every level shares the vertex buffer, only the index range changes
+    size_t indexCount=mesh.numIndices(i);
+    size_t floatSize=verts.size()*sizeof(IndexedMesh::Vertex)+indexCount*sizeof(GLuint);
+    size_t packedSize=packed.size()*sizeof(IndexedMesh::PackedVertex)+indexCount*(verts.size()<=65536 ? sizeof(GLushort) : sizeof(GLuint));
+    std::printf("%4d %10zu %12.1f %12.1f\n",i,indexCount/3,floatSize/1024.0,packedSize/1024.0);
+  }
+  std::printf("total %.1f KB float, %.1f KB quantised (%.1f%% smaller)\n",
+              mesh.floatBytes()/1024.0,mesh.quantisedBytes()/1024.0,
+              100.0-100.0*mesh.quantisedBytes()/mesh.floatBytes());
+  std::printf("max position error %g (radius %g), max normal error %.3f degrees, max uv error %g\n",
+              positionError,mesh.getRadius(),normalError,uvError);
+  return EXIT_SUCCESS;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int Benchmarks::governor()
+{
+  // rough per pass costs in ms on a weak node at full quality, the scene and noise scale with the
+  // pixel count, the blur runs at native resolution after the upscale
+  float sceneCost=14.0f;
+  constexpr float blurCostPerIteration=0.25f;
+  constexpr float shadowCostPerMegaTexel=3.0f;
+  constexpr float noiseCostPerOctave=0.3f;
+  constexpr float target=16.6f;
+  constexpr int frames=1200;
+  constexpr int latency=2;
+
+  QualityGovernor governor(target);
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> jitter(0.95f,1.05f);
+  std::deque<float> inFlight(latency,0.0f);
+  double lastFrames=0.0;
+  int levelChanges=0;
+
+  std::printf("%6s %9s %9s %6s %6s %7s %7s\n","frame","gpu ms","smooth","scale","level","blur","shadow");
+  for(int frame=0; frame<frames; ++frame)
+  {
+    // the scene gets much lighter half way through, the governor should climb back up
+    if(frame==frames/2)
+    {
+      sceneCost=4.0f;
+      std::printf("-- scene cost drops to %.1f ms --\n",sceneCost);
+    }
+    const QualityGovernor::Level &level=governor.settings();
+    float scale=governor.renderScale();
+    float shadowTexels=level.shadowSize*level.shadowSize/(1024.0f*1024.0f);
+    float gpu=(sceneCost*scale*scale+
+               noiseCostPerOctave*level.noiseOctaves*scale*scale+
+               blurCostPerIteration*level.blurIterations+
+               shadowCostPerMegaTexel*shadowTexels)*jitter(rng);
+
+    // the timer queries are read back a couple of frames late
+    inFlight.push_back(gpu);
+    float measured=inFlight.front();
+    inFlight.pop_front();
+    if(governor.update(measured))
+    {
+      ++levelChanges;
+    }
+    if(frame%50==0)
+    {
+      std::printf("%6d %9.2f %9.2f %6.3f %6d %7d %7d\n",frame,gpu,governor.smoothedTime(),
+                  governor.renderScale(),governor.level(),level.blurIterations,level.shadowSize);
+    }
+    if(frame>=frames-100)
+    {
+      lastFrames+=gpu;
+    }
+  }
+  lastFrames/=100.0;
+  bool onTarget= lastFrames<target*1.05 && lastFrames>target*0.5;
+  std::printf("last 100 frames %.2f ms against %.1f ms target, %d level changes, final scale %.3f level %d %s\n",
+              lastFrames,target,levelChanges,governor.renderScale(),governor.level(),onTarget ? "" : " MISSED");
+  return onTarget ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int Benchmarks::transforms()
+{
+  ngl::Camera camera;
+  camera.set(ngl::Vec3(0.0f,1.0f,4.0f),ngl::Vec3(0.0f,1.0f,0.0f),ngl::Vec3(0.0f,1.0f,0.0f));
+  camera.setShape(45.0f,1024.0f/720.0f,0.1f,100.0f);
+  ngl::Mat4 VP=camera.getVPMatrix();
+
+  std::printf("%8s %10s %10s %10s %10s %8s %10s %12s %s\n",
+              "objects","ngl us","batch us","ngl M/s","batch M/s","speedup","mvp us","dirty 1% us","max error");
+  std::mt19937 rng(1234);
+  bool allMatch=true;
+  for(uint32_t count : {1000u,4000u,16000u,64000u,256000u})
+  {
+    SceneStore store;
+    buildShelfScene(store,count);
+    // give every object a full rotation and a non uniform scale so all the terms are exercised
+    std::uniform_real_distribution<float> angle(-180.0f,180.0f);
+    std::uniform_real_distribution<float> scale(0.2f,2.0f);
+    for(uint32_t i=0; i<count; ++i)
+    {
+      store.rotX[i]=angle(rng);
+      store.rotZ[i]=angle(rng);
+      store.scaleY[i]=scale(rng);
+    }
+    std::vector<uint32_t> ids(count);
+    for(uint32_t i=0; i<count; ++i)
+    {
+      ids[i]=i;
+    }
+    int iterations=std::max(5,static_cast<int>(2000000/count));
+
+    // what every draw used to do, build the matrix through ngl then invert the 3x3
+    std::vector<ngl::Mat4> world(count);
+    std::vector<ngl::Mat3> normal(count);
+    double nglTime=timeMicroseconds(iterations,[&]()
+    {
+      for(uint32_t i=0; i<count; ++i)
+      {
+        world[i]=store.worldMatrix(i);
+        normal[i]=world[i];
+        normal[i]=normal[i].inverse();
+        normal[i].transpose();
+      }
+    });
+    std::vector<TransformBatch::Matrices> matrices(count);
+    double batchTime=timeMicroseconds(iterations,[&]()
+    {
+      TransformBatch::compute(store,ids.data(),count,matrices.data());
+    });
+    std::vector<ngl::Mat4> mvp(count);
+    double mvpTime=timeMicroseconds(iterations,[&]()
+    {
+      TransformBatch::multiply(matrices[0].world,sizeof(TransformBatch::Matrices),count,VP,mvp.data());
+    });
+
+    // 1% of the objects scattered through the store, as updateTransforms sees after a few moves
+    std::uniform_int_distribution<uint32_t> pick(0,count-1);
+    std::vector<uint32_t> dirty(std::max(count/100,1u));
+    for(auto &d : dirty)
+    {
+      d=pick(rng);
+    }
+    std::sort(dirty.begin(),dirty.end());
+    std::vector<TransformBatch::Matrices> dirtyOut(dirty.size());
+    double dirtyTime=timeMicroseconds(iterations,[&]()
+    {
+      TransformBatch::compute(store,dirty.data(),dirty.size(),dirtyOut.data());
+    });
+
+    float maxError=0.0f;
+    for(uint32_t i=0; i<count; ++i)
+    {
+      for(int e=0; e<16; ++e)
+      {
+        maxError=std::max(maxError,std::fabs(world[i].m_openGL[e]-matrices[i].world[e]));
+      }
+      for(int row=0; row<3; ++row)
+      {
+        for(int col=0; col<3; ++col)
+        {
+          maxError=std::max(maxError,std::fabs(normal[i].m_m[row][col]-matrices[i].normal[row*4+col]));
+        }
+      }
+    }
+    bool match=maxError<1e-3f;
+    allMatch&=match;
+    std::printf("%8u %10.1f %10.1f %10.2f %10.2f %7.1fx %10.1f %12.2f %.2e%s\n",
+                count,nglTime,batchTime,count/nglTime,count/batchTime,nglTime/batchTime,mvpTime,dirtyTime,maxError,
+                match ? "" : "  MISMATCH");
+  }
+  std::printf("transforms %s\n",TransformBatch::simd() ? "AVX2" : "scalar (this CPU has no AVX2)");
+  return allMatch ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int Benchmarks::tangents()
+{
+  ngl::Obj obj("data/can05.obj");
+  IndexedMesh mesh(obj);
+  unsigned int cores=std::max(1u,std::thread::hardware_concurrency());
+  double serial=timeMicroseconds(20,[&](){ mesh.generateTangents(1); });
+  double parallel=timeMicroseconds(20,[&](){ mesh.generateTangents(cores); });
+  const std::vector<IndexedMesh::Vertex> &verts=mesh.vertices();
+  float maxDot=0.0f;
+  float maxLengthError=0.0f;
+  size_t mirrored=0;
+  for(auto &v : verts)
+  {
+    ngl::Vec3 n(v.nx,v.ny,v.nz);
+    ngl::Vec3 t(v.tx,v.ty,v.tz);
+    n.normalize();
+    maxDot=std::max(maxDot,std::fabs(n.dot(t)));
+    maxLengthError=std::max(maxLengthError,std::fabs(t.length()-1.0f));
+    mirrored+= v.tw<0.0f ? 1 : 0;
+  }
+  std::printf("%d vertices (%zu split at mirrored uvs, %zu mirrored) %d triangles\n",
+              mesh.numVerts(),mesh.tangentSplits(),mirrored,mesh.numTriangles());
+  std::printf("tangents %.1f us on 1 thread, %.1f us on %u (%.1fx), max |n.t| %.2e, max length error %.2e\n",
+              serial,parallel,cores,serial/parallel,maxDot,maxLengthError);
+
+  // fragments at random points on random triangles with a random normal map texel, tilted at most
+  // 60 degrees off the surface like a real normal map
+  constexpr size_t fragments=1000000;
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> unit(0.0f,1.0f);
+  std::vector<ngl::Vec3> N(fragments), T(fragments), B(fragments), texel(fragments);
+  const std::vector<GLuint> &indices=mesh.indices();
+  for(size_t f=0; f<fragments; ++f)
+  {
+    size_t tri=rng()%static_cast<size_t>(mesh.numTriangles());
+    float a=unit(rng), b=unit(rng);
+    if(a+b>1.0f)
+    {
+      a=1.0f-a;
+      b=1.0f-b;
+    }
+    float w[3]={1.0f-a-b,a,b};
+    ngl::Vec3 n(0.0f,0.0f,0.0f), t(0.0f,0.0f,0.0f);
+    float sign=1.0f;
+    for(int k=0; k<3; ++k)
+    {
+      const IndexedMesh::Vertex &v=verts[indices[tri*3+static_cast<size_t>(k)]];
+      n+=ngl::Vec3(v.nx,v.ny,v.nz)*w[k];
+      t+=ngl::Vec3(v.tx,v.ty,v.tz)*w[k];
+      sign=v.tw;
+    }
+    // what the vertex shader hands over, interpolated and not renormalised
+    N[f]=n;
+    T[f]=t;
+    B[f]=n.cross(t)*sign;
+    float phi=6.2831853f*unit(rng);
+    float z=0.5f+0.5f*unit(rng);
+    float r=std::sqrt(1.0f-z*z);
+    texel[f].set(r*std::cos(phi),r*std::sin(phi),z);
+  }
+
+  std::vector<ngl::Vec3> rotated(fragments), framed(fragments);
+  // the old shader, a rotation taking +z to the texel built from scratch and applied to the normal
+  double rotateTime=timeMicroseconds(5,[&]()
+  {
+    for(size_t f=0; f<fragments; ++f)
+    {
+      ngl::Vec3 n=N[f];
+      n.normalize();
+      ngl::Vec3 tgt=texel[f];
+      tgt.normalize();
+      ngl::Vec3 src(0.0f,0.0f,1.0f);
+      float angle=std::acos(std::min(1.0f,src.dot(tgt)));
+      if(angle==0.0f)
+      {
+        rotated[f]=n;
+        continue;
+      }
+      ngl::Vec3 axis=src.cross(tgt);
+      axis.normalize();
+      float s=std::sin(angle), c=std::cos(angle), oc=1.0f-c;
+      float R[3][3]={{oc*axis.m_x*axis.m_x+c,        oc*axis.m_x*axis.m_y-axis.m_z*s, oc*axis.m_z*axis.m_x+axis.m_y*s},
+                     {oc*axis.m_x*axis.m_y+axis.m_z*s, oc*axis.m_y*axis.m_y+c,        oc*axis.m_y*axis.m_z-axis.m_x*s},
+                     {oc*axis.m_z*axis.m_x-axis.m_y*s, oc*axis.m_y*axis.m_z+axis.m_x*s, oc*axis.m_z*axis.m_z+c}};
+      // GLSL's mat4 constructor is column major so R is applied transposed
+      rotated[f].set(R[0][0]*n.m_x+R[1][0]*n.m_y+R[2][0]*n.m_z,
+                     R[0][1]*n.m_x+R[1][1]*n.m_y+R[2][1]*n.m_z,
+                     R[0][2]*n.m_x+R[1][2]*n.m_y+R[2][2]*n.m_z);
+    }
+  });
+  // the tangent frame, one matrix vector multiply and a normalise
+  double frameTime=timeMicroseconds(5,[&]()
+  {
+    for(size_t f=0; f<fragments; ++f)
+    {
+      const ngl::Vec3 &t=texel[f];
+      framed[f]=T[f]*t.m_x+B[f]*t.m_y+N[f]*t.m_z;
+      framed[f].normalize();
+    }
+  });
+
+  double meanAngle=0.0;
+  float maxAngle=0.0f;
+  for(size_t f=0; f<fragments; ++f)
+  {
+    ngl::Vec3 r=rotated[f];
+    r.normalize();
+    float angle=std::acos(std::max(-1.0f,std::min(1.0f,r.dot(framed[f]))))*180.0f/static_cast<float>(M_PI);
+    meanAngle+=angle;
+    maxAngle=std::max(maxAngle,angle);
+  }
+  meanAngle/=fragments;
+  std::printf("per fragment  rotation %.2f ns  tangent frame %.2f ns (%.1fx)\n",
+              rotateTime*1000.0/fragments,frameTime*1000.0/fragments,rotateTime/frameTime);
+  std::printf("the rotation ignores which way the uvs run, its normals are %.1f degrees from the frame's on average (max %.1f)\n",
+              meanAngle,maxAngle);
+  bool orthogonal=maxDot<1e-3f;
+  return orthogonal ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief a vertex only program reading the ObjectMatrices block of ShadowVert.glsl, drawn with
+/// the rasteriser off so the draws cost little beyond reading the block
+//----------------------------------------------------------------------------------------------------------------------
+static GLuint createStreamingProgram()
+{
+  const char *source=
+    "#version 420 core\n"
+    "layout (std140, binding=2) uniform ObjectMatrices\n"
+    "{\n"
+    "    mat4 MV;\n"
+    "    mat4 MVP;\n"
+    "    mat4 M;\n"
+    "    mat3 normalMatrix;\n"
+    "};\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = MVP * MV * M * vec4(normalMatrix[0], 1.0);\n"
+    "}\n";
+  GLuint shader=glCreateShader(GL_VERTEX_SHADER);
+  glShaderSource(shader,1,&source,nullptr);
+  glCompileShader(shader);
+  GLuint program=glCreateProgram();
+  glAttachShader(program,shader);
+  glLinkProgram(program);
+  glDeleteShader(shader);
+  GLint linked=0;
+  glGetProgramiv(program,GL_LINK_STATUS,&linked);
+  if(!linked)
+  {
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int Benchmarks::streaming()
+{
+  QSurfaceFormat format;
+  format.setMajorVersion(4);
+  format.setMinorVersion(3);
+  format.setProfile(QSurfaceFormat::CoreProfile);
+  QOpenGLContext context;
+  context.setFormat(format);
+  QOffscreenSurface surface;
+  surface.setFormat(format);
+  surface.create();
+  if(!context.create() || !context.makeCurrent(&surface))
+  {
+    std::printf("no GL context\n");
+    return EXIT_FAILURE;
+  }
+  ngl::NGLInit::instance();
+  GLuint program=createStreamingProgram();
+  if(program==0)
+  {
+    std::printf("the streaming program didn't link\n");
+    return EXIT_FAILURE;
+  }
+  glUseProgram(program);
+  GLuint vao;
+  glGenVertexArrays(1,&vao);
+  glBindVertexArray(vao);
+  glEnable(GL_RASTERIZER_DISCARD);
+
+  // what loadMatricesToShadowShader writes per object
+  constexpr size_t blockSize=(3*16+12)*sizeof(GLfloat);
+  constexpr GLuint binding=2;
+  constexpr int frames=300;
+  std::vector<GLfloat> block(blockSize/sizeof(GLfloat),1.0f);
+  for(size_t objects : {64u,512u,4096u})
+  {
+    // a frame is the uploads and draws then a flush, glFinish at the end counts every frame
+    auto run=[&](std::function<void(size_t)> _upload, std::function<void()> _beginFrame)
+    {
+      auto start=std::chrono::steady_clock::now();
+      for(int frame=0; frame<frames; ++frame)
+      {
+        _beginFrame();
+        for(size_t i=0; i<objects; ++i)
+        {
+          block[0]=static_cast<GLfloat>(frame+i);
+          _upload(i);
+          glDrawArrays(GL_POINTS,0,1);
+        }
+        glFlush();
+      }
+      glFinish();
+      return std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now()-start).count()/frames;
+    };
+
+    GLuint ubo;
+    glGenBuffers(1,&ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER,ubo);
+    glBufferData(GL_UNIFORM_BUFFER,blockSize,nullptr,GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER,binding,ubo);
+    double subData=run([&](size_t){ glBufferSubData(GL_UNIFORM_BUFFER,0,blockSize,block.data()); },[](){});
+    glBindBuffer(GL_UNIFORM_BUFFER,0);
+    glDeleteBuffers(1,&ubo);
+
+    double times[2];
+    StreamBuffer::Stats stats[2];
+    for(int persistent=0; persistent<2; ++persistent)
+    {
+      StreamBuffer stream;
+      stream.create(GL_UNIFORM_BUFFER,objects*256,persistent==1);
+      times[persistent]=run([&](size_t){ stream.bind(binding,stream.write(block.data(),blockSize)); },
+                            [&](){ stream.beginFrame(); });
+      stats[persistent]=stream.stats();
+    }
+    double megabytes=objects*blockSize/(1024.0*1024.0);
+    std::printf("%5zu objects: buffer sub data %8.1f us %7.1f MB/s, ring sub data %8.1f us %7.1f MB/s, "
+                "persistent %8.1f us %7.1f MB/s (%.1fx), stalls %llu %.2f ms\n",
+                objects,subData,megabytes/(subData*1e-6),times[0],megabytes/(times[0]*1e-6),
+                times[1],megabytes/(times[1]*1e-6),subData/times[1],
+                static_cast<unsigned long long>(stats[1].totalStalls),stats[1].stallTime);
+  }
+  glDisable(GL_RASTERIZER_DISCARD);
+  glDeleteVertexArrays(1,&vao);
+  glDeleteProgram(program);
+  context.doneCurrent();
+  return EXIT_SUCCESS;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief what a worker in the asset benchmark sends back, its load time then its memory once
+/// every worker has loaded
+//----------------------------------------------------------------------------------------------------------------------
+struct AssetWorkerResult
+{
+  double seconds=0.0;
+  double pssKB=0.0;
+  double privateKB=0.0;
+};
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the proportional and private set sizes of this process in KB
+//----------------------------------------------------------------------------------------------------------------------
+static void memoryUse(double &o_pss, double &o_private)
+{
+  o_pss=0.0;
+  o_private=0.0;
+  FILE *file=std::fopen("/proc/self/smaps_rollup","r");
+  if(file==nullptr)
+  {
+    return;
+  }
+  char line[256];
+  while(std::fgets(line,sizeof(line),file)!=nullptr)
+  {
+    double kb=0.0;
+    if(std::sscanf(line,"Pss: %lf",&kb)==1)
+    {
+      o_pss=kb;
+    }
+    else if(std::sscanf(line,"Private_Clean: %lf",&kb)==1 || std::sscanf(line,"Private_Dirty: %lf",&kb)==1)
+    {
+      o_private+=kb;
+    }
+  }
+  std::fclose(file);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief load the scene's textures and can mesh in a forked worker, each decoding its own copy or
+/// through the shared cache, and hold them until the parent closes _go
+//----------------------------------------------------------------------------------------------------------------------
+static void assetWorker(const std::string &_dir, int _ready, int _go)
+{
+  const char *images[]=
+  {
+    "images/gloss.png","images/NormalMap.jpg","images/woodDif.jpg","images/woodSpec.jpg","images/woodNorm.jpg",
+    "images/sky_zneg.png","images/sky_zpos.png","images/sky_ypos.png","images/sky_yneg.png",
+    "images/sky_xneg.png","images/sky_xpos.png"
+  };
+  auto start=std::chrono::steady_clock::now();
+  std::vector<std::unique_ptr<ngl::Image>> decoded;
+  std::vector<AssetCache::Asset> mapped;
+  std::unique_ptr<IndexedMesh> mesh;
+  // reading every pixel is what an upload does, and makes the mapped pages count against the worker
+  uint32_t checksum=0;
+  if(_dir.empty())
+  {
+    for(auto file : images)
+    {
+      decoded.emplace_back(new ngl::Image(file));
+      const ngl::Image &image=*decoded.back();
+      size_t bytes=size_t(image.width())*image.height()*static_cast<size_t>(image.channels());
+      const unsigned char *pixels=decoded.back()->getPixels();
+      for(size_t i=0; i<bytes; i+=64)
+      {
+        checksum+=pixels[i];
+      }
+    }
+    ngl::Obj obj("data/can05.obj");
+    mesh.reset(new IndexedMesh(obj));
+    mesh->generateLODs(IndexedMesh::MAX_LODS);
+  }
+  else
+  {
+    AssetCache cache(_dir);
+    for(auto file : images)
+    {
+      mapped.push_back(cache.image(file));
+      const AssetCache::Asset &asset=mapped.back();
+      for(size_t i=0; asset.valid() && i<asset.sectionBytes(0); i+=64)
+      {
+        checksum+=asset.section(0)[i];
+      }
+    }
+    mesh=cache.mesh("data/can05.obj",IndexedMesh::MAX_LODS);
+  }
+  volatile uint32_t sink=checksum;
+  (void)sink;
+  AssetWorkerResult result;
+  result.seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+  if(write(_ready,&result,sizeof(AssetWorkerResult))!=sizeof(AssetWorkerResult))
+  {
+    return;
+  }
+  // the parent closes its end once every worker is holding its assets
+  char go;
+  while(read(_go,&go,1)>0)
+  {
+  }
+  memoryUse(result.pssKB,result.privateKB);
+  if(write(_ready,&result,sizeof(AssetWorkerResult))!=sizeof(AssetWorkerResult))
+  {
+    return;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief fork _workers workers, wait until they have all loaded and report
+//----------------------------------------------------------------------------------------------------------------------
+static bool runAssetWorkers(const char *_mode, const std::string &_dir, int _workers)
+{
+  int ready[2];
+  int go[2];
+  if(pipe(ready)!=0 || pipe(go)!=0)
+  {
+    return false;
+  }
+  auto start=std::chrono::steady_clock::now();
+  std::vector<pid_t> pids;
+  for(int i=0; i<_workers; ++i)
+  {
+    pid_t pid=fork();
+    if(pid==0)
+    {
+      close(ready[0]);
+      close(go[1]);
+      assetWorker(_dir,ready[1],go[0]);
+      _exit(0);
+    }
+    if(pid>0)
+    {
+      pids.push_back(pid);
+    }
+  }
+  close(ready[1]);
+  close(go[0]);
+  // every worker reports once it has loaded, then again once they all hold their assets
+  std::vector<AssetWorkerResult> results(pids.size());
+  double meanSeconds=0.0;
+  bool ok=true;
+  for(auto &result : results)
+  {
+    ok&=read(ready[0],&result,sizeof(AssetWorkerResult))==sizeof(AssetWorkerResult);
+    meanSeconds+=result.seconds;
+  }
+  double wall=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+  close(go[1]);
+  double pss=0.0;
+  double priv=0.0;
+  for(auto &result : results)
+  {
+    ok&=read(ready[0],&result,sizeof(AssetWorkerResult))==sizeof(AssetWorkerResult);
+    pss+=result.pssKB;
+    priv+=result.privateKB;
+  }
+  close(ready[0]);
+  for(auto pid : pids)
+  {
+    waitpid(pid,nullptr,0);
+  }
+  double n=std::max<double>(1.0,results.size());
+  std::printf("%-12s %2d workers: wall %6.3f s, %6.3f s per worker, Pss %7.1f MB (%6.1f MB per worker) private %6.1f MB per worker\n",
+              _mode,_workers,wall,meanSeconds/n,pss/1024.0,pss/1024.0/n,priv/1024.0/n);
+  return ok && static_cast<int>(pids.size())==_workers;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int Benchmarks::assets()
+{
+  const int workers[]={1,4,16};
+  bool ok=true;
+  for(int count : workers)
+  {
+    // a fresh directory each time so the first run of a count starts cold
+    std::string dir=AssetCache::defaultDir()+"_bench_"+std::to_string(getpid())+"_"+std::to_string(count);
+    ok&=runAssetWorkers("private",std::string(),count);
+    ok&=runAssetWorkers("shared cold",dir,count);
+    ok&=runAssetWorkers("shared warm",dir,count);
+    QDir(QString::fromStdString(dir)).removeRecursively();
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,54 @@
+#include "Histogram.h"
+#include <algorithm>
+
+constexpr float Histogram::BUCKET_MS;
+constexpr int Histogram::NUM_BUCKETS;
+
+//________________________________________________________________________________________________________________________________________//
+
+Histogram::Histogram() : m_buckets(NUM_BUCKETS,0)
+{
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void Histogram::add(float _ms)
+{
+  int bucket=std::min(std::max(static_cast<int>(_ms/BUCKET_MS),0),NUM_BUCKETS-1);
+  ++m_buckets[bucket];
+  ++m_count;
+  m_sum+=_ms;
+  m_max=std::max(m_max,_ms);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void Histogram::reset()
+{
+  std::fill(m_buckets.begin(),m_buckets.end(),0);
+  m_count=0;
+  m_sum=0.0;
+  m_max=0.0f;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+float Histogram::percentile(float _p) const
+{
+  if(m_count==0)
+  {
+    return 0.0f;
+  }
+  uint64_t rank=static_cast<uint64_t>(_p*(m_count-1));
+  uint64_t seen=0;
+  for(int i=0; i<NUM_BUCKETS; ++i)
+  {
+    seen+=m_buckets[i];
+    if(seen>rank)
+    {
+      // the overflow bucket has no upper edge so report the real max
+      return i==NUM_BUCKETS-1 ? m_max : std::min(bucketStart(i+1),m_max);
+    }
+  }
+  return m_max;
+}
@@ -0,0 +1,663 @@
+#include "IndexedMesh.h"
+#include "MeshSimplifier.h"
+#include <ngl/ShaderLib.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <tuple>
+#include <cmath>
+#include <iostream>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief vertex buffer binding point used for the per instance id attribute
+//----------------------------------------------------------------------------------------------------------------------
+constexpr GLuint INSTANCE_ID_ATTRIB=3;
+constexpr GLuint INSTANCE_ID_BINDING=3;
+constexpr GLuint TANGENT_ATTRIB=4;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the largest value of a 16 bit normalised position
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float QUANTISE_MAX=65535.0f;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief below this much uv area a triangle says nothing about the tangent direction
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float UV_AREA_EPSILON=1e-12f;
+
+//________________________________________________________________________________________________________________________________________//
+
+namespace
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief run _func(begin,end) over [0,_count) split into one contiguous range per thread
+  //----------------------------------------------------------------------------------------------------------------------
+  template <typename F>
+  void parallelRanges(size_t _count, unsigned int _threads, F _func)
+  {
+    if(_threads==0)
+    {
+      _threads=std::max(1u,std::thread::hardware_concurrency());
+    }
+    // a thread is only worth starting for a reasonable amount of work
+    _threads=static_cast<unsigned int>(std::min<size_t>(_threads,std::max<size_t>(1,_count/1024)));
+    if(_threads<=1)
+    {
+      _func(size_t(0),_count);
+      return;
+    }
+    std::vector<std::thread> workers;
+    size_t chunk=(_count+_threads-1)/_threads;
+    for(unsigned int t=1; t<_threads; ++t)
+    {
+      size_t begin=std::min(_count,t*chunk);
+      size_t end=std::min(_count,begin+chunk);
+      workers.emplace_back(_func,begin,end);
+    }
+    _func(size_t(0),std::min(_count,chunk));
+    for(auto &worker : workers)
+    {
+      worker.join();
+    }
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+IndexedMesh::IndexedMesh(ngl::Obj &_obj)
+{
+  std::vector<ngl::Vec3> verts=_obj.getVertexList();
+  std::vector<ngl::Vec3> norms=_obj.getNormalList();
+  std::vector<ngl::Vec3> uvs=_obj.getUVList();
+  std::vector<ngl::Face> faces=_obj.getFaceList();
+
+  // each unique position/uv/normal triple becomes one vertex
+  std::map<std::tuple<uint32_t,uint32_t,uint32_t>,GLuint> lookup;
+
+  auto addCorner=[&](const ngl::Face &_f, size_t _i)
+  {
+    uint32_t vi=_f.m_vert[_i];
+    uint32_t ti=_f.m_textureCoord ? _f.m_uv[_i] : 0;
+    uint32_t ni=_f.m_normals ? _f.m_norm[_i] : 0;
+    auto key=std::make_tuple(vi,ti,ni);
+    auto it=lookup.find(key);
+    if(it!=lookup.end())
+    {
+      m_indices.push_back(it->second);
+      return;
+    }
+    Vertex v;
+    v.x=verts[vi].m_x; v.y=verts[vi].m_y; v.z=verts[vi].m_z;
+    v.u=0.0f; v.v=0.0f;
+    if(_f.m_textureCoord)
+    {
+      v.u=uvs[ti].m_x; v.v=uvs[ti].m_y;
+    }
+    v.nx=0.0f; v.ny=1.0f; v.nz=0.0f;
+    if(_f.m_normals)
+    {
+      v.nx=norms[ni].m_x; v.ny=norms[ni].m_y; v.nz=norms[ni].m_z;
+    }
+    v.tx=1.0f; v.ty=0.0f; v.tz=0.0f; v.tw=1.0f;
+    GLuint index=static_cast<GLuint>(m_verts.size());
+    m_verts.push_back(v);
+    lookup[key]=index;
+    m_indices.push_back(index);
+  };
+
+  for(auto &f : faces)
+  {
+    // triangulate any polygon as a fan
+    for(size_t i=2; i<f.m_vert.size(); ++i)
+    {
+      addCorner(f,0);
+      addCorner(f,i-1);
+      addCorner(f,i);
+    }
+  }
+
+  m_lods.push_back({0,static_cast<GLuint>(m_indices.size()),0.0f});
+  generateTangents();
+  computeBounds();
+  std::cout<<"IndexedMesh "<<faces.size()<<" faces welded to "<<m_verts.size()<<" verts ("<<m_tangentSplits
+           <<" split for tangents) "<<numTriangles()<<" triangles\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+IndexedMesh::IndexedMesh(const Vertex *_verts, size_t _numVerts, const GLuint *_indices, size_t _numIndices,
+                         const LOD *_lods, size_t _numLODs, size_t _tangentSplits) :
+  m_verts(_verts,_verts+_numVerts),
+  m_indices(_indices,_indices+_numIndices),
+  m_lods(_lods,_lods+_numLODs),
+  m_tangentSplits(_tangentSplits)
+{
+  computeBounds();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+IndexedMesh::IndexedMesh(ngl::Real _width, ngl::Real _depth, int _steps)
+{
+  _steps=std::max(_steps,1);
+  for(int j=0; j<=_steps; ++j)
+  {
+    for(int i=0; i<=_steps; ++i)
+    {
+      float s=static_cast<float>(i)/_steps;
+      float t=static_cast<float>(j)/_steps;
+      m_verts.push_back({(s-0.5f)*_width,0.0f,(t-0.5f)*_depth,s,t,0.0f,1.0f,0.0f,1.0f,0.0f,0.0f,1.0f});
+    }
+  }
+  GLuint row=static_cast<GLuint>(_steps+1);
+  for(GLuint j=0; j<static_cast<GLuint>(_steps); ++j)
+  {
+    for(GLuint i=0; i<static_cast<GLuint>(_steps); ++i)
+    {
+      GLuint a=j*row+i;
+      GLuint b=a+row;
+      m_indices.insert(m_indices.end(),{a,b,b+1,a,b+1,a+1});
+    }
+  }
+  computeBounds();
+  m_lods.push_back({0,static_cast<GLuint>(m_indices.size()),0.0f});
+  generateTangents();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void IndexedMesh::generateTangents(unsigned int _threads)
+{
+  const size_t corners=m_lods[0].count;
+  const GLuint *indices=m_indices.data()+m_lods[0].firstIndex;
+  // every corner's tangent in its vertex normal's plane, scaled by the corner angle, and which way
+  // round the uvs go. Each triangle only writes its own corners so the threads never share data
+  std::vector<ngl::Vec3> cornerTangent(corners);
+  std::vector<int8_t> cornerSign(corners);
+  auto vec=[this](GLuint _i){ const Vertex &v=m_verts[_i]; return ngl::Vec3(v.x,v.y,v.z); };
+  auto normal=[this](GLuint _i){ const Vertex &v=m_verts[_i]; return ngl::Vec3(v.nx,v.ny,v.nz); };
+  parallelRanges(corners/3,_threads,[&](size_t _begin, size_t _end)
+  {
+    for(size_t tri=_begin; tri<_end; ++tri)
+    {
+      const GLuint *t=indices+tri*3;
+      for(int k=0; k<3; ++k)
+      {
+        GLuint i0=t[k], i1=t[(k+1)%3], i2=t[(k+2)%3];
+        const Vertex &v0=m_verts[i0];
+        ngl::Vec3 e1=vec(i1)-vec(i0);
+        ngl::Vec3 e2=vec(i2)-vec(i0);
+        float du1=m_verts[i1].u-v0.u, dv1=m_verts[i1].v-v0.v;
+        float du2=m_verts[i2].u-v0.u, dv2=m_verts[i2].v-v0.v;
+        float area=du1*dv2-du2*dv1;
+        size_t corner=tri*3+static_cast<size_t>(k);
+        cornerTangent[corner].set(0.0f,0.0f,0.0f);
+        cornerSign[corner]=0;
+        if(std::abs(area)<UV_AREA_EPSILON || e1.lengthSquared()==0.0f || e2.lengthSquared()==0.0f)
+        {
+          continue;
+        }
+        // the directions of increasing u and v across the triangle, only their directions matter
+        ngl::Vec3 tangent=(e1*dv2-e2*dv1)*(area>0.0f ? 1.0f : -1.0f);
+        ngl::Vec3 bitangent=(e2*du1-e1*du2)*(area>0.0f ? 1.0f : -1.0f);
+        ngl::Vec3 n=normal(i0);
+        tangent-=n*n.dot(tangent);
+        if(tangent.lengthSquared()==0.0f)
+        {
+          continue;
+        }
+        tangent.normalize();
+        ngl::Vec3 a=e1; a.normalize();
+        ngl::Vec3 b=e2; b.normalize();
+        float angle=std::acos(std::max(-1.0f,std::min(1.0f,a.dot(b))));
+        cornerTangent[corner]=tangent*angle;
+        cornerSign[corner]=static_cast<int8_t>(n.cross(tangent).dot(bitangent)<0.0f ? -1 : 1);
+      }
+    }
+  });
+
+  // a vertex can only carry one sign, the corners that disagree with the first get a copy of it
+  std::vector<int8_t> vertexSign(m_verts.size(),0);
+  std::vector<GLuint> mirrored(m_verts.size(),0);
+  m_tangentSplits=0;
+  for(size_t corner=0; corner<corners; ++corner)
+  {
+    GLuint vertex=indices[corner];
+    int8_t sign=cornerSign[corner];
+    if(sign==0 || vertexSign[vertex]==0)
+    {
+      vertexSign[vertex]= vertexSign[vertex]==0 ? sign : vertexSign[vertex];
+      continue;
+    }
+    if(sign!=vertexSign[vertex])
+    {
+      if(mirrored[vertex]==0)
+      {
+        mirrored[vertex]=static_cast<GLuint>(m_verts.size());
+        m_verts.push_back(m_verts[vertex]);
+        vertexSign.push_back(sign);
+        ++m_tangentSplits;
+      }
+      m_indices[m_lods[0].firstIndex+corner]=mirrored[vertex];
+    }
+  }
+
+  // the corners of each vertex, packed one vertex after the other
+  std::vector<GLuint> first(m_verts.size()+1,0);
+  for(size_t corner=0; corner<corners; ++corner)
+  {
+    ++first[indices[corner]+1];
+  }
+  for(size_t i=0; i<m_verts.size(); ++i)
+  {
+    first[i+1]+=first[i];
+  }
+  std::vector<GLuint> vertexCorners(corners);
+  std::vector<GLuint> fill(first.begin(),first.end()-1);
+  for(size_t corner=0; corner<corners; ++corner)
+  {
+    vertexCorners[fill[indices[corner]]++]=static_cast<GLuint>(corner);
+  }
+
+  // sum each vertex's corners and make the result orthogonal to the normal
+  parallelRanges(m_verts.size(),_threads,[&](size_t _begin, size_t _end)
+  {
+    for(size_t i=_begin; i<_end; ++i)
+    {
+      ngl::Vec3 tangent(0.0f,0.0f,0.0f);
+      for(GLuint c=first[i]; c<first[i+1]; ++c)
+      {
+        tangent+=cornerTangent[vertexCorners[c]];
+      }
+      Vertex &v=m_verts[i];
+      ngl::Vec3 n(v.nx,v.ny,v.nz);
+      tangent-=n*n.dot(tangent);
+      if(tangent.lengthSquared()<1e-12f)
+      {
+        // no usable uvs, any direction in the normal's plane will do
+        tangent= std::abs(n.m_x)<0.9f ? ngl::Vec3(1.0f,0.0f,0.0f) : ngl::Vec3(0.0f,1.0f,0.0f);
+        tangent-=n*n.dot(tangent);
+      }
+      tangent.normalize();
+      v.tx=tangent.m_x; v.ty=tangent.m_y; v.tz=tangent.m_z;
+      v.tw= vertexSign[i]<0 ? -1.0f : 1.0f;
+    }
+  });
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void IndexedMesh::computeBounds()
+{
+  // bounding sphere from the box centre, good enough for culling cans
+  ngl::Vec3 minP(1e9f,1e9f,1e9f);
+  ngl::Vec3 maxP(-1e9f,-1e9f,-1e9f);
+  for(auto &v : m_verts)
+  {
+    minP.set(std::min(minP.m_x,v.x),std::min(minP.m_y,v.y),std::min(minP.m_z,v.z));
+    maxP.set(std::max(maxP.m_x,v.x),std::max(maxP.m_y,v.y),std::max(maxP.m_z,v.z));
+  }
+  m_center=(minP+maxP)*0.5f;
+  m_radius=0.0f;
+  for(auto &v : m_verts)
+  {
+    ngl::Vec3 d(v.x-m_center.m_x,v.y-m_center.m_y,v.z-m_center.m_z);
+    m_radius=std::max(m_radius,d.length());
+  }
+  // a flat axis (the plane's y) still needs a non zero scale
+  m_positionOffset=minP;
+  m_positionScale.set(std::max(maxP.m_x-minP.m_x,1e-6f),std::max(maxP.m_y-minP.m_y,1e-6f),std::max(maxP.m_z-minP.m_z,1e-6f));
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+IndexedMesh::~IndexedMesh()
+{
+  if(m_vao !=0)
+  {
+    glDeleteBuffers(1,&m_vbo);
+    glDeleteBuffers(1,&m_floatVbo);
+    glDeleteBuffers(1,&m_ibo);
+    glDeleteVertexArrays(1,&m_vao);
+    glDeleteVertexArrays(1,&m_floatVao);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void IndexedMesh::createVAO(bool _instanced)
+{
+  // 16 bit indices whenever every vertex can be addressed
+  glGenBuffers(1,&m_ibo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m_ibo);
+  if(m_verts.size()<=65536)
+  {
+    std::vector<GLushort> shortIndices(m_indices.begin(),m_indices.end());
+    m_indexType=GL_UNSIGNED_SHORT;
+    m_indexSize=sizeof(GLushort);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,shortIndices.size()*sizeof(GLushort),&shortIndices[0],GL_STATIC_DRAW);
+  }
+  else
+  {
+    m_indexType=GL_UNSIGNED_INT;
+    m_indexSize=sizeof(GLuint);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,m_indices.size()*sizeof(GLuint),&m_indices[0],GL_STATIC_DRAW);
+  }
+
+  // the instance id advances once per instance, starting at the command's baseInstance
+  auto instanceAttribute=[_instanced]()
+  {
+    if(_instanced)
+    {
+      glEnableVertexAttribArray(INSTANCE_ID_ATTRIB);
+      glVertexAttribIFormat(INSTANCE_ID_ATTRIB,1,GL_UNSIGNED_INT,0);
+      glVertexAttribBinding(INSTANCE_ID_ATTRIB,INSTANCE_ID_BINDING);
+      glVertexBindingDivisor(INSTANCE_ID_BINDING,1);
+    }
+  };
+
+  // quantised vertices, the fetch unit expands the normals and uvs and the shader rescales the position
+  std::vector<PackedVertex> packed=quantisedVertices();
+  glGenVertexArrays(1,&m_vao);
+  glBindVertexArray(m_vao);
+  glGenBuffers(1,&m_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER,m_vbo);
+  glBufferData(GL_ARRAY_BUFFER,packed.size()*sizeof(PackedVertex),&packed[0],GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m_ibo);
+  // same attribute locations as ngl::Obj so the shaders don't change
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0,3,GL_UNSIGNED_SHORT,GL_TRUE,sizeof(PackedVertex),reinterpret_cast<GLvoid *>(offsetof(PackedVertex,x)));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1,2,GL_HALF_FLOAT,GL_FALSE,sizeof(PackedVertex),reinterpret_cast<GLvoid *>(offsetof(PackedVertex,u)));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2,4,GL_INT_2_10_10_10_REV,GL_TRUE,sizeof(PackedVertex),reinterpret_cast<GLvoid *>(offsetof(PackedVertex,normal)));
+  glEnableVertexAttribArray(TANGENT_ATTRIB);
+  glVertexAttribPointer(TANGENT_ATTRIB,4,GL_INT_2_10_10_10_REV,GL_TRUE,sizeof(PackedVertex),reinterpret_cast<GLvoid *>(offsetof(PackedVertex,tangent)));
+  instanceAttribute();
+
+  // the full float copy for comparison
+  glGenVertexArrays(1,&m_floatVao);
+  glBindVertexArray(m_floatVao);
+  glGenBuffers(1,&m_floatVbo);
+  glBindBuffer(GL_ARRAY_BUFFER,m_floatVbo);
+  glBufferData(GL_ARRAY_BUFFER,m_verts.size()*sizeof(Vertex),&m_verts[0],GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,m_ibo);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(Vertex),reinterpret_cast<GLvoid *>(offsetof(Vertex,x)));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1,2,GL_FLOAT,GL_FALSE,sizeof(Vertex),reinterpret_cast<GLvoid *>(offsetof(Vertex,u)));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2,3,GL_FLOAT,GL_FALSE,sizeof(Vertex),reinterpret_cast<GLvoid *>(offsetof(Vertex,nx)));
+  glEnableVertexAttribArray(TANGENT_ATTRIB);
+  glVertexAttribPointer(TANGENT_ATTRIB,4,GL_FLOAT,GL_FALSE,sizeof(Vertex),reinterpret_cast<GLvoid *>(offsetof(Vertex,tx)));
+  instanceAttribute();
+
+  glBindVertexArray(0);
+  std::cout<<"IndexedMesh GPU memory "<<quantisedBytes()/1024<<" KB quantised, "<<floatBytes()/1024<<" KB as floats ("
+           <<100.0f-100.0f*quantisedBytes()/floatBytes()<<"% smaller)\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+std::vector<IndexedMesh::PackedVertex> IndexedMesh::quantisedVertices() const
+{
+  auto quantise=[](float _v, float _offset, float _scale)
+  {
+    float q=(_v-_offset)/_scale*QUANTISE_MAX;
+    return static_cast<GLushort>(std::lround(std::max(0.0f,std::min(QUANTISE_MAX,q))));
+  };
+  std::vector<PackedVertex> packed(m_verts.size());
+  for(size_t i=0; i<m_verts.size(); ++i)
+  {
+    const Vertex &v=m_verts[i];
+    PackedVertex &p=packed[i];
+    p.x=quantise(v.x,m_positionOffset.m_x,m_positionScale.m_x);
+    p.y=quantise(v.y,m_positionOffset.m_y,m_positionScale.m_y);
+    p.z=quantise(v.z,m_positionOffset.m_z,m_positionScale.m_z);
+    p.w=0;
+    p.u=floatToHalf(v.u);
+    p.v=floatToHalf(v.v);
+    p.normal=packNormal(v.nx,v.ny,v.nz);
+    p.tangent=packTangent(v.tx,v.ty,v.tz,v.tw);
+  }
+  return packed;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+size_t IndexedMesh::quantisedBytes() const
+{
+  size_t indexSize= m_verts.size()<=65536 ? sizeof(GLushort) : sizeof(GLuint);
+  return m_verts.size()*sizeof(PackedVertex)+m_indices.size()*indexSize;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+size_t IndexedMesh::floatBytes() const
+{
+  return m_verts.size()*sizeof(Vertex)+m_indices.size()*sizeof(GLuint);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+GLushort IndexedMesh::floatToHalf(float _f)
+{
+  uint32_t x;
+  std::memcpy(&x,&_f,sizeof(x));
+  uint32_t sign=(x>>16) & 0x8000u;
+  int32_t exponent=static_cast<int32_t>((x>>23) & 0xffu)-127+15;
+  uint32_t mantissa=x & 0x7fffffu;
+  if(((x>>23) & 0xffu)==0xffu)
+  {
+    // inf or nan
+    return static_cast<GLushort>(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+  }
+  if(exponent>=31)
+  {
+    return static_cast<GLushort>(sign | 0x7c00u);
+  }
+  if(exponent<=0)
+  {
+    // denormal or too small
+    if(exponent<-10)
+    {
+      return static_cast<GLushort>(sign);
+    }
+    mantissa|=0x800000u;
+    uint32_t shift=static_cast<uint32_t>(14-exponent);
+    uint32_t h=mantissa>>shift;
+    uint32_t remainder=mantissa & ((1u<<shift)-1u);
+    uint32_t halfway=1u<<(shift-1u);
+    if(remainder>halfway || (remainder==halfway && (h & 1u)))
+    {
+      ++h;
+    }
+    return static_cast<GLushort>(sign | h);
+  }
+  // round to nearest even, a carry out of the mantissa correctly bumps the exponent
+  uint32_t h=(static_cast<uint32_t>(exponent)<<10) | (mantissa>>13);
+  uint32_t remainder=mantissa & 0x1fffu;
+  if(remainder>0x1000u || (remainder==0x1000u && (h & 1u)))
+  {
+    ++h;
+  }
+  return static_cast<GLushort>(sign | h);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+float IndexedMesh::halfToFloat(GLushort _h)
+{
+  uint32_t sign=static_cast<uint32_t>(_h & 0x8000u)<<16;
+  uint32_t exponent=(_h>>10) & 0x1fu;
+  uint32_t mantissa=_h & 0x3ffu;
+  if(exponent==0)
+  {
+    float f=std::ldexp(static_cast<float>(mantissa),-24);
+    return sign ? -f : f;
+  }
+  uint32_t bits= exponent==31 ? (sign | 0x7f800000u | (mantissa<<13))
+                              : (sign | ((exponent+112u)<<23) | (mantissa<<13));
+  float f;
+  std::memcpy(&f,&bits,sizeof(f));
+  return f;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+GLuint IndexedMesh::packNormal(float _x, float _y, float _z)
+{
+  auto component=[](float _v)
+  {
+    int i=static_cast<int>(std::lround(std::max(-1.0f,std::min(1.0f,_v))*511.0f));
+    return static_cast<GLuint>(i) & 0x3ffu;
+  };
+  return component(_x) | (component(_y)<<10) | (component(_z)<<20);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+GLuint IndexedMesh::packTangent(float _x, float _y, float _z, float _w)
+{
+  // a signed 2 bit w is 1 (01) or -1 (11)
+  return packNormal(_x,_y,_z) | ((_w<0.0f ? 3u : 1u)<<30);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+ngl::Vec3 IndexedMesh::unpackNormal(GLuint _n)
+{
+  auto component=[_n](int _shift)
+  {
+    int v=static_cast<int>((_n>>_shift) & 0x3ffu);
+    if(v & 0x200)
+    {
+      v-=1024;
+    }
+    return std::max(static_cast<float>(v)/511.0f,-1.0f);
+  };
+  return ngl::Vec3(component(0),component(10),component(20));
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void IndexedMesh::loadQuantisation() const
+{
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  if(m_quantised)
+  {
+    shader->setShaderParam3f("positionOffset",m_positionOffset.m_x,m_positionOffset.m_y,m_positionOffset.m_z);
+    shader->setShaderParam3f("positionScale",m_positionScale.m_x,m_positionScale.m_y,m_positionScale.m_z);
+  }
+  else
+  {
+    shader->setShaderParam3f("positionOffset",0.0f,0.0f,0.0f);
+    shader->setShaderParam3f("positionScale",1.0f,1.0f,1.0f);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void IndexedMesh::draw(GLsizei _instances) const
+{
+  glBindVertexArray(m_quantised ? m_vao : m_floatVao);
+  glDrawElementsInstanced(GL_TRIANGLES,static_cast<GLsizei>(m_lods[0].count),m_indexType,
+                          reinterpret_cast<GLvoid *>(static_cast<size_t>(m_lods[0].firstIndex)*m_indexSize),_instances);
+  glBindVertexArray(0);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+DrawElementsIndirectCommand IndexedMesh::indirectCommand(int _lod) const
+{
+  DrawElementsIndirectCommand cmd;
+  cmd.count=m_lods[_lod].count;
+  cmd.instanceCount=0;
+  cmd.firstIndex=m_lods[_lod].firstIndex;
+  cmd.baseVertex=0;
+  cmd.baseInstance=0;
+  return cmd;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void IndexedMesh::generateLODs(int _levels)
+{
+  std::vector<float> positions;
+  positions.reserve(m_verts.size()*3);
+  for(auto &v : m_verts)
+  {
+    positions.insert(positions.end(),{v.x,v.y,v.z});
+  }
+  std::vector<uint32_t> full(m_indices.begin(),m_indices.begin()+m_lods[0].count);
+  MeshSimplifier simplifier(positions,full);
+
+  // each level halves the last, the simplifier carries on from where it stopped so the levels nest
+  size_t target=full.size()/3;
+  for(int level=1; level<std::min(_levels,MAX_LODS); ++level)
+  {
+    target/=2;
+    size_t before=simplifier.numTriangles();
+    simplifier.simplify(target);
+    if(simplifier.numTriangles()==before)
+    {
+      // nothing else can collapse, a copy of the last level would only cost memory
+      std::cout<<"LOD "<<level<<" could not go below "<<before<<" triangles, stopping at "<<level<<" levels\n";
+      break;
+    }
+    if(simplifier.numTriangles()>target)
+    {
+      std::cout<<"LOD "<<level<<" stopped at "<<simplifier.numTriangles()<<" triangles of a "<<target<<" target\n";
+    }
+    std::vector<uint32_t> indices=simplifier.indices();
+    m_lods.push_back({static_cast<GLuint>(m_indices.size()),static_cast<GLuint>(indices.size()),simplifier.error()});
+    m_indices.insert(m_indices.end(),indices.begin(),indices.end());
+  }
+
+  std::cout<<"LOD  triangles  % of full  error  % of radius\n";
+  for(int level=0; level<numLODs(); ++level)
+  {
+    const LOD &lod=m_lods[level];
+    std::cout<<level<<"    "<<lod.count/3<<"    "<<100.0f*lod.count/m_lods[0].count<<"    "
+             <<lod.error<<"    "<<100.0f*lod.error/m_radius<<"\n";
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+unsigned int IndexedMesh::selectLOD(float _screenRadius, unsigned int _previous, const float *_thresholds, float _hysteresis) const
+{
+  unsigned int last=static_cast<unsigned int>(numLODs()-1);
+  unsigned int lod=std::min(_previous,last);
+  // step coarser while well below the switch size, finer while well above the one before
+  while(lod<last && _screenRadius<_thresholds[lod]*(1.0f-_hysteresis))
+  {
+    ++lod;
+  }
+  while(lod>0 && _screenRadius>_thresholds[lod-1]*(1.0f+_hysteresis))
+  {
+    --lod;
+  }
+  return lod;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void IndexedMesh::drawIndirect(GLuint _commands, GLsizei _drawCount, GLuint _instanceIds, GLuint _divisor) const
+{
+  glBindVertexArray(m_quantised ? m_vao : m_floatVao);
+  glBindVertexBuffer(INSTANCE_ID_BINDING,_instanceIds,0,sizeof(GLuint));
+  if(_divisor!=1)
+  {
+    glVertexBindingDivisor(INSTANCE_ID_BINDING,_divisor);
+  }
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER,_commands);
+  glMultiDrawElementsIndirect(GL_TRIANGLES,m_indexType,nullptr,_drawCount,0);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER,0);
+  if(_divisor!=1)
+  {
+    // the divisor is part of the VAO, every other draw expects one id per instance
+    glVertexBindingDivisor(INSTANCE_ID_BINDING,1);
+  }
+  glBindVertexArray(0);
+}
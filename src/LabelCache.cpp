@@ -0,0 +1,433 @@
+#include "LabelCache.h"
+#include <QImage>
+#include <QString>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief loads queued at once, more than this and the queue just holds SKUs that will be stale by
+/// the time they are decoded
+//----------------------------------------------------------------------------------------------------------------------
+constexpr size_t MAX_IN_FLIGHT=32;
+constexpr unsigned int MAX_LOADERS=4;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the hue turn between SKUs that share artwork, the golden angle keeps neighbours far apart
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float HUE_STEP=137.50776f;
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief turn the hue of RGBA8 pixels by _degrees about the grey axis
+//----------------------------------------------------------------------------------------------------------------------
+static void rotateHue(uint8_t *io_pixels, size_t _count, float _degrees)
+{
+  const float a=_degrees*static_cast<float>(M_PI)/180.0f;
+  const float c=std::cos(a);
+  const float s=std::sin(a);
+  const float t=(1.0f-c)/3.0f;
+  const float r=std::sqrt(1.0f/3.0f)*s;
+  const float m[3][3]={{c+t,t-r,t+r},
+                       {t+r,c+t,t-r},
+                       {t-r,t+r,c+t}};
+  for(size_t i=0; i<_count; ++i)
+  {
+    uint8_t *p=io_pixels+i*4;
+    const float in[3]={static_cast<float>(p[0]),static_cast<float>(p[1]),static_cast<float>(p[2])};
+    for(int k=0; k<3; ++k)
+    {
+      float v=m[k][0]*in[0]+m[k][1]*in[1]+m[k][2]*in[2];
+      p[k]=static_cast<uint8_t>(std::min(255.0f,std::max(0.0f,v+0.5f)));
+    }
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the next level down of an RGBA8 image, a 2x2 box filter that copes with odd sizes
+//----------------------------------------------------------------------------------------------------------------------
+static void halve(const uint8_t *_src, int _width, int _height, uint8_t *o_dst)
+{
+  const int w=std::max(1,_width/2);
+  const int h=std::max(1,_height/2);
+  for(int y=0; y<h; ++y)
+  {
+    const int y0=std::min(2*y,_height-1);
+    const int y1=std::min(2*y+1,_height-1);
+    for(int x=0; x<w; ++x)
+    {
+      const int x0=std::min(2*x,_width-1);
+      const int x1=std::min(2*x+1,_width-1);
+      for(int c=0; c<4; ++c)
+      {
+        int sum=_src[(y0*_width+x0)*4+c]+_src[(y0*_width+x1)*4+c]+
+                _src[(y1*_width+x0)*4+c]+_src[(y1*_width+x1)*4+c];
+        o_dst[(y*w+x)*4+c]=static_cast<uint8_t>((sum+2)/4);
+      }
+    }
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+LabelCache::~LabelCache()
+{
+  destroy();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void LabelCache::destroy()
+{
+  stopLoaders();
+  if(m_texture!=0)
+  {
+    glDeleteTextures(1,&m_texture);
+    m_texture=0;
+  }
+  if(m_layerBuffer!=0)
+  {
+    glDeleteBuffers(1,&m_layerBuffer);
+    m_layerBuffer=0;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void LabelCache::create(const std::vector<std::string> &_files, uint32_t _count, int _width, int _height, size_t _budget)
+{
+  stopLoaders();
+  m_files=_files;
+  m_count=std::max(1u,_count);
+  m_width=_width;
+  m_height=_height;
+  m_levels=1;
+  for(int size=std::max(_width,_height); size>1; size/=2)
+  {
+    ++m_levels;
+  }
+  m_labelBytes=0;
+  for(int level=0; level<m_levels; ++level)
+  {
+    m_labelBytes+=static_cast<size_t>(std::max(1,_width>>level))*static_cast<size_t>(std::max(1,_height>>level))*4;
+  }
+  // there is no point having more layers than SKUs, and layer 0 is always needed
+  GLint maxLayers=256;
+  glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS,&maxLayers);
+  m_layers=static_cast<int>(std::min<size_t>({_budget/m_labelBytes,static_cast<size_t>(m_count),static_cast<size_t>(maxLayers)}));
+  m_layers=std::max(1,m_layers);
+
+  glDeleteTextures(1,&m_texture);
+  glGenTextures(1,&m_texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,m_texture);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY,m_levels,GL_RGBA8,m_width,m_height,m_layers);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_S,GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+
+  m_skuLayer.assign(m_count,0);
+  m_skuResident.assign(m_count,0);
+  m_skuLoading.assign(m_count,0);
+  m_skuFrame.assign(m_count,0);
+  m_layerSku.assign(static_cast<size_t>(m_layers),NO_SKU);
+  m_lru.clear();
+  m_lruPosition.assign(static_cast<size_t>(m_layers),m_lru.end());
+  // layer 0 is never in the recency list so it can't be evicted
+  for(int layer=1; layer<m_layers; ++layer)
+  {
+    m_lruPosition[static_cast<size_t>(layer)]=m_lru.insert(m_lru.end(),layer);
+  }
+  m_frame=0;
+  m_stats=Stats();
+
+  // SKU 0 is loaded now as it stands in for everything else
+  Load first;
+  first.sku=0;
+  decode(0,first.pixels);
+  upload(first,0);
+  m_stats.uploads=0;
+
+  glDeleteBuffers(1,&m_layerBuffer);
+  glGenBuffers(1,&m_layerBuffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_layerBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER,static_cast<GLsizeiptr>(m_count*sizeof(uint32_t)),m_skuLayer.data(),GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+  m_dirtyFirst=NO_SKU;
+  m_dirtyLast=0;
+
+  m_windowStart=std::chrono::steady_clock::now();
+  m_windowBytes=0;
+  m_quit=false;
+  unsigned int loaders=std::max(1u,std::min(MAX_LOADERS,std::thread::hardware_concurrency()/2));
+  for(unsigned int i=0; i<loaders; ++i)
+  {
+    m_loaders.emplace_back(&LabelCache::loaderLoop,this);
+  }
+  std::cout<<"label cache "<<m_layers<<" layers of "<<m_width<<"x"<<m_height<<" for "<<m_count<<" SKUs, "
+           <<(m_labelBytes*static_cast<size_t>(m_layers))/(1024*1024)<<" MB, "<<loaders<<" loaders\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void LabelCache::stopLoaders()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit=true;
+    m_queue.clear();
+    m_done.clear();
+  }
+  m_wake.notify_all();
+  for(auto &loader : m_loaders)
+  {
+    loader.join();
+  }
+  m_loaders.clear();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void LabelCache::loaderLoop()
+{
+  for(;;)
+  {
+    uint32_t sku;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock,[this]{ return m_quit || !m_queue.empty(); });
+      if(m_quit)
+      {
+        return;
+      }
+      sku=m_queue.front();
+      m_queue.pop_front();
+    }
+    Load load;
+    load.sku=sku;
+    decode(sku,load.pixels);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_quit)
+    {
+      return;
+    }
+    m_done.push_back(std::move(load));
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void LabelCache::decode(uint32_t _sku, std::vector<uint8_t> &o_pixels) const
+{
+  o_pixels.resize(m_labelBytes);
+  std::string file=m_files.empty() ? std::string() : m_files[_sku%m_files.size()];
+  QImage image(QString::fromStdString(file));
+  if(image.isNull())
+  {
+    // a missing file is a flat colour so the shelf still shows which SKUs are which
+    std::cerr<<"label cache can't load "<<file<<'\n';
+    for(size_t i=0; i<static_cast<size_t>(m_width)*static_cast<size_t>(m_height); ++i)
+    {
+      o_pixels[i*4+0]=200; o_pixels[i*4+1]=60; o_pixels[i*4+2]=60; o_pixels[i*4+3]=255;
+    }
+  }
+  else
+  {
+    // the same way up as ngl::Image gave the single label texture
+    image=image.convertToFormat(QImage::Format_RGBA8888)
+               .scaled(m_width,m_height,Qt::IgnoreAspectRatio,Qt::SmoothTransformation)
+               .mirrored(false,true);
+    for(int y=0; y<m_height; ++y)
+    {
+      std::copy(image.constScanLine(y),image.constScanLine(y)+m_width*4,o_pixels.begin()+static_cast<size_t>(y)*static_cast<size_t>(m_width)*4);
+    }
+  }
+  if(!m_files.empty() && _sku>=m_files.size())
+  {
+    rotateHue(o_pixels.data(),static_cast<size_t>(m_width)*static_cast<size_t>(m_height),HUE_STEP*static_cast<float>(_sku/m_files.size()));
+  }
+  uint8_t *level=o_pixels.data();
+  int w=m_width;
+  int h=m_height;
+  for(int l=1; l<m_levels; ++l)
+  {
+    uint8_t *next=level+static_cast<size_t>(w)*static_cast<size_t>(h)*4;
+    halve(level,w,h,next);
+    level=next;
+    w=std::max(1,w/2);
+    h=std::max(1,h/2);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void LabelCache::upload(const Load &_load, int _layer)
+{
+  glBindTexture(GL_TEXTURE_2D_ARRAY,m_texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT,1);
+  const uint8_t *level=_load.pixels.data();
+  for(int l=0; l<m_levels; ++l)
+  {
+    int w=std::max(1,m_width>>l);
+    int h=std::max(1,m_height>>l);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY,l,0,0,_layer,w,h,1,GL_RGBA,GL_UNSIGNED_BYTE,level);
+    level+=static_cast<size_t>(w)*static_cast<size_t>(h)*4;
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT,4);
+
+  m_layerSku[static_cast<size_t>(_layer)]=_load.sku;
+  m_skuLayer[_load.sku]=static_cast<uint32_t>(_layer);
+  m_skuResident[_load.sku]=1;
+  ++m_stats.resident;
+  m_dirtyFirst=std::min(m_dirtyFirst,_load.sku);
+  m_dirtyLast=std::max(m_dirtyLast,_load.sku);
+  ++m_stats.uploads;
+  m_stats.uploadedBytes+=m_labelBytes;
+  m_windowBytes+=m_labelBytes;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int LabelCache::evict()
+{
+  if(m_lru.empty())
+  {
+    return -1;
+  }
+  int layer=m_lru.back();
+  uint32_t sku=m_layerSku[static_cast<size_t>(layer)];
+  if(sku!=NO_SKU)
+  {
+    // anything asked for this frame is on screen, replacing it would thrash
+    if(m_skuFrame[sku]==m_frame)
+    {
+      return -1;
+    }
+    m_skuResident[sku]=0;
+    --m_stats.resident;
+    m_skuLayer[sku]=0;
+    m_dirtyFirst=std::min(m_dirtyFirst,sku);
+    m_dirtyLast=std::max(m_dirtyLast,sku);
+    m_layerSku[static_cast<size_t>(layer)]=NO_SKU;
+    ++m_stats.evictions;
+  }
+  return layer;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void LabelCache::beginFrame()
+{
+  ++m_frame;
+  m_stats.hits=0;
+  m_stats.misses=0;
+  m_stats.uploads=0;
+  m_stats.evictions=0;
+  m_stats.dropped=0;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void LabelCache::request(uint32_t _sku)
+{
+  if(_sku>=m_count || m_skuFrame[_sku]==m_frame)
+  {
+    return;
+  }
+  m_skuFrame[_sku]=m_frame;
+  if(m_skuResident[_sku])
+  {
+    ++m_stats.hits;
+    ++m_stats.totalHits;
+    int layer=static_cast<int>(m_skuLayer[_sku]);
+    if(layer!=0)
+    {
+      m_lru.splice(m_lru.begin(),m_lru,m_lruPosition[static_cast<size_t>(layer)]);
+    }
+    return;
+  }
+  ++m_stats.misses;
+  ++m_stats.totalMisses;
+  if(m_skuLoading[_sku])
+  {
+    return;
+  }
+  if(m_stats.loading>=MAX_IN_FLIGHT)
+  {
+    return;
+  }
+  m_skuLoading[_sku]=1;
+  ++m_stats.loading;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_queue.push_back(_sku);
+  m_wake.notify_one();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void LabelCache::update(GLuint _unit, GLuint _binding)
+{
+  std::deque<Load> done;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t bytes=0;
+    while(!m_done.empty() && bytes<UPLOAD_BYTES_PER_FRAME)
+    {
+      done.push_back(std::move(m_done.front()));
+      m_done.pop_front();
+      bytes+=m_labelBytes;
+    }
+  }
+  for(auto &load : done)
+  {
+    m_skuLoading[load.sku]=0;
+    --m_stats.loading;
+    int layer=evict();
+    if(layer<0)
+    {
+      ++m_stats.dropped;
+      continue;
+    }
+    upload(load,layer);
+    m_lru.splice(m_lru.begin(),m_lru,m_lruPosition[static_cast<size_t>(layer)]);
+  }
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_layerBuffer);
+  if(m_dirtyFirst<=m_dirtyLast)
+  {
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER,static_cast<GLintptr>(m_dirtyFirst*sizeof(uint32_t)),
+                    static_cast<GLsizeiptr>((m_dirtyLast-m_dirtyFirst+1)*sizeof(uint32_t)),&m_skuLayer[m_dirtyFirst]);
+    m_dirtyFirst=NO_SKU;
+    m_dirtyLast=0;
+  }
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER,_binding,m_layerBuffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+  glActiveTexture(GL_TEXTURE0+_unit);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,m_texture);
+
+  auto now=std::chrono::steady_clock::now();
+  float seconds=std::chrono::duration<float>(now-m_windowStart).count();
+  if(seconds>=1.0f)
+  {
+    m_stats.uploadMBps=static_cast<float>(m_windowBytes)/(1024.0f*1024.0f)/seconds;
+    m_windowBytes=0;
+    m_windowStart=now;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+std::string LabelCache::report() const
+{
+  std::ostringstream out;
+  uint64_t asked=m_stats.totalHits+m_stats.totalMisses;
+  out<<"labels "<<m_stats.resident<<"/"<<m_count<<" resident in "<<m_layers<<" layers, hit "
+     <<m_stats.hits<<" miss "<<m_stats.misses<<" ("
+     <<(asked ? 100.0*static_cast<double>(m_stats.totalHits)/static_cast<double>(asked) : 100.0)<<"% overall), loading "
+     <<m_stats.loading<<", up "<<m_stats.uploads<<" evict "<<m_stats.evictions<<" drop "<<m_stats.dropped
+     <<", "<<m_stats.uploadMBps<<" MB/s";
+  return out.str();
+}
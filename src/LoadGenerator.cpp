@@ -0,0 +1,206 @@
+#include "LoadGenerator.h"
+#include "Histogram.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QString>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief how long a client waits on the server before giving up
+//----------------------------------------------------------------------------------------------------------------------
+constexpr int TIMEOUT_MS=30000;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief labels are picked from this many SKUs, the server wraps them to its catalogue
+//----------------------------------------------------------------------------------------------------------------------
+constexpr int LABEL_RANGE=256;
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief what every client adds to once a job comes back
+//----------------------------------------------------------------------------------------------------------------------
+struct LoadResults
+{
+  std::mutex mutex;
+  Histogram latency;
+  Histogram serverLatency;
+  uint64_t bytes=0;
+  double batchSum=0.0;
+  std::atomic<int> completed{0};
+  std::atomic<int> failed{0};
+};
+
+//________________________________________________________________________________________________________________________________________//
+
+static bool readLine(QLocalSocket &_socket, QByteArray &o_line)
+{
+  while(!_socket.canReadLine())
+  {
+    if(!_socket.waitForReadyRead(TIMEOUT_MS))
+    {
+      return false;
+    }
+  }
+  o_line=_socket.readLine();
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+static bool readBytes(QLocalSocket &_socket, int _bytes, QByteArray &o_data)
+{
+  while(_socket.bytesAvailable()<_bytes)
+  {
+    if(!_socket.waitForReadyRead(TIMEOUT_MS))
+    {
+      return false;
+    }
+  }
+  o_data=_socket.read(_bytes);
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+static QJsonArray toJson(float _x, float _y, float _z)
+{
+  return QJsonArray{_x,_y,_z};
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief one connection, sends its jobs keeping _inFlight outstanding and reads back the results
+//----------------------------------------------------------------------------------------------------------------------
+static void client(const QString &_socket, int _client, int _jobs, int _inFlight, LoadResults &io_results)
+{
+  QLocalSocket socket;
+  socket.connectToServer(_socket);
+  if(!socket.waitForConnected(TIMEOUT_MS))
+  {
+    std::printf("client %d could not connect: %s\n",_client,socket.errorString().toStdString().c_str());
+    io_results.failed+=_jobs;
+    return;
+  }
+  // a handful of shots so jobs from different clients can share a frame on the server
+  struct Shot
+  {
+    float eye[3];
+    int width;
+    int height;
+  };
+  const Shot shots[]=
+  {
+    {{0.0f,1.0f,4.0f},512,512},
+    {{3.0f,2.0f,3.0f},512,512},
+    {{-3.0f,1.5f,3.0f},256,256},
+    {{0.0f,4.0f,6.0f},1024,576}
+  };
+  constexpr int numShots=sizeof(shots)/sizeof(Shot);
+  std::mt19937 rng(static_cast<unsigned>(_client)*7919u+1u);
+  std::uniform_int_distribution<int> shotDist(0,numShots-1);
+  std::uniform_int_distribution<int> labelDist(0,LABEL_RANGE-1);
+
+  std::map<int,std::chrono::steady_clock::time_point> sent;
+  int next=0;
+  int received=0;
+  while(received<_jobs)
+  {
+    while(next<_jobs && next-received<_inFlight)
+    {
+      const Shot &shot=shots[shotDist(rng)];
+      int id=_client*_jobs+next;
+      QJsonObject job;
+      job["id"]=id;
+      job["label"]=labelDist(rng);
+      job["eye"]=toJson(shot.eye[0],shot.eye[1],shot.eye[2]);
+      job["look"]=toJson(0.0f,1.0f,0.0f);
+      job["width"]=shot.width;
+      job["height"]=shot.height;
+      sent[id]=std::chrono::steady_clock::now();
+      socket.write(QJsonDocument(job).toJson(QJsonDocument::Compact)+"\n");
+      ++next;
+    }
+    socket.flush();
+
+    QByteArray line;
+    if(!readLine(socket,line))
+    {
+      std::printf("client %d timed out with %d jobs outstanding\n",_client,next-received);
+      io_results.failed+=_jobs-received;
+      return;
+    }
+    QJsonObject header=QJsonDocument::fromJson(line).object();
+    int id=header["id"].toInt();
+    int bytes=header["bytes"].toInt();
+    QByteArray image;
+    bool ok=header["status"].toString()=="ok" && readBytes(socket,bytes,image) &&
+            image.startsWith(QByteArray("\x89PNG\r\n\x1a\n",8));
+    ++received;
+    auto start=sent.find(id);
+    if(!ok || start==sent.end())
+    {
+      ++io_results.failed;
+      continue;
+    }
+    float latency=std::chrono::duration<float,std::milli>(std::chrono::steady_clock::now()-start->second).count();
+    sent.erase(start);
+    ++io_results.completed;
+    std::lock_guard<std::mutex> lock(io_results.mutex);
+    io_results.latency.add(latency);
+    io_results.serverLatency.add(static_cast<float>(header["latencyMs"].toDouble()));
+    io_results.bytes+=static_cast<uint64_t>(bytes);
+    io_results.batchSum+=header["batch"].toDouble();
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int LoadGenerator::run(const QString &_socket, int _clients, int _jobs, int _inFlight)
+{
+  std::printf("%d clients x %d jobs, %d in flight each\n",_clients,_jobs,_inFlight);
+  LoadResults results;
+  auto start=std::chrono::steady_clock::now();
+  std::vector<std::thread> clients;
+  for(int i=0; i<_clients; ++i)
+  {
+    clients.emplace_back(client,std::cref(_socket),i,_jobs,_inFlight,std::ref(results));
+  }
+  for(auto &thread : clients)
+  {
+    thread.join();
+  }
+  double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+  int completed=results.completed;
+  std::printf("completed %d failed %d in %.2f s, %.1f jobs/s %.1f MB/s\n",
+              completed,results.failed.load(),seconds,completed/seconds,results.bytes/seconds/(1024.0*1024.0));
+  std::printf("client latency p50 %.1f p95 %.1f p99 %.1f max %.1f ms, server latency p50 %.1f p99 %.1f ms\n",
+              results.latency.percentile(0.5f),results.latency.percentile(0.95f),
+              results.latency.percentile(0.99f),results.latency.max(),
+              results.serverLatency.percentile(0.5f),results.serverLatency.percentile(0.99f));
+  std::printf("mean batch %.2f\n",completed>0 ? results.batchSum/completed : 0.0);
+
+  // and what the server saw, over every client it has served
+  QLocalSocket socket;
+  socket.connectToServer(_socket);
+  QByteArray line;
+  if(socket.waitForConnected(TIMEOUT_MS))
+  {
+    socket.write(QByteArray("{\"stats\":true}\n"));
+    socket.flush();
+    if(readLine(socket,line))
+    {
+      std::printf("server %s",line.constData());
+    }
+  }
+  return results.failed==0 && completed>0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,357 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief a collapse is rejected if it turns any remaining triangle's normal by more than about 75 degrees
+//----------------------------------------------------------------------------------------------------------------------
+constexpr double MIN_NORMAL_COS=0.25;
+
+//________________________________________________________________________________________________________________________________________//
+
+void MeshSimplifier::Quadric::addPlane(double _x, double _y, double _z, double _d, double _area)
+{
+  a[0]+=_area*_x*_x; a[1]+=_area*_x*_y; a[2]+=_area*_x*_z; a[3]+=_area*_x*_d;
+  a[4]+=_area*_y*_y; a[5]+=_area*_y*_z; a[6]+=_area*_y*_d;
+  a[7]+=_area*_z*_z; a[8]+=_area*_z*_d;
+  a[9]+=_area*_d*_d;
+  area+=_area;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void MeshSimplifier::Quadric::add(const Quadric &_q)
+{
+  for(int i=0; i<10; ++i)
+  {
+    a[i]+=_q.a[i];
+  }
+  area+=_q.area;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+double MeshSimplifier::Quadric::evaluate(double _x, double _y, double _z) const
+{
+  return a[0]*_x*_x + 2.0*a[1]*_x*_y + 2.0*a[2]*_x*_z + 2.0*a[3]*_x
+       + a[4]*_y*_y + 2.0*a[5]*_y*_z + 2.0*a[6]*_y
+       + a[7]*_z*_z + 2.0*a[8]*_z
+       + a[9];
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+MeshSimplifier::MeshSimplifier(const std::vector<float> &_positions, const std::vector<uint32_t> &_indices) :
+  m_positions(_positions)
+{
+  size_t numVerts=m_positions.size()/3;
+  m_vertexTriangles.resize(numVerts);
+  m_quadrics.resize(numVerts);
+  m_locked.assign(numVerts,0);
+  m_vertexAlive.assign(numVerts,1);
+
+  // drop any degenerate triangles up front
+  for(size_t i=0; i+2<_indices.size(); i+=3)
+  {
+    uint32_t a=_indices[i], b=_indices[i+1], c=_indices[i+2];
+    if(a==b || b==c || a==c)
+    {
+      continue;
+    }
+    uint32_t t=static_cast<uint32_t>(m_triangles.size()/3);
+    m_triangles.insert(m_triangles.end(),{a,b,c});
+    m_vertexTriangles[a].push_back(t);
+    m_vertexTriangles[b].push_back(t);
+    m_vertexTriangles[c].push_back(t);
+  }
+  m_liveTriangles=m_triangles.size()/3;
+  m_triangleAlive.assign(m_liveTriangles,1);
+
+  // edges used by a single triangle are borders, in a welded mesh this includes the uv seams
+  std::unordered_map<uint64_t,int> edgeUse;
+  auto edgeKey=[](uint32_t _a, uint32_t _b){ return (static_cast<uint64_t>(std::min(_a,_b))<<32) | std::max(_a,_b); };
+  for(size_t i=0; i<m_triangles.size(); i+=3)
+  {
+    for(int e=0; e<3; ++e)
+    {
+      ++edgeUse[edgeKey(m_triangles[i+e],m_triangles[i+(e+1)%3])];
+    }
+  }
+  for(auto &edge : edgeUse)
+  {
+    if(edge.second==1)
+    {
+      m_locked[edge.first>>32]=1;
+      m_locked[edge.first & 0xffffffffu]=1;
+    }
+  }
+  // also lock anything sharing a position with another vertex in case the seam is closed by other faces
+  std::map<std::tuple<float,float,float>,uint32_t> positionUse;
+  for(size_t v=0; v<numVerts; ++v)
+  {
+    ++positionUse[std::make_tuple(m_positions[3*v],m_positions[3*v+1],m_positions[3*v+2])];
+  }
+  for(size_t v=0; v<numVerts; ++v)
+  {
+    if(positionUse[std::make_tuple(m_positions[3*v],m_positions[3*v+1],m_positions[3*v+2])]>1)
+    {
+      m_locked[v]=1;
+    }
+  }
+
+  // each vertex starts with the planes of the triangles around it
+  for(size_t i=0; i<m_triangles.size(); i+=3)
+  {
+    const float *p0=&m_positions[3*m_triangles[i]];
+    const float *p1=&m_positions[3*m_triangles[i+1]];
+    const float *p2=&m_positions[3*m_triangles[i+2]];
+    double e1[3]={p1[0]-p0[0],p1[1]-p0[1],p1[2]-p0[2]};
+    double e2[3]={p2[0]-p0[0],p2[1]-p0[1],p2[2]-p0[2]};
+    double n[3]={e1[1]*e2[2]-e1[2]*e2[1],e1[2]*e2[0]-e1[0]*e2[2],e1[0]*e2[1]-e1[1]*e2[0]};
+    double len=std::sqrt(n[0]*n[0]+n[1]*n[1]+n[2]*n[2]);
+    if(len<=0.0)
+    {
+      continue;
+    }
+    n[0]/=len; n[1]/=len; n[2]/=len;
+    double d=-(n[0]*p0[0]+n[1]*p0[1]+n[2]*p0[2]);
+    // weighted by area so a dense patch of small triangles doesn't outvote a large one
+    for(int c=0; c<3; ++c)
+    {
+      m_quadrics[m_triangles[i+c]].addPlane(n[0],n[1],n[2],d,0.5*len);
+    }
+  }
+
+  for(uint32_t v=0; v<numVerts; ++v)
+  {
+    pushCandidates(v);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void MeshSimplifier::pushCandidates(uint32_t _v)
+{
+  for(auto t : m_vertexTriangles[_v])
+  {
+    if(!m_triangleAlive[t])
+    {
+      continue;
+    }
+    for(int c=0; c<3; ++c)
+    {
+      uint32_t w=m_triangles[3*t+c];
+      if(w==_v)
+      {
+        continue;
+      }
+      if(!m_locked[_v])
+      {
+        m_heap.push_back({collapseCost(_v,w),_v,w});
+        std::push_heap(m_heap.begin(),m_heap.end(),std::greater<Collapse>());
+      }
+      if(!m_locked[w])
+      {
+        m_heap.push_back({collapseCost(w,_v),w,_v});
+        std::push_heap(m_heap.begin(),m_heap.end(),std::greater<Collapse>());
+      }
+    }
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+double MeshSimplifier::collapseCost(uint32_t _from, uint32_t _to) const
+{
+  // the merged vertex sits at _to so it carries both sets of planes evaluated there, divided by
+  // their area it is the mean squared distance to them. Merged quadrics count a plane shared by
+  // both ends twice, the area does too so the mean is unchanged
+  const float *p=&m_positions[3*_to];
+  double area=m_quadrics[_from].area+m_quadrics[_to].area;
+  if(area<=0.0)
+  {
+    return 0.0;
+  }
+  return std::max(m_quadrics[_from].evaluate(p[0],p[1],p[2])+m_quadrics[_to].evaluate(p[0],p[1],p[2]),0.0)/area;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool MeshSimplifier::isEdge(uint32_t _a, uint32_t _b) const
+{
+  for(auto t : m_vertexTriangles[_a])
+  {
+    if(m_triangleAlive[t] && (m_triangles[3*t]==_b || m_triangles[3*t+1]==_b || m_triangles[3*t+2]==_b))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool MeshSimplifier::canCollapse(uint32_t _from, uint32_t _to) const
+{
+  // link condition, the only vertices both ends share must be the ones opposite the collapsing edge
+  // otherwise the collapse pinches the surface into a non manifold fin
+  std::vector<uint32_t> ringFrom;
+  std::vector<uint32_t> ringTo;
+  size_t shared=0;
+  for(auto t : m_vertexTriangles[_from])
+  {
+    if(!m_triangleAlive[t])
+    {
+      continue;
+    }
+    const uint32_t *tri=&m_triangles[3*t];
+    bool hasTo= tri[0]==_to || tri[1]==_to || tri[2]==_to;
+    shared+=hasTo ? 1 : 0;
+    for(int c=0; c<3; ++c)
+    {
+      if(tri[c]!=_from)
+      {
+        ringFrom.push_back(tri[c]);
+      }
+    }
+    if(hasTo)
+    {
+      continue;
+    }
+    // reject the collapse if the triangle would flip or collapse to a sliver
+    const float *p[3];
+    const float *q[3];
+    for(int c=0; c<3; ++c)
+    {
+      p[c]=&m_positions[3*tri[c]];
+      q[c]= tri[c]==_from ? &m_positions[3*_to] : p[c];
+    }
+    auto normal=[](const float *const *_v, double *o_n)
+    {
+      double e1[3]={_v[1][0]-_v[0][0],_v[1][1]-_v[0][1],_v[1][2]-_v[0][2]};
+      double e2[3]={_v[2][0]-_v[0][0],_v[2][1]-_v[0][1],_v[2][2]-_v[0][2]};
+      o_n[0]=e1[1]*e2[2]-e1[2]*e2[1];
+      o_n[1]=e1[2]*e2[0]-e1[0]*e2[2];
+      o_n[2]=e1[0]*e2[1]-e1[1]*e2[0];
+    };
+    double n0[3];
+    double n1[3];
+    normal(p,n0);
+    normal(q,n1);
+    double d=n0[0]*n1[0]+n0[1]*n1[1]+n0[2]*n1[2];
+    double l0=std::sqrt(n0[0]*n0[0]+n0[1]*n0[1]+n0[2]*n0[2]);
+    double l1=std::sqrt(n1[0]*n1[0]+n1[1]*n1[1]+n1[2]*n1[2]);
+    if(l1<=0.0 || d<MIN_NORMAL_COS*l0*l1)
+    {
+      return false;
+    }
+  }
+  for(auto t : m_vertexTriangles[_to])
+  {
+    if(!m_triangleAlive[t])
+    {
+      continue;
+    }
+    for(int c=0; c<3; ++c)
+    {
+      if(m_triangles[3*t+c]!=_to)
+      {
+        ringTo.push_back(m_triangles[3*t+c]);
+      }
+    }
+  }
+  std::sort(ringFrom.begin(),ringFrom.end());
+  ringFrom.erase(std::unique(ringFrom.begin(),ringFrom.end()),ringFrom.end());
+  std::sort(ringTo.begin(),ringTo.end());
+  ringTo.erase(std::unique(ringTo.begin(),ringTo.end()),ringTo.end());
+  std::vector<uint32_t> common;
+  std::set_intersection(ringFrom.begin(),ringFrom.end(),ringTo.begin(),ringTo.end(),std::back_inserter(common));
+  return common.size()==shared;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void MeshSimplifier::collapse(uint32_t _from, uint32_t _to)
+{
+  for(auto t : m_vertexTriangles[_from])
+  {
+    if(!m_triangleAlive[t])
+    {
+      continue;
+    }
+    uint32_t *tri=&m_triangles[3*t];
+    if(tri[0]==_to || tri[1]==_to || tri[2]==_to)
+    {
+      m_triangleAlive[t]=0;
+      --m_liveTriangles;
+      continue;
+    }
+    for(int c=0; c<3; ++c)
+    {
+      if(tri[c]==_from)
+      {
+        tri[c]=_to;
+      }
+    }
+    m_vertexTriangles[_to].push_back(t);
+  }
+  m_vertexTriangles[_from].clear();
+  m_vertexAlive[_from]=0;
+  m_quadrics[_to].add(m_quadrics[_from]);
+
+  auto &tris=m_vertexTriangles[_to];
+  tris.erase(std::remove_if(tris.begin(),tris.end(),[this](uint32_t _t){ return !m_triangleAlive[_t]; }),tris.end());
+  pushCandidates(_to);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void MeshSimplifier::simplify(size_t _targetTriangles)
+{
+  while(m_liveTriangles>_targetTriangles && !m_heap.empty())
+  {
+    std::pop_heap(m_heap.begin(),m_heap.end(),std::greater<Collapse>());
+    Collapse c=m_heap.back();
+    m_heap.pop_back();
+    if(!m_vertexAlive[c.from] || !m_vertexAlive[c.to] || !isEdge(c.from,c.to))
+    {
+      continue;
+    }
+    // a stale entry that has got dearer is re-queued at its real cost, one that has got cheaper
+    // is still cheaper than anything left in the heap
+    double cost=collapseCost(c.from,c.to);
+    if(cost>c.cost*(1.0+1e-9)+1e-12)
+    {
+      m_heap.push_back({cost,c.from,c.to});
+      std::push_heap(m_heap.begin(),m_heap.end(),std::greater<Collapse>());
+      continue;
+    }
+    if(!canCollapse(c.from,c.to))
+    {
+      continue;
+    }
+    m_error=std::max(m_error,static_cast<float>(std::sqrt(cost)));
+    collapse(c.from,c.to);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+std::vector<uint32_t> MeshSimplifier::indices() const
+{
+  std::vector<uint32_t> out;
+  out.reserve(m_liveTriangles*3);
+  for(size_t t=0; t<m_triangleAlive.size(); ++t)
+  {
+    if(m_triangleAlive[t])
+    {
+      out.insert(out.end(),{m_triangles[3*t],m_triangles[3*t+1],m_triangles[3*t+2]});
+    }
+  }
+  return out;
+}
@@ -14,14 +14,20 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <noise/noise.h>
 
-
-
-constexpr int TEXTURE_WIDTH=1024;
-constexpr int TEXTURE_HEIGHT=1024;
-
-constexpr auto CanProgram="CanProgram";
-constexpr auto PlaneProgram="PlaneProgram";
-
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief texture memory for the label array, it holds as many labels as fit
+//----------------------------------------------------------------------------------------------------------------------
+constexpr size_t LABEL_BUDGET=128*1024*1024;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the uniform block bindings of the streamed blocks, 0 is the turntable's views
+//----------------------------------------------------------------------------------------------------------------------
+constexpr GLuint VIEW_BLOCK_BINDING=1;
+constexpr GLuint OBJECT_BLOCK_BINDING=2;
+constexpr GLuint LIGHT_BLOCK_BINDING=3;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief stream buffer bytes per frame, an object's block takes 256 with the usual alignment
+//----------------------------------------------------------------------------------------------------------------------
+constexpr size_t STREAM_REGION_SIZE=4*1024*1024;
 
 NGLScene::NGLScene()
 {
@@ -31,6 +37,8 @@ NGLScene::NGLScene()
   m_lightXoffset=8.0;
   m_lightZoffset=8.0;
   setTitle("Can Project");
+  m_latencyClock.start();
+  m_latencyReportTimer.start();
 }
 
 //________________________________________________________________________________________________________________________________________//
@@ -39,31 +47,45 @@ NGLScene::NGLScene()
 NGLScene::~NGLScene()
 {
   std::cout<<"Shutting down NGL, removing VAO's and Shaders\n";
+  if(m_renderThread)
+  {
+    m_renderThread->stop();
+  }
 }
 
-void NGLScene::resizeGL( int _w, int _h )
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::releaseRenderer()
 {
-  m_cam.setShape( 45.0f, static_cast<float>( _w ) / _h, 0.05f, 350.0f );
-  m_win.width  = static_cast<int>( _w * devicePixelRatio() );
-  m_win.height = static_cast<int>( _h * devicePixelRatio() );
+  // the VAOs and framebuffers aren't shared with the window's context, so they have to go here
+  m_labels.destroy();
+  m_shadowAtlas.destroy();
+  m_passTimer.destroy();
+  m_variants.releaseQueries();
+  m_stream.destroy();
+  m_canMesh.reset();
+  m_meshes.clear();
+  m_text.reset();
 }
 
 //________________________________________________________________________________________________________________________________________//
 //________________________________________________________________________________________________________________________________________//
 
-void NGLScene::initializeGL()
+void NGLScene::initializeRenderer()
 {
   constexpr float znear=0.1f;
   constexpr float zfar=100.0f;
   // we must call this first before any other GL commands to load and link the
   // gl commands from the lib, if this is not done program will crash
   ngl::NGLInit::instance();
+  // the window published its size before starting the thread
+  m_inputs.update();
+  m_frameInput=m_inputs.readBuffer();
 
   glClearColor(0.4f, 0.4f, 0.4f, 1.0f);			   // Grey Background
   // enable depth testing for drawing
   glEnable(GL_DEPTH_TEST);
-  // enable multisampling for smoother drawing
-  glEnable(GL_MULTISAMPLE);
+  // the surface is single sample, anti-aliasing is done on the scene target after it is rendered
 
 
   m_quadVAO = 0;
@@ -84,15 +106,7 @@ void NGLScene::initializeGL()
   // set the shape using FOV 45 Aspect Ratio based on Width and Height
   // The final two are near and far clipping planes of 0.5 and 10
   m_cam.setShape(45,720.0f/576.0f,znear,zfar);
-
-  // now load to our light POV camera
-  m_lightCamera.set(m_lightPosition,to,up);
-  // here we set the light POV camera shape, the aspect is 1 as our
-  // texture is square.
-  // use the same clip plane as before but set the FOV a bit larger
-  // to get slightly better shadows and the clip planes will help
-  // to get rid of some of the artefacts
-  m_lightCamera.setShape(45,float(width()/height()),znear,zfar);
+  // the light views are placed by the shadow atlas every frame
 
 
   // in this case I'm only using the light to hold the position
@@ -106,7 +120,6 @@ void NGLScene::initializeGL()
 
   // Initialise texture maps here
   initTexture(1, m_glossMapTex, "images/gloss.png");
-  initTexture(2, m_labelTex, "images/colourMapCan.tif");
   initTexture(3, m_bumpTex, "images/NormalMap.jpg");
 
   initTexture(4, m_woodTex, "images/woodDif.jpg");
@@ -119,94 +132,30 @@ void NGLScene::initializeGL()
 
   //________________________________________________________________________________________________________________________________________//
 
-  // we are creating a shader called DOF
-  shader->createShaderProgram("DOF");
-  // now we are going to create empty shaders for Frag and Vert
-  shader->attachShader("DOFVertex",ngl::ShaderType::VERTEX);
-  shader->attachShader("DOFFragment",ngl::ShaderType::FRAGMENT);
-  // attach the source
-  shader->loadShaderSource("DOFVertex","shaders/depthOfFieldVert.glsl");
-  shader->loadShaderSource("DOFFragment","shaders/depthOfFieldFrag.glsl");
-  // compile the shaders
-  shader->compileShader("DOFVertex");
-  shader->compileShader("DOFFragment");
-  // add them to the program
-  shader->attachShaderToProgram("DOF","DOFVertex");
-  shader->attachShaderToProgram("DOF","DOFFragment");
-
-  // now we have associated this data we can link the shader
-  shader->linkProgramObject("DOF");
+  // load the scene description, this creates the ground plane primitive and the can mesh
+  // and says which shader variants the materials need
+  loadScene();
+  std::cout<<m_assets.report()<<"\n";
+  // the labels the scene lists are streamed into unit 2 as a texture array, SKU 0 is loaded here
+  // and the rest when they are first seen
+  m_labels.create(m_sceneBase.labels.files, m_sceneBase.labels.count,
+                  m_sceneBase.labels.width, m_sceneBase.labels.height, LABEL_BUDGET);
 
-  //________________________________________________________________________________________________________________________________________//
-
-
-  // we are creating a shader called DOFFinal
-  shader->createShaderProgram("DOFFinal");
-  // now we are going to create empty shaders for Frag and Vert
-  shader->attachShader("DOFFinalVertex",ngl::ShaderType::VERTEX);
-  shader->attachShader("DOFFinalFragment",ngl::ShaderType::FRAGMENT);
-  // attach the source
-  shader->loadShaderSource("DOFFinalVertex","shaders/DOFFinalVert.glsl");
-  shader->loadShaderSource("DOFFinalFragment","shaders/DOFFinalFrag.glsl");
-  // compile the shaders
-  shader->compileShader("DOFFinalVertex");
-  shader->compileShader("DOFFinalFragment");
-  // add them to the program
-  shader->attachShaderToProgram("DOFFinal","DOFFinalVertex");
-  shader->attachShaderToProgram("DOFFinal","DOFFinalFragment");
-
-  // now we have associated this data we can link the shader
-  shader->linkProgramObject("DOFFinal");
-
-  //________________________________________________________________________________________________________________________________________//
+  // every program is built in one batch so the driver can compile them in parallel, or
+  // loaded straight from the binary cache when nothing has changed since the last run
+  createPrograms();
 
-  // we are creating a shader called Colour
-  shader->createShaderProgram("Colour");
-  // now we are going to create empty shaders for Frag and Vert
-  shader->attachShader("ColourVertex",ngl::ShaderType::VERTEX);
-  shader->attachShader("ColourFragment",ngl::ShaderType::FRAGMENT);
-  // attach the source
-  shader->loadShaderSource("ColourVertex","shaders/ColourVert.glsl");
-  shader->loadShaderSource("ColourFragment","shaders/ColourFrag.glsl");
-  // compile the shaders
-  shader->compileShader("ColourVertex");
-  shader->compileShader("ColourFragment");
-  // add them to the program
-  shader->attachShaderToProgram("Colour","ColourVertex");
-  shader->attachShaderToProgram("Colour","ColourFragment");
-
-  // now we have associated this data we can link the shader
-  shader->linkProgramObject("Colour");
   shader->use("Colour");
-
   shader->setShaderParam4f("Colour",1,0,0,1);
 
+  for(int variant : m_variants.variantsOf("Shadow"))
+  {
+    shader->use(m_variants.name(variant));
 
-  //________________________________________________________________________________________________________________________________________//
-
-  // we are creating a shader called Shadow
-  shader->createShaderProgram("Shadow");
-  // now we are going to create empty shaders for Frag and Vert
-  shader->attachShader("ShadowVertex",ngl::ShaderType::VERTEX);
-  shader->attachShader("ShadowFragment",ngl::ShaderType::FRAGMENT);
-  // attach the source
-  shader->loadShaderSource("ShadowVertex","shaders/ShadowVert.glsl");
-  shader->loadShaderSource("ShadowFragment","shaders/ShadowFrag.glsl");
-  // compile the shaders
-  shader->compileShader("ShadowVertex");
-  shader->compileShader("ShadowFragment");
-  // add them to the program
-  shader->attachShaderToProgram("Shadow","ShadowVertex");
-  shader->attachShaderToProgram("Shadow","ShadowFragment");
-
-  // now we have associated this data we can link the shader
-  shader->linkProgramObject("Shadow");
-
-  shader->use("Shadow");
-
-  shader->setUniform("specMap", 4);
-  shader->setUniform("difMap", 5);
-  shader->setUniform("normMap", 6);
+    shader->setUniform("specMap", 4);
+    shader->setUniform("difMap", 5);
+    shader->setUniform("normMap", 6);
+  }
 
   // shader->use("Shadow");
 
@@ -214,59 +163,37 @@ void NGLScene::initializeGL()
 
   // shader->setUniform("textureMap", 1);
 
-  // create the primitives to draw
-  ngl::VAOPrimitives *prim=ngl::VAOPrimitives::instance();
 
-  prim->createTrianglePlane("plane",80,80,80,80,ngl::Vec3(0,1,0));
+  //________________________________________________________________________________________________________________________________________//
 
+  for(int variant : m_variants.variantsOf(CanProgram))
+  {
+    shader->use(m_variants.name(variant));
+    shader->setUniform("envMap", 0);
+    m_CanID = shader->getProgramID(m_variants.name(variant));
+    glUniform1i(glGetUniformLocation(m_CanID, "gPosition"), 3);
+    glUniform1i(glGetUniformLocation(m_CanID, "gNormal"), 4);
+    glUniform1i(glGetUniformLocation(m_CanID, "gColour"), 5);
+    glUniform1i(glGetUniformLocation(m_CanID, "ssao"), 6);
 
-  //________________________________________________________________________________________________________________________________________//
 
-  shader->loadShader(CanProgram,
-                     "shaders/CanVert.glsl",
-                     "shaders/CanFrag.glsl");
-  shader->getProgramID(CanProgram);
-
-
-  shader->use(CanProgram);
-  m_CanID = shader->getProgramID(CanProgram);
-  glUniform1i(glGetUniformLocation(m_CanID, "gPosition"), 3);
-  glUniform1i(glGetUniformLocation(m_CanID, "gNormal"), 4);
-  glUniform1i(glGetUniformLocation(m_CanID, "gColour"), 5);
-  glUniform1i(glGetUniformLocation(m_CanID, "ssao"), 6);
-
-
-  shader->setUniform("glossMap", 1);
-  shader->setUniform("labelMap", 2);
-  shader->setUniform("normalMap", 3);
-
-  shader->setShaderParam3f("Light[0].La", 0.5, 0.5, 0.5);
-  shader->setShaderParam3f("Light[0].Ld", 1.0, 1.0, 1.0);
-  shader->setShaderParam3f("Light[0].Ls", 1.0, 1.0, 1.0);
-  shader->setShaderParam3f("Light[0].Intensity", 1.0, 1.0, 1.0);
-  shader->setShaderParam1f("Light[0].Linear", 0.0014);
-  shader->setShaderParam1f("Light[0].Quadratic", 0.000007);
-  shader->setShaderParam4f("Light[1].Position",-2.0, 2.0, 4.0, 1.0);
-  shader->setShaderParam3f("Light[1].La", 0.5, 0.5, 0.5);
-  shader->setShaderParam3f("Light[1].Ld", 0.1, 1.0, 1.0);
-  shader->setShaderParam3f("Light[1].Ls", 1.0, 1.0, 1.0);
-  shader->setShaderParam3f("Light[1].Intensity", 1.0, 1.0, 4.0);
-  shader->setShaderParam1f("Light[1].Linear", 0.35);
-  shader->setShaderParam1f("Light[1].Quadratic", 0.44);
-  shader->setShaderParam4f("Light[2].Position",4.0, 3.0, -1.0, 0.0);
-  shader->setShaderParam3f("Light[2].La", 0.5, 0.5, 0.5);
-  shader->setShaderParam3f("Light[2].Ld", 1.0, 0.1, 1.0);
-  shader->setShaderParam3f("Light[2].Ls", 1.0, 1.0, 1.0);
-  shader->setShaderParam3f("Light[2].Intensity", 5.0, 0.6, 0.6);
-  shader->setShaderParam1f("Light[2].Linear", 0.7);
-  shader->setShaderParam1f("Light[2].Quadratic", 1.8); //linear and quadratic values for attenuation from
-  //http://www.ogre3d.org/tikiwiki/tiki-index.php?page=-Point+Light+Attenuation
-
-  shader->setShaderParam2f("iResolution", width(), height());
-
-  // Load the Obj file and create a Vertex Array Object
-  m_mesh.reset(new ngl::Obj("data/can05.obj"));
-  m_mesh->createVAO();
+    shader->setUniform("glossMap", 1);
+    shader->setUniform("labelMap", 2);
+    shader->setUniform("normalMap", 3);
+
+    // the lights come from the Lights block loadShadowLights streams, see SCENE_LIGHTS
+
+    shader->setShaderParam2f("iResolution", m_frameInput.width, m_frameInput.height);
+  }
+
+  // the per instance matrices live in an SSBO, the culling pass writes the visible
+  // ids and indirect draw commands
+  glGenBuffers(1,&m_instanceSSBO);
+  // the view, object and light blocks are streamed every frame
+  m_stream.create(GL_UNIFORM_BUFFER,STREAM_REGION_SIZE);
+  createCullBuffers();
+  buildInstances();
+  glGenQueries(2,m_frameQuery);
 
 
   //________________________________________________________________________________________________________________________________________//
@@ -283,6 +210,10 @@ void NGLScene::initializeGL()
  // createSSAOKernelNoise();
 
   createBlurFBO();
+  createHiZ();
+  createAntiAliasing();
+  createAccumulation();
+  createQualityTargets();
 
 
 
@@ -303,9 +234,7 @@ void NGLScene::initializeGL()
   m_text.reset(  new ngl::Text(QFont("Ariel",14)));
   m_text->setColour(1,1,1);
   // as re-size is not explicitly called we need to do this.
-  // also need to take into account the retina display
-  glViewport(0, 0, width() * devicePixelRatio(), height() * devicePixelRatio());
-  m_lightTimer =startTimer(40);
+  resizeRenderer();
 
   //glEnable(GL_FRAMEBUFFER_SRGB);
 
@@ -314,65 +243,93 @@ void NGLScene::initializeGL()
 //________________________________________________________________________________________________________________________________________//
 //________________________________________________________________________________________________________________________________________//
 
-void NGLScene::loadMatricesToShadowShader()
+void NGLScene::loadMatricesToShadowShader(bool _reflected)
 {
   ngl::ShaderLib *shader=ngl::ShaderLib::instance();
-  shader->use("Shadow");
-  ngl::Mat4 MV;
+  const std::vector<int> &variants=_reflected ? m_reflectionVariant : m_materialVariant;
+  shader->use(m_variants.name(variants[m_scene.material[m_currentObject]]));
+  // the object's matrices are kept up to date by updateTransforms, only the view is applied here
+  const TransformBatch::Matrices &matrices=m_objectMatrices[m_objectSlot[m_currentObject]];
+  ngl::Mat4 model;
+  std::copy(matrices.world,matrices.world+16,model.m_openGL);
   ngl::Mat4 MVP;
   ngl::Mat3 normalMatrix;
-  ngl::Mat4 M;
-  M=m_transform.getMatrix()*m_mouseGlobalTX;
-  MV=  M*m_cam.getViewMatrix();
-  MVP= M*m_cam.getVPMatrix();
-  normalMatrix=MV;
-  normalMatrix = normalMatrix.inverse();
-  // shader->setShaderParamFromMat4("M",M);
-  // shader->setShaderParamFromMat4("MV",MV);
-  shader->setShaderParamFromMat4("MVP",MVP);
-  shader->setShaderParamFromMat3("normalMatrix",normalMatrix);
-  shader->setShaderParam4f("Light[0].Position",m_lightPosition.m_x,m_lightPosition.m_y,m_lightPosition.m_z, 1.0);
-  shader->setShaderParam3f("Light[0].La", 0.5, 0.5, 0.5);
-  shader->setShaderParam3f("Light[0].Ld", 1.0, 1.0, 1.0);
-  shader->setShaderParam3f("Light[0].Ls", 1.0, 1.0, 1.0);
-  shader->setShaderParam3f("Light[0].Intensity", 1.0, 1.0, 1.0);
-  shader->setShaderParam1f("Light[0].Linear", 0.0014);
-  shader->setShaderParam1f("Light[0].Quadratic", 0.000007);
-  shader->setShaderParam4f("Light[1].Position",0.0, 2.0, 4.0, 1.0);
-  shader->setShaderParam3f("Light[1].La", 0.5, 0.5, 0.5);
-  shader->setShaderParam3f("Light[1].Ld", 0.1, 1.0, 1.0);
-  shader->setShaderParam3f("Light[1].Ls", 1.0, 1.0, 1.0);
-  shader->setShaderParam3f("Light[1].Intensity", 1.0, 1.0, 4.0);
-  shader->setShaderParam1f("Light[1].Linear", 0.35);
-  shader->setShaderParam1f("Light[1].Quadratic", 1.44);
-  shader->setShaderParam4f("Light[2].Position",4.0, 3.0, -1.0, 0.0);
-  shader->setShaderParam3f("Light[2].La", 0.5, 0.5, 0.5);
-  shader->setShaderParam3f("Light[2].Ld", 1.0, 0.1, 1.0);
-  shader->setShaderParam3f("Light[2].Ls", 1.0, 1.0, 1.0);
-  shader->setShaderParam3f("Light[2].Intensity", 5.0, 0.6, 0.6);
-  shader->setShaderParam1f("Light[2].Linear", 0.7);
-  shader->setShaderParam1f("Light[2].Quadratic", 1.8);
+  // the mirrored view already has the mouse transform in it and isn't jittered, its texels are
+  // several pixels across and the resolve would only blur them further
+  ngl::Mat4 V=_reflected ? m_reflectionView : m_mouseGlobalTX*m_cam.getViewMatrix();
+  MVP= _reflected ? model*m_reflectionView*m_reflectionProjection : model*V*m_cam.getProjectionMatrix()*m_jitter;
+  // the mouse and camera transforms are rigid so the model inverse transpose just needs rotating
+  for(int row=0; row<3; ++row)
+  {
+    for(int col=0; col<3; ++col)
+    {
+      normalMatrix.m_m[row][col]=matrices.normal[row*4+col];
+    }
+  }
+  normalMatrix=normalMatrix*ngl::Mat3(V);
+  // the eye space position and the tangent frame come from MV
+  streamObjectMatrices(model,model*V,MVP,normalMatrix);
+  loadShadowLights();
 
 
   // shader->setShaderParam4f("inColour",1,1,1,1);
 
-  // x = x* 0.5 + 0.5
-  // y = y* 0.5 + 0.5
-  // z = z* 0.5 + 0.5
-  // Moving from unit cube [-1,1] to [0,1]
-  ngl::Mat4 bias;
-  bias.scale(0.5,0.5,0.5);
-  bias.translate(0.5,0.5,0.5);
+  // the shadow lookups go through the atlas views in world space, see ShadowFrag.glsl
+  loadMaterial(m_scene.materials[m_scene.material[m_currentObject]]);
+}
 
-  ngl::Mat4 view=m_lightCamera.getViewMatrix();
-  ngl::Mat4 proj=m_lightCamera.getProjectionMatrix();
-  ngl::Mat4 model=m_transform.getMatrix();
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::streamObjectMatrices(const ngl::Mat4 &_model, const ngl::Mat4 &_MV, const ngl::Mat4 &_MVP, const ngl::Mat3 &_normalMatrix)
+{
+  ObjectBlock block;
+  std::copy(_MV.m_openGL,_MV.m_openGL+16,block.MV);
+  std::copy(_MVP.m_openGL,_MVP.m_openGL+16,block.MVP);
+  std::copy(_model.m_openGL,_model.m_openGL+16,block.M);
+  for(int col=0; col<3; ++col)
+  {
+    std::copy(_normalMatrix.m_openGL+col*3,_normalMatrix.m_openGL+col*3+3,block.normalMatrix+col*4);
+    block.normalMatrix[col*4+3]=0.0f;
+  }
+  m_stream.bind(OBJECT_BLOCK_BINDING,m_stream.write(block));
+}
 
-  //  ngl::Mat4 lightSpaceMatrix = model * view * proj * bias;
+//________________________________________________________________________________________________________________________________________//
 
-  ngl::Mat4 textureMatrix= model * view*proj * bias;
-  shader->setShaderParamFromMat4("textureMatrix",textureMatrix);
-  // shader->setShaderParamFromMat4("lightSpaceMatrix",lightSpaceMatrix);
+void NGLScene::loadShadowLights()
+{
+  // a block from an earlier region may already be fenced and overwritten, even within a frame
+  if(m_lightBlockGeneration!=m_stream.generation())
+  {
+    // the positions and attenuation are the ones the shadow atlas placed its views for, the
+    // directional light has w 0
+    LightBlock block[3];
+    for(int i=0; i<3; ++i)
+    {
+      const SceneLight &light=SCENE_LIGHTS[i];
+      const ngl::Vec3 &position=m_shadowLights[i].position;
+      const ngl::Vec3 *colours[4]={&light.ambient,&light.diffuse,&light.specular,&light.intensity};
+      GLfloat *values[4]={block[i].La,block[i].Ld,block[i].Ls,block[i].intensity};
+      for(int c=0; c<4; ++c)
+      {
+        values[c][0]=colours[c]->m_x;
+        values[c][1]=colours[c]->m_y;
+        values[c][2]=colours[c]->m_z;
+      }
+      block[i].La[3]=block[i].Ld[3]=block[i].Ls[3]=0.0f;
+      block[i].position[0]=position.m_x;
+      block[i].position[1]=position.m_y;
+      block[i].position[2]=position.m_z;
+      block[i].position[3]=light.light.type==ShadowLight::Type::DIRECTIONAL ? 0.0f : 1.0f;
+      block[i].linear=m_shadowLights[i].linear;
+      block[i].quadratic=m_shadowLights[i].quadratic;
+      block[i].pad[0]=block[i].pad[1]=block[i].pad[2]=0.0f;
+    }
+    m_lightBlock=m_stream.write(block);
+    // the write itself may have overflowed into the next region, it is the generation after it
+    m_lightBlockGeneration=m_stream.generation();
+  }
+  m_stream.bind(LIGHT_BLOCK_BINDING,m_lightBlock);
 }
 
 //________________________________________________________________________________________________________________________________________//
@@ -381,72 +338,85 @@ void NGLScene::loadMatricesToShadowShader()
 void NGLScene::loadToLightPOVShader()
 {
   ngl::ShaderLib *shader=ngl::ShaderLib::instance();
-  shader->use("Colour");
-  ngl::Mat4 MVP=m_transform.getMatrix()* m_lightCamera.getVPMatrix();
-  shader->setShaderParamFromMat4("MVP",MVP);
+  shader->use("ShadowAtlas");
+  // the views were loaded once for the pass, each object only needs its world matrix
+  ngl::Mat4 model;
+  const float *world=m_objectMatrices[m_objectSlot[m_currentObject]].world;
+  std::copy(world,world+16,model.m_openGL);
+  shader->setShaderParamFromMat4("M",model);
+  shader->setShaderParam1i("instanced",0);
 }
 
 //________________________________________________________________________________________________________________________________________//
 //________________________________________________________________________________________________________________________________________//
 
-void NGLScene::drawScene(std::function<void()> _shaderFunc )
+void NGLScene::updateMouseTransform()
 {
   // Rotation based on the mouse position for our global transform
   ngl::Mat4 rotX;
   ngl::Mat4 rotY;
   // create the rotation matrices
-  rotX.rotateX(m_win.spinXFace);
-  rotY.rotateY(m_win.spinYFace);
+  rotX.rotateX(m_frameInput.spinXFace);
+  rotY.rotateY(m_frameInput.spinYFace);
   // multiply the rotations
   m_mouseGlobalTX=rotY*rotX;
   // add the translations
-  m_mouseGlobalTX.m_m[3][0] = m_modelPos.m_x;
-  m_mouseGlobalTX.m_m[3][1] = m_modelPos.m_y;
-  m_mouseGlobalTX.m_m[3][2] = m_modelPos.m_z;
-
-  //________________________________________________________________________________________________________________________________________//
-
-  // get the VBO instance
-  ngl::VAOPrimitives *prim=ngl::VAOPrimitives::instance();
+  m_mouseGlobalTX.m_m[3][0] = m_frameInput.modelPos.m_x;
+  m_mouseGlobalTX.m_m[3][1] = m_frameInput.modelPos.m_y;
+  m_mouseGlobalTX.m_m[3][2] = m_frameInput.modelPos.m_z;
+}
 
+//________________________________________________________________________________________________________________________________________//
+//________________________________________________________________________________________________________________________________________//
 
-  m_transform.reset();
-  m_transform.setPosition(0.0f,0.0f,0.0f);
-  _shaderFunc();
-  prim->draw("plane");
+void NGLScene::drawScene(std::function<void()> _shaderFunc, std::function<void()> _instanceFunc, int _pass )
+{
+  // the primitive objects inside this pass's frustum are drawn one at a time
+  for(auto object : m_cpuVisible[_pass])
+  {
+    const IndexedMesh *mesh=m_meshes[m_scene.mesh[object]].get();
+    if(mesh==nullptr)
+    {
+      continue;
+    }
+    m_currentObject=object;
+    _shaderFunc();
+    mesh->loadQuantisation();
+    // only the camera pass uses the material shaders
+    m_variants.beginDraw(_pass==0 ? m_materialVariant[m_scene.material[object]] : -1);
+    mesh->draw();
+    m_variants.endDraw();
+    ++m_drawCalls;
+  }
   //________________________________________________________________________________________________________________________________________//
 
-  m_transform.reset();
-  m_transform.setPosition(0.0f,0.0f,0.0f);
-  m_transform.setScale(0.4,0.4,0.4);
-  _shaderFunc();
-  m_mesh->draw();
+  // all the visible cans (one or a whole shelf) go in a single indirect draw
+  if(m_instances.empty())
+  {
+    return;
+  }
+  _instanceFunc();
+  m_canMesh->loadQuantisation();
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,m_instanceSSBO);
+  m_variants.beginDraw(_pass==0 ? m_materialVariant[m_canMaterialID] : -1);
+  m_canMesh->drawIndirect(m_cull[_pass].commands,m_canMesh->numLODs(),m_cull[_pass].visible);
+  m_variants.endDraw();
+  ++m_drawCalls;
 
 }
 
 //________________________________________________________________________________________________________________________________________//
 //________________________________________________________________________________________________________________________________________//
 
-void NGLScene::paintGL()
+void NGLScene::renderShadowAtlas()
 {
-  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
-
-
-  //________________________________________________________________________________________________________________________________________//
-
-  //----------------------------------------------------------------------------------------------------------------------
-  // Pass 1 render the Depth texture to the FBO
-  //----------------------------------------------------------------------------------------------------------------------
   // enable culling
   glEnable(GL_CULL_FACE);
 
-  // bind the FBO and render offscreen to the texture
-  glBindFramebuffer(GL_FRAMEBUFFER,m_ShadowfboID);
-  // bind the texture object to 0 (off )
+  // bind the atlas FBO, every layer is attached and each view has a viewport of its own
+  glBindFramebuffer(GL_FRAMEBUFFER,m_shadowAtlas.fbo());
   glBindTexture(GL_TEXTURE_2D,0);
-  // render to the same size as the texture to avoid
-  // distortions
-  glViewport(0,0,TEXTURE_WIDTH,TEXTURE_HEIGHT);
+  loadShadowViews();
 
   // Clear previous frame values
   glClear( GL_DEPTH_BUFFER_BIT);
@@ -455,8 +425,58 @@ void NGLScene::paintGL()
 
   // render only the back faces so less self shadowing
   glCullFace(GL_FRONT);
-  // draw the scene from the POV of the light
-  drawScene(std::bind(&NGLScene::loadToLightPOVShader,this));
+  // cull the cans against the box the atlas views cover, the geometry shader drops what each view can't see
+  float shadowPixelScale=m_shadowAtlas.casterVP().m_m[1][1]*m_shadowSize*0.5f;
+  cullInstances(1,m_shadowAtlas.casterVP(),shadowPixelScale,false,m_shadowLODBias);
+  drawScene(std::bind(&NGLScene::loadToLightPOVShader,this),
+            std::bind(&NGLScene::loadInstancesToLightPOVShader,this),
+            1);
+}
+
+//________________________________________________________________________________________________________________________________________//
+//________________________________________________________________________________________________________________________________________//
+
+bool NGLScene::renderFrame()
+{
+  consumeInput();
+  updateMouseTransform();
+  if(!updateAccumulation())
+  {
+    return false;
+  }
+  beginFrameStats();
+  updateQuality();
+  updateJitter();
+  cullScene();
+  streamLabels();
+
+  //________________________________________________________________________________________________________________________________________//
+
+  //----------------------------------------------------------------------------------------------------------------------
+  // Pass 1 render the Depth texture to the FBO
+  //----------------------------------------------------------------------------------------------------------------------
+  renderShadowAtlas();
+  m_passTimer.mark(SHADOW_PASS);
+  // blur the exponential moments if a receiver uses them and bind the shadow map views
+  prefilterShadows();
+  renderView();
+
+  endFrameStats();
+  publishFrame();
+  // after the frame is handed over so it neither waits for nor is timed with the thumbnails
+  renderTurntable();
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::renderView()
+{
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+
+  // the scene mirrored in the ground plane for the plane's shader to blend in
+  renderReflection();
 
   //________________________________________________________________________________________________________________________________________//
 
@@ -464,36 +484,43 @@ void NGLScene::paintGL()
   // Pass two : use the shadow map texture
   // Render the scene with the shadow map texture on the ground plane
   //----------------------------------------------------------------------------------------------------------------------
+  // cull against the camera frustum and last frame's depth pyramid
+  ngl::Mat4 cameraVP=m_mouseGlobalTX*m_cam.getVPMatrix();
+  // fewer pixels below full render scale so coarser levels of detail are fine, and a tile's
+  // pixels are as big as the whole picture's
+  float pixelScale=m_cam.getProjectionMatrix().m_m[1][1]*m_tileProjection.m_m[1][1]*
+                   m_frameInput.height*m_frameInput.devicePixelRatio*m_renderScale*0.5f;
+  cullInstances(0,cameraVP*m_tileProjection,pixelScale,m_occlusionCulling,0);
+
   // store framebuffer for main scene to a texture
   glBindFramebuffer(GL_FRAMEBUFFER, m_blurFBO);
 
-  // set the viewport to the screen dimensions
-  glViewport(0, 0, width() * devicePixelRatio(), height() * devicePixelRatio());
+  // render into the part of the target the current render scale covers
+  glViewport(0, 0, m_renderWidth, m_renderHeight);
   // enable colour rendering again
   glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
   // clear the screen
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   glClearColor(0.5f, 0.5f, 0.6f, 1.0f);
 
-  // bind the shadow texture
-  glBindTexture(GL_TEXTURE_2D,m_ShadowtextureID);
-
+  // the shadow atlas views were bound to their own units by prefilterShadows
 
   // only cull back faces
   glDisable(GL_CULL_FACE);
   glCullFace(GL_BACK);
-  // render scene with the shadow shader
-  drawScene(std::bind(&NGLScene::loadMatricesToShadowShader,this));
+  // render the ground with the shadow shader and the cans with the can shader
+  drawScene(std::bind(&NGLScene::loadMatricesToShadowShader,this,false),
+            std::bind(&NGLScene::loadInstancesToCanShader,this,false),
+            0);
 
-  //Draw the can
+  // the depth from this frame is next frame's occluder
+  buildHiZ(cameraVP*m_jitter);
 
-  m_transform.reset();
-  m_transform.setPosition(0.0f,0.0f,0.0f);
-  m_transform.setScale(0.4,0.4,0.4);
-  loadMatrices(CanProgram);
-  shader->use(CanProgram);
-  shader->setShaderParam4f("Light[0].Position",m_lightPosition.m_x,m_lightPosition.m_y,m_lightPosition.m_z, 1.0);
-  m_mesh->draw();
+  //----------------------------------------------------------------------------------------------------------------------
+  // Anti-alias the scene before it is blurred, or average it with the frames before while idle
+  //----------------------------------------------------------------------------------------------------------------------
+  m_passTimer.mark(SCENE_PASS);
+  GLuint sceneColour=upscale(m_accumulating ? accumulate() : antiAlias(cameraVP));
 
 
   //________________________________________________________________________________________________________________________________________//
@@ -505,16 +532,19 @@ void NGLScene::paintGL()
 
  //Code taken from https://learnopengl.com/#!Advanced-Lighting/Bloom
   bool horizontal = true, first_iteration = true;
-  unsigned int amount = 30;
-  shader->use("DOF");
+  unsigned int amount = static_cast<unsigned int>(m_blurIterations);
+  glViewport(0, 0, m_aaWidth, m_aaHeight);
   for (unsigned int i = 0; i < amount; i++)
   {
     glBindFramebuffer(GL_FRAMEBUFFER, m_pingpongFBO[horizontal]);
-    shader->setRegisteredUniform1i("horizontal", horizontal);
-    glBindTexture(GL_TEXTURE_2D, first_iteration ? m_blurTexFBO : m_pingpongColourBuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
+    // each direction is its own program rather than a per fragment branch
+    shader->use(m_variants.name(m_blurVariant[horizontal]));
+    glBindTexture(GL_TEXTURE_2D, first_iteration ? sceneColour : m_pingpongColourBuffers[!horizontal]);  // bind texture of other framebuffer (or scene if first iteration)
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D, m_blurDepthFBO);
+    m_variants.beginDraw(m_blurVariant[horizontal]);
     RenderQuad();
+    m_variants.endDraw();
     horizontal = !horizontal;
     if (first_iteration)
       first_iteration = false;
@@ -522,10 +552,10 @@ void NGLScene::paintGL()
   //End of code taken from https://learnopengl.com/#!Advanced-Lighting/Bloom
 
   //----------------------------------------------------------------------------------------------------------------------
-  // Pass four : Render to default Framebuffer
+  // Pass four : Render to this frame's slot for the window to show
   //----------------------------------------------------------------------------------------------------------------------
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  bindPresentTarget();
 
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   shader->use("DOFFinal");
@@ -534,6 +564,7 @@ void NGLScene::paintGL()
   glBindTexture(GL_TEXTURE_2D, m_pingpongColourBuffers[0]);
 
   RenderQuad();
+  m_passTimer.mark(POST_PASS);
 }
 
 //________________________________________________________________________________________________________________________________________//
@@ -543,35 +574,9 @@ void NGLScene::paintGL()
 
 void NGLScene::createShadowFBO()
 {
-
-
-  glGenTextures(1, &m_ShadowtextureID);
-  glBindTexture(GL_TEXTURE_2D, m_ShadowtextureID);
-
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-
-  glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-  glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
-
-  glTexImage2D( GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, TEXTURE_WIDTH, TEXTURE_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
-
-  glBindTexture(GL_TEXTURE_2D, 0);
-
-  // create FBO
-  glGenFramebuffers(1, &m_ShadowfboID);
-  glBindFramebuffer(GL_FRAMEBUFFER, m_ShadowfboID);
-  // disable the colour and read buffers as only depth needed
-  glDrawBuffer(GL_NONE);
-  glReadBuffer(GL_NONE);
-
-  // attach texture to the FBO
-
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,GL_TEXTURE_2D, m_ShadowtextureID, 0);
-
-  // switch back to default framebuffer
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  // the quality governor can ask for a new size at any time, the atlas layers take it on and
+  // are recreated the next time the views are placed, the filters follow in prefilterShadows
+  m_shadowAtlas.setLayerSize(m_shadowSize);
 }
 
 //________________________________________________________________________________________________________________________________________//
@@ -596,8 +601,8 @@ void NGLScene::createBlurFBO()
     glTexImage2D(GL_TEXTURE_2D,
                  0,
                  GL_RGB,
-                 width(),
-                 height(),
+                 m_frameInput.width,
+                 m_frameInput.height,
                  0,
                  GL_RGB,
                  GL_UNSIGNED_BYTE,
@@ -615,8 +620,8 @@ void NGLScene::createBlurFBO()
     glTexImage2D(GL_TEXTURE_2D,
                  0,
                  GL_DEPTH_COMPONENT,
-                 width(),
-                 height(),
+                 m_frameInput.width,
+                 m_frameInput.height,
                  0,
                  GL_DEPTH_COMPONENT,
                  GL_UNSIGNED_BYTE,
@@ -645,7 +650,7 @@ void NGLScene::createBlurFBO()
   {
     glBindFramebuffer(GL_FRAMEBUFFER, m_pingpongFBO[i]);
     glBindTexture(GL_TEXTURE_2D, m_pingpongColourBuffers[i]);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width(), height(), 0, GL_RGB, GL_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, m_frameInput.width, m_frameInput.height, 0, GL_RGB, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // clamp to the edge as the blur filter would otherwise sample repeated texture values
@@ -665,15 +670,12 @@ void NGLScene::createBlurFBO()
 void NGLScene::keyPressEvent(QKeyEvent *_event)
 {
   // this method is called every time the main window recives a key event.
-  // we then switch on the key value and set the camera in the GLWindow
+  // the window and light keys are handled here on the GUI thread, anything that
+  // changes how the scene is rendered is queued for the render thread
   switch (_event->key())
   {
   // escape key to quite
   case Qt::Key_Escape : QGuiApplication::exit(EXIT_SUCCESS); break;
-    // turn on wirframe rendering
-  case Qt::Key_W : glPolygonMode(GL_FRONT_AND_BACK,GL_LINE); break;
-    // turn off wire frame
-  case Qt::Key_S : glPolygonMode(GL_FRONT_AND_BACK,GL_FILL); break;
     // show full screen
   case Qt::Key_F : showFullScreen(); break;
     // show windowed
@@ -685,11 +687,64 @@ void NGLScene::keyPressEvent(QKeyEvent *_event)
   case Qt::Key_Down : changeLightYPos(-0.1f); break;
   case Qt::Key_I : changeLightZOffset(-0.1f); break;
   case Qt::Key_O : changeLightZOffset(0.1f); break;
+  case Qt::Key_P : saveScreenshot(); break;
+    // write the latency and frame time histograms and toggle low latency mode
+  case Qt::Key_H : exportHistograms(); break;
+  case Qt::Key_K : setLowLatency(!m_lowLatency); break;
 
-  default : break;
+  default :
+    if(!m_keys.push(_event->key()))
+    {
+      std::cerr<<"Render thread is behind, dropping key\n";
+    }
+    else if(m_renderThread)
+    {
+      m_renderThread->wake();
+    }
+  break;
   }
+}
+
+//________________________________________________________________________________________________________________________________________//
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::applyKey(int _key)
+{
+  switch (_key)
+  {
+    // turn on wirframe rendering
+  case Qt::Key_W : glPolygonMode(GL_FRONT_AND_BACK,GL_LINE); break;
+    // turn off wire frame
+  case Qt::Key_S : glPolygonMode(GL_FRONT_AND_BACK,GL_FILL); break;
+    // toggle the instanced shelf and change the number of cans on it
+  case Qt::Key_M : toggleShelfMode(); break;
+  case Qt::Key_Plus :
+  case Qt::Key_Equal : changeShelfCount(2.0f); break;
+  case Qt::Key_Minus : changeShelfCount(0.5f); break;
+    // cycle GPU / CPU BVH / no culling and toggle hierarchical depth occlusion culling
+  case Qt::Key_C : cycleCullMode(); break;
+  case Qt::Key_Z : toggleOcclusionCulling(); break;
+    // toggle level of detail and change how much coarser the shadow pass levels are
+  case Qt::Key_L : toggleLOD(); break;
+  case Qt::Key_B : cycleShadowLODBias(); break;
+  case Qt::Key_V : toggleQuantisedVertices(); break;
+  case Qt::Key_A : cycleAAMode(); break;
+  case Qt::Key_G : toggleGovernor(); break;
+  case Qt::Key_BracketLeft : changeFrameTarget(-1.0f); break;
+  case Qt::Key_BracketRight : changeFrameTarget(1.0f); break;
+    // print the GPU time spent in each shader variant last frame
+  case Qt::Key_T : m_variants.printTimings(); break;
+    // cycle the shadow filter and change its radius
+  case Qt::Key_X : cycleShadowFilter(); break;
+  case Qt::Key_Comma : changeShadowRadius(1.0f/1.5f); break;
+  case Qt::Key_Period : changeShadowRadius(1.5f); break;
+    // turn the planar reflection pass off and on to see what it costs
+  case Qt::Key_R : toggleReflections(); break;
+    // render the next SKU's turntable thumbnails, one view at a time and all in one pass
+  case Qt::Key_J : requestTurntable(); break;
 
-  update();
+  default : break;
+  }
 }
 
 //________________________________________________________________________________________________________________________________________//
@@ -700,8 +755,8 @@ void NGLScene::updateLight()
   // change the light angle
   m_lightAngle+=0.02;
   m_lightPosition.set(m_lightXoffset*cos(m_lightAngle),m_lightYPos,m_lightXoffset*sin(m_lightAngle));
-  // set this value and load to the shader
-  m_lightCamera.set(m_lightPosition,ngl::Vec3(0,0,0),ngl::Vec3(0,1,0));
+  // the render thread sets the light camera from it
+  publishInput();
 }
 
 //________________________________________________________________________________________________________________________________________//
@@ -713,8 +768,6 @@ void NGLScene::timerEvent(QTimerEvent *_event )
   {
     updateLight();
   }
-  // re-draw GL
-  update();
 }
 
 //________________________________________________________________________________________________________________________________________//
@@ -723,10 +776,15 @@ void NGLScene::timerEvent(QTimerEvent *_event )
 void NGLScene::debugTexture(float _t, float _b, float _l, float _r)
 {
   ngl::ShaderLib *shader=ngl::ShaderLib::instance();
-  shader->use("Shadow");
+  std::vector<int> shadow=m_variants.variantsOf("Shadow");
+  if(shadow.empty())
+  {
+    return;
+  }
+  shader->use(m_variants.name(shadow[0]));
   ngl::Mat4 MVP=1;
   shader->setShaderParamFromMat4("MVP",MVP);
-  glBindTexture(GL_TEXTURE_2D,m_ShadowtextureID);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,m_shadowAtlas.texture());
 
   std::unique_ptr<ngl::AbstractVAO> quad(ngl::VAOFactory::createVAO("multiBufferVAO",GL_TRIANGLES));
   std::array<float,18> vert ;	// vertex array
@@ -766,8 +824,8 @@ void NGLScene::initTexture(const GLuint& texUnit, GLuint &texId, const char *fil
   // Set active texture unit
   glActiveTexture(GL_TEXTURE0 + texUnit);
 
-  // Load up the image using NGL routine
-  ngl::Image img(filename);
+  // Decode the image once per machine, every other process maps the same pixels
+  AssetCache::Asset img=m_assets.image(filename);
 
   // Create storage for the new texture
   glGenTextures(1, &texId);
@@ -776,16 +834,19 @@ void NGLScene::initTexture(const GLuint& texUnit, GLuint &texId, const char *fil
   glBindTexture(GL_TEXTURE_2D, texId);
 
   // Transfer image data onto the GPU using the teximage2D call
-  glTexImage2D (
-        GL_TEXTURE_2D,    // The target (in this case, which side of the cube)
-        0,                // Level of mipmap to load
-        img.format(),     // Internal format (number of colour components)
-        img.width(),      // Width in pixels
-        img.height(),     // Height in pixels
-        0,                // Border
-        GL_RGB,          // Format of the pixel data
-        GL_UNSIGNED_BYTE, // Data type of pixel data
-        img.getPixels()); // Pointer to image data in memory
+  if(img.valid())
+  {
+    glTexImage2D (
+          GL_TEXTURE_2D,    // The target (in this case, which side of the cube)
+          0,                // Level of mipmap to load
+          GLint(img.meta(2)), // Internal format (number of colour components)
+          GLsizei(img.meta(0)), // Width in pixels
+          GLsizei(img.meta(1)), // Height in pixels
+          0,                // Border
+          GL_RGB,          // Format of the pixel data
+          GL_UNSIGNED_BYTE, // Data type of pixel data
+          img.section(0)); // Pointer to image data in memory
+  }
 
   // Set up parameters for our texture
   glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
@@ -834,11 +895,7 @@ void NGLScene::initEnvironment() {
   glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &anisotropy);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
 
-  // Set cube map texture to on the shader so we can use it
-  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
-  shader->use(CanProgram);
-  shader->setUniform("envMap", 0);
-
+  // the can shaders are told to use unit 0 for it once they have been built
 }
 
 //________________________________________________________________________________________________________________________________________//
@@ -854,48 +911,51 @@ void NGLScene::initEnvironment() {
  */
 void NGLScene::initEnvironmentSide(GLenum target, const char *filename)
 {
-  // Load up the image using NGL routine
-  ngl::Image img(filename);
+  // Map the decoded image from the asset cache, the mapping is released once it is uploaded
+  AssetCache::Asset img=m_assets.image(filename);
+  if(!img.valid())
+  {
+    return;
+  }
 
   // Transfer image data onto the GPU using the teximage2D call
   glTexImage2D (
         target,           // The target (in this case, which side of the cube)
         0,                // Level of mipmap to load
-        img.format(),     // Internal format (number of colour components)
-        img.width(),      // Width in pixels
-        img.height(),     // Height in pixels
+        GLint(img.meta(2)), // Internal format (number of colour components)
+        GLsizei(img.meta(0)), // Width in pixels
+        GLsizei(img.meta(1)), // Height in pixels
         0,                // Border
         GL_RGBA,          // Format of the pixel data
         GL_UNSIGNED_BYTE, // Data type of pixel data
-        img.getPixels()   // Pointer to image data in memory
+        img.section(0)    // Pointer to image data in memory
         );
 }
 
 //________________________________________________________________________________________________________________________________________//
 //________________________________________________________________________________________________________________________________________//
 
-void NGLScene::loadMatrices(const std::string _program)
+void NGLScene::loadMatrices(const std::string _program, bool _reflected)
 {
   ngl::ShaderLib *shader=ngl::ShaderLib::instance();
 
   shader->use(_program);
-  ngl::Mat4 MV;
-  ngl::Mat4 MVP;
-  ngl::Mat3 normalMatrix;
-  ngl::Mat4 M;
-  ngl::Mat4 P;
+  // the model matrix comes from the instance buffer so only the view level
+  // matrices are streamed, the mouse transform is folded into the view
   ngl::Mat4 V;
-  M=m_transform.getMatrix()*m_mouseGlobalTX;
-  MV=  M*m_cam.getViewMatrix();
-  MVP= M*m_cam.getVPMatrix();
-  V = m_cam.getViewMatrix();
-  P = m_cam.getProjectionMatrix();
-  normalMatrix=MV;
-  normalMatrix.inverse();
-  shader->setShaderParamFromMat4("MV",MV);
-  shader->setShaderParamFromMat4("MVP",MVP);
-  shader->setShaderParamFromMat3("N",normalMatrix);
-  shader->setUniform("viewPos", m_cam.getEye().toVec3());
+  ngl::Mat4 VP;
+  V = _reflected ? m_reflectionView : m_mouseGlobalTX*m_cam.getViewMatrix();
+  VP= _reflected ? m_reflectionView*m_reflectionProjection : m_mouseGlobalTX*m_cam.getVPMatrix()*m_jitter;
+  ViewBlock block;
+  std::copy(V.m_openGL,V.m_openGL+16,block.V);
+  std::copy(VP.m_openGL,VP.m_openGL+16,block.VP);
+  ngl::Vec3 eye=m_cam.getEye().toVec3();
+  block.viewPos[0]=eye.m_x;
+  block.viewPos[1]=eye.m_y;
+  block.viewPos[2]=eye.m_z;
+  block.viewPos[3]=1.0f;
+  m_stream.bind(VIEW_BLOCK_BINDING,m_stream.write(block));
+  loadShadowLights();
  }
 
 //________________________________________________________________________________________________________________________________________//
@@ -0,0 +1,138 @@
+#include "NGLScene.h"
+#include <ngl/ShaderLib.h>
+#include <iostream>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the anti-aliasing units, the resolve is skipped while accumulating
+//----------------------------------------------------------------------------------------------------------------------
+constexpr GLuint ACCUMULATE_SCENE_UNIT=8;
+constexpr GLuint ACCUMULATE_HISTORY_UNIT=10;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief how long the camera and light have to be still before accumulating, long enough that a
+/// pause in a drag doesn't throw the TAA history away
+//----------------------------------------------------------------------------------------------------------------------
+constexpr qint64 ACCUMULATION_IDLE_MS=250;
+
+//________________________________________________________________________________________________________________________________________//
+
+static bool sameMatrix(const ngl::Mat4 &_a, const ngl::Mat4 &_b)
+{
+  for(int row=0; row<4; ++row)
+  {
+    for(int column=0; column<4; ++column)
+    {
+      if(_a.m_m[row][column]!=_b.m_m[row][column])
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::createAccumulation()
+{
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  shader->use("Accumulate");
+  shader->setUniform("scene",static_cast<int>(ACCUMULATE_SCENE_UNIT));
+  shader->setUniform("history",static_cast<int>(ACCUMULATE_HISTORY_UNIT));
+
+  // the same size as the anti-aliasing targets, 32 bit floats so the last of 256 frames still
+  // moves the mean of an 8 bit scene
+  glGenFramebuffers(2,m_accumulationFBO);
+  glGenTextures(2,m_accumulationTex);
+  for(int i=0; i<2; ++i)
+  {
+    glBindTexture(GL_TEXTURE_2D,m_accumulationTex[i]);
+    glTexStorage2D(GL_TEXTURE_2D,1,GL_RGBA32F,m_aaWidth,m_aaHeight);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+    glBindFramebuffer(GL_FRAMEBUFFER,m_accumulationFBO[i]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,m_accumulationTex[i],0);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) !=GL_FRAMEBUFFER_COMPLETE)
+    {
+      std::cerr<<"Accumulation framebuffer not complete\n";
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D,0);
+  glBindFramebuffer(GL_FRAMEBUFFER,0);
+  m_accumulating=false;
+  m_accumulatedSamples=0;
+  m_accumulationReset=true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool NGLScene::updateAccumulation()
+{
+  bool converged=m_accumulating && m_accumulatedSamples>=ACCUMULATION_SAMPLES;
+  if(converged)
+  {
+    // nothing else is rendered, but a label that finished loading since changes the picture
+    streamLabels();
+  }
+  ngl::Mat4 cameraVP=m_mouseGlobalTX*m_cam.getVPMatrix();
+  if(m_accumulationReset || !m_idleTimer.isValid() || !sameMatrix(cameraVP,m_accumulationVP) ||
+     !(m_frameInput.lightPosition==m_accumulationLight))
+  {
+    m_accumulationReset=false;
+    m_accumulationVP=cameraVP;
+    m_accumulationLight=m_frameInput.lightPosition;
+    m_idleTimer.start();
+    if(m_accumulating)
+    {
+      // the TAA history was left behind when accumulation took over
+      m_accumulating=false;
+      m_taaHistoryValid=false;
+      std::cout<<"Accumulation stopped at "<<m_accumulatedSamples<<" samples\n";
+    }
+    m_accumulatedSamples=0;
+    return true;
+  }
+  if(!m_accumulating && m_idleTimer.elapsed()>=ACCUMULATION_IDLE_MS)
+  {
+    m_accumulating=true;
+    m_accumulatedSamples=0;
+  }
+  if(converged)
+  {
+    return false;
+  }
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+GLuint NGLScene::accumulate()
+{
+  // the governor may change the render size between samples, the ones taken at the old size start over
+  if(m_renderWidth!=m_accumulationWidth || m_renderHeight!=m_accumulationHeight)
+  {
+    m_accumulationWidth=m_renderWidth;
+    m_accumulationHeight=m_renderHeight;
+    m_accumulatedSamples=0;
+  }
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  int current=m_accumulationCurrent;
+  glViewport(0,0,m_renderWidth,m_renderHeight);
+  glActiveTexture(GL_TEXTURE0+ACCUMULATE_SCENE_UNIT);
+  glBindTexture(GL_TEXTURE_2D,m_blurTexFBO);
+  glActiveTexture(GL_TEXTURE0+ACCUMULATE_HISTORY_UNIT);
+  glBindTexture(GL_TEXTURE_2D,m_accumulationTex[1-current]);
+  glBindFramebuffer(GL_FRAMEBUFFER,m_accumulationFBO[current]);
+  shader->use("Accumulate");
+  // the running mean, the first frame replaces whatever the target held
+  shader->setShaderParam1f("weight",1.0f/(m_accumulatedSamples+1));
+  RenderQuad();
+  glActiveTexture(GL_TEXTURE0);
+  m_accumulationCurrent=1-current;
+  if(++m_accumulatedSamples==ACCUMULATION_SAMPLES)
+  {
+    std::cout<<"Accumulation converged at "<<ACCUMULATION_SAMPLES<<" samples\n";
+  }
+  return m_accumulationTex[current];
+}
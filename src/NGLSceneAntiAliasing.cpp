@@ -0,0 +1,217 @@
+#include "NGLScene.h"
+#include <ngl/ShaderLib.h>
+#include <QImage>
+#include <cmath>
+#include <iostream>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief texture units used by the resolve passes, clear of the material textures (0-6) and the depth pyramid (7)
+//----------------------------------------------------------------------------------------------------------------------
+constexpr GLuint AA_SCENE_UNIT=8;
+constexpr GLuint AA_DEPTH_UNIT=9;
+constexpr GLuint AA_HISTORY_UNIT=10;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief length of the jitter sequence, 8 Halton(2,3) points cover the pixel well without a visible cycle
+//----------------------------------------------------------------------------------------------------------------------
+constexpr unsigned int TAA_SAMPLES=8;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief how much of the history is kept each frame, higher is smoother but slower to react
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float TAA_FEEDBACK=0.9f;
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the _index'th element of the Halton sequence in _base, in [0,1)
+//----------------------------------------------------------------------------------------------------------------------
+static float halton(unsigned int _index, unsigned int _base)
+{
+  float result=0.0f;
+  float fraction=1.0f/_base;
+  while(_index>0)
+  {
+    result+=fraction*(_index%_base);
+    _index/=_base;
+    fraction/=_base;
+  }
+  return result;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::createAntiAliasing()
+{
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+
+  shader->use("FXAA");
+  shader->setUniform("scene",static_cast<int>(AA_SCENE_UNIT));
+
+  shader->use("TAA");
+  shader->setUniform("scene",static_cast<int>(AA_SCENE_UNIT));
+  shader->setUniform("depth",static_cast<int>(AA_DEPTH_UNIT));
+  shader->setUniform("history",static_cast<int>(AA_HISTORY_UNIT));
+  shader->setShaderParam1f("feedback",TAA_FEEDBACK);
+
+  // same size as the scene target in createBlurFBO, two so TAA can ping pong its history
+  m_aaWidth=m_frameInput.width;
+  m_aaHeight=m_frameInput.height;
+  glGenFramebuffers(2,m_aaFBO);
+  glGenTextures(2,m_aaTex);
+  for(int i=0; i<2; ++i)
+  {
+    glBindTexture(GL_TEXTURE_2D,m_aaTex[i]);
+    glTexStorage2D(GL_TEXTURE_2D,1,GL_RGBA16F,m_aaWidth,m_aaHeight);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+    glBindFramebuffer(GL_FRAMEBUFFER,m_aaFBO[i]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,m_aaTex[i],0);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) !=GL_FRAMEBUFFER_COMPLETE)
+    {
+      std::cerr<<"Anti-aliasing framebuffer not complete\n";
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D,0);
+  glBindFramebuffer(GL_FRAMEBUFFER,0);
+  glGenQueries(4,&m_aaQuery[0][0]);
+  m_taaHistoryValid=false;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::updateJitter()
+{
+  m_jitter=m_tileProjection;
+  m_jitterUV[0]=0.0f;
+  m_jitterUV[1]=0.0f;
+  m_shadowKernelRotation=0.0f;
+  if(m_aaMode !=AAMode::TAA && !m_accumulating)
+  {
+    return;
+  }
+  // an accumulated still walks the whole sequence once, and turns the PCF disc by the golden
+  // ratio each frame so its taps never line up with an earlier frame's
+  unsigned int index=(m_frameIndex%TAA_SAMPLES)+1;
+  if(m_accumulating)
+  {
+    index=m_accumulatedSamples+1;
+    m_shadowKernelRotation=std::fmod(m_accumulatedSamples*0.618034f,1.0f);
+  }
+  // a sub pixel offset in NDC, added to clip x and y as a multiple of w by the last row
+  float x=(halton(index,2)-0.5f)*2.0f/m_renderWidth;
+  float y=(halton(index,3)-0.5f)*2.0f/m_renderHeight;
+  m_jitter.m_m[3][0]+=x;
+  m_jitter.m_m[3][1]+=y;
+  m_jitterUV[0]=x*0.5f;
+  m_jitterUV[1]=y*0.5f;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+GLuint NGLScene::antiAlias(const ngl::Mat4 &_VP)
+{
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+
+  // timestamps are double buffered like the frame query so reading last frame's never stalls
+  GLuint *lastQuery=m_aaQuery[(m_frameIndex+1)%2];
+  GLuint *query=m_aaQuery[m_frameIndex%2];
+  if(m_frameIndex>0)
+  {
+    GLint available=0;
+    glGetQueryObjectiv(lastQuery[1],GL_QUERY_RESULT_AVAILABLE,&available);
+    if(available)
+    {
+      GLuint64 start=0;
+      GLuint64 end=0;
+      glGetQueryObjectui64v(lastQuery[0],GL_QUERY_RESULT,&start);
+      glGetQueryObjectui64v(lastQuery[1],GL_QUERY_RESULT,&end);
+      m_aaTime=(end-start)/1000000.0f;
+    }
+  }
+  glQueryCounter(query[0],GL_TIMESTAMP);
+
+  GLuint output=m_blurTexFBO;
+  if(m_aaMode==AAMode::NONE)
+  {
+    m_taaHistoryValid=false;
+  }
+  else
+  {
+    // resolve at the render scale, the upscale pass takes it to full size
+    glViewport(0,0,m_renderWidth,m_renderHeight);
+    float uvScale[2]={static_cast<float>(m_renderWidth)/m_aaWidth,static_cast<float>(m_renderHeight)/m_aaHeight};
+    glActiveTexture(GL_TEXTURE0+AA_SCENE_UNIT);
+    glBindTexture(GL_TEXTURE_2D,m_blurTexFBO);
+    if(m_aaMode==AAMode::FXAA)
+    {
+      glBindFramebuffer(GL_FRAMEBUFFER,m_aaFBO[0]);
+      shader->use("FXAA");
+      shader->setShaderParam2f("texelSize",1.0f/m_aaWidth,1.0f/m_aaHeight);
+      shader->setShaderParam2f("uvScale",uvScale[0],uvScale[1]);
+      output=m_aaTex[0];
+    }
+    else
+    {
+      // resolve into one buffer reading the other as history
+      int current=m_aaCurrent;
+      glActiveTexture(GL_TEXTURE0+AA_DEPTH_UNIT);
+      glBindTexture(GL_TEXTURE_2D,m_blurDepthFBO);
+      glActiveTexture(GL_TEXTURE0+AA_HISTORY_UNIT);
+      glBindTexture(GL_TEXTURE_2D,m_aaTex[1-current]);
+      glBindFramebuffer(GL_FRAMEBUFFER,m_aaFBO[current]);
+      shader->use("TAA");
+      ngl::Mat4 inverseVP=_VP;
+      inverseVP=inverseVP.inverse();
+      shader->setShaderParamFromMat4("inverseVP",inverseVP);
+      shader->setShaderParamFromMat4("prevVP",m_taaPrevVP);
+      shader->setShaderParam2f("jitter",m_jitterUV[0],m_jitterUV[1]);
+      shader->setShaderParam2f("texelSize",1.0f/m_aaWidth,1.0f/m_aaHeight);
+      shader->setShaderParam2f("uvScale",uvScale[0],uvScale[1]);
+      shader->setShaderParam1i("historyValid",m_taaHistoryValid);
+      m_taaPrevVP=_VP;
+      m_taaHistoryValid=true;
+      m_aaCurrent=1-current;
+      output=m_aaTex[current];
+    }
+    RenderQuad();
+    glActiveTexture(GL_TEXTURE0);
+  }
+  glQueryCounter(query[1],GL_TIMESTAMP);
+  return output;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::cycleAAMode()
+{
+  m_aaMode=static_cast<AAMode>((static_cast<int>(m_aaMode)+1)%3);
+  m_taaHistoryValid=false;
+  std::cout<<"Anti-aliasing "<<aaModeName()<<"\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+const char *NGLScene::aaModeName() const
+{
+  const char *names[]={"none","fxaa","taa"};
+  return names[static_cast<int>(m_aaMode)];
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::saveScreenshot()
+{
+  // grab the same view in each mode to compare the edges side by side, this runs on the GUI
+  // thread so the name and timings come from the frame being shown not the one being rendered
+  const PresentFrame &frame=m_presentFrames.readBuffer();
+  QString name=QString("aa_%1_%2.png").arg(QString(frame.aaMode)).arg(frame.frameIndex);
+  if(grabFramebuffer().save(name))
+  {
+    std::cout<<"Saved "<<name.toStdString()<<"  aa "<<frame.aaTime<<" ms  gpu "<<frame.gpuTime<<" ms\n";
+  }
+  else
+  {
+    std::cerr<<"Could not save "<<name.toStdString()<<"\n";
+  }
+}
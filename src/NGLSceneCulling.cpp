@@ -0,0 +1,273 @@
+#include "NGLScene.h"
+#include <ngl/ShaderLib.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief work group sizes, must match the local_size in the compute shaders
+//----------------------------------------------------------------------------------------------------------------------
+constexpr GLuint CULL_GROUP_SIZE=64;
+constexpr GLuint HIZ_GROUP_SIZE=8;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief texture unit the depth pyramid is bound to, units 0-6 are taken by the material textures
+//----------------------------------------------------------------------------------------------------------------------
+constexpr GLuint HIZ_TEXTURE_UNIT=7;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief projected bounding sphere radius in pixels below which the next level of detail is used,
+/// and how far past a threshold an instance has to be before it switches
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float LOD_THRESHOLDS[IndexedMesh::MAX_LODS-1]={64.0f,32.0f,16.0f,8.0f};
+constexpr float LOD_HYSTERESIS=0.15f;
+constexpr unsigned int MAX_SHADOW_LOD_BIAS=3;
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::createCullBuffers()
+{
+  for(auto &pass : m_cull)
+  {
+    glGenBuffers(1,&pass.visible);
+    glGenBuffers(1,&pass.commands);
+    glGenBuffers(1,&pass.lodState);
+    glGenBuffers(2,pass.readback);
+
+    // one command per level of detail
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER,pass.commands);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER,IndexedMesh::MAX_LODS*sizeof(DrawElementsIndirectCommand),nullptr,GL_DYNAMIC_DRAW);
+    for(auto readback : pass.readback)
+    {
+      glBindBuffer(GL_COPY_WRITE_BUFFER,readback);
+      glBufferData(GL_COPY_WRITE_BUFFER,IndexedMesh::MAX_LODS*sizeof(DrawElementsIndirectCommand),nullptr,GL_STREAM_READ);
+    }
+  }
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER,0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER,0);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::resizeCullBuffers()
+{
+  // worst case every instance is visible at any one level so each level gets a full size region
+  size_t count=std::max<size_t>(m_instances.size(),1);
+  std::vector<GLuint> lodState(count,0);
+  for(int i=0; i<NUM_CULL_VIEWS; ++i)
+  {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_cull[i].visible);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,IndexedMesh::MAX_LODS*count*sizeof(GLuint),nullptr,GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_cull[i].lodState);
+    glBufferData(GL_SHADER_STORAGE_BUFFER,count*sizeof(GLuint),&lodState[0],GL_DYNAMIC_COPY);
+    m_cpuLOD[i].assign(count,0);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::createHiZ()
+{
+  if(m_hiZTex !=0)
+  {
+    glDeleteTextures(1,&m_hiZTex);
+  }
+  // same size as the scene depth texture in createBlurFBO
+  m_hiZWidth=m_frameInput.width;
+  m_hiZHeight=m_frameInput.height;
+  m_hiZLevels=1+static_cast<int>(std::floor(std::log2(std::max(m_hiZWidth,m_hiZHeight))));
+
+  glGenTextures(1,&m_hiZTex);
+  glBindTexture(GL_TEXTURE_2D,m_hiZTex);
+  glTexStorage2D(GL_TEXTURE_2D,m_hiZLevels,GL_R32F,m_hiZWidth,m_hiZHeight);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D,0);
+  m_hiZValid=false;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::cullInstances(int _pass, const ngl::Mat4 &_VP, float _pixelScale, bool _occlusion, unsigned int _lodBias)
+{
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  CullPass &pass=m_cull[_pass];
+  GLuint count=static_cast<GLuint>(m_instances.size());
+  GLuint lods=static_cast<GLuint>(m_canMesh->numLODs());
+  _lodBias=std::min(_lodBias,lods-1);
+
+  // one command per level, each level's visible ids start at lod * count
+  DrawElementsIndirectCommand cmds[IndexedMesh::MAX_LODS];
+  for(GLuint lod=0; lod<lods; ++lod)
+  {
+    cmds[lod]=m_canMesh->indirectCommand(static_cast<int>(lod));
+    cmds[lod].baseInstance=lod*count;
+  }
+
+  if(m_cullMode==CullMode::CPU)
+  {
+    // cullScene has already walked the BVH, pick the levels and upload the ids and counts directly
+    for(auto &ids : m_visibleInstances)
+    {
+      ids.clear();
+    }
+    std::vector<uint8_t> &lodState=m_cpuLOD[_pass];
+    for(auto object : m_cpuVisible[_pass])
+    {
+      int32_t instance=m_objectInstance[object];
+      if(instance<0)
+      {
+        continue;
+      }
+      unsigned int lod=0;
+      if(m_lodEnabled)
+      {
+        float depth=m_scene.centreX[object]*_VP.m_m[0][3]+m_scene.centreY[object]*_VP.m_m[1][3]+
+                    m_scene.centreZ[object]*_VP.m_m[2][3]+_VP.m_m[3][3];
+        float screenRadius=m_scene.radius[object]*_pixelScale/std::max(depth,1e-3f);
+        lod=m_canMesh->selectLOD(screenRadius,lodState[instance],LOD_THRESHOLDS,LOD_HYSTERESIS);
+        lodState[instance]=static_cast<uint8_t>(lod);
+        lod=std::min(lod+_lodBias,lods-1);
+      }
+      m_visibleInstances[lod].push_back(static_cast<GLuint>(instance));
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,pass.visible);
+    for(GLuint lod=0; lod<lods; ++lod)
+    {
+      cmds[lod].instanceCount=static_cast<GLuint>(m_visibleInstances[lod].size());
+      glBufferSubData(GL_SHADER_STORAGE_BUFFER,cmds[lod].baseInstance*sizeof(GLuint),
+                      m_visibleInstances[lod].size()*sizeof(GLuint),m_visibleInstances[lod].data());
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,pass.commands);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER,0,lods*sizeof(DrawElementsIndirectCommand),cmds);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+    readCullStats(pass,cmds);
+    return;
+  }
+
+  // reset the commands, the compute shader counts the visible instances into them
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,pass.commands);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER,0,lods*sizeof(DrawElementsIndirectCommand),cmds);
+
+  shader->use("Cull");
+  GLuint id=shader->getProgramID("Cull");
+  Frustum frustum=Frustum::fromMatrix(_VP);
+  const ngl::Vec3 &centre=m_canMesh->getCenter();
+  bool occlusion=_occlusion && m_hiZValid;
+  bool gpuCulling= m_cullMode==CullMode::GPU;
+  glUniform1ui(glGetUniformLocation(id,"instanceCount"),count);
+  glUniform4fv(glGetUniformLocation(id,"frustumPlanes"),6,&frustum.planes[0].m_x);
+  glUniform4f(glGetUniformLocation(id,"boundingSphere"),centre.m_x,centre.m_y,centre.m_z,m_canMesh->getRadius());
+  glUniform1i(glGetUniformLocation(id,"cullEnabled"),gpuCulling);
+  glUniform1i(glGetUniformLocation(id,"occlusionEnabled"),gpuCulling && occlusion);
+  glUniformMatrix4fv(glGetUniformLocation(id,"prevVP"),1,GL_FALSE,m_prevVP.m_openGL);
+  glUniform2f(glGetUniformLocation(id,"hiZSize"),static_cast<float>(m_hiZWidth),static_cast<float>(m_hiZHeight));
+  glUniform1i(glGetUniformLocation(id,"lodEnabled"),m_lodEnabled);
+  glUniform1ui(glGetUniformLocation(id,"lodCount"),lods);
+  glUniform1fv(glGetUniformLocation(id,"lodThresholds"),IndexedMesh::MAX_LODS-1,LOD_THRESHOLDS);
+  glUniform1f(glGetUniformLocation(id,"lodHysteresis"),LOD_HYSTERESIS);
+  glUniform1ui(glGetUniformLocation(id,"lodBias"),_lodBias);
+  glUniform1f(glGetUniformLocation(id,"pixelScale"),_pixelScale);
+  glUniformMatrix4fv(glGetUniformLocation(id,"VP"),1,GL_FALSE,_VP.m_openGL);
+
+  glActiveTexture(GL_TEXTURE0+HIZ_TEXTURE_UNIT);
+  glBindTexture(GL_TEXTURE_2D,m_hiZTex);
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,m_instanceSSBO);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER,1,pass.visible);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER,2,pass.commands);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER,3,pass.lodState);
+  glDispatchCompute((count+CULL_GROUP_SIZE-1)/CULL_GROUP_SIZE,1,1);
+  // the results are consumed as draw commands and instanced vertex attributes
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+  // keep this frame's counts and read last frame's so the stats never stall the pipeline
+  GLsizeiptr size=lods*sizeof(DrawElementsIndirectCommand);
+  glBindBuffer(GL_COPY_READ_BUFFER,pass.commands);
+  glBindBuffer(GL_COPY_WRITE_BUFFER,pass.readback[m_frameIndex%2]);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,0,0,size);
+  if(m_frameIndex>0)
+  {
+    glBindBuffer(GL_COPY_READ_BUFFER,pass.readback[(m_frameIndex+1)%2]);
+    glGetBufferSubData(GL_COPY_READ_BUFFER,0,size,cmds);
+    readCullStats(pass,cmds);
+  }
+  glBindBuffer(GL_COPY_READ_BUFFER,0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER,0);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::readCullStats(CullPass &_pass, const DrawElementsIndirectCommand *_commands)
+{
+  _pass.visibleCount=0;
+  _pass.triangles=0;
+  for(int lod=0; lod<IndexedMesh::MAX_LODS; ++lod)
+  {
+    _pass.lodInstances[lod]= lod<m_canMesh->numLODs() ? _commands[lod].instanceCount : 0;
+    _pass.visibleCount+=_pass.lodInstances[lod];
+    _pass.triangles+=_pass.lodInstances[lod]*static_cast<GLuint>(m_canMesh->numTriangles(lod));
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::buildHiZ(const ngl::Mat4 &_VP)
+{
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  shader->use("HiZ");
+  GLuint id=shader->getProgramID("HiZ");
+  glActiveTexture(GL_TEXTURE0+HIZ_TEXTURE_UNIT);
+
+  int w=m_hiZWidth;
+  int h=m_hiZHeight;
+  for(int level=0; level<m_hiZLevels; ++level)
+  {
+    // level 0 copies the scene depth, each level after that reduces the one above
+    if(level==0)
+    {
+      glBindTexture(GL_TEXTURE_2D,m_blurDepthFBO);
+      glUniform1i(glGetUniformLocation(id,"copyDepth"),1);
+      glUniform2f(glGetUniformLocation(id,"depthScale"),static_cast<float>(m_renderWidth)/m_hiZWidth,static_cast<float>(m_renderHeight)/m_hiZHeight);
+      glUniform1i(glGetUniformLocation(id,"srcLevel"),0);
+    }
+    else
+    {
+      glBindTexture(GL_TEXTURE_2D,m_hiZTex);
+      glUniform1i(glGetUniformLocation(id,"copyDepth"),0);
+      glUniform1i(glGetUniformLocation(id,"srcLevel"),level-1);
+    }
+    glBindImageTexture(0,m_hiZTex,level,GL_FALSE,0,GL_WRITE_ONLY,GL_R32F);
+    glDispatchCompute((w+HIZ_GROUP_SIZE-1)/HIZ_GROUP_SIZE,(h+HIZ_GROUP_SIZE-1)/HIZ_GROUP_SIZE,1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    w=std::max(1,w/2);
+    h=std::max(1,h/2);
+  }
+  glBindTexture(GL_TEXTURE_2D,0);
+  glActiveTexture(GL_TEXTURE0);
+
+  m_prevVP=_VP;
+  m_hiZValid=true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::cycleCullMode()
+{
+  switch(m_cullMode)
+  {
+    case CullMode::GPU : m_cullMode=CullMode::CPU; break;
+    case CullMode::CPU : m_cullMode=CullMode::NONE; break;
+    case CullMode::NONE : m_cullMode=CullMode::GPU; break;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::cycleShadowLODBias()
+{
+  m_shadowLODBias=(m_shadowLODBias+1)%(MAX_SHADOW_LOD_BIAS+1);
+}
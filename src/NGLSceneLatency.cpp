@@ -0,0 +1,144 @@
+#include "NGLScene.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief how often the latency summary is printed, the GPU clock offset is refreshed at the same time
+//----------------------------------------------------------------------------------------------------------------------
+constexpr qint64 LATENCY_REPORT_MS=1000;
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::setLowLatency(bool _lowLatency)
+{
+  m_lowLatency=_lowLatency;
+  if(m_renderThread)
+  {
+    m_renderThread->setFramesAhead(m_lowLatency ? 1 : RenderThread::MAX_FRAMES_AHEAD);
+  }
+  // start again so the numbers are for one mode only
+  m_latency.reset();
+  m_presentInterval.reset();
+  m_lastPresentTime=-1;
+  std::cout<<"Low latency mode "<<(m_lowLatency ? "on" : "off")<<"\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::markInput()
+{
+  // every motion event is stamped, but the render thread only ever picks up the newest snapshot
+  // so however many arrive they become one state update per frame
+  ++m_inputSeq;
+  m_inputTimes[m_inputSeq%INPUT_HISTORY]=m_latencyClock.nsecsElapsed();
+  publishInput();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::timePresent(const PresentFrame &_frame)
+{
+  if(m_presentQueryCount==PRESENT_QUERIES)
+  {
+    // the GPU is far behind, skip measuring this frame rather than stall, its events get
+    // counted against the next frame that is measured
+    return;
+  }
+  PresentQuery &present=m_presentQueries[(m_presentQueryHead+m_presentQueryCount)%PRESENT_QUERIES];
+  if(present.query==0)
+  {
+    glGenQueries(1,&present.query);
+  }
+  // the blit finishing is as close to the photons as GL can see, scan out adds up to a refresh more
+  glQueryCounter(present.query,GL_TIMESTAMP);
+  present.firstSeq=m_presentedSeq+1;
+  present.lastSeq=_frame.inputSeq;
+  m_presentedSeq=std::max(m_presentedSeq,_frame.inputSeq);
+  ++m_presentQueryCount;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::readPresentTimes()
+{
+  if(!m_gpuClockValid || m_latencyReportTimer.elapsed()>LATENCY_REPORT_MS)
+  {
+    GLint64 gpuNow=0;
+    glGetInteger64v(GL_TIMESTAMP,&gpuNow);
+    m_gpuClockOffset=m_latencyClock.nsecsElapsed()-gpuNow;
+    m_gpuClockValid=true;
+    if(m_latencyReportTimer.elapsed()>LATENCY_REPORT_MS)
+    {
+      reportLatency();
+      m_latencyReportTimer.restart();
+    }
+  }
+  while(m_presentQueryCount>0)
+  {
+    PresentQuery &present=m_presentQueries[m_presentQueryHead];
+    GLint available=0;
+    glGetQueryObjectiv(present.query,GL_QUERY_RESULT_AVAILABLE,&available);
+    if(!available)
+    {
+      break;
+    }
+    GLuint64 gpuTime=0;
+    glGetQueryObjectui64v(present.query,GL_QUERY_RESULT,&gpuTime);
+    qint64 presentTime=static_cast<qint64>(gpuTime)+m_gpuClockOffset;
+    if(m_lastPresentTime>=0)
+    {
+      m_presentInterval.add((presentTime-m_lastPresentTime)/1000000.0f);
+    }
+    m_lastPresentTime=presentTime;
+    // only the last INPUT_HISTORY event times are kept, older ones in the range are lost
+    uint32_t first=present.firstSeq;
+    if(present.lastSeq>=first && present.lastSeq-first>=INPUT_HISTORY)
+    {
+      first=present.lastSeq-INPUT_HISTORY+1;
+    }
+    for(uint32_t seq=first; seq<=present.lastSeq; ++seq)
+    {
+      m_latency.add((presentTime-m_inputTimes[seq%INPUT_HISTORY])/1000000.0f);
+    }
+    m_presentQueryHead=(m_presentQueryHead+1)%PRESENT_QUERIES;
+    --m_presentQueryCount;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::reportLatency()
+{
+  if(m_latency.count()==0)
+  {
+    return;
+  }
+  std::cout<<"latency p50 "<<m_latency.percentile(0.5f)
+           <<" p95 "<<m_latency.percentile(0.95f)
+           <<" p99 "<<m_latency.percentile(0.99f)
+           <<" max "<<m_latency.max()<<" ms ("<<m_latency.count()<<" events)"
+           <<"  present p50 "<<m_presentInterval.percentile(0.5f)
+           <<" p99 "<<m_presentInterval.percentile(0.99f)<<" ms"
+           <<"  frames ahead "<<m_renderThread->framesAhead()<<"\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::exportHistograms()
+{
+  const char *name=m_lowLatency ? "latency_low.csv" : "latency.csv";
+  std::ofstream out(name);
+  if(!out)
+  {
+    std::cerr<<"Could not write "<<name<<"\n";
+    return;
+  }
+  // one row per bucket, the time between shown frames next to the input latency
+  out<<"bucket_ms,present_interval,latency\n";
+  for(int i=0; i<Histogram::NUM_BUCKETS; ++i)
+  {
+    out<<Histogram::bucketStart(i)<<","<<m_presentInterval.bucket(i)<<","<<m_latency.bucket(i)<<"\n";
+  }
+  std::cout<<"Saved "<<name<<"  "<<m_latency.count()<<" latency samples  "<<m_presentInterval.count()<<" frames\n";
+}
@@ -16,7 +16,7 @@ void NGLScene::mouseMoveEvent( QMouseEvent* _event )
     m_win.spinYFace += static_cast<int>( 0.5f * diffx );
     m_win.origX = _event->x();
     m_win.origY = _event->y();
-    update();
+    markInput();
   }
   // right mouse translate code
   else if ( m_win.translate && _event->buttons() == Qt::RightButton )
@@ -27,7 +27,7 @@ void NGLScene::mouseMoveEvent( QMouseEvent* _event )
     m_win.origYPos = _event->y();
     m_modelPos.m_x += INCREMENT * diffX;
     m_modelPos.m_y -= INCREMENT * diffY;
-    update();
+    markInput();
   }
 }
 
@@ -81,5 +81,5 @@ void NGLScene::wheelEvent( QWheelEvent* _event )
   {
     m_modelPos.m_z -= ZOOM;
   }
-  update();
+  markInput();
 }
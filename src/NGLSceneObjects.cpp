@@ -0,0 +1,211 @@
+#include "NGLScene.h"
+#include <ngl/ShaderLib.h>
+#include <algorithm>
+#include <iostream>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the scene description loaded at start up
+//----------------------------------------------------------------------------------------------------------------------
+constexpr auto SCENE_FILE="data/scene.json";
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief where the can shader finds the label array and the SKU to layer table
+//----------------------------------------------------------------------------------------------------------------------
+constexpr GLuint LABEL_UNIT=2;
+constexpr GLuint LABEL_BINDING=4;
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::loadScene()
+{
+  if(!m_sceneBase.load(SCENE_FILE))
+  {
+    std::cerr<<"Using the default scene\n";
+    m_sceneBase.loadDefault();
+  }
+
+  // the shelf always needs a can mesh even if the scene doesn't place one
+  if(std::none_of(m_sceneBase.meshes.begin(),m_sceneBase.meshes.end(),[](const SceneMesh &_m){ return !_m.isPlane; }))
+  {
+    SceneMesh can;
+    can.name="can";
+    can.file="data/can05.obj";
+    m_sceneBase.meshes.push_back(can);
+  }
+
+  // all the obj objects are drawn instanced with the can shader, so only one obj mesh is supported
+  m_meshes.clear();
+  m_meshes.resize(m_sceneBase.meshes.size());
+  for(size_t i=0; i<m_sceneBase.meshes.size(); ++i)
+  {
+    SceneMesh &mesh=m_sceneBase.meshes[i];
+    if(mesh.isPlane)
+    {
+      // planes use the same quantised vertex format as the cans
+      m_meshes[i].reset(new IndexedMesh(mesh.planeWidth,mesh.planeDepth,mesh.planeSteps));
+      m_meshes[i]->createVAO(false);
+    }
+    else if(m_canMeshID<0)
+    {
+      // weld the obj into an indexed mesh so the cans can be instanced, the welded and simplified
+      // mesh comes from the asset cache when any process has built it before
+      m_canMesh=m_assets.mesh(mesh.file,IndexedMesh::MAX_LODS);
+      if(m_canMesh==nullptr)
+      {
+        std::cerr<<"Could not load "<<mesh.file<<"\n";
+        continue;
+      }
+      m_canMesh->createVAO();
+      mesh.centre=m_canMesh->getCenter();
+      mesh.radius=m_canMesh->getRadius();
+      m_canMeshID=static_cast<int>(i);
+    }
+    else
+    {
+      std::cerr<<"Only one obj mesh is supported, ignoring "<<mesh.name<<"\n";
+    }
+  }
+  // the shelf cans use the first material for the can shader
+  for(size_t i=0; i<m_sceneBase.materials.size(); ++i)
+  {
+    if(m_sceneBase.materials[i].program==CanProgram)
+    {
+      m_canMaterialID=static_cast<int>(i);
+      break;
+    }
+  }
+  if(m_canMaterialID<0)
+  {
+    SceneMaterial material;
+    material.name="can";
+    material.program=CanProgram;
+    m_canMaterialID=static_cast<int>(m_sceneBase.materials.size());
+    m_sceneBase.materials.push_back(material);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::toggleQuantisedVertices()
+{
+  m_quantisedVertices^=true;
+  m_canMesh->setQuantised(m_quantisedVertices);
+  for(auto &mesh : m_meshes)
+  {
+    if(mesh)
+    {
+      mesh->setQuantised(m_quantisedVertices);
+    }
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::loadMaterial(const SceneMaterial &_material)
+{
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  shader->setShaderParam3f("Material.Ka",_material.ka.m_x,_material.ka.m_y,_material.ka.m_z);
+  shader->setShaderParam3f("Material.Kd",_material.kd.m_x,_material.kd.m_y,_material.kd.m_z);
+  shader->setShaderParam3f("Material.Ks",_material.ks.m_x,_material.ks.m_y,_material.ks.m_z);
+  shader->setShaderParam1f("Material.Shininess",_material.shininess);
+  shader->setShaderParam1f("Material.Roughness",_material.roughness);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::cullScene()
+{
+  QElapsedTimer timer;
+  timer.start();
+  // only the objects that moved since last frame need their bounds and BVH nodes updated
+  m_scene.updateBounds();
+  m_bvh.refit(m_scene);
+  updateTransforms();
+  m_scene.clearDirty();
+  // the shadow views depend on the scene bounds and the camera so they are placed every frame
+  updateShadowAtlas();
+  updateReflection();
+
+  if(m_cullMode==CullMode::NONE)
+  {
+    for(auto &visible : m_cpuVisible)
+    {
+      visible.resize(m_scene.size());
+      for(uint32_t i=0; i<m_scene.size(); ++i)
+      {
+        visible[i]=i;
+      }
+    }
+  }
+  else
+  {
+    m_bvh.cull(Frustum::fromMatrix(m_mouseGlobalTX*m_cam.getVPMatrix()),m_cpuVisible[0]);
+    m_bvh.cull(Frustum::fromMatrix(m_shadowAtlas.casterVP()),m_cpuVisible[1]);
+    if(m_reflectionActive)
+    {
+      // the oblique near plane is the mirror so this frustum only holds what is above it
+      m_bvh.cull(Frustum::fromMatrix(m_reflectionView*m_reflectionProjection),m_cpuVisible[2]);
+    }
+  }
+  // the mirror never reflects itself
+  std::vector<uint32_t> &reflected=m_cpuVisible[2];
+  if(!m_reflectionActive)
+  {
+    reflected.clear();
+  }
+  reflected.erase(std::remove_if(reflected.begin(),reflected.end(),[this](uint32_t _object)
+  {
+    return (m_scene.materials[m_scene.material[_object]].features & FEATURE_PLANAR_REFLECTION)!=0;
+  }),reflected.end());
+  m_cpuCullTime=timer.nsecsElapsed()/1000000.0f;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::streamLabels()
+{
+  m_labels.beginFrame();
+  // the light's view never samples a label, the camera's view is asked for last so its labels
+  // are the most recently used
+  for(int view : {2,0})
+  {
+    for(auto object : m_cpuVisible[view])
+    {
+      int32_t instance=m_objectInstance[object];
+      if(instance>=0)
+      {
+        m_labels.request(m_instances[static_cast<size_t>(instance)].label);
+      }
+    }
+  }
+  // the turntable waits for its label so it never renders the fallback
+  if(m_turntableSku>=0)
+  {
+    m_labels.request(static_cast<uint32_t>(m_turntableSku));
+  }
+  m_labels.update(LABEL_UNIT,LABEL_BINDING);
+  if(m_labels.stats().uploads>0)
+  {
+    // the frames accumulated so far have the fallback label where this one is
+    m_accumulationReset=true;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::streamJobLabels(const std::vector<uint32_t> &_labels)
+{
+  // only the waiting jobs' labels count as used, so the ones already rendered are evicted first
+  m_labels.beginFrame();
+  for(auto label : _labels)
+  {
+    m_labels.request(label%m_sceneBase.labels.count);
+  }
+  m_labels.update(LABEL_UNIT,LABEL_BINDING);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool NGLScene::jobLabelResident(uint32_t _label) const
+{
+  return m_labels.resident(_label%m_sceneBase.labels.count);
+}
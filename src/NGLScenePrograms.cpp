@@ -0,0 +1,75 @@
+#include "NGLScene.h"
+#include <iostream>
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::createPrograms()
+{
+  // the scene shaders are specialised per material, only the variants the scene uses are built
+  m_variants.addBase("Shadow",{{GL_VERTEX_SHADER,"shaders/ShadowVert.glsl"},{GL_FRAGMENT_SHADER,"shaders/ShadowFrag.glsl"}},
+                     FEATURE_LIGHT_COUNT | FEATURE_SHADOW_FILTER | FEATURE_PLANAR_REFLECTION | FEATURE_NORMAL_MAP | FEATURE_MULTI_VIEW);
+  m_variants.addBase(CanProgram,{{GL_VERTEX_SHADER,"shaders/CanVert.glsl"},{GL_FRAGMENT_SHADER,"shaders/CanFrag.glsl"}},
+                     FEATURE_LIGHT_COUNT | FEATURE_MICROFACET | FEATURE_REFRACT | FEATURE_NOISE | FEATURE_NORMAL_MAP | FEATURE_MULTI_VIEW);
+  m_variants.addBase("DOF",{{GL_VERTEX_SHADER,"shaders/depthOfFieldVert.glsl"},{GL_FRAGMENT_SHADER,"shaders/depthOfFieldFrag.glsl"}},
+                     FEATURE_BLUR_HORIZONTAL);
+  m_materialVariant.clear();
+  m_reflectionVariant.clear();
+  m_turntableVariant.clear();
+  for(auto &material : m_sceneBase.materials)
+  {
+    int variant=m_variants.request(material.program,material.features);
+    if(variant<0)
+    {
+      // drawn the way the primitives always were
+      variant=m_variants.request("Shadow",material.features);
+    }
+    m_materialVariant.push_back(variant);
+    if(m_variants.features(variant) & FEATURE_SHADOW_FILTER)
+    {
+      // the filter can be changed at run time, build every one now so switching never stalls
+      for(uint32_t filter : {SHADOW_HARD,SHADOW_PCF,SHADOW_EVSM})
+      {
+        m_variants.request("Shadow",(material.features & ~FEATURE_SHADOW_FILTER) | filter);
+        if(m_variants.request(material.program,turntableFeatures((material.features & ~FEATURE_SHADOW_FILTER) | filter))<0)
+        {
+          m_variants.request("Shadow",turntableFeatures((material.features & ~FEATURE_SHADOW_FILTER) | filter));
+        }
+      }
+    }
+    // the mirrored scene is drawn with a cheaper variant of every material
+    int reflection=m_variants.request(material.program,reflectionFeatures(material.features));
+    m_reflectionVariant.push_back(reflection<0 ? m_variants.request("Shadow",reflectionFeatures(material.features)) : reflection);
+    // and the turntable with one that draws every view at once, picked with the filter below
+    int turntable=m_variants.request(material.program,turntableFeatures(material.features));
+    m_turntableVariant.push_back(turntable<0 ? m_variants.request("Shadow",turntableFeatures(material.features)) : turntable);
+  }
+  m_blurVariant[0]=m_variants.request("DOF",0);
+  m_blurVariant[1]=m_variants.request("DOF",FEATURE_BLUR_HORIZONTAL);
+
+  // the screen space passes all share the quad vertex shader
+  const ProgramCache::Stage quadVertex{GL_VERTEX_SHADER,"shaders/DOFFinalVert.glsl"};
+  std::vector<ProgramCache::Program> programs=
+  {
+    {"DOFFinal",{quadVertex,{GL_FRAGMENT_SHADER,"shaders/DOFFinalFrag.glsl"}},""},
+    {"Colour",{{GL_VERTEX_SHADER,"shaders/ColourVert.glsl"},{GL_FRAGMENT_SHADER,"shaders/ColourFrag.glsl"}},""},
+    {"Cull",{{GL_COMPUTE_SHADER,"shaders/CullComp.glsl"}},""},
+    {"Thumbnail",{{GL_COMPUTE_SHADER,"shaders/ThumbnailComp.glsl"}},""},
+    {"HiZ",{{GL_COMPUTE_SHADER,"shaders/HiZComp.glsl"}},""},
+    {"FXAA",{quadVertex,{GL_FRAGMENT_SHADER,"shaders/FXAAFrag.glsl"}},""},
+    {"TAA",{quadVertex,{GL_FRAGMENT_SHADER,"shaders/TAAFrag.glsl"}},""},
+    {"Accumulate",{quadVertex,{GL_FRAGMENT_SHADER,"shaders/AccumulateFrag.glsl"}},""},
+    {"Upscale",{quadVertex,{GL_FRAGMENT_SHADER,"shaders/UpscaleFrag.glsl"}},""},
+    {"ShadowMoments",{quadVertex,{GL_FRAGMENT_SHADER,"shaders/ShadowMomentsFrag.glsl"}},""},
+    {"ShadowBlur",{quadVertex,{GL_FRAGMENT_SHADER,"shaders/ShadowBlurFrag.glsl"}},""},
+    {"ShadowAtlas",{{GL_VERTEX_SHADER,"shaders/ShadowAtlasVert.glsl"},{GL_GEOMETRY_SHADER,"shaders/ShadowAtlasGeom.glsl"},{GL_FRAGMENT_SHADER,"shaders/ShadowAtlasFrag.glsl"}},""}
+  };
+  std::vector<ProgramCache::Program> variants=m_variants.programs();
+  programs.insert(programs.end(),variants.begin(),variants.end());
+  if(!m_programCache.build(programs))
+  {
+    std::cerr<<"Some shader programs failed to build, see above\n";
+  }
+  std::cout<<m_variants.size()<<" shader variants in use\n";
+  selectShadowVariants();
+}
+
@@ -0,0 +1,129 @@
+#include "NGLScene.h"
+#include <ngl/ShaderLib.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief texture unit for the upscale source, the same one the anti-aliasing passes read the scene from
+//----------------------------------------------------------------------------------------------------------------------
+constexpr GLuint UPSCALE_UNIT=8;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief sharpening at the lowest render scale, fading to none at full scale
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float MAX_SHARPNESS=0.25f;
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::createQualityTargets()
+{
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  shader->use("Upscale");
+  shader->setUniform("scene",static_cast<int>(UPSCALE_UNIT));
+
+  // full size, the scene and anti-aliasing targets are only partly used below full scale
+  glGenTextures(1,&m_upscaleTex);
+  glBindTexture(GL_TEXTURE_2D,m_upscaleTex);
+  glTexStorage2D(GL_TEXTURE_2D,1,GL_RGBA16F,m_aaWidth,m_aaHeight);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+  glGenFramebuffers(1,&m_upscaleFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER,m_upscaleFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,m_upscaleTex,0);
+  if(glCheckFramebufferStatus(GL_FRAMEBUFFER) !=GL_FRAMEBUFFER_COMPLETE)
+  {
+    std::cerr<<"Upscale framebuffer not complete\n";
+  }
+  glBindTexture(GL_TEXTURE_2D,0);
+  glBindFramebuffer(GL_FRAMEBUFFER,0);
+
+  m_passTimer.create();
+  applyQualityLevel();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::updateQuality()
+{
+  if(m_governor.update(m_passTimer.total()))
+  {
+    applyQualityLevel();
+  }
+  float scale=m_governor.renderScale();
+  if(scale !=m_renderScale)
+  {
+    // the TAA history is at the old size
+    m_taaHistoryValid=false;
+    std::cout<<"Render scale "<<scale<<" level "<<m_governor.level()<<" (gpu "<<m_governor.smoothedTime()
+             <<" ms target "<<m_governor.target()<<" ms)\n";
+  }
+  m_renderScale=scale;
+  m_renderWidth=std::max(1,static_cast<int>(std::lround(m_aaWidth*m_renderScale)));
+  m_renderHeight=std::max(1,static_cast<int>(std::lround(m_aaHeight*m_renderScale)));
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::applyQualityLevel()
+{
+  const QualityGovernor::Level &level=m_governor.settings();
+  m_blurIterations=level.blurIterations;
+  if(level.shadowSize !=m_shadowSize)
+  {
+    m_shadowSize=level.shadowSize;
+    createShadowFBO();
+  }
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  for(int variant : m_variants.variantsOf(CanProgram))
+  {
+    if(m_variants.features(variant) & FEATURE_NOISE)
+    {
+      shader->use(m_variants.name(variant));
+      shader->setShaderParam1i("noiseOctaves",level.noiseOctaves);
+    }
+  }
+  std::cout<<"Quality level "<<m_governor.level()<<"  blur "<<level.blurIterations<<"  shadow "<<level.shadowSize
+           <<"  noise octaves "<<level.noiseOctaves<<"  scale "<<m_governor.renderScale()<<"\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+GLuint NGLScene::upscale(GLuint _input)
+{
+  if(m_renderScale>=QualityGovernor::MAX_SCALE)
+  {
+    return _input;
+  }
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  glBindFramebuffer(GL_FRAMEBUFFER,m_upscaleFBO);
+  glViewport(0,0,m_aaWidth,m_aaHeight);
+  glActiveTexture(GL_TEXTURE0+UPSCALE_UNIT);
+  glBindTexture(GL_TEXTURE_2D,_input);
+  shader->use("Upscale");
+  shader->setShaderParam2f("uvScale",static_cast<float>(m_renderWidth)/m_aaWidth,static_cast<float>(m_renderHeight)/m_aaHeight);
+  shader->setShaderParam2f("texelSize",1.0f/m_aaWidth,1.0f/m_aaHeight);
+  float sharpness=MAX_SHARPNESS*(QualityGovernor::MAX_SCALE-m_renderScale)/(QualityGovernor::MAX_SCALE-QualityGovernor::MIN_SCALE);
+  shader->setShaderParam1f("sharpness",sharpness);
+  RenderQuad();
+  glActiveTexture(GL_TEXTURE0);
+  return m_upscaleTex;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::toggleGovernor()
+{
+  m_governor.setEnabled(!m_governor.enabled());
+  applyQualityLevel();
+  std::cout<<"Quality governor "<<(m_governor.enabled() ? "on" : "off")<<"\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::changeFrameTarget(float _dt)
+{
+  m_governor.setTarget(m_governor.target()+_dt);
+  std::cout<<"Frame target "<<m_governor.target()<<" ms\n";
+}
@@ -0,0 +1,268 @@
+#include "NGLScene.h"
+#include <ngl/ShaderLib.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the reflection's texture unit, 11-13 are the shadow map views
+//----------------------------------------------------------------------------------------------------------------------
+constexpr GLuint REFLECTION_UNIT=14;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the target is the frame size divided by this, the budget moves between the two
+//----------------------------------------------------------------------------------------------------------------------
+constexpr int MIN_REFLECTION_DIVISOR=2;
+constexpr int MAX_REFLECTION_DIVISOR=4;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the share of the scene pass time the reflection may take. Halving the resolution about
+/// quarters the cost so it only comes back up once the finer size would fit well within it
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float REFLECTION_BUDGET=0.25f;
+constexpr float REFLECTION_RETURN=0.05f;
+constexpr float REFLECTION_TIME_SMOOTHING=0.1f;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief mips for the roughness blur, past this many the image is too blurred to be worth it
+//----------------------------------------------------------------------------------------------------------------------
+constexpr int MAX_REFLECTION_LEVELS=6;
+
+//________________________________________________________________________________________________________________________________________//
+
+uint32_t NGLScene::reflectionFeatures(uint32_t _features)
+{
+  // the mirror image is low resolution and mostly blurred so the per pixel detail goes, one cheap
+  // lighting model with no noise, normal map or shadow lookups and no reflections of reflections
+  return _features & ~(FEATURE_MICROFACET | FEATURE_NOISE | FEATURE_NORMAL_MAP | FEATURE_SHADOW_FILTER | FEATURE_PLANAR_REFLECTION);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::updateReflection()
+{
+  m_reflectionActive=false;
+  if(!m_reflectionEnabled)
+  {
+    return;
+  }
+  // the first primitive with a reflecting material is the mirror
+  int mirror=-1;
+  for(uint32_t object=0; object<m_scene.size() && mirror<0; ++object)
+  {
+    if(m_objectSlot[object]>=0 && (m_scene.materials[m_scene.material[object]].features & FEATURE_PLANAR_REFLECTION))
+    {
+      mirror=static_cast<int>(object);
+    }
+  }
+  if(mirror<0)
+  {
+    return;
+  }
+  // a plane mesh lies in its model xz plane so its world normal is the transformed y axis
+  const float *world=m_objectMatrices[m_objectSlot[mirror]].world;
+  ngl::Vec3 normal(world[4],world[5],world[6]);
+  normal.normalize();
+  ngl::Vec3 point(world[12],world[13],world[14]);
+  float offset=-normal.dot(point);
+
+  // the view is rigid so the eye is the inverse rotation of minus the translation
+  ngl::Mat4 view=m_mouseGlobalTX*m_cam.getViewMatrix();
+  ngl::Vec3 eye;
+  for(int j=0; j<3; ++j)
+  {
+    eye[j]=-(view.m_m[j][0]*view.m_m[3][0]+view.m_m[j][1]*view.m_m[3][1]+view.m_m[j][2]*view.m_m[3][2]);
+  }
+  // from below the mirror there is nothing to see in it
+  if(normal.dot(eye)+offset<=0.0f)
+  {
+    return;
+  }
+
+  // reflect the world in the plane then look at it with the real camera, the mirrored image
+  // lands on the same pixels as the points of the plane it is seen in
+  ngl::Mat4 reflect;
+  for(int i=0; i<3; ++i)
+  {
+    for(int j=0; j<3; ++j)
+    {
+      reflect.m_m[i][j]=(i==j ? 1.0f : 0.0f)-2.0f*normal[i]*normal[j];
+    }
+    reflect.m_m[3][i]=-2.0f*offset*normal[i];
+  }
+  m_reflectionView=reflect*view;
+
+  // replace the near plane with the mirror (Lengyel's oblique frustum) so whatever is below it is
+  // clipped for free. Above the plane is behind the flipped plane in the mirrored world, in view
+  // space the camera is on its negative side
+  float clip[4];
+  float d=0.0f;
+  for(int i=0; i<3; ++i)
+  {
+    clip[i]=-(view.m_m[0][i]*normal.m_x+view.m_m[1][i]*normal.m_y+view.m_m[2][i]*normal.m_z);
+    d-=clip[i]*(view.m_m[0][i]*point.m_x+view.m_m[1][i]*point.m_y+view.m_m[2][i]*point.m_z+view.m_m[3][i]);
+  }
+  clip[3]=d;
+  ngl::Mat4 projection=m_cam.getProjectionMatrix();
+  auto sign=[](float _v){ return _v>0.0f ? 1.0f : (_v<0.0f ? -1.0f : 0.0f); };
+  // the corner of the frustum opposite the plane, moved onto the new far plane
+  float q[4]={(sign(clip[0])+projection.m_m[2][0])/projection.m_m[0][0],
+              (sign(clip[1])+projection.m_m[2][1])/projection.m_m[1][1],
+              -1.0f,
+              (1.0f+projection.m_m[2][2])/projection.m_m[3][2]};
+  float scale=2.0f/(clip[0]*q[0]+clip[1]*q[1]+clip[2]*q[2]+clip[3]*q[3]);
+  for(int j=0; j<4; ++j)
+  {
+    projection.m_m[j][2]=clip[j]*scale-projection.m_m[j][3];
+  }
+  // a tile's mirror image has to land on the same pixels as the tile
+  m_reflectionProjection=projection*m_tileProjection;
+  m_reflectionPlane=ngl::Vec4(normal.m_x,normal.m_y,normal.m_z,offset);
+  m_reflectionEye=eye;
+  m_reflectionActive=true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::createReflectionFBO(int _width, int _height)
+{
+  if(m_reflectionFBO!=0)
+  {
+    glDeleteTextures(1,&m_reflectionTex);
+    glDeleteRenderbuffers(1,&m_reflectionDepth);
+    glDeleteFramebuffers(1,&m_reflectionFBO);
+  }
+  m_reflectionWidth=_width;
+  m_reflectionHeight=_height;
+  m_reflectionLevels=1;
+  while(m_reflectionLevels<MAX_REFLECTION_LEVELS && (std::max(_width,_height)>>m_reflectionLevels)>0)
+  {
+    ++m_reflectionLevels;
+  }
+  glGenTextures(1,&m_reflectionTex);
+  glBindTexture(GL_TEXTURE_2D,m_reflectionTex);
+  glTexStorage2D(GL_TEXTURE_2D,m_reflectionLevels,GL_RGBA8,_width,_height);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D,0);
+
+  // the depth is only needed while drawing so it never leaves the renderbuffer
+  glGenRenderbuffers(1,&m_reflectionDepth);
+  glBindRenderbuffer(GL_RENDERBUFFER,m_reflectionDepth);
+  glRenderbufferStorage(GL_RENDERBUFFER,GL_DEPTH_COMPONENT24,_width,_height);
+  glBindRenderbuffer(GL_RENDERBUFFER,0);
+
+  glGenFramebuffers(1,&m_reflectionFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER,m_reflectionFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,m_reflectionTex,0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,GL_RENDERBUFFER,m_reflectionDepth);
+  if(glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE)
+  {
+    std::cerr<<"Reflection framebuffer not complete\n";
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER,0);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::renderReflection()
+{
+  // the pass covers the same fraction of its target as the scene does of its own
+  int width=std::max(1,m_renderWidth/m_reflectionDivisor);
+  int height=std::max(1,m_renderHeight/m_reflectionDivisor);
+  if(m_reflectionActive)
+  {
+    int targetWidth=std::max(1,m_frameInput.width/m_reflectionDivisor);
+    int targetHeight=std::max(1,m_frameInput.height/m_reflectionDivisor);
+    if(m_reflectionFBO==0 || targetWidth!=m_reflectionWidth || targetHeight!=m_reflectionHeight)
+    {
+      createReflectionFBO(targetWidth,targetHeight);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER,m_reflectionFBO);
+    glViewport(0,0,width,height);
+    glColorMask(GL_TRUE,GL_TRUE,GL_TRUE,GL_TRUE);
+    // the whole target so the coarse mips fade to the background past the edge of the pass
+    glClearColor(0.5f,0.5f,0.6f,1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_CULL_FACE);
+
+    // fewer pixels so the level of detail choice picks coarser cans on its own
+    ngl::Mat4 VP=m_reflectionView*m_reflectionProjection;
+    float pixelScale=m_reflectionProjection.m_m[1][1]*height*0.5f;
+    cullInstances(2,VP,pixelScale,false,0);
+    drawScene(std::bind(&NGLScene::loadMatricesToShadowShader,this,true),
+              std::bind(&NGLScene::loadInstancesToCanShader,this,true),
+              2);
+    glBindTexture(GL_TEXTURE_2D,m_reflectionTex);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D,0);
+  }
+  m_passTimer.mark(REFLECTION_PASS);
+
+  glActiveTexture(GL_TEXTURE0+REFLECTION_UNIT);
+  glBindTexture(GL_TEXTURE_2D,m_reflectionTex);
+  glActiveTexture(GL_TEXTURE0);
+
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  std::vector<int> receivers;
+  for(int variant : m_materialVariant)
+  {
+    if((m_variants.features(variant) & FEATURE_PLANAR_REFLECTION) &&
+       std::find(receivers.begin(),receivers.end(),variant)==receivers.end())
+    {
+      receivers.push_back(variant);
+    }
+  }
+  for(int variant : receivers)
+  {
+    shader->use(m_variants.name(variant));
+    shader->setUniform("reflectionMap",static_cast<int>(REFLECTION_UNIT));
+    shader->setUniform("reflectionStrength",m_reflectionActive ? 1.0f : 0.0f);
+    if(m_reflectionWidth>0)
+    {
+      // scene pixels to the reflection's texture coordinates, clamped half a texel in from its edge
+      shader->setShaderParam2f("reflectionScale",static_cast<float>(width)/(m_renderWidth*m_reflectionWidth),
+                                                 static_cast<float>(height)/(m_renderHeight*m_reflectionHeight));
+      shader->setShaderParam2f("reflectionMaxUV",(width-0.5f)/m_reflectionWidth,(height-0.5f)/m_reflectionHeight);
+    }
+    shader->setUniform("reflectionMaxLod",static_cast<float>(m_reflectionLevels-1));
+    shader->setShaderParam4f("reflectionPlane",m_reflectionPlane.m_x,m_reflectionPlane.m_y,m_reflectionPlane.m_z,m_reflectionPlane.m_w);
+    shader->setShaderParam3f("reflectionEye",m_reflectionEye.m_x,m_reflectionEye.m_y,m_reflectionEye.m_z);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::toggleReflections()
+{
+  m_reflectionEnabled^=true;
+  m_reflectionCost=0.0f;
+  std::cout<<"Planar reflections "<<(m_reflectionEnabled ? "on" : "off")<<"\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::updateReflectionBudget()
+{
+  float scene=m_passTimer.passTime(SCENE_PASS);
+  if(!m_reflectionActive || scene<=0.0f)
+  {
+    return;
+  }
+  m_reflectionCost+=(m_passTimer.passTime(REFLECTION_PASS)/scene-m_reflectionCost)*REFLECTION_TIME_SMOOTHING;
+  int divisor=m_reflectionDivisor;
+  if(m_reflectionCost>REFLECTION_BUDGET && divisor<MAX_REFLECTION_DIVISOR)
+  {
+    divisor*=2;
+  }
+  else if(m_reflectionCost<REFLECTION_RETURN && divisor>MIN_REFLECTION_DIVISOR)
+  {
+    divisor/=2;
+  }
+  if(divisor!=m_reflectionDivisor)
+  {
+    // the average starts again at the new size, the target follows on the next pass
+    m_reflectionDivisor=divisor;
+    m_reflectionCost=REFLECTION_BUDGET*0.5f;
+    std::cout<<"Reflection resolution 1/"<<m_reflectionDivisor<<"\n";
+  }
+}
@@ -0,0 +1,74 @@
+#include "NGLScene.h"
+#include "RenderServer.h"
+#include <QImage>
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::initializeServer()
+{
+  initializeRenderer();
+  // every job is a still so there is no frame rate to keep and no history to accumulate
+  m_governor.setEnabled(false);
+  m_aaMode=AAMode::FXAA;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::setJobLabel(uint32_t _label)
+{
+  GLuint label=_label%m_sceneBase.labels.count;
+  bool changed=false;
+  for(auto &instance : m_instances)
+  {
+    changed|=instance.label!=label;
+    instance.label=label;
+  }
+  if(changed)
+  {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_instanceSSBO);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER,0,m_instances.size()*sizeof(InstanceData),m_instances.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::renderJobs(std::vector<RenderJob> &io_jobs)
+{
+  const RenderJob &shared=io_jobs.front();
+  // the scene targets keep the server's size, only the camera and the present target follow the job
+  if(shared.width!=m_frameInput.width || shared.height!=m_frameInput.height)
+  {
+    m_frameInput.width=shared.width;
+    m_frameInput.height=shared.height;
+    resizeRenderer();
+  }
+  m_frameInput.lightPosition=shared.light;
+  m_frameInput.spinXFace=0;
+  m_frameInput.spinYFace=0;
+  m_frameInput.modelPos.set(0.0f,0.0f,0.0f);
+  m_cam.set(shared.eye,shared.look,ngl::Vec3(0.0f,1.0f,0.0f));
+
+  // the culling and the shadow atlas depend on the camera and light, so the batch shares them
+  beginFrameStats();
+  updateQuality();
+  updateMouseTransform();
+  updateJitter();
+  cullScene();
+  renderShadowAtlas();
+  m_passTimer.mark(SHADOW_PASS);
+  prefilterShadows();
+  for(auto &job : io_jobs)
+  {
+    setJobLabel(job.label);
+    renderView();
+    // read the present target straight back, the jobs are never shown
+    const PresentFrame &frame=m_presentFrames.writeBuffer();
+    job.image=QImage(frame.width,frame.height,QImage::Format_RGBA8888);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER,frame.fbo);
+    glPixelStorei(GL_PACK_ALIGNMENT,4);
+    glReadPixels(0,0,frame.width,frame.height,GL_RGBA,GL_UNSIGNED_BYTE,job.image.bits());
+    job.image=job.image.mirrored();
+  }
+  endFrameStats();
+}
@@ -0,0 +1,302 @@
+#include "NGLScene.h"
+#include <ngl/ShaderLib.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the shadow map views have units of their own, the raw depth for the hard filter, the
+/// same depth through the comparison sampler for PCF and the blurred moments for EVSM
+//----------------------------------------------------------------------------------------------------------------------
+constexpr GLuint SHADOW_DEPTH_UNIT=11;
+constexpr GLuint SHADOW_COMPARE_UNIT=12;
+constexpr GLuint SHADOW_MOMENTS_UNIT=13;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief positive and negative warp exponents, 42 is as far as the positive one goes in 32 bit float
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float EVSM_POSITIVE_EXPONENT=40.0f;
+constexpr float EVSM_NEGATIVE_EXPONENT=5.0f;
+constexpr float EVSM_LIGHT_BLEED=0.2f;
+constexpr float MIN_SHADOW_RADIUS=0.5f;
+constexpr float MAX_SHADOW_RADIUS=16.0f;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief weight of each frame in the per filter timing average
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float SHADOW_TIME_SMOOTHING=0.1f;
+
+//________________________________________________________________________________________________________________________________________//
+
+const char *NGLScene::shadowFilterName(uint32_t _filter)
+{
+  const char *names[]={"scene","hard","pcf","evsm"};
+  return names[(_filter & FEATURE_SHADOW_FILTER)>>SHADOW_FILTER_SHIFT];
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::createShadowFilters()
+{
+  if(m_shadowCompareSampler==0)
+  {
+    // the PCF taps each compare and bilinearly weight a 2x2 footprint, the depth texture itself
+    // keeps compare mode off so the hard filter and the moments pass can read the depths
+    glGenSamplers(1,&m_shadowCompareSampler);
+    glSamplerParameteri(m_shadowCompareSampler,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+    glSamplerParameteri(m_shadowCompareSampler,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+    glSamplerParameteri(m_shadowCompareSampler,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(m_shadowCompareSampler,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(m_shadowCompareSampler,GL_TEXTURE_COMPARE_MODE,GL_COMPARE_REF_TO_TEXTURE);
+    glSamplerParameteri(m_shadowCompareSampler,GL_TEXTURE_COMPARE_FUNC,GL_LEQUAL);
+  }
+  if(m_evsmFBO[0]!=0)
+  {
+    glDeleteTextures(2,m_evsmTex);
+    glDeleteFramebuffers(2,m_evsmFBO);
+  }
+  m_evsmSize=m_shadowAtlas.layerSize();
+  m_evsmLayers=m_shadowAtlas.layers();
+  m_evsmLevels=1;
+  while((m_evsmSize>>m_evsmLevels)>0)
+  {
+    ++m_evsmLevels;
+  }
+  glGenTextures(2,m_evsmTex);
+  glGenFramebuffers(2,m_evsmFBO);
+  for(int i=0; i<2; ++i)
+  {
+    // only the sampled one needs mips and every layer, the horizontal pass is done a layer at a time
+    glBindTexture(GL_TEXTURE_2D_ARRAY,m_evsmTex[i]);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY,i==0 ? m_evsmLevels : 1,GL_RGBA32F,m_evsmSize,m_evsmSize,i==0 ? m_evsmLayers : 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MIN_FILTER,i==0 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+    glBindFramebuffer(GL_FRAMEBUFFER,m_evsmFBO[i]);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,m_evsmTex[i],0,0);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE)
+    {
+      std::cerr<<"EVSM framebuffer not complete\n";
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY,0);
+  glBindFramebuffer(GL_FRAMEBUFFER,0);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::updateShadowAtlas()
+{
+  // the spot light follows the light the user moves, the other two stay where the scene put them
+  m_shadowLights={SCENE_LIGHTS[0].light,SCENE_LIGHTS[1].light,SCENE_LIGHTS[2].light};
+  m_shadowLights[0].position=m_frameInput.lightPosition;
+  // the BVH root was refitted this frame, an empty scene falls back to the default ground
+  float sceneMin[3]={-10.0f,-1.0f,-10.0f};
+  float sceneMax[3]={10.0f,5.0f,10.0f};
+  m_bvh.bounds(sceneMin,sceneMax);
+  m_shadowAtlas.update(m_shadowLights,m_mouseGlobalTX*m_cam.getViewMatrix(),m_cam.getProjectionMatrix(),sceneMin,sceneMax);
+  m_shadowAtlas.allocate();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::loadShadowViews()
+{
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  shader->use("ShadowAtlas");
+  const std::vector<ShadowAtlas::View> &views=m_shadowAtlas.views();
+  shader->setUniform("viewCount",static_cast<int>(views.size()));
+  for(size_t i=0; i<views.size(); ++i)
+  {
+    const ShadowAtlas::View &view=views[i];
+    std::string index="["+std::to_string(i)+"]";
+    shader->setShaderParamFromMat4("viewVP"+index,view.VP);
+    shader->setShaderParam4f("viewDepthPlane"+index,view.depthPlane.m_x,view.depthPlane.m_y,view.depthPlane.m_z,view.depthPlane.m_w);
+    shader->setUniform("viewLayer"+index,view.layer);
+    glViewportIndexedf(static_cast<GLuint>(i),view.x,view.y,view.size,view.size);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::selectShadowVariants()
+{
+  m_shadowReceivers.clear();
+  m_shadowFiltersUsed=0;
+  for(size_t i=0; i<m_sceneBase.materials.size(); ++i)
+  {
+    const SceneMaterial &material=m_sceneBase.materials[i];
+    uint32_t features=material.features;
+    // materials that don't take shadows keep SHADOW_NONE whatever the filter
+    if(m_shadowFilter!=SHADOW_NONE && (features & FEATURE_SHADOW_FILTER))
+    {
+      features=(features & ~FEATURE_SHADOW_FILTER) | m_shadowFilter;
+    }
+    int variant=m_variants.request(material.program,features);
+    if(variant<0)
+    {
+      variant=m_variants.request("Shadow",features);
+    }
+    m_materialVariant[i]=variant;
+    uint32_t filter=m_variants.features(variant) & FEATURE_SHADOW_FILTER;
+    if(filter!=SHADOW_NONE && std::find(m_shadowReceivers.begin(),m_shadowReceivers.end(),variant)==m_shadowReceivers.end())
+    {
+      m_shadowReceivers.push_back(variant);
+      m_shadowFiltersUsed|=1u<<(filter>>SHADOW_FILTER_SHIFT);
+    }
+    // the turntable follows the same filter, its draws aren't timed so it adds nothing to the filter costs
+    int turntable=m_variants.request(material.program,turntableFeatures(features));
+    if(turntable<0)
+    {
+      turntable=m_variants.request("Shadow",turntableFeatures(features));
+    }
+    m_turntableVariant[i]=turntable;
+    if(filter!=SHADOW_NONE && std::find(m_shadowReceivers.begin(),m_shadowReceivers.end(),turntable)==m_shadowReceivers.end())
+    {
+      m_shadowReceivers.push_back(turntable);
+    }
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::cycleShadowFilter()
+{
+  const uint32_t order[]={SHADOW_NONE,SHADOW_HARD,SHADOW_PCF,SHADOW_EVSM};
+  int current=static_cast<int>(m_shadowFilter>>SHADOW_FILTER_SHIFT);
+  m_shadowFilter=order[(current+1)%4];
+  selectShadowVariants();
+  std::cout<<"Shadow filter "<<shadowFilterName(m_shadowFilter)<<"\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::changeShadowRadius(float _scale)
+{
+  m_shadowRadius=std::min(std::max(m_shadowRadius*_scale,MIN_SHADOW_RADIUS),MAX_SHADOW_RADIUS);
+  std::cout<<"Shadow filter radius "<<m_shadowRadius<<" texels\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::prefilterShadows()
+{
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  bool evsm=(m_shadowFiltersUsed & (1u<<(SHADOW_EVSM>>SHADOW_FILTER_SHIFT)))!=0;
+  // the moments follow the atlas, which only changes when it grows or the governor resizes it
+  if(m_shadowCompareSampler==0 ||
+     (evsm && (m_evsmLayers!=m_shadowAtlas.layers() || m_evsmSize!=m_shadowAtlas.layerSize())))
+  {
+    createShadowFilters();
+  }
+  if(evsm)
+  {
+    // the quad passes draw every texel, none of the shadow pass state applies
+    glDisable(GL_CULL_FACE);
+    glColorMask(GL_TRUE,GL_TRUE,GL_TRUE,GL_TRUE);
+    glViewport(0,0,m_evsmSize,m_evsmSize);
+    glActiveTexture(GL_TEXTURE0);
+    int radius=static_cast<int>(std::lround(m_shadowRadius));
+    float texel=1.0f/m_evsmSize;
+
+    // only the layers this frame's views use, the rest hold nothing a receiver looks up
+    for(int layer=0; layer<m_shadowAtlas.usedLayers(); ++layer)
+    {
+      // warp the depths into the two exponential moments
+      glBindFramebuffer(GL_FRAMEBUFFER,m_evsmFBO[0]);
+      glFramebufferTextureLayer(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,m_evsmTex[0],0,layer);
+      shader->use("ShadowMoments");
+      shader->setUniform("depthMap",0);
+      shader->setUniform("layer",layer);
+      shader->setShaderParam2f("exponents",EVSM_POSITIVE_EXPONENT,EVSM_NEGATIVE_EXPONENT);
+      glBindTexture(GL_TEXTURE_2D_ARRAY,m_shadowAtlas.texture());
+      RenderQuad();
+
+      // the blur cost is per shadow texel so a wider penumbra costs the receivers nothing
+      if(radius>0)
+      {
+        shader->use("ShadowBlur");
+        shader->setUniform("image",0);
+        shader->setUniform("radius",radius);
+        glBindFramebuffer(GL_FRAMEBUFFER,m_evsmFBO[1]);
+        shader->setUniform("layer",layer);
+        shader->setShaderParam2f("texelStep",texel,0.0f);
+        glBindTexture(GL_TEXTURE_2D_ARRAY,m_evsmTex[0]);
+        RenderQuad();
+        glBindFramebuffer(GL_FRAMEBUFFER,m_evsmFBO[0]);
+        shader->setUniform("layer",0);
+        shader->setShaderParam2f("texelStep",0.0f,texel);
+        glBindTexture(GL_TEXTURE_2D_ARRAY,m_evsmTex[1]);
+        RenderQuad();
+      }
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY,m_evsmTex[0]);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+  }
+  m_passTimer.mark(SHADOW_FILTER_PASS);
+
+  // the atlas is recreated when it grows or the governor changes its size so it is bound every frame
+  glActiveTexture(GL_TEXTURE0+SHADOW_DEPTH_UNIT);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,m_shadowAtlas.texture());
+  glActiveTexture(GL_TEXTURE0+SHADOW_COMPARE_UNIT);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,m_shadowAtlas.texture());
+  glBindSampler(SHADOW_COMPARE_UNIT,m_shadowCompareSampler);
+  glActiveTexture(GL_TEXTURE0+SHADOW_MOMENTS_UNIT);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,m_evsmTex[0]);
+  glActiveTexture(GL_TEXTURE0);
+
+  const std::vector<ShadowAtlas::View> &views=m_shadowAtlas.views();
+  float atlasSize=static_cast<float>(m_shadowAtlas.layerSize());
+  for(int variant : m_shadowReceivers)
+  {
+    shader->use(m_variants.name(variant));
+    switch(m_variants.features(variant) & FEATURE_SHADOW_FILTER)
+    {
+      case SHADOW_PCF : shader->setUniform("ShadowMap",static_cast<int>(SHADOW_COMPARE_UNIT)); break;
+      case SHADOW_EVSM : shader->setUniform("ShadowMap",static_cast<int>(SHADOW_MOMENTS_UNIT)); break;
+      default : shader->setUniform("ShadowMap",static_cast<int>(SHADOW_DEPTH_UNIT)); break;
+    }
+    for(size_t i=0; i<views.size(); ++i)
+    {
+      const ShadowAtlas::View &view=views[i];
+      std::string index="["+std::to_string(i)+"]";
+      shader->setShaderParamFromMat4("shadowVP"+index,view.VP);
+      shader->setShaderParam4f("shadowDepthPlane"+index,view.depthPlane.m_x,view.depthPlane.m_y,view.depthPlane.m_z,view.depthPlane.m_w);
+      shader->setShaderParam4f("shadowTile"+index,view.x/atlasSize,view.y/atlasSize,view.size/atlasSize,view.size/atlasSize);
+      shader->setUniform("shadowLayer"+index,view.layer);
+    }
+    for(int light=0; light<ShadowAtlas::MAX_LIGHTS; ++light)
+    {
+      std::string index="["+std::to_string(light)+"]";
+      shader->setUniform("shadowFirstView"+index,m_shadowAtlas.firstView(light));
+      shader->setUniform("shadowViewCount"+index,m_shadowAtlas.viewCount(light));
+      const ngl::Vec3 &position=m_shadowLights[light].position;
+      shader->setShaderParam3f("shadowLightPosition"+index,position.m_x,position.m_y,position.m_z);
+    }
+    shader->setUniform("shadowRadius",m_shadowRadius);
+    shader->setUniform("shadowKernelRotation",m_shadowKernelRotation);
+    shader->setUniform("shadowTexelSize",1.0f/atlasSize);
+    shader->setShaderParam2f("evsmExponents",EVSM_POSITIVE_EXPONENT,EVSM_NEGATIVE_EXPONENT);
+    shader->setUniform("lightBleedReduction",EVSM_LIGHT_BLEED);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::updateShadowTimings()
+{
+  // the pass and variant times are last frame's, near enough to the current filter as it
+  // only changes on a key press
+  float time=m_passTimer.passTime(SHADOW_FILTER_PASS);
+  for(int variant : m_shadowReceivers)
+  {
+    time+=m_variants.gpuTime(variant);
+  }
+  for(unsigned int filter=1; filter<4; ++filter)
+  {
+    if(m_shadowFiltersUsed & (1u<<filter))
+    {
+      m_shadowFilterTime[filter]+=(time-m_shadowFilterTime[filter])*SHADOW_TIME_SMOOTHING;
+    }
+  }
+}
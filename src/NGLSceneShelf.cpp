@@ -0,0 +1,297 @@
+#include "NGLScene.h"
+#include <ngl/ShaderLib.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief shelf layout, a shelf unit is SHELF_COLUMNS wide, SHELF_DEPTH deep and SHELF_LEVELS high,
+/// extra units are placed one behind the other like aisles
+//----------------------------------------------------------------------------------------------------------------------
+constexpr int SHELF_COLUMNS=100;
+constexpr int SHELF_DEPTH=4;
+constexpr int SHELF_LEVELS=5;
+constexpr float SHELF_AISLE=3.0f;
+constexpr float CAN_SCALE=0.4f;
+constexpr int MAX_SHELF_COUNT=20000;
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::buildInstances()
+{
+  // start from the loaded scene, in shelf mode the hero cans are swapped for the shelf
+  m_scene.clear();
+  m_scene.meshes=m_sceneBase.meshes;
+  m_scene.materials=m_sceneBase.materials;
+  for(uint32_t i=0; i<m_sceneBase.size(); ++i)
+  {
+    if(m_shelfMode && m_sceneBase.mesh[i]==m_canMeshID)
+    {
+      continue;
+    }
+    m_scene.addObject(m_sceneBase.mesh[i],m_sceneBase.material[i],
+                      ngl::Vec3(m_sceneBase.posX[i],m_sceneBase.posY[i],m_sceneBase.posZ[i]),
+                      ngl::Vec3(m_sceneBase.rotX[i],m_sceneBase.rotY[i],m_sceneBase.rotZ[i]),
+                      ngl::Vec3(m_sceneBase.scaleX[i],m_sceneBase.scaleY[i],m_sceneBase.scaleZ[i]),
+                      m_sceneBase.label[i]);
+  }
+
+  if(m_shelfMode)
+  {
+    // space the cans by the bounding sphere so they never intersect
+    float spacing=2.0f*m_canMesh->getRadius()*CAN_SCALE;
+    int perUnit=SHELF_COLUMNS*SHELF_DEPTH*SHELF_LEVELS;
+    for(int i=0; i<m_shelfCount; ++i)
+    {
+      int unit=i/perUnit;
+      int local=i%perUnit;
+      int level=local/(SHELF_COLUMNS*SHELF_DEPTH);
+      int row=(local/SHELF_COLUMNS)%SHELF_DEPTH;
+      int column=local%SHELF_COLUMNS;
+      // give each can a different turn so the labels don't all line up
+      m_scene.addObject(static_cast<uint16_t>(m_canMeshID),static_cast<uint16_t>(m_canMaterialID),
+                        ngl::Vec3((column-SHELF_COLUMNS*0.5f)*spacing,
+                                  level*spacing,
+                                  -(row*spacing+unit*(SHELF_DEPTH*spacing+SHELF_AISLE))),
+                        ngl::Vec3(0.0f,static_cast<float>((i*37)%360),0.0f),
+                        ngl::Vec3(CAN_SCALE,CAN_SCALE,CAN_SCALE),
+                        static_cast<uint32_t>(i)%m_sceneBase.labels.count);
+    }
+  }
+  m_scene.updateBounds(true);
+  m_scene.clearDirty();
+  m_bvh.build(m_scene);
+
+  // every can object becomes an instance, the rest are drawn on their own
+  m_instances.clear();
+  m_instanceObject.clear();
+  m_slotObject.clear();
+  m_objectInstance.assign(m_scene.size(),-1);
+  m_objectSlot.assign(m_scene.size(),-1);
+  InstanceData data;
+  data.pad[0]=data.pad[1]=data.pad[2]=0;
+  for(uint32_t i=0; i<m_scene.size(); ++i)
+  {
+    if(m_scene.mesh[i]!=m_canMeshID)
+    {
+      m_objectSlot[i]=static_cast<int32_t>(m_slotObject.size());
+      m_slotObject.push_back(i);
+      continue;
+    }
+    // the layer table has one entry per SKU so anything past the catalogue wraps
+    data.label=m_scene.label[i]%m_sceneBase.labels.count;
+    m_objectInstance[i]=static_cast<int32_t>(m_instances.size());
+    m_instanceObject.push_back(i);
+    m_instances.push_back(data);
+  }
+  // the matrices are written straight into the instance data, 8 objects at a time. A scene with
+  // no cans has no first instance to take the member of
+  TransformBatch::compute(m_scene,m_instanceObject.data(),m_instanceObject.size(),
+                          m_instances.empty() ? nullptr : &m_instances[0].transform,sizeof(InstanceData));
+  m_objectMatrices.resize(m_slotObject.size());
+  TransformBatch::compute(m_scene,m_slotObject.data(),m_slotObject.size(),m_objectMatrices.data());
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_instanceSSBO);
+  glBufferData(GL_SHADER_STORAGE_BUFFER,m_instances.size()*sizeof(InstanceData),m_instances.data(),GL_STATIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+  resizeCullBuffers();
+  std::cout<<"Objects "<<m_scene.size()<<" BVH nodes "<<m_bvh.numNodes()
+           <<" Instances "<<m_instances.size()<<" ("<<m_instances.size()*m_canMesh->numTriangles()<<" triangles per pass)\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::updateTransforms()
+{
+  if(m_scene.dirtyList.empty())
+  {
+    return;
+  }
+  std::vector<uint32_t> instances;
+  for(auto object : m_scene.dirtyList)
+  {
+    if(m_objectInstance[object]>=0)
+    {
+      instances.push_back(static_cast<uint32_t>(m_objectInstance[object]));
+    }
+    else
+    {
+      TransformBatch::compute(m_scene,&object,1,&m_objectMatrices[m_objectSlot[object]]);
+    }
+  }
+  if(instances.empty())
+  {
+    return;
+  }
+  // recompute each run of neighbouring instances as one batch, then upload the span they cover
+  std::sort(instances.begin(),instances.end());
+  size_t start=0;
+  while(start<instances.size())
+  {
+    size_t end=start+1;
+    while(end<instances.size() && instances[end]==instances[end-1]+1)
+    {
+      ++end;
+    }
+    uint32_t first=instances[start];
+    TransformBatch::compute(m_scene,&m_instanceObject[first],end-start,&m_instances[first].transform,sizeof(InstanceData));
+    start=end;
+  }
+  GLintptr offset=instances.front()*sizeof(InstanceData);
+  GLsizeiptr size=(instances.back()-instances.front()+1)*sizeof(InstanceData);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_instanceSSBO);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER,offset,size,reinterpret_cast<const char *>(m_instances.data())+offset);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::changeShelfCount(float _scale)
+{
+  m_shelfCount=static_cast<int>(m_shelfCount*_scale);
+  m_shelfCount=std::max(1,std::min(m_shelfCount,MAX_SHELF_COUNT));
+  if(m_shelfMode)
+  {
+    buildInstances();
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::loadInstancesToLightPOVShader()
+{
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  shader->use("ShadowAtlas");
+  shader->setShaderParam1i("instanced",1);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::loadInstancesToCanShader(bool _reflected)
+{
+  const std::vector<int> &variants=_reflected ? m_reflectionVariant : m_materialVariant;
+  loadMatrices(m_variants.name(variants[m_canMaterialID]),_reflected);
+  loadMaterial(m_scene.materials[m_canMaterialID]);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::beginFrameStats()
+{
+  if(!m_frameTimer.isValid())
+  {
+    m_frameTimer.start();
+    m_reportTimer.start();
+  }
+  // time between successive paints is the real frame time
+  m_frameTime=m_frameTimer.nsecsElapsed()/1000000.0f;
+  m_frameTimer.restart();
+  m_drawCalls=0;
+  // queries are double buffered so reading last frame's never stalls
+  glBeginQuery(GL_TIME_ELAPSED,m_frameQuery[m_frameIndex%2]);
+  m_passTimer.begin();
+  m_variants.beginFrame();
+  m_stream.beginFrame();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::endFrameStats()
+{
+  glEndQuery(GL_TIME_ELAPSED);
+  if(m_frameIndex>0)
+  {
+    GLuint available=0;
+    glGetQueryObjectuiv(m_frameQuery[(m_frameIndex+1)%2],GL_QUERY_RESULT_AVAILABLE,&available);
+    if(available)
+    {
+      GLuint64 gpuTime=0;
+      glGetQueryObjectui64v(m_frameQuery[(m_frameIndex+1)%2],GL_QUERY_RESULT,&gpuTime);
+      m_gpuFrameTime=gpuTime/1000000.0f;
+    }
+  }
+  ++m_frameIndex;
+
+  int cans=static_cast<int>(m_instances.size());
+  QString stats=QString("cans %1  draw calls %2  frame %3 ms  gpu %4 ms  %5 vertices  aa %6 %7 ms")
+                .arg(cans)
+                .arg(static_cast<int>(m_drawCalls))
+                .arg(m_frameTime,0,'f',2)
+                .arg(m_gpuFrameTime,0,'f',2)
+                .arg(m_quantisedVertices ? "quantised" : "float")
+                .arg(aaModeName())
+                .arg(m_aaTime,0,'f',3);
+  const char *modes[]={"gpu","cpu bvh","none"};
+  QString cull=QString("%1 cull  camera visible %2 culled %3  light visible %4 culled %5  bvh %6 ms")
+               .arg(modes[static_cast<int>(m_cullMode)])
+               .arg(static_cast<int>(m_cull[0].visibleCount))
+               .arg(cans-static_cast<int>(m_cull[0].visibleCount))
+               .arg(static_cast<int>(m_cull[1].visibleCount))
+               .arg(cans-static_cast<int>(m_cull[1].visibleCount))
+               .arg(m_cpuCullTime,0,'f',3);
+  // triangles actually drawn against what the same instances would cost at full detail
+  auto percent=[this](const CullPass &_pass)
+  {
+    GLuint full=_pass.visibleCount*static_cast<GLuint>(m_canMesh->numTriangles(0));
+    return full>0 ? 100.0f*_pass.triangles/full : 100.0f;
+  };
+  QString lod=QString("lod %1  shadow bias %2  camera tris %3 (%4%)  light tris %5 (%6%)  camera levels")
+              .arg(m_lodEnabled ? "on" : "off")
+              .arg(m_shadowLODBias)
+              .arg(m_cull[0].triangles)
+              .arg(percent(m_cull[0]),0,'f',1)
+              .arg(m_cull[1].triangles)
+              .arg(percent(m_cull[1]),0,'f',1);
+  for(int i=0; i<m_canMesh->numLODs(); ++i)
+  {
+    lod+=QString(" %1").arg(m_cull[0].lodInstances[i]);
+  }
+  m_text->renderText(10,18,stats);
+  m_text->renderText(10,38,cull);
+  QString quality=QString("quality %1 level %2  scale %3 (%4x%5)  target %6 ms  shadow %7 scene %8 post %9 ms")
+                  .arg(m_governor.enabled() ? "auto" : "fixed")
+                  .arg(m_governor.level())
+                  .arg(m_renderScale,0,'f',3)
+                  .arg(m_renderWidth)
+                  .arg(m_renderHeight)
+                  .arg(m_governor.target(),0,'f',1)
+                  .arg(m_passTimer.passTime(SHADOW_PASS),0,'f',2)
+                  .arg(m_passTimer.passTime(SCENE_PASS),0,'f',2)
+                  .arg(m_passTimer.passTime(POST_PASS),0,'f',2);
+  updateShadowTimings();
+  QString shadows=QString("shadows %1  radius %2 texels  prefilter %3 ms  hard %4 pcf %5 evsm %6 ms  %7")
+                  .arg(shadowFilterName(m_shadowFilter))
+                  .arg(m_shadowRadius,0,'f',2)
+                  .arg(m_passTimer.passTime(SHADOW_FILTER_PASS),0,'f',3)
+                  .arg(m_shadowFilterTime[1],0,'f',3)
+                  .arg(m_shadowFilterTime[2],0,'f',3)
+                  .arg(m_shadowFilterTime[3],0,'f',3)
+                  .arg(QString::fromStdString(m_shadowAtlas.report()));
+  m_text->renderText(10,58,lod);
+  m_text->renderText(10,78,quality);
+  m_text->renderText(10,98,shadows);
+  updateReflectionBudget();
+  QString reflection=QString("reflection %1  1/%2 res  %3 ms  %4% of scene (budget 25%)  visible %5 cans")
+                     .arg(!m_reflectionEnabled ? "off" : (m_reflectionActive ? "on" : "unseen"))
+                     .arg(m_reflectionDivisor)
+                     .arg(m_passTimer.passTime(REFLECTION_PASS),0,'f',3)
+                     .arg(m_reflectionCost*100.0f,0,'f',1)
+                     .arg(static_cast<int>(m_cull[2].visibleCount));
+  m_text->renderText(10,118,reflection);
+  QString labels=QString::fromStdString(m_labels.report());
+  m_text->renderText(10,138,labels);
+  QString stream=QString::fromStdString(m_stream.report());
+  m_text->renderText(10,158,stream);
+  QString accumulation=QString("accumulation %1/%2 samples").arg(m_accumulatedSamples).arg(static_cast<int>(ACCUMULATION_SAMPLES));
+  if(!m_accumulating)
+  {
+    accumulation="accumulation waiting for the view to settle";
+  }
+  m_text->renderText(10,178,accumulation);
+
+  if(m_reportTimer.elapsed()>1000)
+  {
+    std::cout<<stats.toStdString()<<"  "<<cull.toStdString()<<"  "<<lod.toStdString()<<"  "<<quality.toStdString()<<"  "<<shadows.toStdString()<<"  "<<reflection.toStdString()<<"  "<<labels.toStdString()<<"  "<<stream.toStdString()<<"\n";
+    m_reportTimer.restart();
+  }
+}
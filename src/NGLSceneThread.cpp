@@ -0,0 +1,196 @@
+#include "NGLScene.h"
+#include <ngl/Text.h>
+#include <iostream>
+
+//________________________________________________________________________________________________________________________________________//
+//========================================================================================================================================//
+// GUI thread
+//========================================================================================================================================//
+
+void NGLScene::initializeGL()
+{
+  // the window only shows finished frames, all of the scene set up happens on the render thread
+  // with its own context sharing this one so the frame textures can be read here
+  m_guiInput.width=width();
+  m_guiInput.height=height();
+  m_guiInput.devicePixelRatio=devicePixelRatio();
+  publishInput();
+  m_renderThread.reset(new RenderThread(this,context()));
+  m_renderThread->setFramesAhead(m_lowLatency ? 1 : RenderThread::MAX_FRAMES_AHEAD);
+  m_renderThread->start();
+  m_lightTimer =startTimer(40);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::resizeGL( int _w, int _h )
+{
+  m_win.width  = static_cast<int>( _w * devicePixelRatio() );
+  m_win.height = static_cast<int>( _h * devicePixelRatio() );
+  m_guiInput.width=_w;
+  m_guiInput.height=_h;
+  m_guiInput.devicePixelRatio=devicePixelRatio();
+  publishInput();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::paintGL()
+{
+  // the GL functions are only used here once the render thread has published a frame, by then
+  // NGLInit on the render thread has loaded them
+  bool newFrame=m_presentFrames.update();
+  PresentFrame &frame=m_presentFrames.readBuffer();
+  if(frame.texture==0)
+  {
+    return;
+  }
+  readPresentTimes();
+  if(newFrame)
+  {
+    // make this context wait for the render thread's commands without stalling the CPU
+    glWaitSync(frame.fence,0,GL_TIMEOUT_IGNORED);
+  }
+  if(m_blitFence!=nullptr)
+  {
+    // in low latency mode don't queue a blit behind one the driver hasn't finished
+    glClientWaitSync(m_blitFence,GL_SYNC_FLUSH_COMMANDS_BIT,100000000);
+    glDeleteSync(m_blitFence);
+    m_blitFence=nullptr;
+  }
+  if(m_presentReadFBO==0)
+  {
+    glGenFramebuffers(1,&m_presentReadFBO);
+  }
+  // framebuffers are not shared between contexts so this one only borrows the slot's texture
+  glBindFramebuffer(GL_READ_FRAMEBUFFER,m_presentReadFBO);
+  glFramebufferTexture2D(GL_READ_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,frame.texture,0);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER,defaultFramebufferObject());
+  int w=static_cast<int>(width()*devicePixelRatio());
+  int h=static_cast<int>(height()*devicePixelRatio());
+  glBlitFramebuffer(0,0,frame.width,frame.height,0,0,w,h,GL_COLOR_BUFFER_BIT,GL_LINEAR);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER,0);
+  if(m_lowLatency)
+  {
+    m_blitFence=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+  }
+  if(newFrame)
+  {
+    timePresent(frame);
+    m_renderThread->framePresented();
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::publishInput()
+{
+  m_guiInput.spinXFace=m_win.spinXFace;
+  m_guiInput.spinYFace=m_win.spinYFace;
+  m_guiInput.modelPos=m_modelPos;
+  m_guiInput.lightPosition=m_lightPosition;
+  m_guiInput.inputSeq=m_inputSeq;
+  m_inputs.writeBuffer()=m_guiInput;
+  m_inputs.publish();
+  if(m_renderThread)
+  {
+    m_renderThread->wake();
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+//========================================================================================================================================//
+// render thread
+//========================================================================================================================================//
+
+void NGLScene::consumeInput()
+{
+  if(m_inputs.update())
+  {
+    const SceneInput &input=m_inputs.readBuffer();
+    bool resized=input.width!=m_frameInput.width || input.height!=m_frameInput.height;
+    m_frameInput=input;
+    if(resized)
+    {
+      resizeRenderer();
+    }
+  }
+  int key;
+  while(m_keys.pop(key))
+  {
+    applyKey(key);
+    // most keys change the picture, the few that don't are too rare to be worth telling apart
+    m_accumulationReset=true;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::resizeRenderer()
+{
+  int w=m_frameInput.width;
+  int h=m_frameInput.height;
+  m_cam.setShape( 45.0f, static_cast<float>( w ) / h, 0.05f, 350.0f );
+  if(m_text)
+  {
+    m_text->setScreenSize(w,h);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::bindPresentTarget()
+{
+  PresentFrame &frame=m_presentFrames.writeBuffer();
+  int w=static_cast<int>(m_frameInput.width*m_frameInput.devicePixelRatio);
+  int h=static_cast<int>(m_frameInput.height*m_frameInput.devicePixelRatio);
+  if(frame.texture==0 || frame.width!=w || frame.height!=h)
+  {
+    if(frame.texture==0)
+    {
+      glGenTextures(1,&frame.texture);
+      glGenFramebuffers(1,&frame.fbo);
+    }
+    frame.width=w;
+    frame.height=h;
+    glBindTexture(GL_TEXTURE_2D,frame.texture);
+    glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,w,h,0,GL_RGBA,GL_UNSIGNED_BYTE,nullptr);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER,frame.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,frame.texture,0);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE)
+    {
+      std::cerr<<"Present framebuffer not complete\n";
+    }
+  }
+  // the triple buffer never hands back the slot the window is showing, so any fence left on
+  // this one has been waited on or belongs to a frame that was skipped and can go
+  if(frame.fence!=nullptr)
+  {
+    glDeleteSync(frame.fence);
+    frame.fence=nullptr;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER,frame.fbo);
+  glViewport(0,0,w,h);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::publishFrame()
+{
+  PresentFrame &frame=m_presentFrames.writeBuffer();
+  frame.fence=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+  // the fence has to reach the GPU before another context can wait on it
+  glFlush();
+  frame.frameIndex=m_frameIndex;
+  frame.gpuTime=m_gpuFrameTime;
+  frame.aaTime=m_aaTime;
+  frame.aaMode=aaModeName();
+  frame.inputSeq=m_frameInput.inputSeq;
+  if(m_presentFrames.publish())
+  {
+    // the window never saw the frame this one replaced so it will not give its slot back
+    m_renderThread->framePresented();
+  }
+}
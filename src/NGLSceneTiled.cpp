@@ -0,0 +1,218 @@
+#include "NGLScene.h"
+#include "TiffWriter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief how far the post passes read from a pixel, each blur pass samples 4 texels either side in
+/// one direction and the FXAA edge search walks up to 26.5 texels along an edge
+//----------------------------------------------------------------------------------------------------------------------
+constexpr int BLUR_TAP_REACH=4;
+constexpr int FXAA_REACH=28;
+constexpr int MARGIN_ALIGNMENT=16;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief how long to wait for the label before rendering without it
+//----------------------------------------------------------------------------------------------------------------------
+constexpr int LABEL_TIMEOUT_MS=10000;
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the most resident memory this process has used, in MB
+//----------------------------------------------------------------------------------------------------------------------
+static double peakRSS()
+{
+  FILE *file=std::fopen("/proc/self/status","r");
+  if(file==nullptr)
+  {
+    return 0.0;
+  }
+  char line[256];
+  double kb=0.0;
+  while(std::fgets(line,sizeof(line),file)!=nullptr)
+  {
+    if(std::sscanf(line,"VmHWM: %lf",&kb)==1)
+    {
+      break;
+    }
+  }
+  std::fclose(file);
+  return kb/1024.0;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::setTile(int _x, int _y, int _width, int _height, int _tile, int _margin)
+{
+  // the tile and its margins in NDC of the whole picture, y is up in NDC and down in the image
+  float left=2.0f*(_x-_margin)/_width-1.0f;
+  float right=2.0f*(_x+_tile+_margin)/_width-1.0f;
+  float top=1.0f-2.0f*(_y-_margin)/_height;
+  float bottom=1.0f-2.0f*(_y+_tile+_margin)/_height;
+  // scale and offset clip x and y after the projection, the offset as a multiple of w like the jitter
+  m_tileProjection.identity();
+  m_tileProjection.m_m[0][0]=2.0f/(right-left);
+  m_tileProjection.m_m[1][1]=2.0f/(top-bottom);
+  m_tileProjection.m_m[3][0]=-(right+left)/(right-left);
+  m_tileProjection.m_m[3][1]=-(top+bottom)/(top-bottom);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int NGLScene::renderTiled(const TiledRender &_settings)
+{
+  int tile=std::max(64,_settings.tile);
+  int margin=_settings.margin;
+  if(margin<0)
+  {
+    // the blur alternates direction so half its passes go each way
+    int blur=QualityGovernor::LEVELS[QualityGovernor::NUM_LEVELS-1].blurIterations;
+    margin=((blur+1)/2*BLUR_TAP_REACH+FXAA_REACH+MARGIN_ALIGNMENT-1)/MARGIN_ALIGNMENT*MARGIN_ALIGNMENT;
+  }
+  int target=tile+2*margin;
+  // stand in for the window, the scene targets are made the size of one tile and its margins
+  m_guiInput.width=target;
+  m_guiInput.height=target;
+  m_guiInput.devicePixelRatio=1.0f;
+  publishInput();
+  initializeServer();
+  GLint maxSize=0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE,&maxSize);
+  if(target>maxSize)
+  {
+    std::cerr<<"A "<<tile<<" tile with a "<<margin<<" margin needs "<<target<<" pixel targets, the most is "<<maxSize<<"\n";
+    return EXIT_FAILURE;
+  }
+  // the depth pyramid is the last tile's view so it can't cull this one
+  m_occlusionCulling=false;
+
+  TiffWriter writer;
+  if(!writer.open(_settings.file,static_cast<uint32_t>(_settings.width),static_cast<uint32_t>(_settings.height),
+                  static_cast<uint32_t>(tile)))
+  {
+    return EXIT_FAILURE;
+  }
+  int tilesX=(_settings.width+tile-1)/tile;
+  int tilesY=(_settings.height+tile-1)/tile;
+  std::cout<<"Rendering "<<_settings.width<<"x"<<_settings.height<<" as "<<tilesX<<"x"<<tilesY<<" tiles of "
+           <<tile<<" with a "<<margin<<" pixel margin to "<<_settings.file<<"\n";
+
+  // the whole picture's camera, each tile narrows it with m_tileProjection
+  m_frameInput.spinXFace=0;
+  m_frameInput.spinYFace=0;
+  m_frameInput.modelPos.set(0.0f,0.0f,0.0f);
+  m_cam.set(_settings.eye,_settings.look,ngl::Vec3(0.0f,1.0f,0.0f));
+  m_cam.setShape(45.0f,static_cast<float>(_settings.width)/_settings.height,0.05f,350.0f);
+  setJobLabel(_settings.label);
+  std::vector<uint32_t> labels(1,_settings.label);
+  auto labelStart=std::chrono::steady_clock::now();
+  while(!jobLabelResident(_settings.label) &&
+        std::chrono::steady_clock::now()-labelStart<std::chrono::milliseconds(LABEL_TIMEOUT_MS))
+  {
+    streamJobLabels(labels);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // the shadow views are placed for the whole picture and rendered once for every tile
+  auto start=std::chrono::steady_clock::now();
+  m_tileProjection.identity();
+  beginFrameStats();
+  updateQuality();
+  updateMouseTransform();
+  updateJitter();
+  cullScene();
+  renderShadowAtlas();
+  m_passTimer.mark(SHADOW_PASS);
+  prefilterShadows();
+  endFrameStats();
+
+  // each tile is read into one pack buffer while the last one is mapped and written, so the read
+  // back doesn't wait on the GPU and only two tiles are ever held
+  struct Readback
+  {
+    GLuint pbo=0;
+    int x=0;
+    int y=0;
+    int width=0;
+    int height=0;
+    bool pending=false;
+  };
+  Readback readbacks[2];
+  GLsizeiptr tileBytes=static_cast<GLsizeiptr>(tile)*tile*4;
+  for(auto &readback : readbacks)
+  {
+    glGenBuffers(1,&readback.pbo);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER,readback.pbo);
+    glBufferData(GL_PIXEL_PACK_BUFFER,tileBytes,nullptr,GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+  bool ok=true;
+  auto write=[&](Readback &_readback)
+  {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER,_readback.pbo);
+    GLsizeiptr bytes=static_cast<GLsizeiptr>(_readback.width)*_readback.height*4;
+    const uint8_t *pixels=static_cast<const uint8_t *>(glMapBufferRange(GL_PIXEL_PACK_BUFFER,0,bytes,GL_MAP_READ_BIT));
+    ok&=pixels!=nullptr && writer.write(static_cast<uint32_t>(_readback.x),static_cast<uint32_t>(_readback.y),
+                                         static_cast<uint32_t>(_readback.width),static_cast<uint32_t>(_readback.height),
+                                         pixels,4,true);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+    _readback.pending=false;
+  };
+
+  int index=0;
+  for(int ty=0; ty<tilesY && ok; ++ty)
+  {
+    for(int tx=0; tx<tilesX && ok; ++tx)
+    {
+      Readback &readback=readbacks[index%2];
+      readback.x=tx*tile;
+      readback.y=ty*tile;
+      readback.width=std::min(tile,_settings.width-readback.x);
+      readback.height=std::min(tile,_settings.height-readback.y);
+      setTile(readback.x,readback.y,_settings.width,_settings.height,tile,margin);
+
+      beginFrameStats();
+      updateJitter();
+      updateReflection();
+      renderView();
+      // the tile without its margins, the top rows of the target are the top of the tile
+      const PresentFrame &frame=m_presentFrames.writeBuffer();
+      glBindFramebuffer(GL_READ_FRAMEBUFFER,frame.fbo);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER,readback.pbo);
+      glPixelStorei(GL_PACK_ALIGNMENT,4);
+      glReadPixels(margin,target-margin-readback.height,readback.width,readback.height,GL_RGBA,GL_UNSIGNED_BYTE,nullptr);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+      readback.pending=true;
+      endFrameStats();
+
+      Readback &last=readbacks[(index+1)%2];
+      if(last.pending)
+      {
+        write(last);
+      }
+      ++index;
+    }
+    std::cout<<"row "<<ty+1<<"/"<<tilesY<<" peak RSS "<<peakRSS()<<" MB\n";
+  }
+  for(auto &readback : readbacks)
+  {
+    if(readback.pending && ok)
+    {
+      write(readback);
+    }
+    glDeleteBuffers(1,&readback.pbo);
+  }
+  m_tileProjection.identity();
+  ok&=writer.close();
+
+  float seconds=std::chrono::duration<float>(std::chrono::steady_clock::now()-start).count();
+  std::printf("%d tiles in %.2f s, %.2f tiles/s %.1f MPixels/s, %.1f MB written, peak RSS %.1f MB%s\n",
+              index,seconds,index/seconds,double(_settings.width)*_settings.height/seconds/1e6,
+              writer.fileSize()/(1024.0*1024.0),peakRSS(),ok ? "" : " FAILED");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
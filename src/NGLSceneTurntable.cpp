@@ -0,0 +1,320 @@
+#include "NGLScene.h"
+#include <ngl/ShaderLib.h>
+#include <QOpenGLContext>
+#include <QDir>
+#include <QImage>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the size of every view, the thumbnails are this divided by THUMBNAIL_FACTOR (see ThumbnailComp.glsl)
+//----------------------------------------------------------------------------------------------------------------------
+constexpr int TURNTABLE_SIZE=512;
+constexpr int THUMBNAIL_FACTOR=4;
+constexpr int THUMBNAIL_SIZE=TURNTABLE_SIZE/THUMBNAIL_FACTOR;
+constexpr int THUMBNAIL_GROUP_SIZE=8;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the views look down on the can from this many degrees above the ground
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float TURNTABLE_ELEVATION=20.0f;
+constexpr float TURNTABLE_FOV=35.0f;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the turntable shares the Hi-Z unit and image binding, the pyramid is rebuilt every frame
+//----------------------------------------------------------------------------------------------------------------------
+constexpr GLuint TURNTABLE_UNIT=7;
+constexpr GLuint TURNTABLE_VIEW_BINDING=0;
+
+//________________________________________________________________________________________________________________________________________//
+
+uint32_t NGLScene::turntableFeatures(uint32_t _features)
+{
+  return (_features & ~FEATURE_PLANAR_REFLECTION) | FEATURE_MULTI_VIEW;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::createTurntable()
+{
+  // the layer is picked in the vertex shader, without the extension it needs a geometry shader
+  // pass per view which is what the turntable is there to avoid
+  QOpenGLContext *context=QOpenGLContext::currentContext();
+  m_turntableSupported=context!=nullptr && context->hasExtension("GL_ARB_shader_viewport_layer_array");
+  if(!m_turntableSupported)
+  {
+    std::cerr<<"GL_ARB_shader_viewport_layer_array not supported, no turntable thumbnails\n";
+    return;
+  }
+
+  glGenTextures(1,&m_turntableColour);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,m_turntableColour);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY,1,GL_RGBA8,TURNTABLE_SIZE,TURNTABLE_SIZE,MAX_TURNTABLE_VIEWS);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+  glGenTextures(1,&m_turntableDepth);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,m_turntableDepth);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY,1,GL_DEPTH_COMPONENT24,TURNTABLE_SIZE,TURNTABLE_SIZE,MAX_TURNTABLE_VIEWS);
+  glGenTextures(1,&m_thumbnails);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,m_thumbnails);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY,1,GL_RGBA8,THUMBNAIL_SIZE,THUMBNAIL_SIZE,MAX_TURNTABLE_VIEWS);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,0);
+
+  // every layer is attached so one draw can reach all of them
+  glGenFramebuffers(1,&m_turntableFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER,m_turntableFBO);
+  glFramebufferTexture(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,m_turntableColour,0);
+  glFramebufferTexture(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,m_turntableDepth,0);
+  if(glCheckFramebufferStatus(GL_FRAMEBUFFER)!=GL_FRAMEBUFFER_COMPLETE)
+  {
+    std::cerr<<"Turntable framebuffer not complete\n";
+  }
+  // one thumbnail layer at a time for the sequential read back
+  glGenFramebuffers(1,&m_thumbnailFBO);
+  glBindFramebuffer(GL_FRAMEBUFFER,0);
+
+  // std140 mat4 viewV[64], mat4 viewVP[64], vec4 viewEye[64], see CanVert.glsl
+  glGenBuffers(1,&m_turntableViewUBO);
+  glBindBuffer(GL_UNIFORM_BUFFER,m_turntableViewUBO);
+  glBufferData(GL_UNIFORM_BUFFER,MAX_TURNTABLE_VIEWS*(2*16+4)*sizeof(float),nullptr,GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER,0);
+
+  // the can is a single instance, its id is read once per view through the divisor
+  GLuint id=0;
+  glGenBuffers(1,&m_turntableIds);
+  glBindBuffer(GL_ARRAY_BUFFER,m_turntableIds);
+  glBufferData(GL_ARRAY_BUFFER,sizeof(GLuint),&id,GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER,0);
+  glGenBuffers(1,&m_turntableInstance);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_turntableInstance);
+  glBufferData(GL_SHADER_STORAGE_BUFFER,sizeof(InstanceData),nullptr,GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+  glGenBuffers(1,&m_turntableCommand);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER,m_turntableCommand);
+  glBufferData(GL_DRAW_INDIRECT_BUFFER,sizeof(DrawElementsIndirectCommand),nullptr,GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER,0);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::requestTurntable()
+{
+  if(m_canMesh==nullptr || m_sceneBase.labels.count==0)
+  {
+    return;
+  }
+  m_turntableSku=m_turntableNextSku;
+  m_turntableNextSku=(m_turntableNextSku+1)%static_cast<int>(m_sceneBase.labels.count);
+  std::cout<<"Turntable of SKU "<<m_turntableSku<<" ("<<m_turntableViews<<" views) once its label is loaded\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::drawTurntableViews(int _firstView, int _views)
+{
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  // the ground and anything else that isn't a can, instanced once per view
+  for(uint32_t object=0; object<m_scene.size(); ++object)
+  {
+    const IndexedMesh *mesh=m_meshes[m_scene.mesh[object]].get();
+    if(m_objectSlot[object]<0 || mesh==nullptr)
+    {
+      continue;
+    }
+    shader->use(m_variants.name(m_turntableVariant[m_scene.material[object]]));
+    ngl::Mat4 model;
+    const float *world=m_objectMatrices[m_objectSlot[object]].world;
+    std::copy(world,world+16,model.m_openGL);
+    // the views supply the rest, only the model matrix is read
+    streamObjectMatrices(model,model,model,ngl::Mat3());
+    shader->setUniform("firstView",_firstView);
+    shader->setUniform("viewCount",_views);
+    loadShadowLights();
+    loadMaterial(m_scene.materials[m_scene.material[object]]);
+    mesh->loadQuantisation();
+    mesh->draw(_views);
+  }
+
+  // the can, its one id is repeated for every view by the divisor
+  shader->use(m_variants.name(m_turntableVariant[m_canMaterialID]));
+  shader->setUniform("firstView",_firstView);
+  shader->setUniform("viewCount",_views);
+  loadShadowLights();
+  loadMaterial(m_scene.materials[m_canMaterialID]);
+  m_canMesh->loadQuantisation();
+  DrawElementsIndirectCommand command=m_canMesh->indirectCommand(0);
+  command.instanceCount=static_cast<GLuint>(_views);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER,m_turntableCommand);
+  glBufferSubData(GL_DRAW_INDIRECT_BUFFER,0,sizeof(command),&command);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER,0);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER,0,m_turntableInstance);
+  m_canMesh->drawIndirect(m_turntableCommand,1,m_turntableIds,static_cast<GLuint>(_views));
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::resolveThumbnails(int _firstLayer, int _layers)
+{
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  shader->use("Thumbnail");
+  shader->setUniform("turntable",static_cast<int>(TURNTABLE_UNIT));
+  shader->setUniform("firstLayer",_firstLayer);
+  glActiveTexture(GL_TEXTURE0+TURNTABLE_UNIT);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,m_turntableColour);
+  glActiveTexture(GL_TEXTURE0);
+  glBindImageTexture(0,m_thumbnails,0,GL_TRUE,0,GL_WRITE_ONLY,GL_RGBA8);
+  GLuint groups=(THUMBNAIL_SIZE+THUMBNAIL_GROUP_SIZE-1)/THUMBNAIL_GROUP_SIZE;
+  glDispatchCompute(groups,groups,static_cast<GLuint>(_layers));
+  glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void NGLScene::renderTurntable()
+{
+  if(m_turntableSku<0 || !m_labels.resident(static_cast<uint32_t>(m_turntableSku)))
+  {
+    return;
+  }
+  if(m_turntableFBO==0)
+  {
+    createTurntable();
+  }
+  int sku=m_turntableSku;
+  m_turntableSku=-1;
+  if(!m_turntableSupported)
+  {
+    return;
+  }
+  int views=std::min(m_turntableViews,MAX_TURNTABLE_VIEWS);
+
+  // the hero can from the scene file, or one at the origin if it only has a shelf
+  SceneStore can;
+  uint32_t hero=0;
+  while(hero<m_sceneBase.size() && m_sceneBase.mesh[hero]!=m_canMeshID)
+  {
+    ++hero;
+  }
+  if(hero<m_sceneBase.size())
+  {
+    can.addObject(static_cast<uint16_t>(m_canMeshID),static_cast<uint16_t>(m_canMaterialID),
+                  ngl::Vec3(m_sceneBase.posX[hero],m_sceneBase.posY[hero],m_sceneBase.posZ[hero]),
+                  ngl::Vec3(m_sceneBase.rotX[hero],m_sceneBase.rotY[hero],m_sceneBase.rotZ[hero]),
+                  ngl::Vec3(m_sceneBase.scaleX[hero],m_sceneBase.scaleY[hero],m_sceneBase.scaleZ[hero]),
+                  static_cast<uint32_t>(sku));
+  }
+  else
+  {
+    can.addObject(static_cast<uint16_t>(m_canMeshID),static_cast<uint16_t>(m_canMaterialID),
+                  ngl::Vec3(0.0f,0.0f,0.0f),ngl::Vec3(0.0f,0.0f,0.0f),ngl::Vec3(1.0f,1.0f,1.0f),static_cast<uint32_t>(sku));
+  }
+  InstanceData data;
+  data.label=static_cast<GLuint>(sku);
+  data.pad[0]=data.pad[1]=data.pad[2]=0;
+  uint32_t first=0;
+  TransformBatch::compute(can,&first,1,&data.transform,sizeof(InstanceData));
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,m_turntableInstance);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER,0,sizeof(InstanceData),&data);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER,0);
+
+  // the views circle the can's bounding sphere, far enough back for it to fill the frame
+  const float *world=data.transform.world;
+  const ngl::Vec3 &centre=m_canMesh->getCenter();
+  ngl::Vec3 target(world[0]*centre.m_x+world[4]*centre.m_y+world[8]*centre.m_z+world[12],
+                   world[1]*centre.m_x+world[5]*centre.m_y+world[9]*centre.m_z+world[13],
+                   world[2]*centre.m_x+world[6]*centre.m_y+world[10]*centre.m_z+world[14]);
+  float scale=std::max(std::max(std::abs(can.scaleX[0]),std::abs(can.scaleY[0])),std::abs(can.scaleZ[0]));
+  float radius=m_canMesh->getRadius()*scale;
+  float distance=1.1f*radius/std::sin(0.5f*TURNTABLE_FOV*static_cast<float>(M_PI)/180.0f);
+  float elevation=TURNTABLE_ELEVATION*static_cast<float>(M_PI)/180.0f;
+  std::vector<float> block(MAX_TURNTABLE_VIEWS*(2*16+4),0.0f);
+  for(int i=0; i<views; ++i)
+  {
+    float angle=2.0f*static_cast<float>(M_PI)*i/views;
+    ngl::Vec3 eye(target.m_x+distance*std::cos(elevation)*std::sin(angle),
+                  target.m_y+distance*std::sin(elevation),
+                  target.m_z+distance*std::cos(elevation)*std::cos(angle));
+    ngl::Camera camera;
+    camera.set(eye,target,ngl::Vec3(0.0f,1.0f,0.0f));
+    camera.setShape(TURNTABLE_FOV,1.0f,0.05f*distance,10.0f*distance);
+    ngl::Mat4 VP=camera.getVPMatrix();
+    std::copy(camera.getViewMatrix().m_openGL,camera.getViewMatrix().m_openGL+16,&block[i*16]);
+    std::copy(VP.m_openGL,VP.m_openGL+16,&block[(MAX_TURNTABLE_VIEWS+i)*16]);
+    float *eyeOut=&block[2*MAX_TURNTABLE_VIEWS*16+i*4];
+    eyeOut[0]=eye.m_x;
+    eyeOut[1]=eye.m_y;
+    eyeOut[2]=eye.m_z;
+    eyeOut[3]=1.0f;
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER,m_turntableViewUBO);
+  glBufferSubData(GL_UNIFORM_BUFFER,0,block.size()*sizeof(float),block.data());
+  glBindBuffer(GL_UNIFORM_BUFFER,0);
+  glBindBufferBase(GL_UNIFORM_BUFFER,TURNTABLE_VIEW_BINDING,m_turntableViewUBO);
+
+  // the shadow pass leaves its own target, mask and culling behind, the scene pass state comes back here
+  auto bindTarget=[this]()
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER,m_turntableFBO);
+    glViewport(0,0,TURNTABLE_SIZE,TURNTABLE_SIZE);
+    glColorMask(GL_TRUE,GL_TRUE,GL_TRUE,GL_TRUE);
+    glDisable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glClearColor(0.5f,0.5f,0.6f,1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  };
+  size_t thumbnailBytes=static_cast<size_t>(THUMBNAIL_SIZE)*THUMBNAIL_SIZE*4;
+  std::vector<uint8_t> sequential(thumbnailBytes*views);
+  std::vector<uint8_t> batched(thumbnailBytes*MAX_TURNTABLE_VIEWS);
+  QElapsedTimer timer;
+
+  // one view at a time the way a frame per thumbnail would, shadow pass, scene, resolve and read back
+  glFinish();
+  timer.start();
+  for(int i=0; i<views; ++i)
+  {
+    renderShadowAtlas();
+    bindTarget();
+    drawTurntableViews(i,1);
+    resolveThumbnails(i,1);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER,m_thumbnailFBO);
+    glFramebufferTextureLayer(GL_READ_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,m_thumbnails,0,i);
+    glReadPixels(0,0,THUMBNAIL_SIZE,THUMBNAIL_SIZE,GL_RGBA,GL_UNSIGNED_BYTE,&sequential[thumbnailBytes*i]);
+  }
+  float sequentialTime=timer.nsecsElapsed()/1000000.0f;
+
+  // every view from one shadow pass, one submission of each object and one resolve
+  glFinish();
+  timer.restart();
+  renderShadowAtlas();
+  bindTarget();
+  drawTurntableViews(0,views);
+  resolveThumbnails(0,views);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,m_thumbnails);
+  glGetTexImage(GL_TEXTURE_2D_ARRAY,0,GL_RGBA,GL_UNSIGNED_BYTE,batched.data());
+  glBindTexture(GL_TEXTURE_2D_ARRAY,0);
+  float batchedTime=timer.nsecsElapsed()/1000000.0f;
+
+  glBindFramebuffer(GL_FRAMEBUFFER,0);
+  glViewport(0,0,m_renderWidth,m_renderHeight);
+
+  // both paths draw the same thing so any difference is a bug in the multi-view shaders
+  int difference=0;
+  for(size_t i=0; i<sequential.size(); ++i)
+  {
+    difference=std::max(difference,std::abs(static_cast<int>(sequential[i])-static_cast<int>(batched[i])));
+  }
+  std::cout<<"Turntable SKU "<<sku<<" "<<views<<" views  sequential "<<sequentialTime<<" ms ("
+           <<views*1000.0f/sequentialTime<<" thumbnails/s)  multi-view "<<batchedTime<<" ms ("
+           <<views*1000.0f/batchedTime<<" thumbnails/s)  max difference "<<difference<<"\n";
+
+  QDir().mkpath("thumbnails");
+  for(int i=0; i<views; ++i)
+  {
+    QImage image(&batched[thumbnailBytes*i],THUMBNAIL_SIZE,THUMBNAIL_SIZE,QImage::Format_RGBA8888);
+    QString name=QString("thumbnails/sku%1_%2.png").arg(sku,3,10,QChar('0')).arg(i,2,10,QChar('0'));
+    if(!image.mirrored().save(name))
+    {
+      std::cerr<<"Could not save "<<name.toStdString()<<"\n";
+    }
+  }
+}
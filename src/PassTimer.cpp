@@ -0,0 +1,79 @@
+#include "PassTimer.h"
+
+//________________________________________________________________________________________________________________________________________//
+
+PassTimer::PassTimer(int _passes) : m_passes(_passes), m_times(_passes,0.0f)
+{
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+PassTimer::~PassTimer()
+{
+  destroy();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void PassTimer::destroy()
+{
+  for(auto &queries : m_queries)
+  {
+    if(!queries.empty())
+    {
+      glDeleteQueries(static_cast<GLsizei>(queries.size()),&queries[0]);
+      queries.clear();
+    }
+  }
+  m_issued[0]=m_issued[1]=false;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void PassTimer::create()
+{
+  // one timestamp for the start plus one per pass
+  for(auto &queries : m_queries)
+  {
+    queries.resize(m_passes+1);
+    glGenQueries(m_passes+1,&queries[0]);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void PassTimer::begin()
+{
+  ++m_frame;
+  std::vector<GLuint> &last=m_queries[(m_frame+1)%2];
+  if(m_issued[(m_frame+1)%2])
+  {
+    GLint available=0;
+    glGetQueryObjectiv(last[m_passes],GL_QUERY_RESULT_AVAILABLE,&available);
+    if(available)
+    {
+      std::vector<GLuint64> stamps(m_passes+1,0);
+      for(int i=0; i<=m_passes; ++i)
+      {
+        glGetQueryObjectui64v(last[i],GL_QUERY_RESULT,&stamps[i]);
+      }
+      for(int i=0; i<m_passes; ++i)
+      {
+        m_times[i]=(stamps[i+1]-stamps[i])/1000000.0f;
+      }
+      m_total=(stamps[m_passes]-stamps[0])/1000000.0f;
+    }
+  }
+  glQueryCounter(m_queries[m_frame%2][0],GL_TIMESTAMP);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void PassTimer::mark(int _pass)
+{
+  glQueryCounter(m_queries[m_frame%2][_pass+1],GL_TIMESTAMP);
+  if(_pass==m_passes-1)
+  {
+    m_issued[m_frame%2]=true;
+  }
+}
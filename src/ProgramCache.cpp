@@ -0,0 +1,341 @@
+#include "ProgramCache.h"
+#include <ngl/ShaderLib.h>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QOpenGLContext>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief identifies a cache file and its layout, bump the version if the layout changes
+//----------------------------------------------------------------------------------------------------------------------
+constexpr uint32_t CACHE_MAGIC=0x31425043; // "CPB1"
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the whole of a text file, empty if it can't be read
+//----------------------------------------------------------------------------------------------------------------------
+static std::string readFile(const std::string &_file)
+{
+  std::ifstream in(_file);
+  if(!in.is_open())
+  {
+    return std::string();
+  }
+  std::stringstream buffer;
+  buffer<<in.rdbuf();
+  return buffer.str();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+ProgramCache::ProgramCache(const std::string &_dir) : m_dir(_dir)
+{
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+uint64_t ProgramCache::hash(const std::string &_data, uint64_t _seed)
+{
+  uint64_t h=_seed;
+  for(unsigned char c : _data)
+  {
+    h^=c;
+    h*=1099511628211ULL;
+  }
+  return h;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+std::string ProgramCache::injectDefines(const std::string &_source, const std::string &_defines)
+{
+  if(_defines.empty())
+  {
+    return _source;
+  }
+  // #version has to stay the first statement, skip any comments before it
+  size_t pos=0;
+  while(pos<_source.size())
+  {
+    if(_source.compare(pos,2,"//")==0)
+    {
+      pos=_source.find('\n',pos);
+    }
+    else if(_source.compare(pos,2,"/*")==0)
+    {
+      pos=_source.find("*/",pos+2);
+      pos= pos==std::string::npos ? pos : pos+2;
+    }
+    else if(std::isspace(static_cast<unsigned char>(_source[pos])))
+    {
+      ++pos;
+    }
+    else
+    {
+      break;
+    }
+  }
+  if(pos>=_source.size() || _source.compare(pos,8,"#version") !=0)
+  {
+    return _defines+_source;
+  }
+  size_t lineEnd=_source.find('\n',pos);
+  if(lineEnd==std::string::npos)
+  {
+    return _source+"\n"+_defines;
+  }
+  return _source.substr(0,lineEnd+1)+_defines+_source.substr(lineEnd+1);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+std::string ProgramCache::cachePath(const Program &_program) const
+{
+  return m_dir+"/"+_program.name+".bin";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ProgramCache::enableParallelCompile()
+{
+  QOpenGLContext *context=QOpenGLContext::currentContext();
+  if(context==nullptr)
+  {
+    return;
+  }
+  typedef void (*MaxShaderCompilerThreads)(GLuint);
+  MaxShaderCompilerThreads maxThreads=nullptr;
+  if(context->hasExtension("GL_KHR_parallel_shader_compile"))
+  {
+    maxThreads=reinterpret_cast<MaxShaderCompilerThreads>(context->getProcAddress("glMaxShaderCompilerThreadsKHR"));
+  }
+  else if(context->hasExtension("GL_ARB_parallel_shader_compile"))
+  {
+    maxThreads=reinterpret_cast<MaxShaderCompilerThreads>(context->getProcAddress("glMaxShaderCompilerThreadsARB"));
+  }
+  if(maxThreads !=nullptr)
+  {
+    // let the driver pick the number of threads
+    maxThreads(0xFFFFFFFFu);
+    m_parallel=true;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool ProgramCache::loadBinary(const Program &_program, uint64_t _key, GLuint _id) const
+{
+  std::ifstream in(cachePath(_program),std::ios::binary);
+  if(!in.is_open())
+  {
+    return false;
+  }
+  uint32_t magic=0;
+  uint64_t key=0;
+  GLenum format=0;
+  uint32_t length=0;
+  in.read(reinterpret_cast<char *>(&magic),sizeof(magic));
+  in.read(reinterpret_cast<char *>(&key),sizeof(key));
+  in.read(reinterpret_cast<char *>(&format),sizeof(format));
+  in.read(reinterpret_cast<char *>(&length),sizeof(length));
+  if(!in || magic !=CACHE_MAGIC || key !=_key || length==0)
+  {
+    return false;
+  }
+  std::vector<char> binary(length);
+  in.read(&binary[0],length);
+  if(!in)
+  {
+    return false;
+  }
+  // the driver may still refuse a binary from an older build of itself
+  glProgramBinary(_id,format,&binary[0],static_cast<GLsizei>(length));
+  GLint linked=GL_FALSE;
+  glGetProgramiv(_id,GL_LINK_STATUS,&linked);
+  return linked==GL_TRUE;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ProgramCache::saveBinary(const Program &_program, uint64_t _key, GLuint _id) const
+{
+  GLint length=0;
+  glGetProgramiv(_id,GL_PROGRAM_BINARY_LENGTH,&length);
+  if(length<=0)
+  {
+    // no binary formats on this driver
+    return;
+  }
+  std::vector<char> binary(static_cast<size_t>(length));
+  GLenum format=0;
+  glGetProgramBinary(_id,length,nullptr,&format,&binary[0]);
+
+  QDir().mkpath(QString::fromStdString(m_dir));
+  // render servers started together all miss and write the same programs, each writes its own
+  // file and renames it over the entry so a reader never sees a torn or interleaved binary
+  std::string path=cachePath(_program);
+  std::string temp=path+"."+std::to_string(getpid())+".tmp";
+  {
+    std::ofstream out(temp,std::ios::binary | std::ios::trunc);
+    if(!out.is_open())
+    {
+      std::cerr<<"Could not write program cache "<<temp<<"\n";
+      return;
+    }
+    uint32_t size=static_cast<uint32_t>(length);
+    out.write(reinterpret_cast<const char *>(&CACHE_MAGIC),sizeof(CACHE_MAGIC));
+    out.write(reinterpret_cast<const char *>(&_key),sizeof(_key));
+    out.write(reinterpret_cast<const char *>(&format),sizeof(format));
+    out.write(reinterpret_cast<const char *>(&size),sizeof(size));
+    out.write(&binary[0],length);
+    if(!out.good())
+    {
+      out.close();
+      std::remove(temp.c_str());
+      std::cerr<<"Could not write program cache "<<temp<<"\n";
+      return;
+    }
+  }
+  if(std::rename(temp.c_str(),path.c_str())!=0)
+  {
+    std::remove(temp.c_str());
+    std::cerr<<"Could not write program cache "<<path<<"\n";
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ProgramCache::submit(Pending &_pending, const std::vector<std::string> &_sources) const
+{
+  for(size_t i=0; i<_sources.size(); ++i)
+  {
+    GLuint id=glCreateShader(_pending.program->stages[i].type);
+    const char *source=_sources[i].c_str();
+    glShaderSource(id,1,&source,nullptr);
+    glCompileShader(id);
+    glAttachShader(_pending.id,id);
+    _pending.shaders.push_back(id);
+  }
+  glProgramParameteri(_pending.id,GL_PROGRAM_BINARY_RETRIEVABLE_HINT,GL_TRUE);
+  glLinkProgram(_pending.id);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool ProgramCache::finish(Pending &_pending) const
+{
+  // the first status query is where we wait for the driver
+  GLint linked=GL_FALSE;
+  glGetProgramiv(_pending.id,GL_LINK_STATUS,&linked);
+  if(linked !=GL_TRUE)
+  {
+    std::cerr<<"Program "<<_pending.program->name<<" failed to build\n";
+    for(size_t i=0; i<_pending.shaders.size(); ++i)
+    {
+      GLint compiled=GL_FALSE;
+      glGetShaderiv(_pending.shaders[i],GL_COMPILE_STATUS,&compiled);
+      if(compiled !=GL_TRUE)
+      {
+        GLint length=0;
+        glGetShaderiv(_pending.shaders[i],GL_INFO_LOG_LENGTH,&length);
+        std::vector<char> log(static_cast<size_t>(std::max(length,1)));
+        glGetShaderInfoLog(_pending.shaders[i],length,nullptr,&log[0]);
+        std::cerr<<_pending.program->stages[i].file<<"\n"<<&log[0]<<"\n";
+      }
+    }
+    GLint length=0;
+    glGetProgramiv(_pending.id,GL_INFO_LOG_LENGTH,&length);
+    std::vector<char> log(static_cast<size_t>(std::max(length,1)));
+    glGetProgramInfoLog(_pending.id,length,nullptr,&log[0]);
+    std::cerr<<&log[0]<<"\n";
+  }
+  for(auto id : _pending.shaders)
+  {
+    glDetachShader(_pending.id,id);
+    glDeleteShader(id);
+  }
+  if(linked !=GL_TRUE)
+  {
+    return false;
+  }
+  saveBinary(*_pending.program,_pending.key,_pending.id);
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool ProgramCache::build(const std::vector<Program> &_programs)
+{
+  QElapsedTimer timer;
+  timer.start();
+  m_hits=0;
+  m_compiled=0;
+  enableParallelCompile();
+
+  // a driver update invalidates everything
+  std::string driver;
+  for(GLenum name : {GL_VENDOR,GL_RENDERER,GL_VERSION})
+  {
+    const GLubyte *value=glGetString(name);
+    driver+= value ? reinterpret_cast<const char *>(value) : "";
+    driver+="\n";
+  }
+  uint64_t driverKey=hash(driver);
+
+  ngl::ShaderLib *shader=ngl::ShaderLib::instance();
+  bool ok=true;
+  std::vector<Pending> pending;
+  pending.reserve(_programs.size());
+  for(auto &program : _programs)
+  {
+    uint64_t key=hash(program.defines,driverKey);
+    std::vector<std::string> sources;
+    for(auto &stage : program.stages)
+    {
+      std::string source=readFile(stage.file);
+      if(source.empty())
+      {
+        std::cerr<<"Could not read shader "<<stage.file<<"\n";
+        ok=false;
+      }
+      sources.push_back(injectDefines(source,program.defines));
+      key=hash(std::to_string(stage.type)+sources.back(),key);
+    }
+    shader->createShaderProgram(program.name);
+    GLuint id=shader->getProgramID(program.name);
+    if(loadBinary(program,key,id))
+    {
+      shader->autoRegisterUniforms(program.name);
+      ++m_hits;
+      continue;
+    }
+    // kick off the compile now and collect the result once everything has been submitted
+    pending.push_back({&program,key,id,{}});
+    submit(pending.back(),sources);
+  }
+  for(auto &p : pending)
+  {
+    if(finish(p))
+    {
+      shader->autoRegisterUniforms(p.program->name);
+      ++m_compiled;
+    }
+    else
+    {
+      ok=false;
+    }
+  }
+  m_buildTime=timer.nsecsElapsed()/1000000.0f;
+  std::cout<<"Shader setup "<<m_buildTime<<" ms, "<<m_hits<<" programs from the cache, "<<m_compiled<<" compiled"
+           <<(m_parallel ? " in parallel" : "")<<"\n";
+  return ok;
+}
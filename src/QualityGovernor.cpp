@@ -0,0 +1,141 @@
+#include "QualityGovernor.h"
+#include <algorithm>
+#include <cmath>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief lowest to highest, the top level is the original fixed pipeline
+//----------------------------------------------------------------------------------------------------------------------
+const QualityGovernor::Level QualityGovernor::LEVELS[QualityGovernor::NUM_LEVELS]=
+{
+  { 2, 512,2},
+  { 6, 512,4},
+  {12,1024,5},
+  {20,1024,6},
+  {30,1024,8}
+};
+constexpr float QualityGovernor::MIN_SCALE;
+constexpr float QualityGovernor::MAX_SCALE;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief exponential smoothing of the frame time, the queries are already a frame or two behind
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float SMOOTHING=0.1f;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the scale only moves when the time is this far either side of the target, by at most
+/// MAX_SCALE_STEP in SCALE_QUANTUM increments, then waits SCALE_COOLDOWN frames to see the effect
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float SCALE_DEADBAND=0.05f;
+constexpr float MAX_SCALE_STEP=0.05f;
+constexpr float SCALE_QUANTUM=0.025f;
+constexpr int SCALE_COOLDOWN=4;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief drop a level when the scale has had to go below LEVEL_DOWN_SCALE to stay on budget for
+/// LEVEL_DOWN_FRAMES, raise one at full scale LEVEL_UP_MARGIN under for LEVEL_UP_FRAMES
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float LEVEL_DOWN_SCALE=0.75f;
+constexpr int LEVEL_DOWN_FRAMES=20;
+constexpr float LEVEL_UP_MARGIN=0.3f;
+constexpr int LEVEL_UP_FRAMES=120;
+constexpr int LEVEL_COOLDOWN=30;
+
+//________________________________________________________________________________________________________________________________________//
+
+QualityGovernor::QualityGovernor(float _targetMs) : m_target(_targetMs)
+{
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void QualityGovernor::reset()
+{
+  m_smoothed=0.0f;
+  m_scale=MAX_SCALE;
+  m_level=NUM_LEVELS-1;
+  m_overBudgetFrames=0;
+  m_underBudgetFrames=0;
+  m_cooldown=0;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void QualityGovernor::setEnabled(bool _enabled)
+{
+  m_enabled=_enabled;
+  reset();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void QualityGovernor::setTarget(float _targetMs)
+{
+  m_target=std::max(_targetMs,1.0f);
+  m_overBudgetFrames=0;
+  m_underBudgetFrames=0;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool QualityGovernor::update(float _gpuMs)
+{
+  if(!m_enabled || _gpuMs<=0.0f)
+  {
+    return false;
+  }
+  m_smoothed= m_smoothed>0.0f ? m_smoothed+SMOOTHING*(_gpuMs-m_smoothed) : _gpuMs;
+  if(m_cooldown>0)
+  {
+    --m_cooldown;
+    return false;
+  }
+  float ratio=m_smoothed/m_target;
+
+  // the render scale first, the cost of the scene and post passes goes with the pixel count
+  if(std::abs(ratio-1.0f)>SCALE_DEADBAND)
+  {
+    float wanted=m_scale/std::sqrt(ratio);
+    wanted=std::max(m_scale-MAX_SCALE_STEP,std::min(m_scale+MAX_SCALE_STEP,wanted));
+    wanted=std::round(wanted/SCALE_QUANTUM)*SCALE_QUANTUM;
+    wanted=std::max(MIN_SCALE,std::min(MAX_SCALE,wanted));
+    if(wanted !=m_scale)
+    {
+      m_scale=wanted;
+      m_cooldown=SCALE_COOLDOWN;
+    }
+  }
+
+  // then whole levels, a low scale that is only just holding the budget is worth trading for
+  // cheaper post effects, and it is slow to go back up so a level that only just fits isn't
+  // retried every second
+  int previous=m_level;
+  if(ratio>1.0f-SCALE_DEADBAND && m_scale<LEVEL_DOWN_SCALE && m_level>0)
+  {
+    if(++m_overBudgetFrames>=LEVEL_DOWN_FRAMES)
+    {
+      --m_level;
+    }
+  }
+  else
+  {
+    m_overBudgetFrames=0;
+  }
+  if(ratio<1.0f-LEVEL_UP_MARGIN && m_scale>=MAX_SCALE && m_level<NUM_LEVELS-1)
+  {
+    if(++m_underBudgetFrames>=LEVEL_UP_FRAMES)
+    {
+      ++m_level;
+    }
+  }
+  else
+  {
+    m_underBudgetFrames=0;
+  }
+  if(m_level==previous)
+  {
+    return false;
+  }
+  // let the new level settle before judging it
+  m_overBudgetFrames=0;
+  m_underBudgetFrames=0;
+  m_cooldown=LEVEL_COOLDOWN;
+  m_smoothed=0.0f;
+  return true;
+}
@@ -0,0 +1,1028 @@
+#include "RayTracer.h"
+#include "IndexedMesh.h"
+#include <QImage>
+#include <QString>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+constexpr float PI=3.14159265358979f;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the program the raster draws the labelled cans with, see CanProgram in NGLScene.h, every
+/// other material is the wood ground
+//----------------------------------------------------------------------------------------------------------------------
+constexpr auto LABELLED_PROGRAM="CanProgram";
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the wood textures repeat this many times across the plane as ShadowFrag.glsl samples them
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float WOOD_UV_SCALE=10.0f;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the reflectance at normal incidence of the varnish and lacquer, a plain dielectric
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float DIELECTRIC_F0=0.04f;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the smoothest microfacet distribution used, the can's 0.01 is all but a mirror
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float MIN_ALPHA=0.002f;
+constexpr float GAMMA=2.2f;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief how far a new ray starts off the surface, relative to the hit's distance from the origin
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float RAY_OFFSET=1e-4f;
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief a PCG32 stream per sample, seeded from the pixel and the sample index so the picture
+/// doesn't depend on which thread traced which tile
+//----------------------------------------------------------------------------------------------------------------------
+class RayTracer::Random
+{
+  public:
+    Random(uint64_t _pixel, uint64_t _sample)
+    {
+      m_increment=(mix(_pixel)<<1u) | 1u;
+      m_state=mix(_sample+m_increment);
+      next();
+    }
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief uniform in [0,1)
+    //----------------------------------------------------------------------------------------------------------------------
+    float next()
+    {
+      uint64_t old=m_state;
+      m_state=old*6364136223846793005ULL+m_increment;
+      uint32_t shifted=static_cast<uint32_t>(((old>>18u)^old)>>27u);
+      uint32_t rotate=static_cast<uint32_t>(old>>59u);
+      uint32_t bits=(shifted>>rotate) | (shifted<<((32u-rotate)&31u));
+      return (bits>>8)*(1.0f/16777216.0f);
+    }
+
+  private:
+    //----------------------------------------------------------------------------------------------------------------------
+    /// @brief splitmix64's finaliser, neighbouring pixels get unrelated streams
+    //----------------------------------------------------------------------------------------------------------------------
+    static uint64_t mix(uint64_t _x)
+    {
+      _x+=0x9e3779b97f4a7c15ULL;
+      _x=(_x^(_x>>30))*0xbf58476d1ce4e5b9ULL;
+      _x=(_x^(_x>>27))*0x94d049bb133111ebULL;
+      return _x^(_x>>31);
+    }
+    uint64_t m_state;
+    uint64_t m_increment;
+};
+
+//________________________________________________________________________________________________________________________________________//
+
+static ngl::Vec3 normalised(ngl::Vec3 _v)
+{
+  float length=_v.length();
+  return length>0.0f ? _v/length : ngl::Vec3(0.0f,1.0f,0.0f);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+static float luminance(const ngl::Vec3 &_c)
+{
+  return 0.2126f*_c.m_x+0.7152f*_c.m_y+0.0722f*_c.m_z;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief ngl's row vector order, v * M with the translation in the last row
+//----------------------------------------------------------------------------------------------------------------------
+static ngl::Vec3 transformVector(const float _m[4][3], const ngl::Vec3 &_v)
+{
+  return ngl::Vec3(_v.m_x*_m[0][0]+_v.m_y*_m[1][0]+_v.m_z*_m[2][0],
+                   _v.m_x*_m[0][1]+_v.m_y*_m[1][1]+_v.m_z*_m[2][1],
+                   _v.m_x*_m[0][2]+_v.m_y*_m[1][2]+_v.m_z*_m[2][2]);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+static ngl::Vec3 transformPoint(const float _m[4][3], const ngl::Vec3 &_p)
+{
+  return transformVector(_m,_p)+ngl::Vec3(_m[3][0],_m[3][1],_m[3][2]);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief a normal goes through the inverse transpose, so through the inverse from the other side
+//----------------------------------------------------------------------------------------------------------------------
+static ngl::Vec3 transformNormal(const float _inverse[4][3], const ngl::Vec3 &_n)
+{
+  return ngl::Vec3(_n.m_x*_inverse[0][0]+_n.m_y*_inverse[0][1]+_n.m_z*_inverse[0][2],
+                   _n.m_x*_inverse[1][0]+_n.m_y*_inverse[1][1]+_n.m_z*_inverse[1][2],
+                   _n.m_x*_inverse[2][0]+_n.m_y*_inverse[2][1]+_n.m_z*_inverse[2][2]);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief two unit vectors at right angles to _n without a branch on its direction, Duff et al. 2017
+//----------------------------------------------------------------------------------------------------------------------
+static void basis(const ngl::Vec3 &_n, ngl::Vec3 &o_t, ngl::Vec3 &o_b)
+{
+  float sign=std::copysign(1.0f,_n.m_z);
+  float a=-1.0f/(sign+_n.m_z);
+  float b=_n.m_x*_n.m_y*a;
+  o_t.set(1.0f+sign*_n.m_x*_n.m_x*a,sign*b,-sign*_n.m_x);
+  o_b.set(b,sign+_n.m_y*_n.m_y*a,-_n.m_y);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+static float fresnel(float _cosine)
+{
+  float m=1.0f-std::min(std::max(_cosine,0.0f),1.0f);
+  return DIELECTRIC_F0+(1.0f-DIELECTRIC_F0)*m*m*m*m*m;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+static float ggxD(float _nh, float _alpha)
+{
+  float a2=_alpha*_alpha;
+  float d=_nh*_nh*(a2-1.0f)+1.0f;
+  return a2/(PI*d*d);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+static float smithG1(float _cosine, float _alpha)
+{
+  float a2=_alpha*_alpha;
+  return 2.0f*_cosine/(_cosine+std::sqrt(a2+(1.0f-a2)*_cosine*_cosine));
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the Lambert and GGX halves of the material, kept apart as the lights colour them differently
+//----------------------------------------------------------------------------------------------------------------------
+struct Lobes
+{
+  ngl::Vec3 diffuse;
+  ngl::Vec3 specular;
+};
+
+static Lobes brdf(const ngl::Vec3 &_n, const ngl::Vec3 &_wo, const ngl::Vec3 &_wi, const ngl::Vec3 &_albedo, const ngl::Vec3 &_ks, float _alpha)
+{
+  ngl::Vec3 h=normalised(_wo+_wi);
+  float nl=std::max(_n.dot(_wi),0.0f);
+  float nv=std::max(_n.dot(_wo),1e-4f);
+  float nh=std::max(_n.dot(h),0.0f);
+  float f=fresnel(_wo.dot(h));
+  Lobes lobes;
+  lobes.diffuse=_albedo*((1.0f-f)/PI);
+  lobes.specular=_ks*(f*ggxD(nh,_alpha)*smithG1(nl,_alpha)*smithG1(nv,_alpha)/(4.0f*std::max(nl,1e-4f)*nv));
+  return lobes;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief Moller Trumbore, _ray is in the triangle's model space
+//----------------------------------------------------------------------------------------------------------------------
+static bool intersectTriangle(const float _v0[3], const float _e1[3], const float _e2[3], const TraceRay &_ray, float _tMax,
+                              float &o_t, float &o_u, float &o_v)
+{
+  const float *d=_ray.dir;
+  float p[3]={d[1]*_e2[2]-d[2]*_e2[1],d[2]*_e2[0]-d[0]*_e2[2],d[0]*_e2[1]-d[1]*_e2[0]};
+  float det=_e1[0]*p[0]+_e1[1]*p[1]+_e1[2]*p[2];
+  if(std::fabs(det)<1e-14f)
+  {
+    return false;
+  }
+  float inverse=1.0f/det;
+  float s[3]={_ray.origin[0]-_v0[0],_ray.origin[1]-_v0[1],_ray.origin[2]-_v0[2]};
+  float u=(s[0]*p[0]+s[1]*p[1]+s[2]*p[2])*inverse;
+  if(u<0.0f || u>1.0f)
+  {
+    return false;
+  }
+  float q[3]={s[1]*_e1[2]-s[2]*_e1[1],s[2]*_e1[0]-s[0]*_e1[2],s[0]*_e1[1]-s[1]*_e1[0]};
+  float v=(d[0]*q[0]+d[1]*q[1]+d[2]*q[2])*inverse;
+  if(v<0.0f || u+v>1.0f)
+  {
+    return false;
+  }
+  float t=(_e2[0]*q[0]+_e2[1]*q[1]+_e2[2]*q[2])*inverse;
+  if(t<=0.0f || t>=_tMax)
+  {
+    return false;
+  }
+  o_t=t;
+  o_u=u;
+  o_v=v;
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief _ray moved into an instance's model space, the direction isn't normalised so t is the same in both
+//----------------------------------------------------------------------------------------------------------------------
+static TraceRay toModel(const float _inverse[4][3], const TraceRay &_ray)
+{
+  ngl::Vec3 origin=transformPoint(_inverse,ngl::Vec3(_ray.origin[0],_ray.origin[1],_ray.origin[2]));
+  ngl::Vec3 dir=transformVector(_inverse,ngl::Vec3(_ray.dir[0],_ray.dir[1],_ray.dir[2]));
+  float o[3]={origin.m_x,origin.m_y,origin.m_z};
+  float d[3]={dir.m_x,dir.m_y,dir.m_z};
+  TraceRay local;
+  local.set(o,d);
+  return local;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief 8 bit sRGB to linear light
+//----------------------------------------------------------------------------------------------------------------------
+static const float *linearTable()
+{
+  static const std::vector<float> table=[]()
+  {
+    std::vector<float> values(256);
+    for(int i=0; i<256; ++i)
+    {
+      values[i]=std::pow(i/255.0f,GAMMA);
+    }
+    return values;
+  }();
+  return table.data();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+ngl::Vec3 RayTracer::Texture::sample(float _u, float _v, bool _linear) const
+{
+  if(!image.valid())
+  {
+    return ngl::Vec3(1.0f,1.0f,1.0f);
+  }
+  const uint8_t *pixels=image.section(0);
+  const float *table=linearTable();
+  float x=_u*width-0.5f;
+  float y=_v*height-0.5f;
+  float fx=std::floor(x);
+  float fy=std::floor(y);
+  float tx=x-fx;
+  float ty=y-fy;
+  auto wrap=[](int _i, int _n){ return ((_i%_n)+_n)%_n; };
+  int x0=wrap(static_cast<int>(fx),width);
+  int y0=wrap(static_cast<int>(fy),height);
+  int x1=(x0+1)%width;
+  int y1=(y0+1)%height;
+  auto texel=[&](int _x, int _y)
+  {
+    const uint8_t *p=pixels+(size_t(_y)*size_t(width)+size_t(_x))*size_t(channels);
+    // grey images repeat their one channel
+    uint8_t r=p[0];
+    uint8_t g=p[std::min(1,channels-1)];
+    uint8_t b=p[std::min(2,channels-1)];
+    return _linear ? ngl::Vec3(table[r],table[g],table[b]) : ngl::Vec3(r/255.0f,g/255.0f,b/255.0f);
+  };
+  return (texel(x0,y0)*(1.0f-tx)+texel(x1,y0)*tx)*(1.0f-ty)+(texel(x0,y1)*(1.0f-tx)+texel(x1,y1)*tx)*ty;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+RayTracer::RayTracer(const Settings &_settings) :
+  m_settings(_settings)
+{
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int RayTracer::texture(const std::string &_file)
+{
+  for(size_t i=0; i<m_textureFiles.size(); ++i)
+  {
+    if(m_textureFiles[i]==_file)
+    {
+      return static_cast<int>(i);
+    }
+  }
+  // mapped from the asset cache, the same decoded pixels the raster uploads
+  Texture texture;
+  texture.image=m_assets.image(_file);
+  if(!texture.image.valid())
+  {
+    std::cerr<<"RayTracer can't load "<<_file<<"\n";
+    return -1;
+  }
+  texture.width=static_cast<int>(texture.image.meta(0));
+  texture.height=static_cast<int>(texture.image.meta(1));
+  texture.channels=static_cast<int>(texture.image.meta(3));
+  m_textures.push_back(std::move(texture));
+  m_textureFiles.push_back(_file);
+  return static_cast<int>(m_textures.size()-1);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RayTracer::addMesh(const std::vector<Vertex> &_vertices, const std::vector<uint32_t> &_indices)
+{
+  Mesh mesh;
+  mesh.vertices=_vertices;
+  mesh.indices=_indices;
+  size_t count=_indices.size()/3;
+  std::vector<WideBVH::Box> boxes(count);
+  for(size_t i=0; i<count; ++i)
+  {
+    for(int corner=0; corner<3; ++corner)
+    {
+      boxes[i].grow(_vertices[_indices[i*3+corner]].position);
+    }
+  }
+  mesh.bvh.build(boxes);
+  // the triangles are stored in leaf order with their edges ready for the test
+  mesh.triangles.resize(count);
+  for(size_t i=0; i<count; ++i)
+  {
+    uint32_t index=mesh.bvh.order()[i];
+    const float *a=_vertices[_indices[index*3]].position;
+    const float *b=_vertices[_indices[index*3+1]].position;
+    const float *c=_vertices[_indices[index*3+2]].position;
+    Triangle &triangle=mesh.triangles[i];
+    for(int axis=0; axis<3; ++axis)
+    {
+      triangle.v0[axis]=a[axis];
+      triangle.e1[axis]=b[axis]-a[axis];
+      triangle.e2[axis]=c[axis]-a[axis];
+    }
+    triangle.index=index;
+  }
+  m_meshes.push_back(std::move(mesh));
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool RayTracer::load()
+{
+  auto start=std::chrono::steady_clock::now();
+  if(!m_store.load(m_settings.scene))
+  {
+    std::cerr<<"Using the default scene\n";
+    m_store.loadDefault();
+  }
+
+  // the full detail level of each mesh, planes are built the same way the raster builds them
+  std::vector<int> meshIndex(m_store.meshes.size(),-1);
+  size_t triangles=0;
+  for(size_t i=0; i<m_store.meshes.size(); ++i)
+  {
+    const SceneMesh &sceneMesh=m_store.meshes[i];
+    std::unique_ptr<IndexedMesh> indexed;
+    if(sceneMesh.isPlane)
+    {
+      indexed.reset(new IndexedMesh(sceneMesh.planeWidth,sceneMesh.planeDepth,sceneMesh.planeSteps));
+    }
+    else
+    {
+      indexed=m_assets.mesh(sceneMesh.file,IndexedMesh::MAX_LODS);
+    }
+    if(indexed==nullptr)
+    {
+      std::cerr<<"Could not load "<<sceneMesh.file<<"\n";
+      continue;
+    }
+    std::vector<Vertex> vertices(indexed->vertices().size());
+    for(size_t v=0; v<vertices.size(); ++v)
+    {
+      const IndexedMesh::Vertex &source=indexed->vertices()[v];
+      vertices[v]={{source.x,source.y,source.z},{source.u,source.v},{source.nx,source.ny,source.nz},
+                   {source.tx,source.ty,source.tz,source.tw}};
+    }
+    const IndexedMesh::LOD &lod=indexed->getLOD(0);
+    std::vector<uint32_t> indices(indexed->indices().begin()+lod.firstIndex,indexed->indices().begin()+lod.firstIndex+lod.count);
+    triangles+=indices.size()/3;
+    meshIndex[i]=static_cast<int>(m_meshes.size());
+    addMesh(vertices,indices);
+  }
+
+  // the raster binds the wood to every material but the can's, the can takes its label from the object
+  m_materials.clear();
+  for(const SceneMaterial &sceneMaterial : m_store.materials)
+  {
+    Material material;
+    material.kd=sceneMaterial.kd;
+    material.ks=sceneMaterial.ks;
+    material.roughness=sceneMaterial.roughness;
+    if(sceneMaterial.program==LABELLED_PROGRAM)
+    {
+      material.labelled=true;
+      if(sceneMaterial.features & FEATURE_NORMAL_MAP)
+      {
+        material.normal=texture("images/NormalMap.jpg");
+      }
+    }
+    else
+    {
+      material.albedo=texture("images/woodDif.jpg");
+      material.normal=texture("images/woodNorm.jpg");
+      material.uvScale=WOOD_UV_SCALE;
+    }
+    m_materials.push_back(material);
+  }
+  m_labels.clear();
+  for(const std::string &file : m_store.labels.files)
+  {
+    m_labels.push_back(texture(file));
+  }
+  const char *sky[6]={"images/sky_xpos.png","images/sky_xneg.png","images/sky_ypos.png",
+                      "images/sky_yneg.png","images/sky_zpos.png","images/sky_zneg.png"};
+  for(int face=0; face<6; ++face)
+  {
+    m_sky[face]=texture(sky[face]);
+  }
+
+  // every object is an instance of its mesh's tree, the top tree is over their world boxes
+  m_instances.clear();
+  std::vector<WideBVH::Box> boxes;
+  for(uint32_t i=0; i<m_store.size(); ++i)
+  {
+    int mesh=meshIndex[m_store.mesh[i]];
+    if(mesh<0 || m_store.material[i]>=m_materials.size())
+    {
+      continue;
+    }
+    Instance instance;
+    ngl::Mat4 world=m_store.worldMatrix(i);
+    ngl::Mat4 inverse=world.inverse();
+    for(int row=0; row<4; ++row)
+    {
+      for(int column=0; column<3; ++column)
+      {
+        instance.world[row][column]=world.m_m[row][column];
+        instance.inverse[row][column]=inverse.m_m[row][column];
+      }
+    }
+    instance.mesh=static_cast<uint32_t>(mesh);
+    instance.material=m_store.material[i];
+    instance.label=m_labels.empty() ? -1 : m_labels[m_store.label[i]%m_labels.size()];
+    const WideBVH::Box &local=m_meshes[mesh].bvh.bounds();
+    WideBVH::Box box;
+    for(int corner=0; corner<8; ++corner)
+    {
+      ngl::Vec3 p(local.min[0],local.min[1],local.min[2]);
+      p.m_x=(corner & 1) ? local.max[0] : p.m_x;
+      p.m_y=(corner & 2) ? local.max[1] : p.m_y;
+      p.m_z=(corner & 4) ? local.max[2] : p.m_z;
+      ngl::Vec3 w=transformPoint(instance.world,p);
+      float point[3]={w.m_x,w.m_y,w.m_z};
+      box.grow(point);
+    }
+    boxes.push_back(box);
+    m_instances.push_back(instance);
+  }
+  m_top.build(boxes);
+
+  // the three shadow casting lights the raster passes use, the spot light is the one the user
+  // moves. Diffuse is Ld * Intensity and specular Ls * Intensity
+  m_lights.clear();
+  for(const SceneLight &scene : SCENE_LIGHTS)
+  {
+    Light light;
+    light.type=scene.light.type;
+    light.position=scene.light.type==ShadowLight::Type::SPOT ? m_settings.lightPosition : scene.light.position;
+    light.diffuse=scene.diffuse*scene.intensity;
+    light.specular=scene.specular*scene.intensity;
+    light.linear=scene.light.linear;
+    light.quadratic=scene.light.quadratic;
+    m_lights.push_back(light);
+  }
+
+  // the raster camera, a vertical field of view as ngl::Camera::setShape takes it
+  m_forward=normalised(m_settings.look-m_settings.eye);
+  ngl::Vec3 right=normalised(m_forward.cross(ngl::Vec3(0.0f,1.0f,0.0f)));
+  ngl::Vec3 up=right.cross(m_forward);
+  float tanHalf=std::tan(m_settings.fov*0.5f*PI/180.0f);
+  m_up=up*tanHalf;
+  m_right=right*(tanHalf*m_settings.width/m_settings.height);
+
+  float seconds=std::chrono::duration<float>(std::chrono::steady_clock::now()-start).count();
+  std::printf("Loaded %zu meshes (%zu triangles) as %zu instances, %zu textures in %.2f s",
+              m_meshes.size(),triangles,m_instances.size(),m_textures.size(),seconds);
+  for(const Mesh &mesh : m_meshes)
+  {
+    std::printf(", %zu nodes SAH %.1f",mesh.bvh.numNodes(),mesh.bvh.sahCost());
+  }
+  std::printf("\n%s\n",m_assets.report().c_str());
+  return !m_instances.empty();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool RayTracer::intersect(const TraceRay &_ray, Hit &o_hit) const
+{
+  float tMax=std::numeric_limits<float>::max();
+  return m_top.intersect(_ray,0.0f,tMax,[&](uint32_t _first, uint32_t _count, float &io_tMax)
+  {
+    bool found=false;
+    for(uint32_t i=_first; i<_first+_count; ++i)
+    {
+      uint32_t id=m_top.order()[i];
+      const Instance &instance=m_instances[id];
+      const Mesh &mesh=m_meshes[instance.mesh];
+      TraceRay local=toModel(instance.inverse,_ray);
+      found|=mesh.bvh.intersect(local,0.0f,io_tMax,[&](uint32_t _triFirst, uint32_t _triCount, float &io_t)
+      {
+        bool hit=false;
+        for(uint32_t j=_triFirst; j<_triFirst+_triCount; ++j)
+        {
+          const Triangle &triangle=mesh.triangles[j];
+          float t,u,v;
+          if(intersectTriangle(triangle.v0,triangle.e1,triangle.e2,local,io_t,t,u,v))
+          {
+            io_t=t;
+            o_hit={t,id,triangle.index,u,v};
+            hit=true;
+          }
+        }
+        return hit;
+      });
+    }
+    return found;
+  });
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool RayTracer::occluded(const float _origin[3], const ngl::Vec3 &_dir, float _distance) const
+{
+  float dir[3]={_dir.m_x,_dir.m_y,_dir.m_z};
+  TraceRay ray;
+  ray.set(_origin,dir);
+  return m_top.occluded(ray,0.0f,_distance,[&](uint32_t _first, uint32_t _count, float &io_tMax)
+  {
+    for(uint32_t i=_first; i<_first+_count; ++i)
+    {
+      const Instance &instance=m_instances[m_top.order()[i]];
+      const Mesh &mesh=m_meshes[instance.mesh];
+      TraceRay local=toModel(instance.inverse,ray);
+      bool blocked=mesh.bvh.occluded(local,0.0f,io_tMax,[&](uint32_t _triFirst, uint32_t _triCount, float &io_t)
+      {
+        for(uint32_t j=_triFirst; j<_triFirst+_triCount; ++j)
+        {
+          const Triangle &triangle=mesh.triangles[j];
+          float t,u,v;
+          if(intersectTriangle(triangle.v0,triangle.e1,triangle.e2,local,io_t,t,u,v))
+          {
+            return true;
+          }
+        }
+        return false;
+      });
+      if(blocked)
+      {
+        return true;
+      }
+    }
+    return false;
+  });
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+ngl::Vec3 RayTracer::environment(const ngl::Vec3 &_dir) const
+{
+  // the face and its coordinates the way GL picks them from a cube map lookup
+  float x=std::fabs(_dir.m_x);
+  float y=std::fabs(_dir.m_y);
+  float z=std::fabs(_dir.m_z);
+  int face;
+  float sc,tc,ma;
+  if(x>=y && x>=z)
+  {
+    face=_dir.m_x>0.0f ? 0 : 1;
+    sc=_dir.m_x>0.0f ? -_dir.m_z : _dir.m_z;
+    tc=-_dir.m_y;
+    ma=x;
+  }
+  else if(y>=z)
+  {
+    face=_dir.m_y>0.0f ? 2 : 3;
+    sc=_dir.m_x;
+    tc=_dir.m_y>0.0f ? _dir.m_z : -_dir.m_z;
+    ma=y;
+  }
+  else
+  {
+    face=_dir.m_z>0.0f ? 4 : 5;
+    sc=_dir.m_z>0.0f ? _dir.m_x : -_dir.m_x;
+    tc=-_dir.m_y;
+    ma=z;
+  }
+  if(m_sky[face]<0)
+  {
+    return ngl::Vec3(0.0f,0.0f,0.0f);
+  }
+  return m_textures[m_sky[face]].sample(0.5f*(sc/ma+1.0f),0.5f*(tc/ma+1.0f),true);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+ngl::Vec3 RayTracer::radiance(TraceRay _ray, Random &_random, Counters &io_counters) const
+{
+  ngl::Vec3 result(0.0f,0.0f,0.0f);
+  ngl::Vec3 throughput(1.0f,1.0f,1.0f);
+  for(int bounce=0; ; ++bounce)
+  {
+    ngl::Vec3 dir(_ray.dir[0],_ray.dir[1],_ray.dir[2]);
+    Hit hit;
+    if(!intersect(_ray,hit))
+    {
+      result+=throughput*environment(dir);
+      break;
+    }
+    const Instance &instance=m_instances[hit.instance];
+    const Mesh &mesh=m_meshes[instance.mesh];
+    const Material &material=m_materials[instance.material];
+    const Vertex &a=mesh.vertices[mesh.indices[hit.triangle*3]];
+    const Vertex &b=mesh.vertices[mesh.indices[hit.triangle*3+1]];
+    const Vertex &c=mesh.vertices[mesh.indices[hit.triangle*3+2]];
+    float w=1.0f-hit.u-hit.v;
+    auto interpolate=[&](const float *_a, const float *_b, const float *_c)
+    {
+      return ngl::Vec3(_a[0]*w+_b[0]*hit.u+_c[0]*hit.v,_a[1]*w+_b[1]*hit.u+_c[1]*hit.v,_a[2]*w+_b[2]*hit.u+_c[2]*hit.v);
+    };
+    ngl::Vec3 p=ngl::Vec3(_ray.origin[0],_ray.origin[1],_ray.origin[2])+dir*hit.t;
+    ngl::Vec3 wo=-dir;
+    ngl::Vec3 pa(a.position[0],a.position[1],a.position[2]);
+    ngl::Vec3 edge1=ngl::Vec3(b.position[0],b.position[1],b.position[2])-pa;
+    ngl::Vec3 edge2=ngl::Vec3(c.position[0],c.position[1],c.position[2])-pa;
+    // both sides of a surface shade, the normals are turned to face the ray
+    ngl::Vec3 ng=normalised(transformNormal(instance.inverse,edge1.cross(edge2)));
+    if(ng.dot(wo)<0.0f)
+    {
+      ng=-ng;
+    }
+    ngl::Vec3 n=normalised(transformNormal(instance.inverse,interpolate(a.normal,b.normal,c.normal)));
+    if(n.dot(ng)<0.0f)
+    {
+      n=-n;
+    }
+    float u=(a.uv[0]*w+b.uv[0]*hit.u+c.uv[0]*hit.v)*material.uvScale;
+    float v=(a.uv[1]*w+b.uv[1]*hit.u+c.uv[1]*hit.v)*material.uvScale;
+    ngl::Vec3 albedo=material.kd;
+    if(material.labelled && instance.label>=0)
+    {
+      albedo=albedo*m_textures[instance.label].sample(u,v,true);
+    }
+    else if(material.albedo>=0)
+    {
+      albedo=albedo*m_textures[material.albedo].sample(u,v,true);
+    }
+    if(material.normal>=0)
+    {
+      ngl::Vec3 tangent=transformVector(instance.world,interpolate(a.tangent,b.tangent,c.tangent));
+      tangent=normalised(tangent-n*n.dot(tangent));
+      ngl::Vec3 bitangent=n.cross(tangent)*(a.tangent[3]<0.0f ? -1.0f : 1.0f);
+      ngl::Vec3 mapped=m_textures[material.normal].sample(u,v,false)*2.0f-ngl::Vec3(1.0f,1.0f,1.0f);
+      mapped=normalised(tangent*mapped.m_x+bitangent*mapped.m_y+n*mapped.m_z);
+      // a map that bends the normal away from the viewer would light the back of the surface
+      if(mapped.dot(wo)>0.0f)
+      {
+        n=mapped;
+      }
+    }
+    float alpha=std::max(material.roughness,MIN_ALPHA);
+    float offset=RAY_OFFSET*(1.0f+std::max(std::fabs(p.m_x),std::max(std::fabs(p.m_y),std::fabs(p.m_z))));
+    ngl::Vec3 start=p+ng*offset;
+    float origin[3]={start.m_x,start.m_y,start.m_z};
+
+    // the lights are points and directions so they can only be reached by aiming at them
+    for(const Light &light : m_lights)
+    {
+      ngl::Vec3 wi;
+      float distance;
+      float attenuation=1.0f;
+      if(light.type==ShadowLight::Type::DIRECTIONAL)
+      {
+        wi=normalised(light.position);
+        distance=std::numeric_limits<float>::max();
+      }
+      else
+      {
+        ngl::Vec3 toLight=light.position-start;
+        distance=toLight.length();
+        wi=toLight/distance;
+        attenuation=1.0f/(1.0f+light.linear*distance+light.quadratic*distance*distance);
+      }
+      float nl=n.dot(wi);
+      if(nl<=0.0f || ng.dot(wi)<=0.0f)
+      {
+        continue;
+      }
+      ++io_counters.shadowRays;
+      if(occluded(origin,wi,distance))
+      {
+        continue;
+      }
+      // the light's colour as the irradiance of a surface facing it, so a white Lambert surface
+      // comes out as bright as the raster's Kd * Ld * NdotS
+      Lobes lobes=brdf(n,wo,wi,albedo,material.ks,alpha);
+      result+=throughput*(lobes.diffuse*light.diffuse+lobes.specular*light.specular)*(PI*attenuation*nl);
+    }
+
+    if(bounce+1>=m_settings.maxBounces)
+    {
+      break;
+    }
+    // pick a lobe by how much each reflects and weigh by the pdf of both, so either can find a direction
+    float f=fresnel(n.dot(wo));
+    float specularWeight=luminance(material.ks)*f;
+    float diffuseWeight=luminance(albedo)*(1.0f-f);
+    float pSpecular=std::min(0.9f,std::max(0.1f,specularWeight/std::max(specularWeight+diffuseWeight,1e-6f)));
+    ngl::Vec3 t,s;
+    basis(n,t,s);
+    float r1=_random.next();
+    float r2=_random.next();
+    float phi=2.0f*PI*r2;
+    ngl::Vec3 wi;
+    if(_random.next()<pSpecular)
+    {
+      float cosTheta=std::sqrt((1.0f-r1)/(1.0f+(alpha*alpha-1.0f)*r1));
+      float sinTheta=std::sqrt(std::max(0.0f,1.0f-cosTheta*cosTheta));
+      ngl::Vec3 h=t*(sinTheta*std::cos(phi))+s*(sinTheta*std::sin(phi))+n*cosTheta;
+      wi=h*(2.0f*wo.dot(h))-wo;
+    }
+    else
+    {
+      float radius=std::sqrt(r1);
+      wi=t*(radius*std::cos(phi))+s*(radius*std::sin(phi))+n*std::sqrt(std::max(0.0f,1.0f-r1));
+    }
+    float nl=n.dot(wi);
+    if(nl<=0.0f || ng.dot(wi)<=0.0f)
+    {
+      break;
+    }
+    ngl::Vec3 h=normalised(wo+wi);
+    float nh=std::max(n.dot(h),0.0f);
+    float pdf=pSpecular*ggxD(nh,alpha)*nh/(4.0f*std::max(wo.dot(h),1e-4f))+(1.0f-pSpecular)*nl/PI;
+    if(!(pdf>0.0f))
+    {
+      break;
+    }
+    Lobes lobes=brdf(n,wo,wi,albedo,material.ks,alpha);
+    throughput=throughput*(lobes.diffuse+lobes.specular)*(nl/pdf);
+    if(bounce>=ROULETTE_BOUNCE)
+    {
+      float keep=std::min(0.95f,std::max(throughput.m_x,std::max(throughput.m_y,throughput.m_z)));
+      if(_random.next()>=keep)
+      {
+        break;
+      }
+      throughput/=keep;
+    }
+    float next[3]={wi.m_x,wi.m_y,wi.m_z};
+    _ray.set(origin,next);
+    ++io_counters.bounceRays;
+  }
+  return result;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RayTracer::renderTile(int _tile, Counters &io_counters)
+{
+  int width=m_settings.width;
+  int height=m_settings.height;
+  int tilesX=(width+TILE-1)/TILE;
+  int x0=(_tile%tilesX)*TILE;
+  int y0=(_tile/tilesX)*TILE;
+  float eye[3]={m_settings.eye.m_x,m_settings.eye.m_y,m_settings.eye.m_z};
+  for(int y=y0; y<std::min(y0+TILE,height); ++y)
+  {
+    for(int x=x0; x<std::min(x0+TILE,width); ++x)
+    {
+      uint64_t pixel=uint64_t(y)*uint64_t(width)+uint64_t(x);
+      ngl::Vec3 sum(0.0f,0.0f,0.0f);
+      for(int sample=0; sample<m_settings.samples; ++sample)
+      {
+        // a box filter, each sample somewhere in the pixel, y is up in the camera and down the picture
+        Random random(pixel,static_cast<uint64_t>(sample));
+        float sx=2.0f*(x+random.next())/width-1.0f;
+        float sy=1.0f-2.0f*(y+random.next())/height;
+        ngl::Vec3 dir=normalised(m_forward+m_right*sx+m_up*sy);
+        float d[3]={dir.m_x,dir.m_y,dir.m_z};
+        TraceRay ray;
+        ray.set(eye,d);
+        ++io_counters.cameraRays;
+        ngl::Vec3 value=radiance(ray,random,io_counters);
+        // a path that went wrong numerically is dropped rather than marking the pixel
+        if(std::isfinite(value.m_x) && std::isfinite(value.m_y) && std::isfinite(value.m_z))
+        {
+          sum+=value;
+        }
+      }
+      sum/=static_cast<float>(std::max(m_settings.samples,1));
+      float *out=&m_image[pixel*3];
+      out[0]=sum.m_x;
+      out[1]=sum.m_y;
+      out[2]=sum.m_z;
+    }
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+RayTracer::Stats RayTracer::render(int _threads)
+{
+  unsigned int threads=_threads>0 ? static_cast<unsigned int>(_threads) : std::max(1u,std::thread::hardware_concurrency());
+  int tilesX=(m_settings.width+TILE-1)/TILE;
+  int tilesY=(m_settings.height+TILE-1)/TILE;
+  int tiles=tilesX*tilesY;
+  m_image.assign(size_t(m_settings.width)*size_t(m_settings.height)*3,0.0f);
+
+  // each thread starts with a band of rows and works through it from the front, an idle thread
+  // takes from the back of another's so the two rarely want the same end
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<int> tiles;
+  };
+  std::vector<std::unique_ptr<Queue>> queues;
+  for(unsigned int i=0; i<threads; ++i)
+  {
+    queues.emplace_back(new Queue);
+    for(int tile=static_cast<int>(uint64_t(tiles)*i/threads); tile<static_cast<int>(uint64_t(tiles)*(i+1)/threads); ++tile)
+    {
+      queues[i]->tiles.push_back(tile);
+    }
+  }
+  std::vector<Counters> counters(threads);
+  auto worker=[&](unsigned int _index)
+  {
+    // counted locally so the threads don't share cache lines
+    Counters local;
+    for(;;)
+    {
+      int tile=-1;
+      {
+        std::lock_guard<std::mutex> lock(queues[_index]->mutex);
+        if(!queues[_index]->tiles.empty())
+        {
+          tile=queues[_index]->tiles.front();
+          queues[_index]->tiles.pop_front();
+        }
+      }
+      for(unsigned int i=1; tile<0 && i<threads; ++i)
+      {
+        Queue &victim=*queues[(_index+i)%threads];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if(!victim.tiles.empty())
+        {
+          tile=victim.tiles.back();
+          victim.tiles.pop_back();
+          ++local.steals;
+        }
+      }
+      // nothing adds tiles so once every queue is empty the picture is done
+      if(tile<0)
+      {
+        break;
+      }
+      renderTile(tile,local);
+      ++local.tiles;
+    }
+    counters[_index]=local;
+  };
+
+  auto start=std::chrono::steady_clock::now();
+  std::vector<std::thread> pool;
+  for(unsigned int i=1; i<threads; ++i)
+  {
+    pool.emplace_back(worker,i);
+  }
+  worker(0);
+  for(auto &thread : pool)
+  {
+    thread.join();
+  }
+  Stats stats;
+  stats.seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+  stats.threads=static_cast<int>(threads);
+  for(const Counters &counter : counters)
+  {
+    stats.cameraRays+=counter.cameraRays;
+    stats.bounceRays+=counter.bounceRays;
+    stats.shadowRays+=counter.shadowRays;
+    stats.steals+=counter.steals;
+    stats.tilesPerThread.push_back(counter.tiles);
+  }
+  return stats;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool RayTracer::save(const std::string &_file) const
+{
+  if(m_image.empty())
+  {
+    return false;
+  }
+  QImage image(m_settings.width,m_settings.height,QImage::Format_RGB888);
+  for(int y=0; y<m_settings.height; ++y)
+  {
+    uint8_t *line=image.scanLine(y);
+    const float *row=&m_image[size_t(y)*size_t(m_settings.width)*3];
+    for(int i=0; i<m_settings.width*3; ++i)
+    {
+      float value=std::pow(std::max(row[i],0.0f),1.0f/GAMMA);
+      line[i]=static_cast<uint8_t>(std::min(value,1.0f)*255.0f+0.5f);
+    }
+  }
+  return image.save(QString::fromStdString(_file));
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RayTracer::print(const Stats &_stats, double _baseline)
+{
+  double raysPerSecond=_stats.seconds>0.0 ? _stats.rays()/_stats.seconds : 0.0;
+  std::printf("%2d threads: %.2f s, %.2f Mrays/s, %.2f Mrays/s per core (%.1fM camera %.1fM bounce %.1fM shadow)",
+              _stats.threads,_stats.seconds,raysPerSecond/1e6,raysPerSecond/1e6/std::max(_stats.threads,1),
+              _stats.cameraRays/1e6,_stats.bounceRays/1e6,_stats.shadowRays/1e6);
+  if(_baseline>0.0)
+  {
+    double speedUp=raysPerSecond/_baseline;
+    std::printf(", %.2fx (%.0f%% efficient)",speedUp,100.0*speedUp/_stats.threads);
+  }
+  std::printf("\n            %llu tiles stolen, tiles per thread",static_cast<unsigned long long>(_stats.steals));
+  for(uint32_t tiles : _stats.tilesPerThread)
+  {
+    std::printf(" %u",tiles);
+  }
+  std::printf("\n");
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int RayTracer::run(const Settings &_settings)
+{
+  RayTracer tracer(_settings);
+  if(!tracer.load())
+  {
+    std::cerr<<"Nothing to trace in "<<_settings.scene<<"\n";
+    return EXIT_FAILURE;
+  }
+  std::printf("Tracing %dx%d, %d samples per pixel, up to %d bounces\n",_settings.width,_settings.height,
+              _settings.samples,_settings.maxBounces);
+  Stats stats=tracer.render(_settings.threads);
+  print(stats);
+  if(!_settings.file.empty())
+  {
+    if(!tracer.save(_settings.file))
+    {
+      std::cerr<<"Could not write "<<_settings.file<<"\n";
+      return EXIT_FAILURE;
+    }
+    std::cout<<"Wrote "<<_settings.file<<"\n";
+  }
+  return EXIT_SUCCESS;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int RayTracer::scaling(const Settings &_settings)
+{
+  RayTracer tracer(_settings);
+  if(!tracer.load())
+  {
+    return EXIT_FAILURE;
+  }
+  int maxThreads=_settings.threads>0 ? _settings.threads : static_cast<int>(std::max(1u,std::thread::hardware_concurrency()));
+  std::vector<int> counts;
+  for(int count=1; count<maxThreads; count*=2)
+  {
+    counts.push_back(count);
+  }
+  counts.push_back(maxThreads);
+  std::printf("%dx%d, %d samples per pixel, up to %d bounces, %d pixel tiles\n",_settings.width,_settings.height,
+              _settings.samples,_settings.maxBounces,TILE);
+  double baseline=0.0;
+  for(int count : counts)
+  {
+    Stats stats=tracer.render(count);
+    if(count==1 && stats.seconds>0.0)
+    {
+      baseline=stats.rays()/stats.seconds;
+    }
+    print(stats,count==1 ? 0.0 : baseline);
+  }
+  return EXIT_SUCCESS;
+}
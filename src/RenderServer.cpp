@@ -0,0 +1,401 @@
+#include "RenderServer.h"
+#include "NGLScene.h"
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QRunnable>
+#include <QSurfaceFormat>
+#include <QThreadPool>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the largest job in either direction, the final pass resamples the scene targets to it
+//----------------------------------------------------------------------------------------------------------------------
+constexpr int MAX_JOB_SIZE=4096;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief how long the render thread waits for the loaders when every job is waiting for its label
+//----------------------------------------------------------------------------------------------------------------------
+constexpr int LABEL_WAIT_MS=1;
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief a lambda on the thread pool, QRunnable::create is Qt 5.15 only
+//----------------------------------------------------------------------------------------------------------------------
+class PoolTask : public QRunnable
+{
+  public:
+    explicit PoolTask(std::function<void()> _work) : m_work(_work) {}
+    void run() override { m_work(); }
+  private:
+    std::function<void()> m_work;
+};
+
+//________________________________________________________________________________________________________________________________________//
+
+bool RenderJob::compatible(const RenderJob &_other) const
+{
+  return width==_other.width && height==_other.height &&
+         eye==_other.eye && look==_other.look && light==_other.light;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+RenderServer::RenderServer(NGLScene *_scene, int _width, int _height) :
+  m_scene(_scene),m_width(_width),m_height(_height)
+{
+  QSurfaceFormat format;
+  format.setMajorVersion(4);
+  format.setMinorVersion(3);
+  format.setProfile(QSurfaceFormat::CoreProfile);
+  format.setDepthBufferSize(24);
+  m_context.reset(new QOpenGLContext);
+  m_context->setFormat(format);
+  if(!m_context->create())
+  {
+    std::cerr<<"Could not create the render server context\n";
+  }
+  // as with the render thread the surface is made here and the context moves to our thread
+  m_surface.reset(new QOffscreenSurface);
+  m_surface->setFormat(m_context->format());
+  m_surface->create();
+  m_context->moveToThread(this);
+  // stand in for the window, initializeRenderer creates the scene targets at the published size
+  m_scene->m_guiInput.width=_width;
+  m_scene->m_guiInput.height=_height;
+  m_scene->m_guiInput.devicePixelRatio=1.0f;
+  m_scene->publishInput();
+  m_clock.start();
+  m_window.start();
+
+  QObject::connect(&m_listener,&QLocalServer::newConnection,[this]()
+  {
+    while(QLocalSocket *socket=m_listener.nextPendingConnection())
+    {
+      uint64_t client=m_nextClient++;
+      m_connections[client]=Connection{socket,QByteArray()};
+      QObject::connect(socket,&QLocalSocket::readyRead,[this,client](){ readJobs(client); });
+      QObject::connect(socket,&QLocalSocket::disconnected,[this,client]()
+      {
+        // jobs already queued for the client are still rendered, their results are dropped
+        auto found=m_connections.find(client);
+        if(found!=m_connections.end())
+        {
+          found->second.socket->deleteLater();
+          m_connections.erase(found);
+        }
+      });
+    }
+  });
+  QObject::connect(&m_reportTimer,&QTimer::timeout,[this](){ report(); });
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+RenderServer::~RenderServer()
+{
+  stop();
+  // the encoders deliver to this object
+  QThreadPool::globalInstance()->waitForDone();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool RenderServer::listen(const QString &_name)
+{
+  // a server that crashed leaves its socket file behind
+  QLocalServer::removeServer(_name);
+  if(!m_listener.listen(_name))
+  {
+    std::cerr<<"Could not listen on "<<_name.toStdString()<<" "<<m_listener.errorString().toStdString()<<"\n";
+    return false;
+  }
+  std::cout<<"Serving render jobs on "<<m_listener.fullServerName().toStdString()
+           <<" at "<<m_width<<"x"<<m_height<<"\n";
+  start();
+  m_reportTimer.start(1000);
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RenderServer::stop()
+{
+  m_reportTimer.stop();
+  m_listener.close();
+  if(!isRunning())
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_running=false;
+  }
+  m_wake.notify_one();
+  wait();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RenderServer::readJobs(uint64_t _client)
+{
+  auto found=m_connections.find(_client);
+  if(found==m_connections.end())
+  {
+    return;
+  }
+  Connection &connection=found->second;
+  connection.pending+=connection.socket->readAll();
+  int end;
+  while((end=connection.pending.indexOf('\n'))>=0)
+  {
+    QByteArray line=connection.pending.left(end).trimmed();
+    connection.pending.remove(0,end+1);
+    if(line.isEmpty())
+    {
+      continue;
+    }
+    QJsonParseError error;
+    QJsonDocument document=QJsonDocument::fromJson(line,&error);
+    QJsonObject message=document.object();
+    if(message["stats"].toBool())
+    {
+      connection.socket->write(stats());
+      continue;
+    }
+    RenderJob job;
+    job.id=message["id"].toDouble();
+    job.client=_client;
+    job.label=static_cast<uint32_t>(std::max(message["label"].toInt(),0));
+    auto vec3=[](const QJsonValue &_value, const ngl::Vec3 &_default)
+    {
+      QJsonArray array=_value.toArray();
+      return array.size()==3 ? ngl::Vec3(static_cast<float>(array.at(0).toDouble()),
+                                         static_cast<float>(array.at(1).toDouble()),
+                                         static_cast<float>(array.at(2).toDouble())) : _default;
+    };
+    job.eye=vec3(message["eye"],job.eye);
+    job.look=vec3(message["look"],job.look);
+    job.light=vec3(message["light"],job.light);
+    job.width=std::max(1,std::min(message["width"].toInt(job.width),MAX_JOB_SIZE));
+    job.height=std::max(1,std::min(message["height"].toInt(job.height),MAX_JOB_SIZE));
+    job.received=m_clock.nsecsElapsed();
+    if(document.isNull() || (job.eye-job.look).lengthSquared()<1e-6f)
+    {
+      // answered straight away so the client isn't left waiting for it
+      QJsonObject reply;
+      reply["id"]=job.id;
+      reply["status"]="error";
+      reply["message"]=document.isNull() ? error.errorString() : QString("eye and look are the same point");
+      connection.socket->write(QJsonDocument(reply).toJson(QJsonDocument::Compact)+"\n");
+      ++m_failed;
+      continue;
+    }
+    ++m_inFlight;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_queue.push_back(job);
+    }
+    m_wake.notify_one();
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RenderServer::run()
+{
+  m_context->makeCurrent(m_surface.get());
+  m_scene->initializeServer();
+  // jobs taken from the queue whose labels aren't resident yet
+  std::vector<RenderJob> pending;
+  while(m_running)
+  {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      auto wake=[this](){ return !m_queue.empty() || !m_running; };
+      if(pending.empty())
+      {
+        m_wake.wait(lock,wake);
+      }
+      else
+      {
+        m_wake.wait_for(lock,std::chrono::milliseconds(LABEL_WAIT_MS),wake);
+      }
+      while(!m_queue.empty())
+      {
+        pending.push_back(m_queue.front());
+        m_queue.pop_front();
+      }
+    }
+    if(!m_running)
+    {
+      break;
+    }
+    renderReady(pending);
+  }
+  m_scene->releaseRenderer();
+  m_context->doneCurrent();
+  // hand the context back so it can be deleted on the GUI thread
+  m_context->moveToThread(QCoreApplication::instance()->thread());
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RenderServer::renderReady(std::vector<RenderJob> &io_pending)
+{
+  std::vector<uint32_t> labels;
+  labels.reserve(io_pending.size());
+  for(const auto &job : io_pending)
+  {
+    labels.push_back(job.label);
+  }
+  m_scene->streamJobLabels(labels);
+  auto waiting=std::stable_partition(io_pending.begin(),io_pending.end(),[this](const RenderJob &_job)
+  {
+    return m_scene->jobLabelResident(_job.label);
+  });
+  std::vector<RenderJob> ready(io_pending.begin(),waiting);
+  io_pending.erase(io_pending.begin(),waiting);
+
+  // the oldest ready job starts each batch and takes every ready job it can share a frame with
+  while(!ready.empty())
+  {
+    std::vector<RenderJob> batch(1,ready.front());
+    std::vector<RenderJob> rest;
+    for(size_t i=1; i<ready.size(); ++i)
+    {
+      if(batch.size()<MAX_BATCH && ready[i].compatible(batch.front()))
+      {
+        batch.push_back(ready[i]);
+      }
+      else
+      {
+        rest.push_back(ready[i]);
+      }
+    }
+    ready.swap(rest);
+
+    int64_t start=m_clock.nsecsElapsed();
+    m_scene->renderJobs(batch);
+    float renderTime=(m_clock.nsecsElapsed()-start)/1.0e6f;
+    for(auto &job : batch)
+    {
+      job.started=start;
+      job.renderTime=renderTime;
+      job.batchSize=static_cast<int>(batch.size());
+      QThreadPool::globalInstance()->start(new PoolTask([this,job]() mutable { encode(job); }));
+    }
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RenderServer::encode(RenderJob &_job)
+{
+  QBuffer buffer(&_job.encoded);
+  buffer.open(QIODevice::WriteOnly);
+  _job.image.save(&buffer,"PNG");
+  buffer.close();
+  _job.image=QImage();
+  RenderJob job=_job;
+  QMetaObject::invokeMethod(this,[this,job](){ deliver(job); },Qt::QueuedConnection);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RenderServer::deliver(const RenderJob &_job)
+{
+  --m_inFlight;
+  float latency=(m_clock.nsecsElapsed()-_job.received)/1.0e6f;
+  float queueWait=(_job.started-_job.received)/1.0e6f;
+  bool ok=!_job.encoded.isEmpty();
+  if(ok)
+  {
+    m_latency.add(latency);
+    m_queueWait.add(queueWait);
+    m_renderTime.add(_job.renderTime);
+    m_batchSizes+=static_cast<uint64_t>(_job.batchSize);
+    ++m_completed;
+    ++m_windowCompleted;
+  }
+  else
+  {
+    ++m_failed;
+  }
+  auto found=m_connections.find(_job.client);
+  if(found==m_connections.end())
+  {
+    // the client went away while it was being rendered
+    return;
+  }
+  QJsonObject header;
+  header["id"]=_job.id;
+  header["status"]=ok ? "ok" : "error";
+  header["format"]="png";
+  header["bytes"]=ok ? _job.encoded.size() : 0;
+  header["width"]=_job.width;
+  header["height"]=_job.height;
+  header["queueMs"]=queueWait;
+  header["renderMs"]=_job.renderTime;
+  header["latencyMs"]=latency;
+  header["batch"]=_job.batchSize;
+  QLocalSocket *socket=found->second.socket;
+  socket->write(QJsonDocument(header).toJson(QJsonDocument::Compact)+"\n");
+  if(ok)
+  {
+    socket->write(_job.encoded);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+QByteArray RenderServer::stats() const
+{
+  auto percentiles=[](const Histogram &_histogram)
+  {
+    QJsonObject times;
+    times["p50"]=_histogram.percentile(0.5f);
+    times["p95"]=_histogram.percentile(0.95f);
+    times["p99"]=_histogram.percentile(0.99f);
+    times["max"]=_histogram.max();
+    times["mean"]=_histogram.mean();
+    return times;
+  };
+  QJsonObject values;
+  values["queueDepth"]=m_inFlight.load();
+  values["connections"]=static_cast<int>(m_connections.size());
+  values["completed"]=static_cast<double>(m_completed);
+  values["failed"]=static_cast<double>(m_failed);
+  values["jobsPerSecond"]=m_throughput;
+  values["meanBatch"]=m_completed>0 ? static_cast<double>(m_batchSizes)/m_completed : 0.0;
+  values["latencyMs"]=percentiles(m_latency);
+  values["queueMs"]=percentiles(m_queueWait);
+  values["renderMs"]=percentiles(m_renderTime);
+  QJsonObject reply;
+  reply["stats"]=values;
+  return QJsonDocument(reply).toJson(QJsonDocument::Compact)+"\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RenderServer::report()
+{
+  int64_t elapsed=m_window.restart();
+  m_throughput=elapsed>0 ? m_windowCompleted*1000.0f/elapsed : 0.0f;
+  m_windowCompleted=0;
+  if(m_throughput==0.0f && m_inFlight==0)
+  {
+    return;
+  }
+  std::cout<<"Render server "<<m_throughput<<" jobs/s queue "<<m_inFlight
+           <<" latency p50 "<<m_latency.percentile(0.5f)<<" p95 "<<m_latency.percentile(0.95f)
+           <<" p99 "<<m_latency.percentile(0.99f)<<" ms render "<<m_renderTime.mean()
+           <<" ms batch "<<(m_completed>0 ? static_cast<double>(m_batchSizes)/m_completed : 0.0)
+           <<" clients "<<m_connections.size()<<"\n";
+}
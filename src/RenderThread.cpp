@@ -0,0 +1,134 @@
+#include "RenderThread.h"
+#include "NGLScene.h"
+#include <QCoreApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <algorithm>
+#include <iostream>
+
+//________________________________________________________________________________________________________________________________________//
+
+RenderThread::RenderThread(NGLScene *_scene, QOpenGLContext *_shareContext) : m_scene(_scene)
+{
+  m_context.reset(new QOpenGLContext);
+  m_context->setFormat(_shareContext->format());
+  m_context->setShareContext(_shareContext);
+  if(!m_context->create())
+  {
+    std::cerr<<"Could not create the render thread context\n";
+  }
+  // an offscreen surface has to be created on the GUI thread, the context then moves to ours
+  m_surface.reset(new QOffscreenSurface);
+  m_surface->setFormat(m_context->format());
+  m_surface->create();
+  m_context->moveToThread(this);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+RenderThread::~RenderThread()
+{
+  stop();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RenderThread::stop()
+{
+  if(!isRunning())
+  {
+    return;
+  }
+  m_running=false;
+  // wake the thread if it is waiting for the window or idle
+  m_frameSlots.release();
+  m_wake.release();
+  wait();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RenderThread::framePresented()
+{
+  // called from both threads, when the window shows a frame and when a frame it never saw is replaced
+  int debt=m_slotDebt.load();
+  while(debt>0)
+  {
+    if(m_slotDebt.compare_exchange_weak(debt,debt-1))
+    {
+      return;
+    }
+  }
+  m_frameSlots.release();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RenderThread::wake()
+{
+  // one pending wake is enough, the thread reads all of the input there is when it wakes
+  if(m_wake.available()==0)
+  {
+    m_wake.release();
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RenderThread::setFramesAhead(int _frames)
+{
+  _frames=std::max(1,std::min(_frames,MAX_FRAMES_AHEAD));
+  int change=_frames-m_framesAhead.exchange(_frames);
+  if(change>0)
+  {
+    // pay back anything still owed before adding new slots
+    int debt=m_slotDebt.exchange(0);
+    if(change>debt)
+    {
+      m_frameSlots.release(change-debt);
+    }
+    else
+    {
+      m_slotDebt+=debt-change;
+    }
+  }
+  else if(change<0)
+  {
+    // take free slots straight away, the rest are kept back as frames in flight are shown
+    int owed=-change;
+    while(owed>0 && m_frameSlots.tryAcquire())
+    {
+      --owed;
+    }
+    m_slotDebt+=owed;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void RenderThread::run()
+{
+  m_context->makeCurrent(m_surface.get());
+  m_scene->initializeRenderer();
+  while(m_running)
+  {
+    m_frameSlots.acquire();
+    if(!m_running)
+    {
+      break;
+    }
+    if(!m_scene->renderFrame())
+    {
+      // nothing was published so the window won't give the slot back, sleep until the input changes
+      framePresented();
+      m_wake.tryAcquire(1,IDLE_POLL_MS);
+      continue;
+    }
+    // ask the window to show it, update is a slot so this is queued to the GUI thread
+    QMetaObject::invokeMethod(m_scene,"update",Qt::QueuedConnection);
+  }
+  m_scene->releaseRenderer();
+  m_context->doneCurrent();
+  // hand the context back so it can be deleted on the GUI thread
+  m_context->moveToThread(QCoreApplication::instance()->thread());
+}
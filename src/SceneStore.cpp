@@ -0,0 +1,349 @@
+#include "SceneStore.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief read a [x,y,z] array from a JSON object, missing values give the default
+//----------------------------------------------------------------------------------------------------------------------
+static ngl::Vec3 readVec3(const QJsonObject &_obj, const char *_key, const ngl::Vec3 &_default)
+{
+  if(!_obj.contains(_key))
+  {
+    return _default;
+  }
+  QJsonArray a=_obj[_key].toArray();
+  return ngl::Vec3(static_cast<float>(a.at(0).toDouble(_default.m_x)),
+                   static_cast<float>(a.at(1).toDouble(_default.m_y)),
+                   static_cast<float>(a.at(2).toDouble(_default.m_z)));
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief read the shader features of a material, anything not given keeps its bit from _default
+//----------------------------------------------------------------------------------------------------------------------
+static uint32_t readFeatures(const QJsonObject &_obj, uint32_t _default)
+{
+  uint32_t features=_default;
+  auto setBit=[&](const char *_key, uint32_t _bit)
+  {
+    if(_obj.contains(_key))
+    {
+      features=_obj[_key].toBool() ? (features | _bit) : (features & ~_bit);
+    }
+  };
+  if(_obj.contains("lights"))
+  {
+    int lights=std::min(std::max(_obj["lights"].toInt(3),0),3);
+    features=(features & ~FEATURE_LIGHT_COUNT) | static_cast<uint32_t>(lights);
+  }
+  if(_obj.contains("lighting"))
+  {
+    bool microfacet=_obj["lighting"].toString()=="microfacet";
+    features=microfacet ? (features | FEATURE_MICROFACET) : (features & ~FEATURE_MICROFACET);
+  }
+  setBit("refract",FEATURE_REFRACT);
+  setBit("noise",FEATURE_NOISE);
+  setBit("normalMap",FEATURE_NORMAL_MAP);
+  setBit("planarReflection",FEATURE_PLANAR_REFLECTION);
+  if(_obj.contains("shadow"))
+  {
+    QString name=_obj["shadow"].toString();
+    uint32_t filter=SHADOW_HARD;
+    if(name=="none")
+    {
+      filter=SHADOW_NONE;
+    }
+    else if(name=="pcf")
+    {
+      filter=SHADOW_PCF;
+    }
+    else if(name=="evsm")
+    {
+      filter=SHADOW_EVSM;
+    }
+    features=(features & ~FEATURE_SHADOW_FILTER) | filter;
+  }
+  return features;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void SceneStore::clear()
+{
+  meshes.clear();
+  materials.clear();
+  labels=SceneLabels();
+  for(auto *v : {&posX,&posY,&posZ,&rotX,&rotY,&rotZ,&scaleX,&scaleY,&scaleZ,&centreX,&centreY,&centreZ,&radius})
+  {
+    v->clear();
+  }
+  mesh.clear();
+  material.clear();
+  label.clear();
+  dirty.clear();
+  dirtyList.clear();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool SceneStore::load(const std::string &_fname)
+{
+  QFile file(QString::fromStdString(_fname));
+  if(!file.open(QIODevice::ReadOnly))
+  {
+    std::cerr<<"SceneStore could not open "<<_fname<<"\n";
+    return false;
+  }
+  QJsonParseError error;
+  QJsonDocument doc=QJsonDocument::fromJson(file.readAll(),&error);
+  if(doc.isNull())
+  {
+    std::cerr<<"SceneStore error parsing "<<_fname<<" : "<<error.errorString().toStdString()<<"\n";
+    return false;
+  }
+  clear();
+  QJsonObject root=doc.object();
+
+  for(auto m : root["meshes"].toArray())
+  {
+    QJsonObject o=m.toObject();
+    SceneMesh mesh;
+    mesh.name=o["name"].toString().toStdString();
+    mesh.isPlane= o["type"].toString()=="plane";
+    mesh.file=o["file"].toString().toStdString();
+    mesh.planeWidth=static_cast<float>(o["width"].toDouble(1.0));
+    mesh.planeDepth=static_cast<float>(o["depth"].toDouble(1.0));
+    mesh.planeSteps=o["steps"].toInt(1);
+    if(mesh.isPlane)
+    {
+      mesh.centre.set(0.0f,0.0f,0.0f);
+      mesh.radius=0.5f*std::sqrt(mesh.planeWidth*mesh.planeWidth+mesh.planeDepth*mesh.planeDepth);
+    }
+    meshes.push_back(mesh);
+  }
+
+  for(auto m : root["materials"].toArray())
+  {
+    QJsonObject o=m.toObject();
+    SceneMaterial mat;
+    mat.name=o["name"].toString().toStdString();
+    mat.program=o["program"].toString().toStdString();
+    mat.ka=readVec3(o,"ka",mat.ka);
+    mat.kd=readVec3(o,"kd",mat.kd);
+    mat.ks=readVec3(o,"ks",mat.ks);
+    mat.shininess=static_cast<float>(o["shininess"].toDouble(mat.shininess));
+    mat.roughness=static_cast<float>(o["roughness"].toDouble(mat.roughness));
+    mat.features=readFeatures(o,mat.features);
+    materials.push_back(mat);
+  }
+
+  if(root.contains("labels"))
+  {
+    QJsonObject o=root["labels"].toObject();
+    if(o.contains("files"))
+    {
+      labels.files.clear();
+      for(auto f : o["files"].toArray())
+      {
+        labels.files.push_back(f.toString().toStdString());
+      }
+    }
+    labels.count=static_cast<uint32_t>(std::max(o["count"].toInt(static_cast<int>(labels.files.size())),1));
+    labels.width=o["width"].toInt(labels.width);
+    labels.height=o["height"].toInt(labels.height);
+  }
+
+  for(auto obj : root["objects"].toArray())
+  {
+    QJsonObject o=obj.toObject();
+    int meshID=findMesh(o["mesh"].toString().toStdString());
+    int matID=findMaterial(o["material"].toString().toStdString());
+    if(meshID<0 || matID<0)
+    {
+      std::cerr<<"SceneStore skipping object with unknown mesh or material\n";
+      continue;
+    }
+    ngl::Vec3 pos=readVec3(o,"position",ngl::Vec3(0.0f,0.0f,0.0f));
+    ngl::Vec3 rot=readVec3(o,"rotation",ngl::Vec3(0.0f,0.0f,0.0f));
+    ngl::Vec3 scale=readVec3(o,"scale",ngl::Vec3(1.0f,1.0f,1.0f));
+    uint32_t lbl=static_cast<uint32_t>(o["label"].toInt(0));
+
+    // an optional array repeats the object on a grid, used for shelves
+    ngl::Vec3 count(1.0f,1.0f,1.0f);
+    ngl::Vec3 spacing(0.0f,0.0f,0.0f);
+    if(o.contains("array"))
+    {
+      QJsonObject a=o["array"].toObject();
+      count=readVec3(a,"count",count);
+      spacing=readVec3(a,"spacing",spacing);
+    }
+    for(int z=0; z<static_cast<int>(count.m_z); ++z)
+    {
+      for(int y=0; y<static_cast<int>(count.m_y); ++y)
+      {
+        for(int x=0; x<static_cast<int>(count.m_x); ++x)
+        {
+          ngl::Vec3 p(pos.m_x+x*spacing.m_x,pos.m_y+y*spacing.m_y,pos.m_z+z*spacing.m_z);
+          addObject(static_cast<uint16_t>(meshID),static_cast<uint16_t>(matID),p,rot,scale,lbl);
+        }
+      }
+    }
+  }
+  std::cout<<"SceneStore loaded "<<_fname<<" "<<meshes.size()<<" meshes "<<materials.size()<<" materials "<<size()<<" objects\n";
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void SceneStore::loadDefault()
+{
+  clear();
+  SceneMesh plane;
+  plane.name="plane";
+  plane.isPlane=true;
+  plane.planeWidth=80.0f;
+  plane.planeDepth=80.0f;
+  plane.planeSteps=80;
+  plane.radius=0.5f*std::sqrt(80.0f*80.0f*2.0f);
+  meshes.push_back(plane);
+  SceneMesh can;
+  can.name="can";
+  can.file="data/can05.obj";
+  meshes.push_back(can);
+
+  SceneMaterial wood;
+  wood.name="wood";
+  wood.program="Shadow";
+  wood.shininess=50.0f;
+  materials.push_back(wood);
+  SceneMaterial canMaterial;
+  canMaterial.name="can";
+  canMaterial.program="CanProgram";
+  materials.push_back(canMaterial);
+
+  addObject(0,0,ngl::Vec3(0.0f,0.0f,0.0f),ngl::Vec3(0.0f,0.0f,0.0f),ngl::Vec3(1.0f,1.0f,1.0f),0);
+  addObject(1,1,ngl::Vec3(0.0f,0.0f,0.0f),ngl::Vec3(0.0f,0.0f,0.0f),ngl::Vec3(0.4f,0.4f,0.4f),0);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+uint32_t SceneStore::addObject(uint16_t _mesh, uint16_t _material, const ngl::Vec3 &_pos, const ngl::Vec3 &_rot, const ngl::Vec3 &_scale, uint32_t _label)
+{
+  uint32_t index=size();
+  posX.push_back(_pos.m_x);   posY.push_back(_pos.m_y);   posZ.push_back(_pos.m_z);
+  rotX.push_back(_rot.m_x);   rotY.push_back(_rot.m_y);   rotZ.push_back(_rot.m_z);
+  scaleX.push_back(_scale.m_x); scaleY.push_back(_scale.m_y); scaleZ.push_back(_scale.m_z);
+  centreX.push_back(0.0f); centreY.push_back(0.0f); centreZ.push_back(0.0f); radius.push_back(0.0f);
+  mesh.push_back(_mesh);
+  material.push_back(_material);
+  label.push_back(_label);
+  dirty.push_back(1);
+  dirtyList.push_back(index);
+  return index;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void SceneStore::setPosition(uint32_t _i, const ngl::Vec3 &_pos)
+{
+  posX[_i]=_pos.m_x;
+  posY[_i]=_pos.m_y;
+  posZ[_i]=_pos.m_z;
+  if(!dirty[_i])
+  {
+    dirty[_i]=1;
+    dirtyList.push_back(_i);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int SceneStore::findMesh(const std::string &_name) const
+{
+  for(size_t i=0; i<meshes.size(); ++i)
+  {
+    if(meshes[i].name==_name)
+    {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int SceneStore::findMaterial(const std::string &_name) const
+{
+  for(size_t i=0; i<materials.size(); ++i)
+  {
+    if(materials[i].name==_name)
+    {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+ngl::Mat4 SceneStore::worldMatrix(uint32_t _i) const
+{
+  ngl::Mat4 s;
+  ngl::Mat4 rx;
+  ngl::Mat4 ry;
+  ngl::Mat4 rz;
+  ngl::Mat4 t;
+  s.scale(scaleX[_i],scaleY[_i],scaleZ[_i]);
+  rx.rotateX(rotX[_i]);
+  ry.rotateY(rotY[_i]);
+  rz.rotateZ(rotZ[_i]);
+  t.translate(posX[_i],posY[_i],posZ[_i]);
+  return s*rx*ry*rz*t;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void SceneStore::updateBounds(bool _all)
+{
+  auto update=[this](uint32_t _i)
+  {
+    const SceneMesh &m=meshes[mesh[_i]];
+    // only the centre offset needs the full matrix, the radius takes the largest scale
+    ngl::Mat4 world=worldMatrix(_i);
+    float cx=m.centre.m_x, cy=m.centre.m_y, cz=m.centre.m_z;
+    centreX[_i]=cx*world.m_m[0][0]+cy*world.m_m[1][0]+cz*world.m_m[2][0]+world.m_m[3][0];
+    centreY[_i]=cx*world.m_m[0][1]+cy*world.m_m[1][1]+cz*world.m_m[2][1]+world.m_m[3][1];
+    centreZ[_i]=cx*world.m_m[0][2]+cy*world.m_m[1][2]+cz*world.m_m[2][2]+world.m_m[3][2];
+    float s=std::max(std::fabs(scaleX[_i]),std::max(std::fabs(scaleY[_i]),std::fabs(scaleZ[_i])));
+    radius[_i]=m.radius*s;
+  };
+  if(_all)
+  {
+    for(uint32_t i=0; i<size(); ++i)
+    {
+      update(i);
+    }
+  }
+  else
+  {
+    for(auto i : dirtyList)
+    {
+      update(i);
+    }
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void SceneStore::clearDirty()
+{
+  for(auto i : dirtyList)
+  {
+    dirty[i]=0;
+  }
+  dirtyList.clear();
+}
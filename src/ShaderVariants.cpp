@@ -0,0 +1,217 @@
+#include "ShaderVariants.h"
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+//________________________________________________________________________________________________________________________________________//
+
+ShaderVariants::~ShaderVariants()
+{
+  releaseQueries();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShaderVariants::releaseQueries()
+{
+  for(int frame=0; frame<2; ++frame)
+  {
+    if(!m_queries[frame].empty())
+    {
+      glDeleteQueries(static_cast<GLsizei>(m_queries[frame].size()),&m_queries[frame][0]);
+      m_queries[frame].clear();
+    }
+    m_queryVariant[frame].clear();
+    m_used[frame]=0;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShaderVariants::addBase(const std::string &_name, const std::vector<ProgramCache::Stage> &_stages, uint32_t _supported)
+{
+  m_bases.push_back({_name,_stages,_supported});
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int ShaderVariants::request(const std::string &_base, uint32_t _features)
+{
+  for(size_t b=0; b<m_bases.size(); ++b)
+  {
+    if(m_bases[b].name !=_base)
+    {
+      continue;
+    }
+    uint32_t features=_features & m_bases[b].supported;
+    for(size_t i=0; i<m_variants.size(); ++i)
+    {
+      if(m_variants[i].base==b && m_variants[i].features==features)
+      {
+        return static_cast<int>(i);
+      }
+    }
+    char hex[16];
+    std::snprintf(hex,sizeof(hex),"%03x",features);
+    m_variants.push_back({_base+"_"+hex,b,features,0.0f,0});
+    return static_cast<int>(m_variants.size()-1);
+  }
+  std::cerr<<"No shader base called "<<_base<<"\n";
+  return -1;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+std::vector<ProgramCache::Program> ShaderVariants::programs() const
+{
+  std::vector<ProgramCache::Program> programs;
+  for(auto &variant : m_variants)
+  {
+    programs.push_back({variant.name,m_bases[variant.base].stages,defines(variant.features)});
+  }
+  return programs;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+std::vector<int> ShaderVariants::variantsOf(const std::string &_base) const
+{
+  std::vector<int> variants;
+  for(size_t i=0; i<m_variants.size(); ++i)
+  {
+    if(m_bases[m_variants[i].base].name==_base)
+    {
+      variants.push_back(static_cast<int>(i));
+    }
+  }
+  return variants;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+std::string ShaderVariants::defines(uint32_t _features)
+{
+  // every macro is always defined so the shaders can use #if and a typo is a compile error
+  std::stringstream out;
+  out<<"#define LIGHT_COUNT "<<(_features & FEATURE_LIGHT_COUNT)<<"\n";
+  out<<"#define LIGHTING_MICROFACET "<<((_features & FEATURE_MICROFACET) ? 1 : 0)<<"\n";
+  out<<"#define REFRACT "<<((_features & FEATURE_REFRACT) ? 1 : 0)<<"\n";
+  out<<"#define NOISE "<<((_features & FEATURE_NOISE) ? 1 : 0)<<"\n";
+  out<<"#define NORMAL_MAP "<<((_features & FEATURE_NORMAL_MAP) ? 1 : 0)<<"\n";
+  out<<"#define SHADOW_FILTER "<<((_features & FEATURE_SHADOW_FILTER)>>SHADOW_FILTER_SHIFT)<<"\n";
+  out<<"#define BLUR_HORIZONTAL "<<((_features & FEATURE_BLUR_HORIZONTAL) ? 1 : 0)<<"\n";
+  out<<"#define PLANAR_REFLECTION "<<((_features & FEATURE_PLANAR_REFLECTION) ? 1 : 0)<<"\n";
+  out<<"#define MULTI_VIEW "<<((_features & FEATURE_MULTI_VIEW) ? 1 : 0)<<"\n";
+  return out.str();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+std::string ShaderVariants::describe(uint32_t _features)
+{
+  std::stringstream out;
+  out<<(_features & FEATURE_LIGHT_COUNT)<<" lights";
+  out<<((_features & FEATURE_MICROFACET) ? " microfacet" : " blinn");
+  out<<((_features & FEATURE_REFRACT) ? " refract" : " reflect");
+  if(_features & FEATURE_NOISE)
+  {
+    out<<" noise";
+  }
+  if(_features & FEATURE_NORMAL_MAP)
+  {
+    out<<" normal-map";
+  }
+  const char *filters[]={""," hard-shadow"," pcf-shadow"," evsm-shadow"};
+  out<<filters[(_features & FEATURE_SHADOW_FILTER)>>SHADOW_FILTER_SHIFT];
+  if(_features & FEATURE_BLUR_HORIZONTAL)
+  {
+    out<<" horizontal";
+  }
+  if(_features & FEATURE_PLANAR_REFLECTION)
+  {
+    out<<" planar-reflection";
+  }
+  if(_features & FEATURE_MULTI_VIEW)
+  {
+    out<<" multi-view";
+  }
+  return out.str();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShaderVariants::beginFrame()
+{
+  ++m_frame;
+  int last=(m_frame+1)%2;
+  if(m_used[last]>0)
+  {
+    GLint available=0;
+    glGetQueryObjectiv(m_queries[last][2*m_used[last]-1],GL_QUERY_RESULT_AVAILABLE,&available);
+    if(available)
+    {
+      for(auto &variant : m_variants)
+      {
+        variant.gpuTime=0.0f;
+        variant.draws=0;
+      }
+      for(size_t i=0; i<m_used[last]; ++i)
+      {
+        GLuint64 start=0;
+        GLuint64 end=0;
+        glGetQueryObjectui64v(m_queries[last][2*i],GL_QUERY_RESULT,&start);
+        glGetQueryObjectui64v(m_queries[last][2*i+1],GL_QUERY_RESULT,&end);
+        Variant &variant=m_variants[m_queryVariant[last][i]];
+        variant.gpuTime+=(end-start)/1000000.0f;
+        ++variant.draws;
+      }
+    }
+  }
+  m_used[m_frame%2]=0;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShaderVariants::beginDraw(int _variant)
+{
+  m_current=_variant;
+  if(_variant<0)
+  {
+    return;
+  }
+  int frame=m_frame%2;
+  std::vector<GLuint> &queries=m_queries[frame];
+  if(2*m_used[frame]==queries.size())
+  {
+    queries.resize(queries.size()+2);
+    glGenQueries(2,&queries[queries.size()-2]);
+    m_queryVariant[frame].resize(queries.size()/2);
+  }
+  m_queryVariant[frame][m_used[frame]]=_variant;
+  glQueryCounter(queries[2*m_used[frame]],GL_TIMESTAMP);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShaderVariants::endDraw()
+{
+  if(m_current<0)
+  {
+    return;
+  }
+  int frame=m_frame%2;
+  glQueryCounter(m_queries[frame][2*m_used[frame]+1],GL_TIMESTAMP);
+  ++m_used[frame];
+  m_current=-1;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShaderVariants::printTimings() const
+{
+  std::cout<<"Shader variants\n";
+  for(auto &variant : m_variants)
+  {
+    std::printf("  %-20s %8.3f ms %5u draws  %s\n",variant.name.c_str(),variant.gpuTime,variant.draws,describe(variant.features).c_str());
+  }
+}
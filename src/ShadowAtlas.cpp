@@ -0,0 +1,351 @@
+#include "ShadowAtlas.h"
+#include "Frustum.h"
+#include <ngl/Camera.h>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <sstream>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the attenuation below which a light is treated as having no effect
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float ATTENUATION_CUTOFF=0.02f;
+constexpr float MAX_RANGE=100.0f;
+constexpr float SPOT_FOV=45.0f;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the cube faces are a little wider than 90 degrees so the filters near a face edge stay in the tile
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float CUBE_FACE_FOV=95.0f;
+constexpr float NEAR_PLANE=0.05f;
+
+const SceneLight SCENE_LIGHTS[ShadowAtlas::MAX_LIGHTS]=
+{
+  {{ShadowLight::Type::SPOT,ngl::Vec3(8.0f,4.0f,8.0f),0.0014f,0.000007f},
+   ngl::Vec3(0.5f,0.5f,0.5f),ngl::Vec3(1.0f,1.0f,1.0f),ngl::Vec3(1.0f,1.0f,1.0f),ngl::Vec3(1.0f,1.0f,1.0f)},
+  {{ShadowLight::Type::POINT,ngl::Vec3(0.0f,2.0f,4.0f),0.35f,1.44f},
+   ngl::Vec3(0.5f,0.5f,0.5f),ngl::Vec3(0.1f,1.0f,1.0f),ngl::Vec3(1.0f,1.0f,1.0f),ngl::Vec3(1.0f,1.0f,4.0f)},
+  {{ShadowLight::Type::DIRECTIONAL,ngl::Vec3(4.0f,3.0f,-1.0f),0.7f,1.8f},
+   ngl::Vec3(0.5f,0.5f,0.5f),ngl::Vec3(1.0f,0.1f,1.0f),ngl::Vec3(1.0f,1.0f,1.0f),ngl::Vec3(5.0f,0.6f,0.6f)}
+};
+
+//________________________________________________________________________________________________________________________________________//
+
+namespace
+{
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief _p transformed by _m, the rows of the GL matrix are the columns of m_m
+  //----------------------------------------------------------------------------------------------------------------------
+  ngl::Vec3 transformPoint(const ngl::Mat4 &_m, const ngl::Vec3 &_p)
+  {
+    return ngl::Vec3(_m.m_m[0][0]*_p.m_x+_m.m_m[1][0]*_p.m_y+_m.m_m[2][0]*_p.m_z+_m.m_m[3][0],
+                     _m.m_m[0][1]*_p.m_x+_m.m_m[1][1]*_p.m_y+_m.m_m[2][1]*_p.m_z+_m.m_m[3][1],
+                     _m.m_m[0][2]*_p.m_x+_m.m_m[1][2]*_p.m_y+_m.m_m[2][2]*_p.m_z+_m.m_m[3][2]);
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief an orthographic projection in ngl's layout
+  //----------------------------------------------------------------------------------------------------------------------
+  ngl::Mat4 ortho(float _left, float _right, float _bottom, float _top, float _near, float _far)
+  {
+    ngl::Mat4 m;
+    m.m_m[0][0]=2.0f/(_right-_left);
+    m.m_m[1][1]=2.0f/(_top-_bottom);
+    m.m_m[2][2]=-2.0f/(_far-_near);
+    m.m_m[3][0]=-(_right+_left)/(_right-_left);
+    m.m_m[3][1]=-(_top+_bottom)/(_top-_bottom);
+    m.m_m[3][2]=-(_far+_near)/(_far-_near);
+    return m;
+  }
+
+  //----------------------------------------------------------------------------------------------------------------------
+  /// @brief the x and y of the _index'th square along a z order curve, squares of a power of two
+  /// size placed largest first at indices aligned to their area never overlap
+  //----------------------------------------------------------------------------------------------------------------------
+  void mortonDecode(unsigned int _index, int &o_x, int &o_y)
+  {
+    o_x=0;
+    o_y=0;
+    for(int bit=0; bit<16; ++bit)
+    {
+      o_x|=static_cast<int>((_index>>(2*bit))&1u)<<bit;
+      o_y|=static_cast<int>((_index>>(2*bit+1))&1u)<<bit;
+    }
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+ShadowAtlas::~ShadowAtlas()
+{
+  destroy();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShadowAtlas::destroy()
+{
+  if(m_texture!=0)
+  {
+    glDeleteTextures(1,&m_texture);
+    glDeleteFramebuffers(1,&m_fbo);
+    m_texture=0;
+    m_fbo=0;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+float ShadowAtlas::range(const ShadowLight &_light)
+{
+  // solve 1/(1+linear d+quadratic d^2)=cutoff for d
+  float c=1.0f/ATTENUATION_CUTOFF-1.0f;
+  float d=MAX_RANGE;
+  if(_light.quadratic>0.0f)
+  {
+    d=(-_light.linear+std::sqrt(_light.linear*_light.linear+4.0f*_light.quadratic*c))/(2.0f*_light.quadratic);
+  }
+  else if(_light.linear>0.0f)
+  {
+    d=c/_light.linear;
+  }
+  return std::min(d,MAX_RANGE);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+float ShadowAtlas::influence(const ShadowLight &_light, float _range, const ngl::Mat4 &_view, const ngl::Mat4 &_projection)
+{
+  if(_light.type==ShadowLight::Type::DIRECTIONAL)
+  {
+    return 1.0f;
+  }
+  Frustum frustum=Frustum::fromMatrix(_view*_projection);
+  if(!frustum.sphereVisible(_light.position.m_x,_light.position.m_y,_light.position.m_z,_range))
+  {
+    return 0.0f;
+  }
+  float distance=transformPoint(_view,_light.position).length();
+  if(distance<=_range)
+  {
+    return 1.0f;
+  }
+  // the projected circle's radius in normalised device y, x is squeezed by the aspect ratio
+  float radius=_projection.m_m[1][1]*_range/std::sqrt(distance*distance-_range*_range);
+  float aspect=_projection.m_m[1][1]/_projection.m_m[0][0];
+  return std::min(1.0f,static_cast<float>(M_PI)*radius*radius/(4.0f*aspect));
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShadowAtlas::addView(int _light, const ngl::Mat4 &_view, const ngl::Mat4 &_projection, float _near, float _far, int _size)
+{
+  View view;
+  view.VP=_view*_projection;
+  // the view space z row, scaled so near is 0 and far is 1
+  float scale=1.0f/(_far-_near);
+  view.depthPlane=ngl::Vec4(-_view.m_m[0][2]*scale,-_view.m_m[1][2]*scale,-_view.m_m[2][2]*scale,(-_view.m_m[3][2]-_near)*scale);
+  view.light=_light;
+  view.layer=0;
+  view.x=0;
+  view.y=0;
+  view.size=_size;
+  m_views.push_back(view);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShadowAtlas::update(const std::vector<ShadowLight> &_lights, const ngl::Mat4 &_view, const ngl::Mat4 &_projection,
+                         const float _sceneMin[3], const float _sceneMax[3])
+{
+  m_views.clear();
+  // padded so a flat scene still gives a box with some depth
+  ngl::Vec3 sceneMin(_sceneMin[0]-NEAR_PLANE,_sceneMin[1]-NEAR_PLANE,_sceneMin[2]-NEAR_PLANE);
+  ngl::Vec3 sceneMax(_sceneMax[0]+NEAR_PLANE,_sceneMax[1]+NEAR_PLANE,_sceneMax[2]+NEAR_PLANE);
+  ngl::Vec3 centre=(sceneMin+sceneMax)*0.5f;
+  float sceneRadius=(sceneMax-sceneMin).length()*0.5f;
+  m_casterVP=ortho(sceneMin.m_x,sceneMax.m_x,sceneMin.m_y,sceneMax.m_y,-sceneMax.m_z,-sceneMin.m_z);
+
+  int minTile=std::max(m_layerSize/MIN_TILE_DIVISOR,1);
+  for(int light=0; light<MAX_LIGHTS; ++light)
+  {
+    m_firstView[light]=static_cast<int>(m_views.size());
+    m_viewCount[light]=0;
+    if(light>=static_cast<int>(_lights.size()))
+    {
+      continue;
+    }
+    const ShadowLight &shadowLight=_lights[light];
+    int views=shadowLight.type==ShadowLight::Type::POINT ? 6 : 1;
+    if(static_cast<int>(m_views.size())+views>MAX_VIEWS)
+    {
+      // the layered pass has a fixed number of invocations, this light goes without
+      continue;
+    }
+    float reach=range(shadowLight);
+    // the tile's side follows the square root of the screen area so texels per pixel stay similar
+    float share=std::sqrt(influence(shadowLight,reach,_view,_projection));
+    int size=minTile;
+    while(size<m_layerSize && size<share*m_layerSize)
+    {
+      size*=2;
+    }
+    ngl::Camera camera;
+    switch(shadowLight.type)
+    {
+      case ShadowLight::Type::SPOT :
+      {
+        // nothing past the far side of the scene needs depth precision
+        float far=std::min(reach,(shadowLight.position-centre).length()+sceneRadius);
+        camera.set(shadowLight.position,ngl::Vec3(0,0,0),ngl::Vec3(0,1,0));
+        camera.setShape(SPOT_FOV,1.0f,NEAR_PLANE,far);
+        addView(light,camera.getViewMatrix(),camera.getProjectionMatrix(),NEAR_PLANE,far,size);
+        break;
+      }
+      case ShadowLight::Type::POINT :
+      {
+        const ngl::Vec3 axes[6]={{1,0,0},{-1,0,0},{0,1,0},{0,-1,0},{0,0,1},{0,0,-1}};
+        const ngl::Vec3 ups[6]={{0,1,0},{0,1,0},{0,0,1},{0,0,-1},{0,1,0},{0,1,0}};
+        for(int face=0; face<6; ++face)
+        {
+          camera.set(shadowLight.position,shadowLight.position+axes[face],ups[face]);
+          camera.setShape(CUBE_FACE_FOV,1.0f,NEAR_PLANE,reach);
+          addView(light,camera.getViewMatrix(),camera.getProjectionMatrix(),NEAR_PLANE,reach,size);
+        }
+        break;
+      }
+      case ShadowLight::Type::DIRECTIONAL :
+      {
+        // an orthographic box fitted around the scene as seen along the light
+        ngl::Vec3 direction=shadowLight.position;
+        direction.normalize();
+        ngl::Vec3 up=std::fabs(direction.m_y)>0.99f ? ngl::Vec3(0,0,1) : ngl::Vec3(0,1,0);
+        camera.set(centre+direction*(2.0f*sceneRadius),centre,up);
+        ngl::Mat4 view=camera.getViewMatrix();
+        ngl::Vec3 lo(1e30f,1e30f,1e30f);
+        ngl::Vec3 hi(-1e30f,-1e30f,-1e30f);
+        for(int corner=0; corner<8; ++corner)
+        {
+          ngl::Vec3 p((corner&1) ? sceneMax.m_x : sceneMin.m_x,(corner&2) ? sceneMax.m_y : sceneMin.m_y,(corner&4) ? sceneMax.m_z : sceneMin.m_z);
+          ngl::Vec3 v=transformPoint(view,p);
+          for(int axis=0; axis<3; ++axis)
+          {
+            lo[axis]=std::min(lo[axis],v[axis]);
+            hi[axis]=std::max(hi[axis],v[axis]);
+          }
+        }
+        // the view looks down -z so the nearest corner has the largest z
+        float near=-hi.m_z;
+        float far=-lo.m_z;
+        addView(light,view,ortho(lo.m_x,hi.m_x,lo.m_y,hi.m_y,near,far),near,far,size);
+        break;
+      }
+    }
+    m_viewCount[light]=static_cast<int>(m_views.size())-m_firstView[light];
+  }
+  pack();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShadowAtlas::pack()
+{
+  // largest first along a z order curve, each layer is filled before the next is started
+  std::vector<size_t> order(m_views.size());
+  std::iota(order.begin(),order.end(),0);
+  std::stable_sort(order.begin(),order.end(),[this](size_t _a, size_t _b){ return m_views[_a].size>m_views[_b].size; });
+  int minTile=std::max(m_layerSize/MIN_TILE_DIVISOR,1);
+  unsigned int cellsPerLayer=static_cast<unsigned int>(MIN_TILE_DIVISOR*MIN_TILE_DIVISOR);
+  unsigned int cursor=0;
+  int layer=0;
+  for(size_t index : order)
+  {
+    View &view=m_views[index];
+    unsigned int side=static_cast<unsigned int>(view.size/minTile);
+    unsigned int cells=side*side;
+    if(cursor+cells>cellsPerLayer)
+    {
+      ++layer;
+      cursor=0;
+    }
+    int x,y;
+    mortonDecode(cursor,x,y);
+    view.layer=layer;
+    view.x=x*minTile;
+    view.y=y*minTile;
+    cursor+=cells;
+  }
+  m_usedLayers=m_views.empty() ? 0 : layer+1;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool ShadowAtlas::allocate()
+{
+  if(m_texture!=0 && m_allocatedSize==m_layerSize && m_allocatedLayers>=m_usedLayers)
+  {
+    return false;
+  }
+  if(m_texture!=0)
+  {
+    glDeleteTextures(1,&m_texture);
+    glDeleteFramebuffers(1,&m_fbo);
+  }
+  m_allocatedSize=m_layerSize;
+  m_allocatedLayers=std::max(m_usedLayers,1);
+  glGenTextures(1,&m_texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,m_texture);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY,1,GL_DEPTH_COMPONENT32F,m_layerSize,m_layerSize,m_allocatedLayers);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D_ARRAY,0);
+
+  // every layer is attached so the geometry shader can pick one with gl_Layer
+  glGenFramebuffers(1,&m_fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER,m_fbo);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  glFramebufferTexture(GL_FRAMEBUFFER,GL_DEPTH_ATTACHMENT,m_texture,0);
+  glBindFramebuffer(GL_FRAMEBUFFER,0);
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+float ShadowAtlas::usage() const
+{
+  if(m_usedLayers==0)
+  {
+    return 0.0f;
+  }
+  double used=0.0;
+  for(auto &view : m_views)
+  {
+    used+=static_cast<double>(view.size)*view.size;
+  }
+  return static_cast<float>(used/(static_cast<double>(m_layerSize)*m_layerSize*m_usedLayers));
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+std::string ShadowAtlas::report() const
+{
+  std::stringstream out;
+  out<<"atlas "<<m_usedLayers<<"/"<<m_allocatedLayers<<" layers of "<<m_layerSize
+     <<" "<<static_cast<int>(usage()*100.0f+0.5f)<<"% used ";
+  for(int light=0; light<MAX_LIGHTS; ++light)
+  {
+    if(m_viewCount[light]==0)
+    {
+      continue;
+    }
+    out<<" light"<<light<<" ";
+    if(m_viewCount[light]>1)
+    {
+      out<<m_viewCount[light]<<"x";
+    }
+    out<<m_views[m_firstView[light]].size;
+  }
+  return out.str();
+}
@@ -0,0 +1,495 @@
+#include "ShardCoordinator.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocalSocket>
+#include <QProcess>
+#include <QStringList>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief how often a worker that isn't listening yet is tried again, and how long each try waits
+//----------------------------------------------------------------------------------------------------------------------
+constexpr int CONNECT_RETRY_MS=100;
+constexpr int CONNECT_WAIT_MS=50;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the camera path, one orbit of the shelf at this radius and height
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float ORBIT_RADIUS=5.0f;
+constexpr float ORBIT_HEIGHT=1.5f;
+
+//________________________________________________________________________________________________________________________________________//
+
+ShardCoordinator::ShardCoordinator(const Settings &_settings) : m_settings(_settings)
+{
+  m_settings.workers=std::max(m_settings.workers,1);
+  m_settings.inFlight=std::max(m_settings.inFlight,1);
+  QObject::connect(&m_watchdog,&QTimer::timeout,[this](){ watchdog(); });
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+ShardCoordinator::~ShardCoordinator()
+{
+  m_finishing=true;
+  for(auto &worker : m_workers)
+  {
+    retire(*worker);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+QByteArray ShardCoordinator::frameJob(int _frame) const
+{
+  float angle=6.2831853f*float(_frame)/float(std::max(m_settings.frames,1));
+  QJsonObject job;
+  job["id"]=_frame;
+  // the server wraps the label to its catalogue, so the cans change as the camera goes round
+  job["label"]=_frame;
+  job["eye"]=QJsonArray{ORBIT_RADIUS*std::sin(angle),ORBIT_HEIGHT,ORBIT_RADIUS*std::cos(angle)};
+  job["look"]=QJsonArray{0.0f,1.0f,0.0f};
+  job["width"]=m_settings.width;
+  job["height"]=m_settings.height;
+  return QJsonDocument(job).toJson(QJsonDocument::Compact)+"\n";
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShardCoordinator::launch(Worker &_worker)
+{
+  ++_worker.generation;
+  _worker.name=QString("can_shard_%1_%2_%3").arg(QCoreApplication::applicationPid())
+                                            .arg(_worker.index).arg(_worker.generation);
+  Worker *worker=&_worker;
+  QProcess *process=new QProcess;
+  _worker.process=process;
+  // the servers report every second, only their errors are wanted here
+  process->setStandardOutputFile(QProcess::nullDevice());
+  process->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+  QObject::connect(process,static_cast<void (QProcess::*)(int,QProcess::ExitStatus)>(&QProcess::finished),
+                   [this,worker,process](int _code, QProcess::ExitStatus)
+  {
+    if(worker->process==process)
+    {
+      lost(*worker,_code==0 ? "exited" : "crashed");
+    }
+  });
+  process->start(QCoreApplication::applicationFilePath(),
+                 QStringList{"--serve",_worker.name,QString::number(m_settings.width),QString::number(m_settings.height)});
+  _worker.progress.start();
+  if(!process->waitForStarted())
+  {
+    std::printf("worker %d could not be started\n",_worker.index);
+    _worker.process=nullptr;
+    process->deleteLater();
+    _worker.dead=true;
+    return;
+  }
+  // the server takes a while to load the scene before it listens
+  int generation=_worker.generation;
+  QTimer::singleShot(CONNECT_RETRY_MS,[this,worker,generation]()
+  {
+    if(worker->generation==generation)
+    {
+      connectWorker(*worker);
+    }
+  });
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShardCoordinator::connectWorker(Worker &_worker)
+{
+  if(_worker.process==nullptr || _worker.ready || _worker.dead || m_finishing)
+  {
+    return;
+  }
+  Worker *worker=&_worker;
+  QLocalSocket *socket=new QLocalSocket;
+  socket->connectToServer(_worker.name);
+  if(!socket->waitForConnected(CONNECT_WAIT_MS))
+  {
+    delete socket;
+    int generation=_worker.generation;
+    QTimer::singleShot(CONNECT_RETRY_MS,[this,worker,generation]()
+    {
+      if(worker->generation==generation)
+      {
+        connectWorker(*worker);
+      }
+    });
+    return;
+  }
+  _worker.socket=socket;
+  _worker.ready=true;
+  _worker.progress.restart();
+  if(m_firstReady<0)
+  {
+    m_firstReady=m_clock.nsecsElapsed();
+  }
+  QObject::connect(socket,&QLocalSocket::readyRead,[this,worker,socket]()
+  {
+    if(worker->socket==socket)
+    {
+      readResults(*worker);
+    }
+  });
+  QObject::connect(socket,&QLocalSocket::disconnected,[this,worker,socket]()
+  {
+    if(worker->socket==socket)
+    {
+      lost(*worker,"dropped its connection");
+    }
+  });
+  dispatch(_worker);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShardCoordinator::dispatch(Worker &_worker)
+{
+  if(!_worker.ready || m_finishing)
+  {
+    return;
+  }
+  if(_worker.outstanding.empty())
+  {
+    _worker.progress.restart();
+  }
+  bool sent=false;
+  while(static_cast<int>(_worker.outstanding.size())<m_settings.inFlight && !m_queue.empty())
+  {
+    int frame=m_queue.front();
+    m_queue.pop_front();
+    _worker.outstanding.insert(frame);
+    ++m_attempts[frame];
+    ++m_dispatched;
+    _worker.socket->write(frameJob(frame));
+    sent=true;
+  }
+  if(sent)
+  {
+    _worker.socket->flush();
+  }
+  if(m_settings.killOne && !m_killed && m_dispatched>=m_settings.frames/2 && !_worker.outstanding.empty())
+  {
+    m_killed=true;
+    std::printf("killing worker %d with %zu frames outstanding\n",_worker.index,_worker.outstanding.size());
+    _worker.process->kill();
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShardCoordinator::dispatchAll()
+{
+  for(auto &worker : m_workers)
+  {
+    dispatch(*worker);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShardCoordinator::readResults(Worker &_worker)
+{
+  _worker.pending+=_worker.socket->readAll();
+  while(!m_finishing)
+  {
+    if(_worker.expectBytes<0)
+    {
+      int end=_worker.pending.indexOf('\n');
+      if(end<0)
+      {
+        break;
+      }
+      QJsonObject header=QJsonDocument::fromJson(_worker.pending.left(end)).object();
+      _worker.pending.remove(0,end+1);
+      int frame=header["id"].toInt();
+      if(_worker.outstanding.count(frame)==0)
+      {
+        // a stats line or a frame already given to someone else
+        continue;
+      }
+      if(header["status"].toString()!="ok")
+      {
+        _worker.outstanding.erase(frame);
+        requeue(frame);
+        continue;
+      }
+      _worker.frame=frame;
+      _worker.expectBytes=header["bytes"].toInt();
+    }
+    if(_worker.pending.size()<_worker.expectBytes)
+    {
+      break;
+    }
+    QByteArray image=_worker.pending.left(_worker.expectBytes);
+    _worker.pending.remove(0,_worker.expectBytes);
+    _worker.outstanding.erase(_worker.frame);
+    ++_worker.rendered;
+    _worker.progress.restart();
+    int frame=_worker.frame;
+    _worker.frame=-1;
+    _worker.expectBytes=-1;
+    finishFrame(frame,image);
+  }
+  dispatch(_worker);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShardCoordinator::requeue(int _frame)
+{
+  if(m_attempts[_frame]>=MAX_ATTEMPTS)
+  {
+    std::printf("frame %d failed %d times, giving up\n",_frame,m_attempts[_frame]);
+    finish(false);
+    return;
+  }
+  // at the front so the frames holding up the writer go first
+  m_queue.push_front(_frame);
+  ++m_result.reissued;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShardCoordinator::retire(Worker &_worker)
+{
+  _worker.ready=false;
+  _worker.pending.clear();
+  _worker.frame=-1;
+  _worker.expectBytes=-1;
+  QLocalSocket *socket=_worker.socket;
+  QProcess *process=_worker.process;
+  // cleared first so the signals closing them raise are ignored
+  _worker.socket=nullptr;
+  _worker.process=nullptr;
+  if(socket!=nullptr)
+  {
+    socket->abort();
+    socket->deleteLater();
+  }
+  if(process!=nullptr)
+  {
+    if(process->state()!=QProcess::NotRunning)
+    {
+      process->kill();
+      process->waitForFinished(1000);
+    }
+    process->deleteLater();
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShardCoordinator::lost(Worker &_worker, const char *_why)
+{
+  if(m_finishing || _worker.dead)
+  {
+    return;
+  }
+  std::vector<int> frames(_worker.outstanding.begin(),_worker.outstanding.end());
+  std::printf("worker %d %s, reissuing %zu frames\n",_worker.index,_why,frames.size());
+  _worker.outstanding.clear();
+  retire(_worker);
+  // pushed to the front in reverse so they go out lowest first
+  for(auto frame=frames.rbegin(); frame!=frames.rend() && !m_finishing; ++frame)
+  {
+    requeue(*frame);
+  }
+  if(m_finishing)
+  {
+    return;
+  }
+  if(_worker.restarts<m_settings.maxRestarts)
+  {
+    ++_worker.restarts;
+    ++m_result.restarts;
+    launch(_worker);
+  }
+  else
+  {
+    _worker.dead=true;
+  }
+  bool anyAlive=std::any_of(m_workers.begin(),m_workers.end(),[](const std::unique_ptr<Worker> &_w){ return !_w->dead; });
+  if(!anyAlive)
+  {
+    std::printf("every worker has failed\n");
+    finish(false);
+    return;
+  }
+  dispatchAll();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShardCoordinator::finishFrame(int _frame, const QByteArray &_image)
+{
+  if(m_done[_frame])
+  {
+    return;
+  }
+  m_done[_frame]=true;
+  m_reorder[_frame]=_image;
+  m_result.maxReorder=std::max(m_result.maxReorder,m_reorder.size());
+  while(!m_reorder.empty() && m_reorder.begin()->first==m_nextOut)
+  {
+    if(!m_settings.outDir.isEmpty())
+    {
+      QFile file(QString("%1/frame_%2.png").arg(m_settings.outDir).arg(m_nextOut,5,10,QChar('0')));
+      if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(m_reorder.begin()->second)<0)
+      {
+        std::printf("could not write frame %d to %s\n",m_nextOut,m_settings.outDir.toStdString().c_str());
+        finish(false);
+        return;
+      }
+    }
+    m_reorder.erase(m_reorder.begin());
+    ++m_nextOut;
+    ++m_result.frames;
+  }
+  if(m_nextOut==m_settings.frames)
+  {
+    finish(true);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShardCoordinator::watchdog()
+{
+  for(auto &worker : m_workers)
+  {
+    // a server still loading counts as stalled too if it never starts listening
+    bool waiting=!worker->ready || !worker->outstanding.empty();
+    if(!worker->dead && worker->process!=nullptr && waiting && worker->progress.elapsed()>STALL_MS)
+    {
+      lost(*worker,"stalled");
+    }
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShardCoordinator::finish(bool _ok)
+{
+  if(m_finishing)
+  {
+    return;
+  }
+  m_finishing=true;
+  m_result.ok=_ok;
+  if(m_loop!=nullptr)
+  {
+    m_loop->quit();
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+ShardCoordinator::Result ShardCoordinator::run()
+{
+  m_clock.start();
+  if(!m_settings.outDir.isEmpty())
+  {
+    QDir().mkpath(m_settings.outDir);
+  }
+  for(int frame=0; frame<m_settings.frames; ++frame)
+  {
+    m_queue.push_back(frame);
+  }
+  m_attempts.assign(static_cast<size_t>(m_settings.frames),0);
+  m_done.assign(static_cast<size_t>(m_settings.frames),false);
+  for(int i=0; i<m_settings.workers; ++i)
+  {
+    m_workers.emplace_back(new Worker);
+    m_workers.back()->index=i;
+    launch(*m_workers.back());
+  }
+  bool anyAlive=std::any_of(m_workers.begin(),m_workers.end(),[](const std::unique_ptr<Worker> &_w){ return !_w->dead; });
+  if(m_settings.frames==0)
+  {
+    m_result.ok=true;
+  }
+  else if(anyAlive)
+  {
+    QEventLoop loop;
+    m_loop=&loop;
+    m_watchdog.start(1000);
+    loop.exec();
+    m_watchdog.stop();
+    m_loop=nullptr;
+  }
+  m_finishing=true;
+
+  qint64 end=m_clock.nsecsElapsed();
+  m_result.seconds=end*1e-9;
+  m_result.renderSeconds=m_firstReady>=0 ? (end-m_firstReady)*1e-9 : 0.0;
+  for(auto &worker : m_workers)
+  {
+    m_result.perWorker.push_back(worker->rendered);
+    retire(*worker);
+  }
+  return m_result;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void ShardCoordinator::print(const Settings &_settings, const Result &_result, double _baseline)
+{
+  double fps=_result.renderSeconds>0.0 ? _result.frames/_result.renderSeconds : 0.0;
+  std::printf("%2d workers: %d/%d frames in %.2f s (%.2f s after the first worker was ready) %.2f frames/s",
+              _settings.workers,_result.frames,_settings.frames,_result.seconds,_result.renderSeconds,fps);
+  if(_baseline>0.0)
+  {
+    double speedUp=fps/_baseline;
+    std::printf(", %.2fx (%.0f%% efficient)",speedUp,100.0*speedUp/_settings.workers);
+  }
+  std::printf("\n            reissued %d restarts %d, at most %zu frames held for ordering, per worker",
+              _result.reissued,_result.restarts,_result.maxReorder);
+  for(int frames : _result.perWorker)
+  {
+    std::printf(" %d",frames);
+  }
+  std::printf("%s\n",_result.ok ? "" : " FAILED");
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int ShardCoordinator::scaling(Settings _settings)
+{
+  int maxWorkers=std::max(_settings.workers,1);
+  std::vector<int> counts;
+  for(int count=1; count<maxWorkers; count*=2)
+  {
+    counts.push_back(count);
+  }
+  counts.push_back(maxWorkers);
+  // only the time matters, nothing is written
+  _settings.outDir=QString();
+  std::printf("%d frames at %dx%d, %d in flight per worker\n",_settings.frames,_settings.width,_settings.height,_settings.inFlight);
+  double baseline=0.0;
+  bool ok=true;
+  for(int count : counts)
+  {
+    _settings.workers=count;
+    ShardCoordinator coordinator(_settings);
+    Result result=coordinator.run();
+    if(count==1 && result.renderSeconds>0.0)
+    {
+      baseline=result.frames/result.renderSeconds;
+    }
+    print(_settings,result,count==1 ? 0.0 : baseline);
+    ok&=result.ok;
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,212 @@
+#include "StreamBuffer.h"
+#include <QOpenGLContext>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief how long each wait on a fence blocks for before trying again, in nanoseconds
+//----------------------------------------------------------------------------------------------------------------------
+constexpr GLuint64 FENCE_WAIT_NS=1000000;
+
+//________________________________________________________________________________________________________________________________________//
+
+StreamBuffer::~StreamBuffer()
+{
+  destroy();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void StreamBuffer::create(GLenum _target, size_t _regionSize, bool _persistent)
+{
+  destroy();
+  m_target=_target;
+  GLint alignment=256;
+  glGetIntegerv(_target==GL_SHADER_STORAGE_BUFFER ? GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT : GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT,&alignment);
+  m_alignment=static_cast<size_t>(std::max(alignment,1));
+  m_regionSize=(_regionSize+m_alignment-1)/m_alignment*m_alignment;
+  size_t size=m_regionSize*REGIONS;
+
+  QOpenGLContext *context=QOpenGLContext::currentContext();
+  bool storage=false;
+  if(context!=nullptr)
+  {
+    QSurfaceFormat format=context->format();
+    storage=format.majorVersion()*10+format.minorVersion()>=44 || context->hasExtension("GL_ARB_buffer_storage");
+  }
+  if(_persistent && !storage)
+  {
+    std::cerr<<"GL_ARB_buffer_storage not supported, streaming with glBufferSubData\n";
+  }
+  glGenBuffers(1,&m_buffer);
+  glBindBuffer(m_target,m_buffer);
+  if(_persistent && storage)
+  {
+    // never unmapped, coherent so the writes need no flush before the draws that read them
+    GLbitfield flags=GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(m_target,static_cast<GLsizeiptr>(size),nullptr,flags);
+    m_mapped=static_cast<char *>(glMapBufferRange(m_target,0,static_cast<GLsizeiptr>(size),flags));
+  }
+  else
+  {
+    glBufferData(m_target,static_cast<GLsizeiptr>(size),nullptr,GL_STREAM_DRAW);
+  }
+  glBindBuffer(m_target,0);
+  m_region=0;
+  m_head=0;
+  m_stats=Stats();
+  m_windowBytes=0;
+  m_windowStart=std::chrono::steady_clock::now();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void StreamBuffer::destroy()
+{
+  for(auto &fence : m_fences)
+  {
+    if(fence!=nullptr)
+    {
+      glDeleteSync(fence);
+      fence=nullptr;
+    }
+  }
+  if(m_buffer!=0)
+  {
+    if(m_mapped!=nullptr)
+    {
+      glBindBuffer(m_target,m_buffer);
+      glUnmapBuffer(m_target);
+      glBindBuffer(m_target,0);
+      m_mapped=nullptr;
+    }
+    glDeleteBuffers(1,&m_buffer);
+    m_buffer=0;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void StreamBuffer::beginFrame()
+{
+  nextRegion();
+  m_stats.frameBytes=0;
+  m_stats.frameStalls=0;
+  m_stats.frameAllocations=0;
+
+  auto now=std::chrono::steady_clock::now();
+  float seconds=std::chrono::duration<float>(now-m_windowStart).count();
+  if(seconds>=1.0f)
+  {
+    m_stats.uploadMBps=float(m_windowBytes)/(1024.0f*1024.0f)/seconds;
+    m_windowBytes=0;
+    m_windowStart=now;
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void StreamBuffer::nextRegion()
+{
+  // everything drawn so far reads from the current region, nothing after this will
+  if(m_fences[m_region]!=nullptr)
+  {
+    glDeleteSync(m_fences[m_region]);
+  }
+  m_fences[m_region]=glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,0);
+  m_region=(m_region+1)%REGIONS;
+  m_head=0;
+  ++m_generation;
+
+  GLsync &fence=m_fences[m_region];
+  if(fence==nullptr)
+  {
+    return;
+  }
+  // a zero timeout only asks, the flush on the blocking waits makes sure the fence is submitted
+  GLenum result=glClientWaitSync(fence,0,0);
+  if(result==GL_TIMEOUT_EXPIRED)
+  {
+    auto start=std::chrono::steady_clock::now();
+    do
+    {
+      result=glClientWaitSync(fence,GL_SYNC_FLUSH_COMMANDS_BIT,FENCE_WAIT_NS);
+    }
+    while(result==GL_TIMEOUT_EXPIRED);
+    m_stats.stallTime+=std::chrono::duration<float,std::milli>(std::chrono::steady_clock::now()-start).count();
+    ++m_stats.frameStalls;
+    ++m_stats.totalStalls;
+  }
+  glDeleteSync(fence);
+  fence=nullptr;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+StreamBuffer::Allocation StreamBuffer::allocate(size_t _size)
+{
+  Allocation allocation;
+  size_t aligned=(_size+m_alignment-1)/m_alignment*m_alignment;
+  if(m_buffer==0 || aligned>m_regionSize)
+  {
+    return allocation;
+  }
+  if(m_head+aligned>m_regionSize)
+  {
+    ++m_stats.overflows;
+    nextRegion();
+  }
+  allocation.offset=static_cast<GLintptr>(m_region*m_regionSize+m_head);
+  allocation.size=static_cast<GLsizeiptr>(_size);
+  allocation.data=m_mapped!=nullptr ? m_mapped+allocation.offset : nullptr;
+  m_head+=aligned;
+  m_stats.frameBytes+=_size;
+  m_stats.totalBytes+=_size;
+  m_windowBytes+=_size;
+  ++m_stats.frameAllocations;
+  return allocation;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+StreamBuffer::Allocation StreamBuffer::write(const void *_data, size_t _size)
+{
+  Allocation allocation=allocate(_size);
+  if(!allocation.valid())
+  {
+    return allocation;
+  }
+  if(m_mapped!=nullptr)
+  {
+    std::memcpy(allocation.data,_data,_size);
+  }
+  else
+  {
+    // the range is never one the GPU is still reading but the driver can't know that, it may
+    // still copy the data or wait
+    glBindBuffer(m_target,m_buffer);
+    glBufferSubData(m_target,allocation.offset,allocation.size,_data);
+    glBindBuffer(m_target,0);
+  }
+  return allocation;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void StreamBuffer::bind(GLuint _binding, const Allocation &_allocation) const
+{
+  glBindBufferRange(m_target,_binding,m_buffer,_allocation.offset,_allocation.size);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+std::string StreamBuffer::report() const
+{
+  std::ostringstream out;
+  out<<"stream "<<(persistent() ? "persistent" : "sub data")<<" "<<m_stats.frameAllocations<<" blocks "
+     <<m_stats.frameBytes/1024<<" KB/frame of "<<m_regionSize/1024<<" KB, "<<m_stats.uploadMBps<<" MB/s, stalls "
+     <<m_stats.totalStalls<<" ("<<m_stats.stallTime<<" ms) overflows "<<m_stats.overflows;
+  return out.str();
+}
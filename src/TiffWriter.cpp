@@ -0,0 +1,198 @@
+#include "TiffWriter.h"
+#include <algorithm>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the field types used in the directory
+//----------------------------------------------------------------------------------------------------------------------
+constexpr uint16_t TIFF_SHORT=3;
+constexpr uint16_t TIFF_LONG=4;
+constexpr uint16_t TIFF_RATIONAL=5;
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the resolution written in the header, only a hint for print layouts
+//----------------------------------------------------------------------------------------------------------------------
+constexpr uint32_t DOTS_PER_INCH=300;
+
+//________________________________________________________________________________________________________________________________________//
+
+static void put16(std::vector<uint8_t> &io_data, size_t _at, uint32_t _value)
+{
+  io_data[_at]=static_cast<uint8_t>(_value);
+  io_data[_at+1]=static_cast<uint8_t>(_value>>8);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+static void put32(std::vector<uint8_t> &io_data, size_t _at, uint32_t _value)
+{
+  put16(io_data,_at,_value&0xffff);
+  put16(io_data,_at+2,_value>>16);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief pwrite all of _size bytes, it may write less than asked
+//----------------------------------------------------------------------------------------------------------------------
+static bool writeAll(int _fd, const uint8_t *_data, size_t _size, uint64_t _offset)
+{
+  while(_size>0)
+  {
+    ssize_t written=pwrite(_fd,_data,_size,static_cast<off_t>(_offset));
+    if(written<=0)
+    {
+      return false;
+    }
+    _data+=written;
+    _size-=static_cast<size_t>(written);
+    _offset+=static_cast<uint64_t>(written);
+  }
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+TiffWriter::~TiffWriter()
+{
+  close();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool TiffWriter::open(const std::string &_file, uint32_t _width, uint32_t _height, uint32_t _rowsPerStrip)
+{
+  close();
+  _rowsPerStrip=std::max(1u,std::min(_rowsPerStrip,_height));
+  uint32_t strips=(_height+_rowsPerStrip-1)/_rowsPerStrip;
+  uint64_t stripBytes=uint64_t(_width)*_rowsPerStrip*3;
+
+  // the directory straight after the header, then the values too big to go in it
+  constexpr size_t ENTRIES=13;
+  constexpr size_t IFD=8;
+  size_t bitsAt=IFD+2+ENTRIES*12+4;
+  size_t xResAt=bitsAt+8;
+  size_t yResAt=xResAt+8;
+  size_t offsetsAt=yResAt+8;
+  size_t countsAt=offsetsAt+(strips>1 ? strips*4 : 0);
+  size_t headerSize=countsAt+(strips>1 ? strips*4 : 0);
+  m_dataOffset=(headerSize+15)/16*16;
+  m_width=_width;
+  m_height=_height;
+  if(_width==0 || _height==0 || fileSize()>0xffffffffULL)
+  {
+    std::cerr<<"TiffWriter "<<_width<<"x"<<_height<<" is too big for a classic TIFF\n";
+    return false;
+  }
+
+  std::vector<uint8_t> header(m_dataOffset,0);
+  header[0]='I';
+  header[1]='I';
+  put16(header,2,42);
+  put32(header,4,IFD);
+  put16(header,IFD,ENTRIES);
+  size_t entry=IFD+2;
+  auto field=[&](uint16_t _tag, uint16_t _type, uint32_t _count, uint32_t _value)
+  {
+    put16(header,entry,_tag);
+    put16(header,entry+2,_type);
+    put32(header,entry+4,_count);
+    put32(header,entry+8,_value);
+    entry+=12;
+  };
+  // in ascending tag order as the spec asks
+  field(256,TIFF_LONG,1,_width);
+  field(257,TIFF_LONG,1,_height);
+  field(258,TIFF_SHORT,3,static_cast<uint32_t>(bitsAt));
+  field(259,TIFF_SHORT,1,1);
+  field(262,TIFF_SHORT,1,2);
+  field(273,TIFF_LONG,strips,strips>1 ? static_cast<uint32_t>(offsetsAt) : static_cast<uint32_t>(m_dataOffset));
+  field(277,TIFF_SHORT,1,3);
+  field(278,TIFF_LONG,1,_rowsPerStrip);
+  field(279,TIFF_LONG,strips,strips>1 ? static_cast<uint32_t>(countsAt) : static_cast<uint32_t>(uint64_t(_width)*_height*3));
+  field(282,TIFF_RATIONAL,1,static_cast<uint32_t>(xResAt));
+  field(283,TIFF_RATIONAL,1,static_cast<uint32_t>(yResAt));
+  field(284,TIFF_SHORT,1,1);
+  field(296,TIFF_SHORT,1,2);
+  put32(header,entry,0);
+
+  for(int i=0; i<3; ++i)
+  {
+    put16(header,bitsAt+i*2,8);
+  }
+  put32(header,xResAt,DOTS_PER_INCH);
+  put32(header,xResAt+4,1);
+  put32(header,yResAt,DOTS_PER_INCH);
+  put32(header,yResAt+4,1);
+  if(strips>1)
+  {
+    for(uint32_t i=0; i<strips; ++i)
+    {
+      // the last strip only has the rows that are left
+      uint64_t rows=std::min<uint64_t>(_rowsPerStrip,_height-uint64_t(i)*_rowsPerStrip);
+      put32(header,offsetsAt+i*4,static_cast<uint32_t>(m_dataOffset+i*stripBytes));
+      put32(header,countsAt+i*4,static_cast<uint32_t>(rows*_width*3));
+    }
+  }
+
+  m_fd=::open(_file.c_str(),O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,0644);
+  if(m_fd<0)
+  {
+    std::cerr<<"TiffWriter can't create "<<_file<<"\n";
+    return false;
+  }
+  // sized up front so the blocks can land anywhere, the pixels not yet written read as black
+  if(!writeAll(m_fd,header.data(),header.size(),0) || ftruncate(m_fd,static_cast<off_t>(fileSize()))!=0)
+  {
+    std::cerr<<"TiffWriter can't write "<<_file<<"\n";
+    close();
+    return false;
+  }
+  m_written=0;
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool TiffWriter::write(uint32_t _x, uint32_t _y, uint32_t _width, uint32_t _rows, const uint8_t *_pixels, int _channels, bool _bottomUp)
+{
+  if(m_fd<0 || _x>=m_width || _y>=m_height || _channels<3)
+  {
+    return false;
+  }
+  uint32_t width=std::min(_width,m_width-_x);
+  uint32_t rows=std::min(_rows,m_height-_y);
+  m_row.resize(size_t(width)*3);
+  for(uint32_t r=0; r<rows; ++r)
+  {
+    const uint8_t *source=_pixels+size_t(_bottomUp ? _rows-1-r : r)*_width*_channels;
+    for(uint32_t i=0; i<width; ++i)
+    {
+      m_row[i*3]=source[i*_channels];
+      m_row[i*3+1]=source[i*_channels+1];
+      m_row[i*3+2]=source[i*_channels+2];
+    }
+    uint64_t offset=m_dataOffset+(uint64_t(_y+r)*m_width+_x)*3;
+    if(!writeAll(m_fd,m_row.data(),m_row.size(),offset))
+    {
+      return false;
+    }
+    m_written+=m_row.size();
+  }
+  return true;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool TiffWriter::close()
+{
+  if(m_fd<0)
+  {
+    return true;
+  }
+  bool ok=::close(m_fd)==0;
+  m_fd=-1;
+  return ok;
+}
@@ -0,0 +1,302 @@
+#include "TransformBatch.h"
+#include <cmath>
+// the AVX2 functions are compiled for it on their own and only called when the CPU has it, the
+// rest of the file and the tree stay on the baseline instruction set
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRANSFORM_BATCH_AVX2
+#define AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the store keeps rotations in degrees
+//----------------------------------------------------------------------------------------------------------------------
+constexpr float DEG_TO_RAD=static_cast<float>(M_PI/180.0);
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief address of the k'th output
+//----------------------------------------------------------------------------------------------------------------------
+static inline TransformBatch::Matrices *output(TransformBatch::Matrices *_first, size_t _k, size_t _stride)
+{
+  return reinterpret_cast<TransformBatch::Matrices *>(reinterpret_cast<char *>(_first)+_k*_stride);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief one object, used for the tail of a batch and when there is no AVX2. Rotation is x then
+/// y then z in row vector order, so the rows of R=Rx*Ry*Rz are written out directly
+//----------------------------------------------------------------------------------------------------------------------
+static void computeOne(const SceneStore &_store, uint32_t _i, TransformBatch::Matrices &o_out)
+{
+  float sx=std::sin(_store.rotX[_i]*DEG_TO_RAD), cx=std::cos(_store.rotX[_i]*DEG_TO_RAD);
+  float sy=std::sin(_store.rotY[_i]*DEG_TO_RAD), cy=std::cos(_store.rotY[_i]*DEG_TO_RAD);
+  float sz=std::sin(_store.rotZ[_i]*DEG_TO_RAD), cz=std::cos(_store.rotZ[_i]*DEG_TO_RAD);
+  float r[3][3]=
+  {
+    {cy*cz,              cy*sz,              -sy  },
+    {sx*sy*cz-cx*sz,     sx*sy*sz+cx*cz,     sx*cy},
+    {cx*sy*cz+sx*sz,     cx*sy*sz-sx*cz,     cx*cy}
+  };
+  float scale[3]={_store.scaleX[_i],_store.scaleY[_i],_store.scaleZ[_i]};
+  for(int row=0; row<3; ++row)
+  {
+    // world is S*R so each row is scaled, the inverse transpose of that is S^-1*R
+    for(int col=0; col<3; ++col)
+    {
+      o_out.world[row*4+col]=r[row][col]*scale[row];
+      o_out.normal[row*4+col]=r[row][col]/scale[row];
+    }
+    o_out.world[row*4+3]=0.0f;
+    o_out.normal[row*4+3]=0.0f;
+  }
+  o_out.world[12]=_store.posX[_i];
+  o_out.world[13]=_store.posY[_i];
+  o_out.world[14]=_store.posZ[_i];
+  o_out.world[15]=1.0f;
+}
+
+#ifdef TRANSFORM_BATCH_AVX2
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief true if the CPU running us has AVX2, asked once
+//----------------------------------------------------------------------------------------------------------------------
+static bool hasAVX2()
+{
+  static const bool supported=__builtin_cpu_supports("avx2");
+  return supported;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief sine and cosine of 8 angles in radians, the Cephes sinf/cosf range reduction and
+/// polynomials, good to a couple of ulp over the range the scene uses
+//----------------------------------------------------------------------------------------------------------------------
+AVX2_TARGET static inline void sincos8(__m256 _x, __m256 &o_sin, __m256 &o_cos)
+{
+  const __m256 signMask=_mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(0x80000000)));
+  __m256 signSin=_mm256_and_ps(_x,signMask);
+  __m256 x=_mm256_andnot_ps(signMask,_x);
+  // which octant, rounded up to even so the reduced angle is in [-pi/4,pi/4]
+  __m256i j=_mm256_cvttps_epi32(_mm256_mul_ps(x,_mm256_set1_ps(1.27323954473516f)));
+  j=_mm256_and_si256(_mm256_add_epi32(j,_mm256_set1_epi32(1)),_mm256_set1_epi32(~1));
+  __m256 y=_mm256_cvtepi32_ps(j);
+  __m256 swapSin=_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j,_mm256_set1_epi32(4)),29));
+  __m256 polyMask=_mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j,_mm256_set1_epi32(2)),_mm256_setzero_si256()));
+  __m256 signCos=_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_andnot_si256(_mm256_sub_epi32(j,_mm256_set1_epi32(2)),_mm256_set1_epi32(4)),29));
+  signSin=_mm256_xor_ps(signSin,swapSin);
+  // x - y*pi/4 in three parts to keep the precision
+  x=_mm256_add_ps(x,_mm256_mul_ps(y,_mm256_set1_ps(-0.78515625f)));
+  x=_mm256_add_ps(x,_mm256_mul_ps(y,_mm256_set1_ps(-2.4187564849853515625e-4f)));
+  x=_mm256_add_ps(x,_mm256_mul_ps(y,_mm256_set1_ps(-3.77489497744594108e-8f)));
+  __m256 z=_mm256_mul_ps(x,x);
+  __m256 c=_mm256_set1_ps(2.443315711809948e-5f);
+  c=_mm256_add_ps(_mm256_mul_ps(c,z),_mm256_set1_ps(-1.388731625493765e-3f));
+  c=_mm256_add_ps(_mm256_mul_ps(c,z),_mm256_set1_ps(4.166664568298827e-2f));
+  c=_mm256_mul_ps(_mm256_mul_ps(c,z),z);
+  c=_mm256_add_ps(_mm256_sub_ps(c,_mm256_mul_ps(z,_mm256_set1_ps(0.5f))),_mm256_set1_ps(1.0f));
+  __m256 s=_mm256_set1_ps(-1.9515295891e-4f);
+  s=_mm256_add_ps(_mm256_mul_ps(s,z),_mm256_set1_ps(8.3321608736e-3f));
+  s=_mm256_add_ps(_mm256_mul_ps(s,z),_mm256_set1_ps(-1.6666654611e-1f));
+  s=_mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(s,z),x),x);
+  // in odd quadrant pairs the sine and cosine polynomials swap over
+  o_sin=_mm256_xor_ps(_mm256_blendv_ps(c,s,polyMask),signSin);
+  o_cos=_mm256_xor_ps(_mm256_blendv_ps(s,c,polyMask),signCos);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief transpose 8 registers of 8 so register k holds lane k of every input
+//----------------------------------------------------------------------------------------------------------------------
+AVX2_TARGET static inline void transpose8(__m256 io_r[8])
+{
+  __m256 t0=_mm256_unpacklo_ps(io_r[0],io_r[1]);
+  __m256 t1=_mm256_unpackhi_ps(io_r[0],io_r[1]);
+  __m256 t2=_mm256_unpacklo_ps(io_r[2],io_r[3]);
+  __m256 t3=_mm256_unpackhi_ps(io_r[2],io_r[3]);
+  __m256 t4=_mm256_unpacklo_ps(io_r[4],io_r[5]);
+  __m256 t5=_mm256_unpackhi_ps(io_r[4],io_r[5]);
+  __m256 t6=_mm256_unpacklo_ps(io_r[6],io_r[7]);
+  __m256 t7=_mm256_unpackhi_ps(io_r[6],io_r[7]);
+  __m256 s0=_mm256_shuffle_ps(t0,t2,_MM_SHUFFLE(1,0,1,0));
+  __m256 s1=_mm256_shuffle_ps(t0,t2,_MM_SHUFFLE(3,2,3,2));
+  __m256 s2=_mm256_shuffle_ps(t1,t3,_MM_SHUFFLE(1,0,1,0));
+  __m256 s3=_mm256_shuffle_ps(t1,t3,_MM_SHUFFLE(3,2,3,2));
+  __m256 s4=_mm256_shuffle_ps(t4,t6,_MM_SHUFFLE(1,0,1,0));
+  __m256 s5=_mm256_shuffle_ps(t4,t6,_MM_SHUFFLE(3,2,3,2));
+  __m256 s6=_mm256_shuffle_ps(t5,t7,_MM_SHUFFLE(1,0,1,0));
+  __m256 s7=_mm256_shuffle_ps(t5,t7,_MM_SHUFFLE(3,2,3,2));
+  io_r[0]=_mm256_permute2f128_ps(s0,s4,0x20);
+  io_r[1]=_mm256_permute2f128_ps(s1,s5,0x20);
+  io_r[2]=_mm256_permute2f128_ps(s2,s6,0x20);
+  io_r[3]=_mm256_permute2f128_ps(s3,s7,0x20);
+  io_r[4]=_mm256_permute2f128_ps(s0,s4,0x31);
+  io_r[5]=_mm256_permute2f128_ps(s1,s5,0x31);
+  io_r[6]=_mm256_permute2f128_ps(s2,s6,0x31);
+  io_r[7]=_mm256_permute2f128_ps(s3,s7,0x31);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief _array[_idx[k]] for each lane, a lambda would not get the target attribute
+//----------------------------------------------------------------------------------------------------------------------
+AVX2_TARGET static inline __m256 gather(const std::vector<float> &_array, __m256i _idx)
+{
+  return _mm256_i32gather_ps(_array.data(),_idx,4);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the same as computeOne for the 8 objects _ids[0..7]
+//----------------------------------------------------------------------------------------------------------------------
+AVX2_TARGET static void computeEight(const SceneStore &_store, const uint32_t *_ids, TransformBatch::Matrices *o_out, size_t _stride)
+{
+  __m256i idx=_mm256_loadu_si256(reinterpret_cast<const __m256i *>(_ids));
+  const __m256 toRad=_mm256_set1_ps(DEG_TO_RAD);
+  __m256 sx, cx, sy, cy, sz, cz;
+  sincos8(_mm256_mul_ps(gather(_store.rotX,idx),toRad),sx,cx);
+  sincos8(_mm256_mul_ps(gather(_store.rotY,idx),toRad),sy,cy);
+  sincos8(_mm256_mul_ps(gather(_store.rotZ,idx),toRad),sz,cz);
+  __m256 sxsy=_mm256_mul_ps(sx,sy);
+  __m256 cxsy=_mm256_mul_ps(cx,sy);
+  __m256 r[3][3]=
+  {
+    {_mm256_mul_ps(cy,cz), _mm256_mul_ps(cy,sz), _mm256_sub_ps(_mm256_setzero_ps(),sy)},
+    {_mm256_sub_ps(_mm256_mul_ps(sxsy,cz),_mm256_mul_ps(cx,sz)), _mm256_add_ps(_mm256_mul_ps(sxsy,sz),_mm256_mul_ps(cx,cz)), _mm256_mul_ps(sx,cy)},
+    {_mm256_add_ps(_mm256_mul_ps(cxsy,cz),_mm256_mul_ps(sx,sz)), _mm256_sub_ps(_mm256_mul_ps(cxsy,sz),_mm256_mul_ps(sx,cz)), _mm256_mul_ps(cx,cy)}
+  };
+  __m256 scale[3]={gather(_store.scaleX,idx),gather(_store.scaleY,idx),gather(_store.scaleZ,idx)};
+  const __m256 zero=_mm256_setzero_ps();
+  const __m256 one=_mm256_set1_ps(1.0f);
+
+  // each block of 8 registers is 8 consecutive floats of every object's output
+  __m256 world[2][8];
+  __m256 normal[2][8];
+  for(int row=0; row<3; ++row)
+  {
+    __m256 inv=_mm256_div_ps(one,scale[row]);
+    __m256 *w=&world[row/2][(row%2)*4];
+    __m256 *n=&normal[row/2][(row%2)*4];
+    for(int col=0; col<3; ++col)
+    {
+      w[col]=_mm256_mul_ps(r[row][col],scale[row]);
+      n[col]=_mm256_mul_ps(r[row][col],inv);
+    }
+    w[3]=zero;
+    n[3]=zero;
+  }
+  world[1][4]=gather(_store.posX,idx);
+  world[1][5]=gather(_store.posY,idx);
+  world[1][6]=gather(_store.posZ,idx);
+  world[1][7]=one;
+  for(int i=4; i<8; ++i)
+  {
+    normal[1][i]=zero;
+  }
+  transpose8(world[0]);
+  transpose8(world[1]);
+  transpose8(normal[0]);
+  transpose8(normal[1]);
+  for(int k=0; k<8; ++k)
+  {
+    TransformBatch::Matrices *out=output(o_out,k,_stride);
+    _mm256_storeu_ps(&out->world[0],world[0][k]);
+    _mm256_storeu_ps(&out->world[8],world[1][k]);
+    _mm256_storeu_ps(&out->normal[0],normal[0][k]);
+    _mm_storeu_ps(&out->normal[8],_mm256_castps256_ps128(normal[1][k]));
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief TransformBatch::multiply, each result row is the VP rows weighted by the world row, two
+/// rows per register
+//----------------------------------------------------------------------------------------------------------------------
+AVX2_TARGET static void multiplyAVX2(const char *_world, size_t _worldStride, size_t _count, const ngl::Mat4 &_VP, ngl::Mat4 *o_mvp)
+{
+  __m256 vp[4];
+  for(int k=0; k<4; ++k)
+  {
+    __m128 row=_mm_loadu_ps(_VP.m_m[k]);
+    vp[k]=_mm256_set_m128(row,row);
+  }
+  for(size_t i=0; i<_count; ++i)
+  {
+    const float *w=reinterpret_cast<const float *>(_world+i*_worldStride);
+    for(int half=0; half<2; ++half)
+    {
+      const float *a=w+half*8;
+      const float *b=a+4;
+      __m256 sum=_mm256_mul_ps(_mm256_setr_m128(_mm_set1_ps(a[0]),_mm_set1_ps(b[0])),vp[0]);
+      for(int k=1; k<4; ++k)
+      {
+        sum=_mm256_add_ps(sum,_mm256_mul_ps(_mm256_setr_m128(_mm_set1_ps(a[k]),_mm_set1_ps(b[k])),vp[k]));
+      }
+      _mm256_storeu_ps(&o_mvp[i].m_openGL[half*8],sum);
+    }
+  }
+}
+#endif
+
+//________________________________________________________________________________________________________________________________________//
+
+void TransformBatch::compute(const SceneStore &_store, const uint32_t *_ids, size_t _count, Matrices *o_out, size_t _stride)
+{
+  size_t k=0;
+#ifdef TRANSFORM_BATCH_AVX2
+  if(hasAVX2())
+  {
+    for(; k+8<=_count; k+=8)
+    {
+      computeEight(_store,_ids+k,output(o_out,k,_stride),_stride);
+    }
+  }
+#endif
+  for(; k<_count; ++k)
+  {
+    computeOne(_store,_ids[k],*output(o_out,k,_stride));
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void TransformBatch::multiply(const float *_world, size_t _worldStride, size_t _count, const ngl::Mat4 &_VP, ngl::Mat4 *o_mvp)
+{
+  const char *world=reinterpret_cast<const char *>(_world);
+#ifdef TRANSFORM_BATCH_AVX2
+  if(hasAVX2())
+  {
+    multiplyAVX2(world,_worldStride,_count,_VP,o_mvp);
+    return;
+  }
+#endif
+  for(size_t i=0; i<_count; ++i)
+  {
+    const float *w=reinterpret_cast<const float *>(world+i*_worldStride);
+    for(int row=0; row<4; ++row)
+    {
+      for(int col=0; col<4; ++col)
+      {
+        o_mvp[i].m_m[row][col]=w[row*4]*_VP.m_m[0][col]+w[row*4+1]*_VP.m_m[1][col]+
+                               w[row*4+2]*_VP.m_m[2][col]+w[row*4+3]*_VP.m_m[3][col];
+      }
+    }
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+bool TransformBatch::simd()
+{
+#ifdef TRANSFORM_BATCH_AVX2
+  return hasAVX2();
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,261 @@
+#include "WideBVH.h"
+
+//________________________________________________________________________________________________________________________________________//
+
+void WideBVH::Box::grow(const Box &_box)
+{
+  for(int i=0; i<3; ++i)
+  {
+    min[i]=std::min(min[i],_box.min[i]);
+    max[i]=std::max(max[i],_box.max[i]);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void WideBVH::Box::grow(const float _point[3])
+{
+  for(int i=0; i<3; ++i)
+  {
+    min[i]=std::min(min[i],_point[i]);
+    max[i]=std::max(max[i],_point[i]);
+  }
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+float WideBVH::Box::area() const
+{
+  if(empty())
+  {
+    return 0.0f;
+  }
+  float x=max[0]-min[0];
+  float y=max[1]-min[1];
+  float z=max[2]-min[2];
+  return 2.0f*(x*y+y*z+z*x);
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+void WideBVH::build(const std::vector<Box> &_boxes)
+{
+  uint32_t n=static_cast<uint32_t>(_boxes.size());
+  m_binary.clear();
+  m_nodes.clear();
+  m_order.resize(n);
+  m_bounds=Box();
+  m_rootCount=0;
+  m_sahCost=0.0f;
+  if(n==0)
+  {
+    return;
+  }
+  std::vector<float> centroids(size_t(n)*3);
+  for(uint32_t i=0; i<n; ++i)
+  {
+    m_order[i]=i;
+    m_bounds.grow(_boxes[i]);
+    for(int axis=0; axis<3; ++axis)
+    {
+      centroids[i*3+axis]=0.5f*(_boxes[i].min[axis]+_boxes[i].max[axis]);
+    }
+  }
+  m_binary.reserve(2*n/LEAF_SIZE+1);
+  buildRecursive(_boxes,centroids,0,n,0);
+
+  // the expected cost of a ray through the tree, each node weighted by the chance a ray hits it
+  float rootArea=std::max(m_binary[0].box.area(),1e-12f);
+  for(const BinaryNode &node : m_binary)
+  {
+    m_sahCost+=node.box.area()/rootArea*(node.isLeaf() ? PRIMITIVE_COST*node.count : TRAVERSAL_COST);
+  }
+
+  if(m_binary[0].isLeaf())
+  {
+    m_rootCount=n;
+  }
+  else
+  {
+    m_nodes.reserve(m_binary.size()/2+1);
+    collapse(0);
+  }
+  // only the four wide nodes are traced
+  m_binary.clear();
+  m_binary.shrink_to_fit();
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+int32_t WideBVH::buildRecursive(const std::vector<Box> &_boxes, const std::vector<float> &_centroids, uint32_t _first, uint32_t _count, int _depth)
+{
+  int32_t index=static_cast<int32_t>(m_binary.size());
+  BinaryNode node;
+  node.first=_first;
+  node.count=_count;
+  node.right=-1;
+  Box centroidBox;
+  for(uint32_t i=_first; i<_first+_count; ++i)
+  {
+    node.box.grow(_boxes[m_order[i]]);
+    centroidBox.grow(&_centroids[m_order[i]*3]);
+  }
+  m_binary.push_back(node);
+  if(_count<=1 || _depth>=MAX_DEPTH-1)
+  {
+    return index;
+  }
+
+  // bin the centroids along each axis and sweep the planes between the bins for the cheapest split
+  float bestCost=std::numeric_limits<float>::max();
+  int bestAxis=-1;
+  int bestPlane=0;
+  for(int axis=0; axis<3; ++axis)
+  {
+    float extent=centroidBox.max[axis]-centroidBox.min[axis];
+    if(extent<=0.0f)
+    {
+      continue;
+    }
+    float scale=BINS*(1.0f-1e-6f)/extent;
+    Box binBox[BINS];
+    uint32_t binCount[BINS]={0};
+    for(uint32_t i=_first; i<_first+_count; ++i)
+    {
+      uint32_t primitive=m_order[i];
+      int bin=std::min(BINS-1,static_cast<int>((_centroids[primitive*3+axis]-centroidBox.min[axis])*scale));
+      binBox[bin].grow(_boxes[primitive]);
+      ++binCount[bin];
+    }
+    // the area and count left of each plane, then sweep back from the right
+    float leftArea[BINS-1];
+    uint32_t leftCount[BINS-1];
+    Box box;
+    uint32_t count=0;
+    for(int plane=0; plane<BINS-1; ++plane)
+    {
+      box.grow(binBox[plane]);
+      count+=binCount[plane];
+      leftArea[plane]=box.area();
+      leftCount[plane]=count;
+    }
+    box=Box();
+    count=0;
+    for(int plane=BINS-2; plane>=0; --plane)
+    {
+      box.grow(binBox[plane+1]);
+      count+=binCount[plane+1];
+      if(leftCount[plane]==0 || count==0)
+      {
+        continue;
+      }
+      float cost=leftArea[plane]*leftCount[plane]+box.area()*count;
+      if(cost<bestCost)
+      {
+        bestCost=cost;
+        bestAxis=axis;
+        bestPlane=plane;
+      }
+    }
+  }
+
+  uint32_t leftCount=0;
+  if(bestAxis>=0)
+  {
+    float area=std::max(node.box.area(),1e-12f);
+    float splitCost=TRAVERSAL_COST+PRIMITIVE_COST*bestCost/area;
+    if(_count<=LEAF_SIZE && splitCost>=PRIMITIVE_COST*_count)
+    {
+      return index;
+    }
+    float extent=centroidBox.max[bestAxis]-centroidBox.min[bestAxis];
+    float scale=BINS*(1.0f-1e-6f)/extent;
+    float minimum=centroidBox.min[bestAxis];
+    auto middle=std::partition(m_order.begin()+_first,m_order.begin()+_first+_count,[&](uint32_t _primitive)
+    {
+      return std::min(BINS-1,static_cast<int>((_centroids[_primitive*3+bestAxis]-minimum)*scale))<=bestPlane;
+    });
+    leftCount=static_cast<uint32_t>(middle-(m_order.begin()+_first));
+  }
+  else if(_count>LEAF_SIZE)
+  {
+    // every centroid is in the same place, split them evenly so no leaf gets too big
+    leftCount=_count/2;
+  }
+  else
+  {
+    return index;
+  }
+
+  buildRecursive(_boxes,_centroids,_first,leftCount,_depth+1);
+  int32_t right=buildRecursive(_boxes,_centroids,_first+leftCount,_count-leftCount,_depth+1);
+  m_binary[index].right=right;
+  return index;
+}
+
+//________________________________________________________________________________________________________________________________________//
+
+uint32_t WideBVH::collapse(int32_t _binary)
+{
+  uint32_t index=static_cast<uint32_t>(m_nodes.size());
+  m_nodes.push_back(Node());
+
+  // open up the biggest inner child until there are four, the children of a binary node are
+  // replaced by their own children so the tree loses up to half its levels
+  int32_t children[WIDTH];
+  int count=2;
+  children[0]=_binary+1;
+  children[1]=m_binary[_binary].right;
+  while(count<WIDTH)
+  {
+    int open=-1;
+    float largest=-1.0f;
+    for(int i=0; i<count; ++i)
+    {
+      const BinaryNode &child=m_binary[children[i]];
+      if(!child.isLeaf() && child.box.area()>largest)
+      {
+        largest=child.box.area();
+        open=i;
+      }
+    }
+    if(open<0)
+    {
+      break;
+    }
+    int32_t opened=children[open];
+    children[open]=opened+1;
+    children[count++]=m_binary[opened].right;
+  }
+
+  Node node;
+  for(int i=0; i<WIDTH; ++i)
+  {
+    Box box;
+    node.child[i]=0;
+    node.count[i]=0;
+    if(i<count)
+    {
+      const BinaryNode &child=m_binary[children[i]];
+      box=child.box;
+      if(child.isLeaf())
+      {
+        node.child[i]=child.first;
+        node.count[i]=child.count;
+      }
+      else
+      {
+        // pushing the children moves m_nodes so the node is only stored once they are all built
+        node.child[i]=collapse(children[i]);
+      }
+    }
+    node.minX[i]=box.min[0];
+    node.minY[i]=box.min[1];
+    node.minZ[i]=box.min[2];
+    node.maxX[i]=box.max[0];
+    node.maxY[i]=box.max[1];
+    node.maxZ[i]=box.max[2];
+  }
+  m_nodes[index]=node;
+  return index;
+}
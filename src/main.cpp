@@ -2,19 +2,191 @@
 basic OpenGL demo modified from http://qt-project.org/doc/qt-5.0/qtgui/openglwindow.html
 ****************************************************************************/
 #include <QtGui/QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
 #include "NGLScene.h"
+#include "Benchmarks.h"
+#include "LoadGenerator.h"
+#include "RayTracer.h"
+#include "RenderServer.h"
+#include "ShardCoordinator.h"
+
+//----------------------------------------------------------------------------------------------------------------------
+/// @brief the local socket the render server listens on unless another is given
+//----------------------------------------------------------------------------------------------------------------------
+constexpr const char *RENDER_SOCKET="can_render";
 
 
 
 int main(int argc, char **argv)
 {
+  // the benchmarks don't need a window so run them before Qt is started
+  if(argc>1 && std::strcmp(argv[1],"--bench-cull")==0)
+  {
+    return Benchmarks::culling();
+  }
+  if(argc>1 && std::strcmp(argv[1],"--bench-vertex")==0)
+  {
+    return Benchmarks::vertexFormat();
+  }
+  if(argc>1 && std::strcmp(argv[1],"--bench-governor")==0)
+  {
+    return Benchmarks::governor();
+  }
+  if(argc>1 && std::strcmp(argv[1],"--bench-transform")==0)
+  {
+    return Benchmarks::transforms();
+  }
+  if(argc>1 && std::strcmp(argv[1],"--bench-tangents")==0)
+  {
+    return Benchmarks::tangents();
+  }
+  if(argc>1 && std::strcmp(argv[1],"--bench-assets")==0)
+  {
+    return Benchmarks::assets();
+  }
+  // the streaming benchmark makes its own offscreen context
+  if(argc>1 && std::strcmp(argv[1],"--bench-streaming")==0)
+  {
+    QGuiApplication app(argc, argv);
+    return Benchmarks::streaming();
+  }
+  // the load generator only needs the socket, no GUI
+  if(argc>1 && std::strcmp(argv[1],"--load")==0)
+  {
+    QCoreApplication app(argc, argv);
+    return LoadGenerator::run(argc>2 ? argv[2] : RENDER_SOCKET,
+                              argc>3 ? std::atoi(argv[3]) : 4,
+                              argc>4 ? std::atoi(argv[4]) : 64,
+                              argc>5 ? std::atoi(argv[5]) : 4);
+  }
+  // render an orbit of the shelf across worker servers,
+  // Can_Project --shard [frames] [workers] [directory] [width] [height] [--kill-one]
+  // or time it with 1, 2, 4... workers, Can_Project --bench-shard [frames] [workers]
+  if(argc>1 && (std::strcmp(argv[1],"--shard")==0 || std::strcmp(argv[1],"--bench-shard")==0))
+  {
+    QCoreApplication app(argc, argv);
+    ShardCoordinator::Settings settings;
+    std::vector<const char *> args;
+    for(int i=2; i<argc; ++i)
+    {
+      if(std::strcmp(argv[i],"--kill-one")==0)
+      {
+        settings.killOne=true;
+      }
+      else
+      {
+        args.push_back(argv[i]);
+      }
+    }
+    settings.frames= args.size()>0 ? std::atoi(args[0]) : settings.frames;
+    settings.workers= args.size()>1 ? std::atoi(args[1]) : settings.workers;
+    settings.outDir= args.size()>2 ? QString(args[2]) : settings.outDir;
+    settings.width= args.size()>3 ? std::atoi(args[3]) : settings.width;
+    settings.height= args.size()>4 ? std::atoi(args[4]) : settings.height;
+    if(std::strcmp(argv[1],"--bench-shard")==0)
+    {
+      return ShardCoordinator::scaling(settings);
+    }
+    ShardCoordinator coordinator(settings);
+    ShardCoordinator::Result result=coordinator.run();
+    ShardCoordinator::print(settings,result);
+    return result.ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  // a path traced still on the CPU, Can_Project --trace [file.png] [width] [height] [samples] [threads] [scene.json]
+  // or time it with 1, 2, 4... threads, Can_Project --bench-trace [width] [height] [samples] [threads] [scene.json]
+  if(argc>1 && (std::strcmp(argv[1],"--trace")==0 || std::strcmp(argv[1],"--bench-trace")==0))
+  {
+    // no window or context, only the image plugins the textures are decoded with
+    QCoreApplication app(argc, argv);
+    RayTracer::Settings settings;
+    bool bench=std::strcmp(argv[1],"--bench-trace")==0;
+    int arg=2;
+    if(!bench)
+    {
+      settings.file= argc>arg ? argv[arg] : settings.file;
+      ++arg;
+    }
+    else
+    {
+      // short enough to run at every thread count
+      settings.width=640;
+      settings.height=360;
+      settings.samples=16;
+    }
+    settings.width= argc>arg ? std::atoi(argv[arg]) : settings.width;
+    settings.height= argc>arg+1 ? std::atoi(argv[arg+1]) : settings.height;
+    settings.samples= argc>arg+2 ? std::atoi(argv[arg+2]) : settings.samples;
+    settings.threads= argc>arg+3 ? std::atoi(argv[arg+3]) : settings.threads;
+    settings.scene= argc>arg+4 ? argv[arg+4] : settings.scene;
+    return bench ? RayTracer::scaling(settings) : RayTracer::run(settings);
+  }
+  // a still in tiles, Can_Project --tiled [file.tif] [width] [height] [tile] [margin]
+  if(argc>1 && std::strcmp(argv[1],"--tiled")==0)
+  {
+    if(qgetenv("QT_QPA_PLATFORM").isEmpty())
+    {
+      qputenv("QT_QPA_PLATFORM","offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    QSurfaceFormat format;
+    format.setMajorVersion(4);
+    format.setMinorVersion(3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    format.setDepthBufferSize(24);
+    QOpenGLContext context;
+    context.setFormat(format);
+    QOffscreenSurface surface;
+    surface.setFormat(format);
+    surface.create();
+    if(!context.create() || !context.makeCurrent(&surface))
+    {
+      std::cerr<<"Could not create an OpenGL 4.3 context\n";
+      return EXIT_FAILURE;
+    }
+    NGLScene::TiledRender settings;
+    settings.file= argc>2 ? argv[2] : settings.file;
+    settings.width= argc>3 ? std::atoi(argv[3]) : settings.width;
+    settings.height= argc>4 ? std::atoi(argv[4]) : settings.height;
+    settings.tile= argc>5 ? std::atoi(argv[5]) : settings.tile;
+    settings.margin= argc>6 ? std::atoi(argv[6]) : settings.margin;
+    int result;
+    {
+      // released while the context is still current
+      NGLScene scene;
+      result=scene.renderTiled(settings);
+      scene.releaseRenderer();
+    }
+    context.doneCurrent();
+    return result;
+  }
+  // headless render server, Can_Project --serve [socket] [width] [height]
+  if(argc>1 && std::strcmp(argv[1],"--serve")==0)
+  {
+    if(qgetenv("QT_QPA_PLATFORM").isEmpty())
+    {
+      qputenv("QT_QPA_PLATFORM","offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    // the scene is never shown, the server renders it on its own thread and context
+    NGLScene scene;
+    RenderServer server(&scene,argc>3 ? std::atoi(argv[3]) : 1024,argc>4 ? std::atoi(argv[4]) : 1024);
+    if(!server.listen(argc>2 ? argv[2] : RENDER_SOCKET))
+    {
+      return EXIT_FAILURE;
+    }
+    return app.exec();
+  }
   QGuiApplication app(argc, argv);
   // create an OpenGL format specifier
   QSurfaceFormat format;
-  // set the number of samples for multisampling
-  // will need to enable glEnable(GL_MULTISAMPLE); once we have a context
-  format.setSamples(4);
+  // the scene is rendered to a single sample target and anti-aliased there, so the window
+  // surface doesn't need multisampling
+  format.setSamples(0);
   #if defined(__APPLE__)
     // at present mac osx Mountain Lion only supports GL3.2
     // the new mavericks will have GL 4.x so can change
@@ -35,6 +207,14 @@ int main(int argc, char **argv)
   window.setFormat(format);
   // we can now query the version to see if it worked
   std::cout<<"Profile is "<<format.majorVersion()<<" "<<format.minorVersion()<<"\n";
+  // only one frame in flight, for measuring the best case input latency
+  for(int i=1; i<argc; ++i)
+  {
+    if(std::strcmp(argv[i],"--low-latency")==0)
+    {
+      window.setLowLatency(true);
+    }
+  }
   // set the window size
   window.resize(1024, 720);
   // and finally show